@@ -82,7 +82,7 @@ Java_com_mgpu_MainActivity_generateText(JNIEnv* env, jobject thiz,
 
     int result_tokens[512];
     int num_tokens = moondream2_generate(g_model, g_device, prompt_str,
-                                          max_tokens, nullptr);
+                                          max_tokens, nullptr, nullptr);
 
     // Decode tokens to string
     // For now, just return a placeholder
@@ -0,0 +1,324 @@
+#include "../src/engine/compute.h"
+#include "../src/engine/device.h"
+#include "../src/engine/memory.h"
+#include "../src/models/gguf_loader.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+// Decode attention at the model's shape (Phi-1.5 / Moondream2 LLM), over
+// both KV-cache layouts: seq-major [pos, head, d] and head-major [head, pos, d],
+// each read as buffers and (when supported) through image1d_buffer views,
+// and as int8 caches with per-block fp16 scales (accuracy and speed vs fp16)
+static const int NUM_HEADS = 32;
+static const int HEAD_DIM = 64;
+static const int MAX_CACHE = 4096;
+static const int PREFILL_LEN = 128;  // int8 caches: rows stored at once, then appended one by one
+
+static const int cache_lengths[] = { 128, 512, 1024, 2048, 4096 };
+static const int num_lengths = sizeof(cache_lengths) / sizeof(cache_lengths[0]);
+
+static void fill_random_fp16(uint16_t* buf, int count) {
+    for (int i = 0; i < count; i++) {
+        buf[i] = mgpu::ggml_fp32_to_fp16(((float)rand() / RAND_MAX) * 2.0f - 1.0f);
+    }
+}
+
+// CPU reference: softmax(q . K^T / sqrt(d)) . V per head, in double
+static void attention_reference(const uint16_t* q, const uint16_t* k, const uint16_t* v,
+                                float* out, int cache_len) {
+    const int stride = NUM_HEADS * HEAD_DIM;
+    double* scores = (double*)malloc((size_t)cache_len * sizeof(double));
+    if (!scores) return;
+
+    for (int h = 0; h < NUM_HEADS; h++) {
+        double max_s = -1e300;
+        for (int p = 0; p < cache_len; p++) {
+            double dot = 0.0;
+            for (int d = 0; d < HEAD_DIM; d++) {
+                dot += (double)mgpu::ggml_fp16_to_fp32(q[h * HEAD_DIM + d]) *
+                       mgpu::ggml_fp16_to_fp32(k[p * stride + h * HEAD_DIM + d]);
+            }
+            scores[p] = dot / sqrt((double)HEAD_DIM);
+            if (scores[p] > max_s) max_s = scores[p];
+        }
+        double sum = 0.0;
+        for (int p = 0; p < cache_len; p++) {
+            scores[p] = exp(scores[p] - max_s);
+            sum += scores[p];
+        }
+        for (int d = 0; d < HEAD_DIM; d++) {
+            double acc = 0.0;
+            for (int p = 0; p < cache_len; p++) {
+                acc += scores[p] * mgpu::ggml_fp16_to_fp32(v[p * stride + h * HEAD_DIM + d]);
+            }
+            out[h * HEAD_DIM + d] = (float)(acc / sum);
+        }
+    }
+    free(scores);
+}
+
+static double elapsed_ms(const struct timespec& t0, const struct timespec& t1) {
+    return (double)(t1.tv_sec - t0.tv_sec) * 1e3 + (double)(t1.tv_nsec - t0.tv_nsec) / 1e6;
+}
+
+// Seq-major [MAX_CACHE, heads, d] -> head-major [heads, MAX_CACHE, d]
+static void to_head_major(const uint16_t* src, uint16_t* dst) {
+    for (int p = 0; p < MAX_CACHE; p++) {
+        for (int h = 0; h < NUM_HEADS; h++) {
+            memcpy(dst + ((size_t)h * MAX_CACHE + p) * HEAD_DIM,
+                   src + ((size_t)p * NUM_HEADS + h) * HEAD_DIM,
+                   HEAD_DIM * sizeof(uint16_t));
+        }
+    }
+}
+
+// Quantize the fp16 seq-major K/V into an int8 cache the way the model
+// fills it: a prompt of PREFILL_LEN rows, then one decode row at a time
+// (so blocks go through the requantize-on-grow path)
+static bool build_int8_cache(mgpu::DeviceInfo* device, cl_program program,
+                             cl_mem k, cl_mem v, cl_mem k8, cl_mem v8,
+                             cl_mem k_scales, cl_mem v_scales, mgpu::KVLayout layout) {
+    const size_t row_bytes = (size_t)NUM_HEADS * HEAD_DIM * sizeof(uint16_t);
+    int pos = 0;
+    while (pos < MAX_CACHE) {
+        int n = pos == 0 ? PREFILL_LEN : 1;
+        cl_buffer_region region = { (size_t)pos * row_bytes, (size_t)n * row_bytes };
+        cl_int err;
+        cl_mem new_k = clCreateSubBuffer(k, CL_MEM_READ_ONLY, CL_BUFFER_CREATE_TYPE_REGION,
+                                         &region, &err);
+        cl_mem new_v = clCreateSubBuffer(v, CL_MEM_READ_ONLY, CL_BUFFER_CREATE_TYPE_REGION,
+                                         &region, &err);
+        cl_event ev = (new_k && new_v)
+            ? mgpu::dispatch_kv_cache_store(device, program, new_k, new_v, k8, v8,
+                                            n, NUM_HEADS, HEAD_DIM, pos,
+                                            layout, MAX_CACHE, k_scales, v_scales)
+            : nullptr;
+        if (ev) clReleaseEvent(ev);
+        if (new_k) clReleaseMemObject(new_k);
+        if (new_v) clReleaseMemObject(new_v);
+        if (!ev) return false;
+        pos += n;
+    }
+    clFinish(device->queue);
+    return true;
+}
+
+// Average host wall time (ms) of back-to-back launches (split + reduce)
+static double time_decode(mgpu::DeviceInfo* device, cl_program program,
+                          cl_mem q, cl_mem k, cl_mem v, cl_mem out, int cache_len,
+                          mgpu::KVLayout layout, bool image,
+                          cl_mem k_scales, cl_mem v_scales,
+                          int warmup_iters, int bench_iters) {
+    auto launch = [&]() {
+        cl_event ev = image
+            ? mgpu::dispatch_attention_decode_image(device, program, q, k, v, out,
+                                                    cache_len, NUM_HEADS, HEAD_DIM,
+                                                    layout, MAX_CACHE)
+            : mgpu::dispatch_attention_decode(device, program, q, k, v, out,
+                                              cache_len, NUM_HEADS, HEAD_DIM,
+                                              layout, MAX_CACHE, k_scales, v_scales);
+        if (ev) clReleaseEvent(ev);
+    };
+
+    for (int i = 0; i < warmup_iters; i++) launch();
+    clFinish(device->queue);
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i = 0; i < bench_iters; i++) launch();
+    clFinish(device->queue);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    return elapsed_ms(t0, t1) / bench_iters;
+}
+
+int main(int argc, char** argv) {
+    const char* kernel_file = "src/kernels/attention.cl";
+    int warmup_iters = 5;
+    int bench_iters = 50;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--kernels") == 0 && i + 1 < argc) {
+            kernel_file = argv[++i];
+        } else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) {
+            warmup_iters = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--iters") == 0 && i + 1 < argc) {
+            bench_iters = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--help") == 0) {
+            printf("Usage: %s [--kernels <attention.cl>] [--warmup N] [--iters N]\n", argv[0]);
+            return 0;
+        }
+    }
+    if (bench_iters < 1) bench_iters = 1;
+
+    printf("=== MGPU Decode Attention Benchmark ===\n\n");
+
+    srand(1234);
+
+    mgpu::DeviceInfo device;
+    if (!mgpu::init_device(&device)) {
+        fprintf(stderr, "Error: Failed to initialize OpenCL device\n");
+        return 1;
+    }
+    mgpu::print_device_info(&device);
+
+    printf("\nBuilding attention kernels from: %s\n", kernel_file);
+    const char* build_opts = "-cl-mad-enable -cl-fast-relaxed-math";
+    cl_program program = mgpu::build_program_from_file(&device, kernel_file, build_opts);
+    if (!program) {
+        fprintf(stderr, "Error: Failed to build attention kernels\n");
+        mgpu::destroy_device(&device);
+        return 1;
+    }
+
+    const int row = NUM_HEADS * HEAD_DIM;
+    size_t cache_elems = (size_t)MAX_CACHE * row;
+    uint16_t* h_q = (uint16_t*)malloc((size_t)row * sizeof(uint16_t));
+    uint16_t* h_k = (uint16_t*)malloc(cache_elems * sizeof(uint16_t));
+    uint16_t* h_v = (uint16_t*)malloc(cache_elems * sizeof(uint16_t));
+    uint16_t* h_k_hm = (uint16_t*)malloc(cache_elems * sizeof(uint16_t));
+    uint16_t* h_v_hm = (uint16_t*)malloc(cache_elems * sizeof(uint16_t));
+    uint16_t* h_out = (uint16_t*)malloc((size_t)row * sizeof(uint16_t));
+    float* ref = (float*)malloc((size_t)row * sizeof(float));
+    if (!h_q || !h_k || !h_v || !h_k_hm || !h_v_hm || !h_out || !ref) {
+        fprintf(stderr, "Error: Failed to allocate host buffers\n");
+        return 1;
+    }
+    fill_random_fp16(h_q, row);
+    fill_random_fp16(h_k, (int)cache_elems);
+    fill_random_fp16(h_v, (int)cache_elems);
+    to_head_major(h_k, h_k_hm);
+    to_head_major(h_v, h_v_hm);
+
+    cl_int err;
+    cl_mem d_q = clCreateBuffer(device.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                (size_t)row * sizeof(uint16_t), h_q, &err);
+    cl_mem d_k = clCreateBuffer(device.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                cache_elems * sizeof(uint16_t), h_k, &err);
+    cl_mem d_v = clCreateBuffer(device.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                cache_elems * sizeof(uint16_t), h_v, &err);
+    cl_mem d_k_hm = clCreateBuffer(device.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                   cache_elems * sizeof(uint16_t), h_k_hm, &err);
+    cl_mem d_v_hm = clCreateBuffer(device.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                   cache_elems * sizeof(uint16_t), h_v_hm, &err);
+    cl_mem d_out = clCreateBuffer(device.context, CL_MEM_WRITE_ONLY,
+                                  (size_t)row * sizeof(uint16_t), nullptr, &err);
+    if (!d_q || !d_k || !d_v || !d_k_hm || !d_v_hm || !d_out) {
+        fprintf(stderr, "Error: Failed to create device buffers\n");
+        return 1;
+    }
+
+    // Texture-path views of the same caches (null: unsupported, rows skipped)
+    cl_mem d_k_img = mgpu::create_buffer_image_view(&device, d_k, cache_elems);
+    cl_mem d_v_img = mgpu::create_buffer_image_view(&device, d_v, cache_elems);
+    cl_mem d_k_hm_img = mgpu::create_buffer_image_view(&device, d_k_hm, cache_elems);
+    cl_mem d_v_hm_img = mgpu::create_buffer_image_view(&device, d_v_hm, cache_elems);
+
+    // Int8 caches of the same contents, one per layout
+    size_t scale_bytes = (size_t)(MAX_CACHE / mgpu::KV_Q8_BLOCK) * NUM_HEADS * sizeof(uint16_t);
+    cl_mem d_q8[2][4] = {};  // [layout] = { k, v, k_scales, v_scales }
+    const mgpu::KVLayout q8_layouts[2] = { mgpu::KV_LAYOUT_SEQ_MAJOR, mgpu::KV_LAYOUT_HEAD_MAJOR };
+    for (int l = 0; l < 2; l++) {
+        for (int b = 0; b < 4; b++) {
+            d_q8[l][b] = clCreateBuffer(device.context, CL_MEM_READ_WRITE,
+                                        b < 2 ? cache_elems : scale_bytes, nullptr, &err);
+        }
+        if (!d_q8[l][0] || !d_q8[l][1] || !d_q8[l][2] || !d_q8[l][3] ||
+            !build_int8_cache(&device, program, d_k, d_v, d_q8[l][0], d_q8[l][1],
+                              d_q8[l][2], d_q8[l][3], q8_layouts[l])) {
+            fprintf(stderr, "Error: Failed to build the int8 KV-cache\n");
+            return 1;
+        }
+    }
+
+    printf("\nheads=%d head_dim=%d, warmup %d, iters %d\n\n",
+           NUM_HEADS, HEAD_DIM, warmup_iters, bench_iters);
+    printf("  %-10s  %-17s  %10s  %10s  %10s  %10s\n",
+           "cache_len", "layout", "time (us)", "KV GB/s", "max |err|", "mean |err|");
+    printf("  %-10s  %-17s  %10s  %10s  %10s  %10s\n",
+           "----------", "-----------------", "----------", "----------", "----------",
+           "----------");
+
+    struct LayoutCase {
+        const char* name;
+        mgpu::KVLayout layout;
+        bool image;
+        cl_mem k, v;
+        cl_mem k_scales, v_scales;  // int8 cache
+    };
+    const LayoutCase layouts[] = {
+        { "seq-major",        mgpu::KV_LAYOUT_SEQ_MAJOR,  false, d_k,        d_v,
+          nullptr, nullptr },
+        { "head-major",       mgpu::KV_LAYOUT_HEAD_MAJOR, false, d_k_hm,     d_v_hm,
+          nullptr, nullptr },
+        { "seq-major image",  mgpu::KV_LAYOUT_SEQ_MAJOR,  true,  d_k_img,    d_v_img,
+          nullptr, nullptr },
+        { "head-major image", mgpu::KV_LAYOUT_HEAD_MAJOR, true,  d_k_hm_img, d_v_hm_img,
+          nullptr, nullptr },
+        { "seq-major int8",   mgpu::KV_LAYOUT_SEQ_MAJOR,  false, d_q8[0][0], d_q8[0][1],
+          d_q8[0][2], d_q8[0][3] },
+        { "head-major int8",  mgpu::KV_LAYOUT_HEAD_MAJOR, false, d_q8[1][0], d_q8[1][1],
+          d_q8[1][2], d_q8[1][3] },
+    };
+
+    for (int c = 0; c < num_lengths; c++) {
+        int cache_len = cache_lengths[c];
+        attention_reference(h_q, h_k, h_v, ref, cache_len);
+
+        for (const LayoutCase& lc : layouts) {
+            if (!lc.k || !lc.v) continue;
+            double avg_ms = time_decode(&device, program, d_q, lc.k, lc.v, d_out, cache_len,
+                                        lc.layout, lc.image, lc.k_scales, lc.v_scales,
+                                        warmup_iters, bench_iters);
+            double kv_bytes = lc.k_scales
+                ? 2.0 * cache_len * (row + (double)row / HEAD_DIM / mgpu::KV_Q8_BLOCK *
+                                               sizeof(uint16_t))
+                : 2.0 * cache_len * row * sizeof(uint16_t);
+            double gbps = kv_bytes / (avg_ms * 1e6);
+
+            clEnqueueReadBuffer(device.queue, d_out, CL_TRUE, 0, (size_t)row * sizeof(uint16_t),
+                                h_out, 0, nullptr, nullptr);
+            float max_err = 0.0f;
+            double sum_err = 0.0;
+            for (int i = 0; i < row; i++) {
+                float e = fabsf(mgpu::ggml_fp16_to_fp32(h_out[i]) - ref[i]);
+                if (e > max_err) max_err = e;
+                sum_err += e;
+            }
+
+            printf("  %-10d  %-17s  %10.1f  %10.2f  %10.5f  %10.5f\n",
+                   cache_len, lc.name, avg_ms * 1e3, gbps, max_err, sum_err / row);
+        }
+    }
+
+    for (int l = 0; l < 2; l++) {
+        for (int b = 0; b < 4; b++) clReleaseMemObject(d_q8[l][b]);
+    }
+    if (d_k_img) clReleaseMemObject(d_k_img);
+    if (d_v_img) clReleaseMemObject(d_v_img);
+    if (d_k_hm_img) clReleaseMemObject(d_k_hm_img);
+    if (d_v_hm_img) clReleaseMemObject(d_v_hm_img);
+    clReleaseMemObject(d_q);
+    clReleaseMemObject(d_k);
+    clReleaseMemObject(d_v);
+    clReleaseMemObject(d_k_hm);
+    clReleaseMemObject(d_v_hm);
+    clReleaseMemObject(d_out);
+    free(h_q);
+    free(h_k);
+    free(h_v);
+    free(h_k_hm);
+    free(h_v_hm);
+    free(h_out);
+    free(ref);
+
+    mgpu::kernel_registry_release(program);
+    clReleaseProgram(program);
+    mgpu::destroy_device(&device);
+
+    printf("\nBenchmark complete.\n");
+    return 0;
+}
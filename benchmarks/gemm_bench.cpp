@@ -1,4 +1,6 @@
+#include "../src/engine/compute.h"
 #include "../src/engine/device.h"
+#include "../src/engine/memory.h"
 
 #include <cmath>
 #include <cstdio>
@@ -18,7 +20,13 @@ static const BenchConfig bench_configs[] = {
     { "medium",      2048, 2048, 2048 },
     { "decode_gemv", 1,    2048, 2048 },
     { "llm_ffn",     1,    2048, 8192 },
+    { "batch_2",     2,    2048, 2048 },
+    { "batch_8",     8,    2048, 2048 },
+    { "batch_16",    16,   2048, 2048 },
     { "prefill_32",  32,   2048, 2048 },
+    { "prefill_qkv", 761,  2048, 2048 },
+    { "prefill_ffn", 761,  2048, 8192 },
+    { "vision_proj", 729,  1152, 2048 },
 };
 
 static const int num_configs = sizeof(bench_configs) / sizeof(bench_configs[0]);
@@ -45,39 +53,148 @@ static void fill_random_fp16(uint16_t* buf, int count) {
     }
 }
 
+static float fp16_to_float(uint16_t h) {
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t exp_val = (h >> 10) & 0x1F;
+    uint32_t mant = h & 0x3FF;
+    uint32_t f32;
+    if (exp_val == 0) {
+        f32 = sign;  // flush denormals
+    } else if (exp_val == 31) {
+        f32 = sign | 0x7F800000 | (mant << 13);
+    } else {
+        f32 = sign | ((exp_val - 15 + 127) << 23) | (mant << 13);
+    }
+    float val;
+    memcpy(&val, &f32, 4);
+    return val;
+}
+
 static double compute_gflops(int M, int K, int N, double time_ms) {
     double flops = 2.0 * M * K * N;
     return flops / (time_ms * 1e6); // GFLOPS
 }
 
+// Kernels are launched through the engine's dispatch_* functions, so the
+// benchmark measures exactly the shapes and argument order the model uses.
+enum VariantKind {
+    VARIANT_NAIVE, VARIANT_TILED, VARIANT_IMAGE, VARIANT_BLOCKED, VARIANT_SKINNY, VARIANT_GEMV,
+    VARIANT_AUTO, VARIANT_W8A8,
+};
+
 struct KernelVariant {
     const char* name;
-    const char* kernel_func;
+    VariantKind kind;
 };
 
 static const KernelVariant kernel_variants[] = {
-    { "naive",  "gemm_naive"  },
-    { "tiled",  "gemm_tiled"  },
-    { "image",  "gemm_image"  },
-    { "gemv",   "gemv"        },
+    { "naive",   VARIANT_NAIVE   },
+    { "tiled",   VARIANT_TILED   },
+    { "image",   VARIANT_IMAGE   },
+    { "blocked", VARIANT_BLOCKED },
+    { "skinny",  VARIANT_SKINNY  },
+    { "gemv",    VARIANT_GEMV    },
+    { "auto",    VARIANT_AUTO    },
+    { "w8a8",    VARIANT_W8A8    },
 };
 
 static const int num_variants = sizeof(kernel_variants) / sizeof(kernel_variants[0]);
 
-static bool run_gemm_bench(mgpu::DeviceInfo* device, cl_program program,
-                           const KernelVariant* variant, const BenchConfig* config,
-                           int warmup_iters, int bench_iters) {
+static cl_event dispatch_variant(mgpu::DeviceInfo* device, cl_program program,
+                                 const KernelVariant* variant,
+                                 cl_mem d_a, cl_mem d_b, cl_mem d_b_img, cl_mem d_c,
+                                 const cl_mem* w8a8, int M, int N, int K) {
+    switch (variant->kind) {
+    case VARIANT_NAIVE:
+        return mgpu::dispatch_gemm_naive(device, program, d_a, d_b, d_c, M, N, K);
+    case VARIANT_TILED:
+        return mgpu::dispatch_gemm_tiled(device, program, d_a, d_b, d_c, M, N, K);
+    case VARIANT_IMAGE:
+        return mgpu::dispatch_gemm_image_variant(device, program, mgpu::GEMM_IMAGE_ROW,
+                                                 d_a, d_b_img, d_c, M, N, K);
+    case VARIANT_BLOCKED:
+        return mgpu::dispatch_gemm_image_variant(device, program, mgpu::GEMM_IMAGE_BLOCKED,
+                                                 d_a, d_b_img, d_c, M, N, K);
+    case VARIANT_SKINNY:
+        return mgpu::dispatch_gemm_image_variant(device, program, mgpu::GEMM_IMAGE_SKINNY,
+                                                 d_a, d_b_img, d_c, M, N, K);
+    case VARIANT_GEMV:
+        return mgpu::dispatch_gemv(device, program, d_a, d_b_img, d_c, N, K);
+    case VARIANT_AUTO:
+        return mgpu::dispatch_gemm_image(device, program, d_a, d_b_img, d_c, M, N, K);
+    case VARIANT_W8A8:
+        // The returned (timed) event is the int8 GEMM; the per-row activation
+        // quantize before it is one pass over A
+        return mgpu::dispatch_gemm_w8a8(device, program, d_a, w8a8[0], d_c, M, N, K,
+                                        w8a8[1], w8a8[2]);
+    }
+    return nullptr;
+}
+
+// Max |C - A*B| over the first few rows (CPU reference in double)
+static float check_rows(const uint16_t* h_a, const uint16_t* h_b, const uint16_t* h_c,
+                        int M, int K, int N) {
+    const int rows = M < 4 ? M : 4;
+    float max_err = 0.0f;
+    for (int r = 0; r < rows; r++) {
+        for (int n = 0; n < N; n++) {
+            double acc = 0.0;
+            for (int k = 0; k < K; k++)
+                acc += (double)fp16_to_float(h_a[(size_t)r * K + k]) *
+                       fp16_to_float(h_b[(size_t)k * N + n]);
+            float e = fabsf(fp16_to_float(h_c[(size_t)r * N + n]) - (float)acc);
+            if (e > max_err) max_err = e;
+        }
+    }
+    return max_err;
+}
+
+// Device-to-device copy bandwidth (read + write bytes / time): the practical
+// ceiling for a memory-bound kernel on this device
+static double measure_copy_bandwidth(mgpu::DeviceInfo* device, int iters) {
+    const size_t bytes = (size_t)64 << 20;
     cl_int err;
-    cl_kernel kernel = clCreateKernel(program, variant->kernel_func, &err);
-    if (err != CL_SUCCESS) {
-        printf("  %-8s  %-12s  (kernel not found, skipping)\n", variant->name, config->name);
-        return false;
+    cl_mem src = clCreateBuffer(device->context, CL_MEM_READ_WRITE, bytes, nullptr, &err);
+    cl_mem dst = clCreateBuffer(device->context, CL_MEM_READ_WRITE, bytes, nullptr, &err);
+    if (!src || !dst) {
+        if (src) clReleaseMemObject(src);
+        if (dst) clReleaseMemObject(dst);
+        return 0.0;
+    }
+
+    double best_ms = 1e9;
+    for (int i = 0; i < iters + 1; i++) {
+        cl_event event;
+        err = clEnqueueCopyBuffer(device->queue, src, dst, 0, 0, bytes, 0, nullptr, &event);
+        if (err != CL_SUCCESS) break;
+        clWaitForEvents(1, &event);
+
+        cl_ulong t_start, t_end;
+        clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(t_start), &t_start, nullptr);
+        clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(t_end), &t_end, nullptr);
+        clReleaseEvent(event);
+
+        double ms = (double)(t_end - t_start) / 1e6;
+        if (i > 0 && ms < best_ms) best_ms = ms;  // first copy is warmup
     }
 
+    clReleaseMemObject(src);
+    clReleaseMemObject(dst);
+    return (best_ms < 1e9) ? 2.0 * bytes / (best_ms * 1e6) : 0.0;
+}
+
+static bool run_gemm_bench(mgpu::DeviceInfo* device, cl_program program,
+                           const KernelVariant* variant, const BenchConfig* config,
+                           int warmup_iters, int bench_iters, double peak_gbps) {
     int M = config->M;
     int K = config->K;
     int N = config->N;
 
+    // GEMV is the M = 1 kernel, skinny covers M = 2..16; the others run on
+    // every shape
+    if (variant->kind == VARIANT_GEMV && M != 1) return false;
+    if (variant->kind == VARIANT_SKINNY && (M < 2 || M > mgpu::GEMM_SKINNY_MAX_M)) return false;
+
     size_t size_a = (size_t)M * K * sizeof(uint16_t);
     size_t size_b = (size_t)K * N * sizeof(uint16_t);
     size_t size_c = (size_t)M * N * sizeof(uint16_t);
@@ -85,63 +202,65 @@ static bool run_gemm_bench(mgpu::DeviceInfo* device, cl_program program,
     // Allocate host buffers
     uint16_t* h_a = (uint16_t*)malloc(size_a);
     uint16_t* h_b = (uint16_t*)malloc(size_b);
-    if (!h_a || !h_b) {
+    uint16_t* h_c = (uint16_t*)malloc(size_c);
+    if (!h_a || !h_b || !h_c) {
         fprintf(stderr, "Error: Failed to allocate host buffers\n");
         free(h_a);
         free(h_b);
-        clReleaseKernel(kernel);
+        free(h_c);
         return false;
     }
     fill_random_fp16(h_a, M * K);
     fill_random_fp16(h_b, K * N);
 
-    // Create device buffers
+    // Create device buffers; the image kernels read B from a weight image
+    // (N/4 texels wide, K tall) exactly as the model uploads it
+    cl_int err;
     cl_mem d_a = clCreateBuffer(device->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
                                 size_a, h_a, &err);
     cl_mem d_b = clCreateBuffer(device->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
                                 size_b, h_b, &err);
+    cl_mem d_b_img = mgpu::create_weight_image(device, K, N, (const cl_half*)h_b);
     cl_mem d_c = clCreateBuffer(device->context, CL_MEM_WRITE_ONLY, size_c, nullptr, &err);
 
-    if (!d_a || !d_b || !d_c) {
+    // W8A8: B quantized per column, plus the int8 activation scratch
+    cl_mem w8a8[3] = { nullptr, nullptr, nullptr };
+    if (variant->kind == VARIANT_W8A8) {
+        float* b_f32 = (float*)malloc((size_t)K * N * sizeof(float));
+        void* b_i8 = malloc(mgpu::weight_i8_bytes(K, N));
+        if (b_f32 && b_i8) {
+            for (size_t i = 0; i < (size_t)K * N; i++) b_f32[i] = fp16_to_float(h_b[i]);
+            mgpu::quantize_weight_i8(b_f32, K, N, b_i8);
+            w8a8[0] = clCreateBuffer(device->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                     mgpu::weight_i8_bytes(K, N), b_i8, &err);
+        }
+        free(b_f32);
+        free(b_i8);
+        w8a8[1] = clCreateBuffer(device->context, CL_MEM_READ_WRITE, (size_t)M * K,
+                                 nullptr, &err);
+        w8a8[2] = clCreateBuffer(device->context, CL_MEM_READ_WRITE, (size_t)M * sizeof(float),
+                                 nullptr, &err);
+    }
+    bool w8a8_ok = variant->kind != VARIANT_W8A8 || (w8a8[0] && w8a8[1] && w8a8[2]);
+
+    if (!d_a || !d_b || !d_b_img || !d_c || !w8a8_ok) {
         fprintf(stderr, "Error: Failed to create device buffers\n");
         if (d_a) clReleaseMemObject(d_a);
         if (d_b) clReleaseMemObject(d_b);
+        if (d_b_img) clReleaseMemObject(d_b_img);
         if (d_c) clReleaseMemObject(d_c);
+        for (cl_mem m : w8a8) if (m) clReleaseMemObject(m);
         free(h_a);
         free(h_b);
-        clReleaseKernel(kernel);
+        free(h_c);
         return false;
     }
 
-    // Set kernel args
-    clSetKernelArg(kernel, 0, sizeof(cl_mem), &d_a);
-    clSetKernelArg(kernel, 1, sizeof(cl_mem), &d_b);
-    clSetKernelArg(kernel, 2, sizeof(cl_mem), &d_c);
-    clSetKernelArg(kernel, 3, sizeof(int), &M);
-    clSetKernelArg(kernel, 4, sizeof(int), &K);
-    clSetKernelArg(kernel, 5, sizeof(int), &N);
-
-    size_t global_work_size[2] = { (size_t)N, (size_t)M };
-    size_t local_work_size[2] = { 16, 16 };
-
-    // Clamp local work size for small matrices or GEMV
-    if (M == 1) {
-        global_work_size[0] = (size_t)N;
-        global_work_size[1] = 1;
-        local_work_size[0] = 256;
-        local_work_size[1] = 1;
-        // Round up global to multiple of local
-        global_work_size[0] = ((N + 255) / 256) * 256;
-    } else {
-        // Round up to multiples of local work size
-        global_work_size[0] = ((N + 15) / 16) * 16;
-        global_work_size[1] = ((M + 15) / 16) * 16;
-    }
-
     // Warmup
     for (int i = 0; i < warmup_iters; i++) {
-        clEnqueueNDRangeKernel(device->queue, kernel, 2, nullptr,
-                               global_work_size, local_work_size, 0, nullptr, nullptr);
+        cl_event event = dispatch_variant(device, program, variant,
+                                          d_a, d_b, d_b_img, d_c, w8a8, M, N, K);
+        if (event) clReleaseEvent(event);
     }
     clFinish(device->queue);
 
@@ -149,14 +268,13 @@ static bool run_gemm_bench(mgpu::DeviceInfo* device, cl_program program,
     double total_ms = 0.0;
     double min_ms = 1e9;
     double max_ms = 0.0;
+    int timed = 0;
 
     for (int i = 0; i < bench_iters; i++) {
-        cl_event event;
-        err = clEnqueueNDRangeKernel(device->queue, kernel, 2, nullptr,
-                                      global_work_size, local_work_size,
-                                      0, nullptr, &event);
-        if (err != CL_SUCCESS) {
-            fprintf(stderr, "Error: Kernel enqueue failed (err=%d)\n", err);
+        cl_event event = dispatch_variant(device, program, variant,
+                                          d_a, d_b, d_b_img, d_c, w8a8, M, N, K);
+        if (!event) {
+            fprintf(stderr, "Error: Kernel enqueue failed (%s)\n", variant->name);
             break;
         }
         clWaitForEvents(1, &event);
@@ -168,37 +286,55 @@ static bool run_gemm_bench(mgpu::DeviceInfo* device, cl_program program,
 
         double ms = (double)(t_end - t_start) / 1e6;
         total_ms += ms;
+        timed++;
         if (ms < min_ms) min_ms = ms;
         if (ms > max_ms) max_ms = ms;
     }
 
-    double avg_ms = total_ms / bench_iters;
-    double gflops = compute_gflops(M, K, N, avg_ms);
-
-    // Estimate theoretical peak: compute_units * clock * 2 (FMA) * vector_width
-    // This is a rough estimate; actual peak depends on architecture
-    double peak_gflops = (double)device->compute_units * device->max_clock_freq * 2.0 / 1000.0;
-    if (device->has_fp16) peak_gflops *= 2.0; // fp16 doubles throughput
-    double efficiency = (peak_gflops > 0) ? (gflops / peak_gflops * 100.0) : 0.0;
-
-    printf("  %-8s  %-12s  %4dx%4dx%4d  %8.3f ms  %8.2f GFLOPS  %5.1f%% eff  (min=%.3f max=%.3f)\n",
-           variant->name, config->name, M, K, N,
-           avg_ms, gflops, efficiency, min_ms, max_ms);
+    if (timed > 0) {
+        double avg_ms = total_ms / timed;
+        double gflops = compute_gflops(M, K, N, avg_ms);
+
+        // Estimate theoretical peak: compute_units * clock * 2 (FMA) * vector_width
+        // This is a rough estimate; actual peak depends on architecture
+        double peak_gflops = (double)device->compute_units * device->max_clock_freq * 2.0 / 1000.0;
+        if (device->has_fp16) peak_gflops *= 2.0; // fp16 doubles throughput
+        double efficiency = (peak_gflops > 0) ? (gflops / peak_gflops * 100.0) : 0.0;
+
+        clEnqueueReadBuffer(device->queue, d_c, CL_TRUE, 0, size_c, h_c, 0, nullptr, nullptr);
+        float max_err = check_rows(h_a, h_b, h_c, M, K, N);
+
+        printf("  %-8s  %-12s  %4dx%4dx%4d  %8.3f ms  %8.2f GFLOPS  %5.1f%% eff  (min=%.3f max=%.3f)  err=%.4f\n",
+               variant->name, config->name, M, K, N,
+               avg_ms, gflops, efficiency, min_ms, max_ms, max_err);
+
+        // Single-row shapes are bandwidth-bound: report bytes moved instead
+        if (M == 1) {
+            double bytes = (double)size_b + size_a + size_c;
+            double gbps = bytes / (avg_ms * 1e6);
+            printf("  %-8s  %-12s  %14s  %8.2f GB/s  (%.1f%% of %.1f GB/s peak)\n",
+                   "", "", "", gbps, peak_gbps > 0 ? gbps / peak_gbps * 100.0 : 0.0,
+                   peak_gbps);
+        }
+    }
 
     // Cleanup
     clReleaseMemObject(d_a);
     clReleaseMemObject(d_b);
+    clReleaseMemObject(d_b_img);
     clReleaseMemObject(d_c);
+    for (cl_mem m : w8a8) if (m) clReleaseMemObject(m);
     free(h_a);
     free(h_b);
-    clReleaseKernel(kernel);
-    return true;
+    free(h_c);
+    return timed > 0;
 }
 
 int main(int argc, char** argv) {
     const char* kernel_file = "src/kernels/gemm.cl";
     int warmup_iters = 5;
     int bench_iters = 20;
+    double peak_gbps = 0.0;  // 0: measure with a buffer copy
 
     // Parse args
     for (int i = 1; i < argc; i++) {
@@ -208,8 +344,11 @@ int main(int argc, char** argv) {
             warmup_iters = atoi(argv[++i]);
         } else if (strcmp(argv[i], "--iters") == 0 && i + 1 < argc) {
             bench_iters = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--peak-gbps") == 0 && i + 1 < argc) {
+            peak_gbps = atof(argv[++i]);
         } else if (strcmp(argv[i], "--help") == 0) {
-            printf("Usage: %s [--kernels <gemm.cl>] [--warmup N] [--iters N]\n", argv[0]);
+            printf("Usage: %s [--kernels <gemm.cl>] [--warmup N] [--iters N] [--peak-gbps X]\n",
+                   argv[0]);
             return 0;
         }
     }
@@ -227,7 +366,10 @@ int main(int argc, char** argv) {
 
     // Build GEMM program
     printf("\nBuilding GEMM kernels from: %s\n", kernel_file);
-    const char* build_opts = "-cl-mad-enable -cl-fast-relaxed-math";
+    char build_opts[256];
+    snprintf(build_opts, sizeof(build_opts), "-cl-mad-enable -cl-fast-relaxed-math%s%s",
+             device.has_subgroups ? " -DMGPU_SUBGROUPS" : "",
+             device.has_int_dot_product ? " -DMGPU_INT_DOT" : "");
     cl_program program = mgpu::build_program_from_file(&device, kernel_file, build_opts);
     if (!program) {
         fprintf(stderr, "Error: Failed to build GEMM kernels\n");
@@ -240,22 +382,29 @@ int main(int argc, char** argv) {
     double peak_gflops = (double)device.compute_units * device.max_clock_freq * 2.0 / 1000.0;
     if (device.has_fp16) peak_gflops *= 2.0;
     printf("\nEstimated peak FP16: %.1f GFLOPS (rough estimate)\n", peak_gflops);
+    if (peak_gbps <= 0.0) {
+        peak_gbps = measure_copy_bandwidth(&device, 10);
+        printf("Peak bandwidth:      %.1f GB/s (measured buffer copy)\n", peak_gbps);
+    } else {
+        printf("Peak bandwidth:      %.1f GB/s (--peak-gbps)\n", peak_gbps);
+    }
     printf("Warmup: %d iters, Bench: %d iters\n\n", warmup_iters, bench_iters);
 
-    printf("  %-8s  %-12s  %-14s  %8s    %8s        %5s       %s\n",
-           "Kernel", "Config", "Size", "Time", "GFLOPS", "Eff", "Min/Max");
-    printf("  %-8s  %-12s  %-14s  %8s    %8s        %5s       %s\n",
+    printf("  %-8s  %-12s  %-14s  %8s    %8s        %5s       %-19s  %s\n",
+           "Kernel", "Config", "Size", "Time", "GFLOPS", "Eff", "Min/Max", "Max err");
+    printf("  %-8s  %-12s  %-14s  %8s    %8s        %5s       %-19s  %s\n",
            "--------", "------------", "--------------", "--------",
-           "--------", "-----", "-------------------");
+           "--------", "-----", "-------------------", "----------");
 
     for (int v = 0; v < num_variants; v++) {
         for (int c = 0; c < num_configs; c++) {
             run_gemm_bench(&device, program, &kernel_variants[v], &bench_configs[c],
-                          warmup_iters, bench_iters);
+                          warmup_iters, bench_iters, peak_gbps);
         }
         printf("\n");
     }
 
+    mgpu::kernel_registry_release(program);
     clReleaseProgram(program);
     mgpu::destroy_device(&device);
 
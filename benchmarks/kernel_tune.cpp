@@ -0,0 +1,474 @@
+#include "../src/engine/compute.h"
+#include "../src/engine/device.h"
+#include "../src/engine/memory.h"
+#include "../src/engine/tuning.h"
+#include "../src/models/gguf_loader.h"
+#include "../src/models/moondream2.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+// Sweeps the KernelTuning launch shapes on the current device at the model's
+// shapes (Phi-1.5 / Moondream2 LLM), checks every candidate's output against
+// the default build and stores the fastest shapes in the tuning database that
+// moondream2_load reads from the kernel directory.
+
+static const int LLM_DIM = 2048;
+static const int LLM_FFN = 8192;
+static const int NUM_HEADS = 32;
+static const int HEAD_DIM = 64;
+static const int PREFILL_LEN = 761;   // 729 image tokens + prompt
+static const int DECODE_CACHE = 1024;
+static const int SKINNY_M = 8;
+static const int TILED_M = 256;
+static const float NORM_EPS = 1e-5f;
+
+static double elapsed_ms(const struct timespec& t0, const struct timespec& t1) {
+    return (double)(t1.tv_sec - t0.tv_sec) * 1e3 + (double)(t1.tv_nsec - t0.tv_nsec) / 1e6;
+}
+
+// --- Workloads ---
+
+struct TuneContext {
+    mgpu::DeviceInfo* device;
+
+    cl_mem act;          // [PREFILL_LEN, LLM_DIM] activations (any smaller A / x)
+    cl_mem norm_weight;  // [LLM_DIM]
+    cl_mem b_buf;        // [LLM_DIM, LLM_DIM] buffer B (tiled / naive)
+    cl_mem w_up;         // image [LLM_DIM, LLM_FFN]
+    cl_mem w_down;       // image [LLM_FFN, LLM_DIM]
+    cl_mem w_qkv;        // image [LLM_DIM, 3 * LLM_DIM]
+    cl_mem w_gate_up;    // image [LLM_DIM, 2 * LLM_FFN]
+    cl_mem q, k, v;      // [max(PREFILL_LEN, DECODE_CACHE), LLM_DIM]
+
+    cl_mem out_a;        // [PREFILL_LEN, LLM_DIM]
+    cl_mem out_b;        // [LLM_FFN]
+    cl_mem out_c;        // [LLM_FFN]
+    cl_mem out_d;        // [LLM_FFN]
+};
+
+// Enqueue one pass of a group's workload; false if any launch failed
+typedef bool (*TuneLaunch)(TuneContext* ctx, cl_program program);
+
+static bool launched(cl_event ev) {
+    if (!ev) return false;
+    clReleaseEvent(ev);
+    return true;
+}
+
+static bool launch_gemv(TuneContext* c, cl_program p) {
+    return launched(mgpu::dispatch_gemm_image_variant(c->device, p, mgpu::GEMM_IMAGE_GEMV,
+                                                      c->act, c->w_up, c->out_a,
+                                                      1, LLM_FFN, LLM_DIM)) &&
+           launched(mgpu::dispatch_gemm_image_variant(c->device, p, mgpu::GEMM_IMAGE_GEMV,
+                                                      c->act, c->w_down, c->out_b,
+                                                      1, LLM_DIM, LLM_FFN));
+}
+
+static bool launch_fused_gemv(TuneContext* c, cl_program p) {
+    return launched(mgpu::dispatch_qkv_gemv(c->device, p, c->act, c->w_qkv,
+                                            c->out_a, c->out_b, c->out_c, LLM_DIM, LLM_DIM,
+                                            nullptr, nullptr, HEAD_DIM, 0,
+                                            c->norm_weight, NORM_EPS)) &&
+           launched(mgpu::dispatch_gate_up_silu_gemv(c->device, p, c->act, c->w_gate_up,
+                                                     c->out_d, LLM_FFN, LLM_DIM,
+                                                     c->norm_weight, NORM_EPS));
+}
+
+static bool launch_skinny(TuneContext* c, cl_program p) {
+    return launched(mgpu::dispatch_gemm_image_variant(c->device, p, mgpu::GEMM_IMAGE_SKINNY,
+                                                      c->act, c->w_up, c->out_a,
+                                                      SKINNY_M, LLM_FFN, LLM_DIM));
+}
+
+static bool launch_tiled(TuneContext* c, cl_program p) {
+    return launched(mgpu::dispatch_gemm_tiled(c->device, p, c->act, c->b_buf, c->out_a,
+                                              TILED_M, LLM_DIM, LLM_DIM));
+}
+
+static bool launch_naive(TuneContext* c, cl_program p) {
+    return launched(mgpu::dispatch_gemm_naive(c->device, p, c->act, c->b_buf, c->out_a,
+                                              TILED_M, LLM_DIM, LLM_DIM));
+}
+
+static bool launch_norm(TuneContext* c, cl_program p) {
+    return launched(mgpu::dispatch_rms_norm(c->device, p, c->act, c->out_a, c->norm_weight,
+                                            PREFILL_LEN, LLM_DIM, NORM_EPS)) &&
+           launched(mgpu::dispatch_rms_norm(c->device, p, c->act, c->out_b, c->norm_weight,
+                                            1, LLM_DIM, NORM_EPS));
+}
+
+static bool launch_attn_decode(TuneContext* c, cl_program p) {
+    return launched(mgpu::dispatch_attention_decode(c->device, p, c->q, c->k, c->v, c->out_a,
+                                                    DECODE_CACHE, NUM_HEADS, HEAD_DIM));
+}
+
+static bool launch_attn_prefill(TuneContext* c, cl_program p) {
+    return launched(mgpu::dispatch_attention_prefill(c->device, p, c->q, c->k, c->v, c->out_a,
+                                                     PREFILL_LEN, PREFILL_LEN,
+                                                     NUM_HEADS, HEAD_DIM));
+}
+
+// --- Tuning Groups ---
+//
+// Each group sweeps one or two KernelTuning fields (cartesian product) over
+// a workload; groups are tuned one after the other, each starting from the
+// winners of the previous ones.
+
+static const int MAX_GROUP_VALUES = 6;
+static const int MAX_GROUP_OUTPUTS = 2;
+
+struct TuneOutput {
+    cl_mem TuneContext::* buffer;
+    size_t elems;
+};
+
+struct TuneGroup {
+    const char* name;
+    const char* kernel_file;
+    TuneLaunch launch;
+    int mgpu::KernelTuning::* field_a;
+    int values_a[MAX_GROUP_VALUES];   // 0-terminated
+    int mgpu::KernelTuning::* field_b;   // may be null
+    int values_b[MAX_GROUP_VALUES];
+    TuneOutput outputs[MAX_GROUP_OUTPUTS];
+};
+
+static const TuneGroup TUNE_GROUPS[] = {
+    { "gemv", "gemm.cl", launch_gemv,
+      &mgpu::KernelTuning::gemv_wg_size, { 64, 128, 256 },
+      &mgpu::KernelTuning::gemv_cols4, { 1, 2, 4, 8 },
+      { { &TuneContext::out_a, LLM_FFN }, { &TuneContext::out_b, LLM_DIM } } },
+    { "fused_gemv", "gemm.cl", launch_fused_gemv,
+      &mgpu::KernelTuning::fused_gemv_wg_size, { 64, 128, 256 },
+      &mgpu::KernelTuning::fused_gemv_cols4, { 1, 2, 4, 8 },
+      { { &TuneContext::out_a, LLM_DIM }, { &TuneContext::out_d, LLM_FFN } } },
+    { "skinny", "gemm.cl", launch_skinny,
+      &mgpu::KernelTuning::skinny_wg_size, { 32, 64, 128, 256 },
+      nullptr, { 0 },
+      { { &TuneContext::out_a, (size_t)SKINNY_M * LLM_FFN } } },
+    { "gemm_tiled", "gemm.cl", launch_tiled,
+      &mgpu::KernelTuning::gemm_tile, { 4, 8, 16 },
+      nullptr, { 0 },
+      { { &TuneContext::out_a, (size_t)TILED_M * LLM_DIM } } },
+    { "gemm_naive", "gemm.cl", launch_naive,
+      &mgpu::KernelTuning::gemm_naive_wg, { 8, 16 },
+      nullptr, { 0 },
+      { { &TuneContext::out_a, (size_t)TILED_M * LLM_DIM } } },
+    { "rms_norm", "layernorm.cl", launch_norm,
+      &mgpu::KernelTuning::norm_wg_size, { 64, 128, 256, 512 },
+      nullptr, { 0 },
+      { { &TuneContext::out_a, (size_t)PREFILL_LEN * LLM_DIM }, { &TuneContext::out_b, LLM_DIM } } },
+    { "attn_decode", "attention.cl", launch_attn_decode,
+      &mgpu::KernelTuning::attn_decode_wg_size, { 32, 64, 128, 256 },
+      nullptr, { 0 },
+      { { &TuneContext::out_a, (size_t)NUM_HEADS * HEAD_DIM } } },
+    { "attn_prefill", "attention.cl", launch_attn_prefill,
+      &mgpu::KernelTuning::attn_br, { 8, 16, 32 },
+      &mgpu::KernelTuning::attn_bc, { 8, 16, 32 },
+      { { &TuneContext::out_a, (size_t)PREFILL_LEN * LLM_DIM } } },
+};
+static const int NUM_TUNE_GROUPS = sizeof(TUNE_GROUPS) / sizeof(TUNE_GROUPS[0]);
+
+struct TuneSettings {
+    const char* kernel_dir;
+    const char* base_opts;
+    int warmup_iters;
+    int bench_iters;
+};
+
+// Build `group`'s kernel file with `tuning`, register it and time the
+// workload. Outputs are read into `host` (concatenated). Returns the average
+// ms per pass, or a negative value if the candidate did not build or run.
+static double run_candidate(TuneContext* ctx, const TuneSettings* s, const TuneGroup* group,
+                            const mgpu::KernelTuning* tuning, uint16_t* host) {
+    char opts[1024];
+    int n = snprintf(opts, sizeof(opts), "%s ", s->base_opts);
+    if (!mgpu::kernel_tuning_build_options(tuning, opts + n, sizeof(opts) - n)) return -1.0;
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", s->kernel_dir, group->kernel_file);
+    cl_program program = mgpu::build_program_from_file(ctx->device, path, opts);
+    if (!program) return -1.0;
+    if (!mgpu::kernel_tuning_register(program, tuning)) {
+        clReleaseProgram(program);
+        return -1.0;
+    }
+
+    double avg_ms = -1.0;
+    bool ok = true;
+    for (int i = 0; i < s->warmup_iters && ok; i++) ok = group->launch(ctx, program);
+    clFinish(ctx->device->queue);
+
+    if (ok) {
+        struct timespec t0, t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for (int i = 0; i < s->bench_iters && ok; i++) ok = group->launch(ctx, program);
+        clFinish(ctx->device->queue);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        if (ok) avg_ms = elapsed_ms(t0, t1) / s->bench_iters;
+    }
+
+    size_t offset = 0;
+    for (int o = 0; o < MAX_GROUP_OUTPUTS && ok && group->outputs[o].buffer; o++) {
+        size_t bytes = group->outputs[o].elems * sizeof(uint16_t);
+        if (clEnqueueReadBuffer(ctx->device->queue, ctx->*group->outputs[o].buffer, CL_TRUE, 0,
+                                bytes, host + offset, 0, nullptr, nullptr) != CL_SUCCESS)
+            avg_ms = -1.0;
+        offset += group->outputs[o].elems;
+    }
+
+    mgpu::kernel_registry_release(program);
+    clReleaseProgram(program);
+    return avg_ms;
+}
+
+// Largest |out - ref| relative to the largest |ref|
+static float max_rel_error(const uint16_t* out, const uint16_t* ref, size_t count) {
+    float max_err = 0.0f;
+    float max_ref = 1e-3f;
+    for (size_t i = 0; i < count; i++) {
+        float r = mgpu::ggml_fp16_to_fp32(ref[i]);
+        float e = fabsf(mgpu::ggml_fp16_to_fp32(out[i]) - r);
+        if (e > max_err) max_err = e;
+        if (fabsf(r) > max_ref) max_ref = fabsf(r);
+    }
+    return max_err / max_ref;
+}
+
+static size_t group_output_elems(const TuneGroup* group) {
+    size_t total = 0;
+    for (int o = 0; o < MAX_GROUP_OUTPUTS && group->outputs[o].buffer; o++)
+        total += group->outputs[o].elems;
+    return total;
+}
+
+// Tune one group in place on *best
+static void tune_group(TuneContext* ctx, const TuneSettings* s, const TuneGroup* group,
+                       mgpu::KernelTuning* best) {
+    // Outputs of each candidate must match the default shapes' outputs
+    const float MAX_REL_ERR = 1e-2f;
+
+    size_t elems = group_output_elems(group);
+    uint16_t* ref = (uint16_t*)malloc(elems * sizeof(uint16_t));
+    uint16_t* out = (uint16_t*)malloc(elems * sizeof(uint16_t));
+    if (!ref || !out) {
+        fprintf(stderr, "Error: Failed to allocate host buffers\n");
+        free(ref);
+        free(out);
+        return;
+    }
+
+    printf("\n[%s]\n", group->name);
+    double best_ms = run_candidate(ctx, s, group, best, ref);
+    if (best_ms < 0.0) {
+        printf("  current shapes fail to run, group skipped\n");
+        free(ref);
+        free(out);
+        return;
+    }
+
+    mgpu::KernelTuning current = *best;
+    int num_b = group->field_b ? MAX_GROUP_VALUES : 1;
+    for (int a = 0; a < MAX_GROUP_VALUES && group->values_a[a]; a++) {
+        for (int b = 0; b < num_b; b++) {
+            if (group->field_b && !group->values_b[b]) break;
+
+            mgpu::KernelTuning cand = current;
+            cand.*group->field_a = group->values_a[a];
+            if (group->field_b) cand.*group->field_b = group->values_b[b];
+
+            char label[64];
+            if (group->field_b)
+                snprintf(label, sizeof(label), "%d x %d", group->values_a[a], group->values_b[b]);
+            else
+                snprintf(label, sizeof(label), "%d", group->values_a[a]);
+
+            if (!mgpu::kernel_tuning_valid(&cand, ctx->device)) {
+                printf("  %-10s  %10s\n", label, "invalid");
+                continue;
+            }
+            double ms = run_candidate(ctx, s, group, &cand, out);
+            if (ms < 0.0) {
+                printf("  %-10s  %10s\n", label, "failed");
+                continue;
+            }
+            float err = max_rel_error(out, ref, elems);
+            bool match = err <= MAX_REL_ERR;
+            printf("  %-10s  %10.1f us  rel err %.5f%s\n", label, ms * 1e3, err,
+                   match ? "" : "  (mismatch, rejected)");
+            if (match && ms < best_ms) {
+                best_ms = ms;
+                *best = cand;
+            }
+        }
+    }
+
+    if (group->field_b)
+        printf("  -> %d x %d (%.1f us)\n", (*best).*group->field_a, (*best).*group->field_b,
+               best_ms * 1e3);
+    else
+        printf("  -> %d (%.1f us)\n", (*best).*group->field_a, best_ms * 1e3);
+
+    free(ref);
+    free(out);
+}
+
+// --- Setup ---
+
+static cl_mem random_buffer(mgpu::DeviceInfo* device, size_t count, float scale) {
+    uint16_t* host = (uint16_t*)malloc(count * sizeof(uint16_t));
+    if (!host) return nullptr;
+    for (size_t i = 0; i < count; i++)
+        host[i] = mgpu::ggml_fp32_to_fp16((((float)rand() / RAND_MAX) * 2.0f - 1.0f) * scale);
+    cl_mem buf = mgpu::create_buffer(device, count * sizeof(uint16_t),
+                                     CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, host);
+    free(host);
+    return buf;
+}
+
+static cl_mem random_image(mgpu::DeviceInfo* device, int rows, int cols, float scale) {
+    size_t count = (size_t)rows * cols;
+    uint16_t* host = (uint16_t*)malloc(count * sizeof(uint16_t));
+    if (!host) return nullptr;
+    for (size_t i = 0; i < count; i++)
+        host[i] = mgpu::ggml_fp32_to_fp16((((float)rand() / RAND_MAX) * 2.0f - 1.0f) * scale);
+    cl_mem img = mgpu::create_weight_image(device, rows, cols, (const cl_half*)host);
+    free(host);
+    return img;
+}
+
+static void release_context(TuneContext* ctx) {
+    cl_mem* bufs[] = {
+        &ctx->act, &ctx->norm_weight, &ctx->b_buf, &ctx->w_up, &ctx->w_down, &ctx->w_qkv,
+        &ctx->w_gate_up, &ctx->q, &ctx->k, &ctx->v,
+        &ctx->out_a, &ctx->out_b, &ctx->out_c, &ctx->out_d,
+    };
+    for (cl_mem* b : bufs) {
+        if (*b) clReleaseMemObject(*b);
+        *b = nullptr;
+    }
+}
+
+static bool init_context(TuneContext* ctx, mgpu::DeviceInfo* device) {
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->device = device;
+
+    const float w_scale = 1.0f / sqrtf((float)LLM_DIM);
+    const size_t kv_rows = PREFILL_LEN > DECODE_CACHE ? PREFILL_LEN : DECODE_CACHE;
+    ctx->act         = random_buffer(device, (size_t)PREFILL_LEN * LLM_DIM, 1.0f);
+    ctx->norm_weight = random_buffer(device, LLM_DIM, 1.0f);
+    ctx->b_buf       = random_buffer(device, (size_t)LLM_DIM * LLM_DIM, w_scale);
+    ctx->w_up        = random_image(device, LLM_DIM, LLM_FFN, w_scale);
+    ctx->w_down      = random_image(device, LLM_FFN, LLM_DIM, w_scale);
+    ctx->w_qkv       = random_image(device, LLM_DIM, 3 * LLM_DIM, w_scale);
+    ctx->w_gate_up   = random_image(device, LLM_DIM, 2 * LLM_FFN, w_scale);
+    ctx->q           = random_buffer(device, kv_rows * LLM_DIM, 1.0f);
+    ctx->k           = random_buffer(device, kv_rows * LLM_DIM, 1.0f);
+    ctx->v           = random_buffer(device, kv_rows * LLM_DIM, 1.0f);
+    ctx->out_a = mgpu::create_buffer(device, (size_t)PREFILL_LEN * LLM_DIM * sizeof(uint16_t),
+                                     CL_MEM_READ_WRITE);
+    ctx->out_b = mgpu::create_buffer(device, LLM_FFN * sizeof(uint16_t), CL_MEM_READ_WRITE);
+    ctx->out_c = mgpu::create_buffer(device, LLM_FFN * sizeof(uint16_t), CL_MEM_READ_WRITE);
+    ctx->out_d = mgpu::create_buffer(device, LLM_FFN * sizeof(uint16_t), CL_MEM_READ_WRITE);
+
+    return ctx->act && ctx->norm_weight && ctx->b_buf && ctx->w_up && ctx->w_down &&
+           ctx->w_qkv && ctx->w_gate_up && ctx->q && ctx->k && ctx->v &&
+           ctx->out_a && ctx->out_b && ctx->out_c && ctx->out_d;
+}
+
+int main(int argc, char** argv) {
+    const char* kernel_dir = "src/kernels";
+    const char* out_path = nullptr;
+    const char* only_group = nullptr;
+    int warmup_iters = 3;
+    int bench_iters = 20;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--kernels") == 0 && i + 1 < argc) {
+            kernel_dir = argv[++i];
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            out_path = argv[++i];
+        } else if (strcmp(argv[i], "--group") == 0 && i + 1 < argc) {
+            only_group = argv[++i];
+        } else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) {
+            warmup_iters = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--iters") == 0 && i + 1 < argc) {
+            bench_iters = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--help") == 0) {
+            printf("Usage: %s [--kernels <dir>] [--out <tuning file>] [--group <name>]"
+                   " [--warmup N] [--iters N]\n", argv[0]);
+            printf("  --out defaults to <kernels>/%s (read by moondream2_load)\n",
+                   mgpu::TUNING_DB_FILENAME);
+            printf("  groups:");
+            for (int g = 0; g < NUM_TUNE_GROUPS; g++) printf(" %s", TUNE_GROUPS[g].name);
+            printf("\n");
+            return 0;
+        }
+    }
+    if (bench_iters < 1) bench_iters = 1;
+
+    char default_out[512];
+    if (!out_path) {
+        snprintf(default_out, sizeof(default_out), "%s/%s", kernel_dir, mgpu::TUNING_DB_FILENAME);
+        out_path = default_out;
+    }
+
+    printf("=== MGPU Kernel Tuner ===\n\n");
+
+    srand(1234);
+
+    mgpu::DeviceInfo device;
+    if (!mgpu::init_device(&device)) {
+        fprintf(stderr, "Error: Failed to initialize OpenCL device\n");
+        return 1;
+    }
+    mgpu::print_device_info(&device);
+
+    TuneContext ctx;
+    if (!init_context(&ctx, &device)) {
+        fprintf(stderr, "Error: Failed to create device buffers\n");
+        release_context(&ctx);
+        mgpu::destroy_device(&device);
+        return 1;
+    }
+
+    // Candidates build on the specialized options of moondream2_load (the
+    // default config, whose shapes the workloads above use), exactly as its
+    // tuned build does
+    const mgpu::Moondream2Config config;
+    char build_opts[256];
+    char spec_opts[512];
+    mgpu::moondream2_build_options(&device, config, build_opts, sizeof(build_opts),
+                                   spec_opts, sizeof(spec_opts));
+    TuneSettings settings = { kernel_dir, spec_opts, warmup_iters, bench_iters };
+
+    // Start from the stored entry, so a single-group run keeps the others
+    mgpu::KernelTuning best;
+    if (mgpu::tuning_db_load(out_path, &device, &best))
+        printf("\nStarting from the stored tuning in %s\n", out_path);
+
+    for (int g = 0; g < NUM_TUNE_GROUPS; g++) {
+        if (only_group && strcmp(only_group, TUNE_GROUPS[g].name) != 0) continue;
+        tune_group(&ctx, &settings, &TUNE_GROUPS[g], &best);
+    }
+
+    char summary[512];
+    mgpu::kernel_tuning_format(&best, summary, sizeof(summary));
+    printf("\nTuned: %s\n", summary);
+
+    int status = 0;
+    if (mgpu::tuning_db_store(out_path, &device, &best)) {
+        printf("Written to %s (%s | %s)\n", out_path, device.device_name, device.driver_version);
+    } else {
+        fprintf(stderr, "Error: Failed to write %s\n", out_path);
+        status = 1;
+    }
+
+    release_context(&ctx);
+    mgpu::destroy_device(&device);
+    return status;
+}
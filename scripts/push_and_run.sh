@@ -14,7 +14,7 @@ adb shell "mkdir -p $DEVICE_DIR/kernels"
 
 # Push binaries
 echo ">>> Pushing binaries..."
-for bin in mgpu_device_info mgpu_cli mgpu_bench; do
+for bin in mgpu_device_info mgpu_cli mgpu_bench mgpu_attn_bench mgpu_tune; do
     if [ -f "$BUILD_DIR/$bin" ]; then
         adb push "$BUILD_DIR/$bin" "$DEVICE_DIR/"
         adb shell "chmod +x $DEVICE_DIR/$bin"
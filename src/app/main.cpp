@@ -1,4 +1,5 @@
 #include "../engine/device.h"
+#include "../engine/compute.h"
 #include "../models/moondream2.h"
 
 #include <cstdio>
@@ -25,6 +26,19 @@ static void print_usage(const char* program) {
     printf("  --kernels <dir>     Path to OpenCL kernel directory\n");
     printf("  --vocab <path>      Path to tokenizer vocabulary file\n");
     printf("  --max-tokens <n>    Maximum tokens to generate (default: 128)\n");
+    printf("  --temperature <t>   Sampling temperature, 0 = greedy (default: 0)\n");
+    printf("  --top-k <n>         Keep the n most likely tokens (default: 40, max 64)\n");
+    printf("  --top-p <p>         Nucleus sampling cutoff, within the top-k tokens (default: 1.0)\n");
+    printf("  --min-p <p>         Drop tokens below p * max probability (default: 0)\n");
+    printf("  --repeat-penalty <r> Repetition penalty over the last 64 tokens (default: 1.0)\n");
+    printf("  --seed <n>          Sampling RNG seed (default: 0)\n");
+    printf("  --no-kernel-cache   Create kernels per dispatch (enqueue-overhead A/B)\n");
+    printf("  --sync-ops          Wait for every kernel on the host (debugging)\n");
+    printf("  --no-decode-graph   Dispatch every decode step eagerly (no capture/replay)\n");
+    printf("  --kv-head-major     Head-major KV-cache [heads, seq, head_dim] (contiguous decode reads)\n");
+    printf("  --kv-int8           Int8 KV-cache with per-block fp16 scales (half the memory)\n");
+    printf("  --w8a8              Int8 weights x int8 activations for the LLM projections\n");
+    printf("  --kv-read <mode>    Decode KV reads: buffer (default), image, auto (experimental)\n");
     printf("  --benchmark         Run benchmark mode\n");
     printf("  --help              Show this help message\n");
     printf("\nExamples:\n");
@@ -40,7 +54,14 @@ int main(int argc, char** argv) {
     const char* kernel_dir = nullptr;
     const char* vocab_path = nullptr;
     int max_tokens = 128;
+    mgpu::SamplerConfig sampler;
     bool benchmark = false;
+    bool sync_ops = false;
+    bool no_decode_graph = false;
+    bool kv_head_major = false;
+    bool kv_int8 = false;
+    bool w8a8 = false;
+    mgpu::KVCacheRead kv_read = mgpu::KV_READ_BUFFER;
 
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--model") == 0 && i + 1 < argc) {
@@ -55,6 +76,42 @@ int main(int argc, char** argv) {
             vocab_path = argv[++i];
         } else if (strcmp(argv[i], "--max-tokens") == 0 && i + 1 < argc) {
             max_tokens = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--temperature") == 0 && i + 1 < argc) {
+            sampler.temperature = (float)atof(argv[++i]);
+        } else if (strcmp(argv[i], "--top-k") == 0 && i + 1 < argc) {
+            sampler.top_k = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--top-p") == 0 && i + 1 < argc) {
+            sampler.top_p = (float)atof(argv[++i]);
+        } else if (strcmp(argv[i], "--min-p") == 0 && i + 1 < argc) {
+            sampler.min_p = (float)atof(argv[++i]);
+        } else if (strcmp(argv[i], "--repeat-penalty") == 0 && i + 1 < argc) {
+            sampler.repetition_penalty = (float)atof(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            sampler.seed = (unsigned int)strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--no-kernel-cache") == 0) {
+            mgpu::kernel_registry_set_enabled(false);
+        } else if (strcmp(argv[i], "--sync-ops") == 0) {
+            sync_ops = true;
+        } else if (strcmp(argv[i], "--no-decode-graph") == 0) {
+            no_decode_graph = true;
+        } else if (strcmp(argv[i], "--kv-head-major") == 0) {
+            kv_head_major = true;
+        } else if (strcmp(argv[i], "--w8a8") == 0) {
+            w8a8 = true;
+        } else if (strcmp(argv[i], "--kv-int8") == 0) {
+            kv_int8 = true;
+        } else if (strcmp(argv[i], "--kv-read") == 0 && i + 1 < argc) {
+            const char* mode = argv[++i];
+            if (strcmp(mode, "buffer") == 0) {
+                kv_read = mgpu::KV_READ_BUFFER;
+            } else if (strcmp(mode, "image") == 0) {
+                kv_read = mgpu::KV_READ_IMAGE;
+            } else if (strcmp(mode, "auto") == 0) {
+                kv_read = mgpu::KV_READ_AUTO;
+            } else {
+                fprintf(stderr, "Error: --kv-read expects buffer, image or auto\n");
+                return 1;
+            }
         } else if (strcmp(argv[i], "--benchmark") == 0) {
             benchmark = true;
         } else if (strcmp(argv[i], "--help") == 0) {
@@ -90,11 +147,22 @@ int main(int argc, char** argv) {
 
     if (model_path) {
         mgpu::Moondream2Model model;
-        if (!mgpu::moondream2_load(&model, &device, model_path, kernel_dir)) {
+        mgpu::Moondream2Config config;
+        if (kv_int8) config.kv_cache_type = mgpu::KV_CACHE_INT8;
+        if (kv_head_major) config.kv_layout = mgpu::KV_LAYOUT_HEAD_MAJOR;
+        config.w8a8 = w8a8;
+        if (!mgpu::moondream2_load(&model, &device, model_path, kernel_dir, &config)) {
             fprintf(stderr, "Error: Failed to load model: %s\n", model_path);
             mgpu::destroy_device(&device);
             return 1;
         }
+        model.sync_each_op = sync_ops;
+        model.no_decode_graph = no_decode_graph;
+        if (!mgpu::moondream2_set_kv_read(&model, &device, kv_read)) {
+            mgpu::moondream2_destroy(&model);
+            mgpu::destroy_device(&device);
+            return 1;
+        }
 
         // Process with vision encoder if image provided
         if (image_path) {
@@ -125,7 +193,7 @@ int main(int argc, char** argv) {
         // Text generation (with optional vision context already processed)
         if (prompt) {
             int n = mgpu::moondream2_generate(&model, &device, prompt,
-                                               max_tokens, vocab_path);
+                                               max_tokens, vocab_path, &sampler);
             if (n < 0) {
                 fprintf(stderr, "Error: generation failed\n");
             }
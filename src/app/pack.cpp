@@ -0,0 +1,70 @@
+#include "../models/moondream2.h"
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+// Offline weight repacking: GGUF -> GPU-native weight pack (weight_pack.h)
+// that moondream2_load picks up next to the GGUF. Runs on the host only.
+
+static void print_usage(const char* program) {
+    printf("MGPU weight packer: converts a GGUF into a GPU-native weight pack\n\n");
+    printf("Usage: %s --model <path> [options]\n\n", program);
+    printf("Options:\n");
+    printf("  --model <path>      Path to GGUF model file\n");
+    printf("  --out <path>        Output pack (default: the GGUF path with .mgpu,\n");
+    printf("                      where moondream2_load looks for it)\n");
+    printf("  --quantize q8_0     Store F16 projections as Q8_0 blocks\n");
+    printf("  --help              Show this help message\n");
+}
+
+int main(int argc, char** argv) {
+    const char* model_path = nullptr;
+    const char* out_path = nullptr;
+    mgpu::WeightFormat quantize = mgpu::WEIGHT_F16;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--model") == 0 && i + 1 < argc) {
+            model_path = argv[++i];
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            out_path = argv[++i];
+        } else if (strcmp(argv[i], "--quantize") == 0 && i + 1 < argc) {
+            const char* type = argv[++i];
+            if (strcmp(type, "q8_0") != 0) {
+                fprintf(stderr, "Error: --quantize supports q8_0\n");
+                return 1;
+            }
+            quantize = mgpu::WEIGHT_Q8_0;
+        } else if (strcmp(argv[i], "--help") == 0) {
+            print_usage(argv[0]);
+            return 0;
+        } else {
+            fprintf(stderr, "Error: Unknown argument: %s\n", argv[i]);
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!model_path) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    char default_out[512];
+    if (!out_path) {
+        mgpu::moondream2_pack_path(model_path, default_out, sizeof(default_out));
+        out_path = default_out;
+    }
+
+    printf("Packing %s -> %s\n", model_path, out_path);
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if (!mgpu::moondream2_pack(model_path, out_path, quantize)) {
+        fprintf(stderr, "Error: packing failed\n");
+        return 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    printf("Done in %.1f s\n",
+           (double)(t1.tv_sec - t0.tv_sec) + (double)(t1.tv_nsec - t0.tv_nsec) / 1e9);
+    return 0;
+}
@@ -1,6 +1,15 @@
 #include "compute.h"
+#include "pipeline.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <thread>
 
 #ifdef MGPU_ANDROID
 #include <android/log.h>
@@ -23,15 +32,554 @@ static inline size_t round_up(size_t value, size_t multiple) {
     return ((value + multiple - 1) / multiple) * multiple;
 }
 
+static inline uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// --- Kernel Registry ---
+//
+// clCreateKernel is not free: the driver looks the name up, allocates
+// argument storage and on some Adreno drivers finishes lazy compilation.
+// The registry creates each (program, kernel name) once and every dispatch_*
+// reuses it. clSetKernelArg mutates the kernel object, so each host thread
+// gets its own copy: the owning list below holds every copy for release,
+// while each thread looks kernels up in its own table without locking.
+
+static const int KERNEL_NAME_MAX = 64;
+static const int THREAD_KERNEL_MAX = 256;
+
+struct RegistryEntry {
+    cl_program program;
+    cl_kernel kernel;
+    char name[KERNEL_NAME_MAX];
+};
+
+// Owning list of every kernel copy, across all threads
+static std::mutex g_registry_lock;
+static RegistryEntry* g_registry = nullptr;
+static int g_registry_count = 0;
+static int g_registry_capacity = 0;
+
+// Bumped on release so other threads drop their stale lookups
+static std::atomic<unsigned> g_registry_epoch{1};
+static std::atomic<bool> g_registry_enabled{true};
+
+// Per-thread lookup table (non-owning)
+struct ThreadKernelTable {
+    RegistryEntry entries[THREAD_KERNEL_MAX];
+    int count;
+    unsigned epoch;
+};
+
+// Per-thread copy of the launch tuning of each program seen (see program_tuning)
+static const int TUNING_ENTRY_MAX = 32;
+
+struct TuningEntry {
+    cl_program program;
+    KernelTuning tuning;
+};
+
+struct ThreadTuningTable {
+    TuningEntry entries[TUNING_ENTRY_MAX];
+    int count;
+    unsigned epoch;
+};
+
+static thread_local ThreadKernelTable t_kernels;
+static thread_local ThreadTuningTable t_tunings;
+static thread_local DispatchStats t_stats;
+static thread_local uint64_t t_dispatch_start_ns = 0;
+// Kernel created outside the registry for the in-flight dispatch (registry
+// disabled, or graph capture). Released or handed to the graph after enqueue;
+// released at the next acquire if arg setup bailed out.
+static thread_local cl_kernel t_uncached_kernel = nullptr;
+static thread_local const char* t_uncached_name = nullptr;
+static thread_local DecodeGraph* t_capture = nullptr;
+
+static void thread_table_sync() {
+    unsigned epoch = g_registry_epoch.load(std::memory_order_acquire);
+    if (t_kernels.epoch != epoch) {
+        t_kernels.count = 0;
+        t_kernels.epoch = epoch;
+    }
+}
+
+static cl_kernel thread_table_find(cl_program program, const char* name) {
+    for (int i = 0; i < t_kernels.count; i++) {
+        const RegistryEntry* e = &t_kernels.entries[i];
+        if (e->program == program && strcmp(e->name, name) == 0)
+            return e->kernel;
+    }
+    return nullptr;
+}
+
+// Take ownership of `kernel` and make it visible to the calling thread
+static bool registry_insert(cl_program program, const char* name, cl_kernel kernel) {
+    if (strlen(name) >= (size_t)KERNEL_NAME_MAX || t_kernels.count >= THREAD_KERNEL_MAX)
+        return false;
+
+    {
+        std::lock_guard<std::mutex> lock(g_registry_lock);
+        if (g_registry_count == g_registry_capacity) {
+            int new_capacity = g_registry_capacity ? g_registry_capacity * 2 : 64;
+            RegistryEntry* grown = (RegistryEntry*)realloc(
+                g_registry, (size_t)new_capacity * sizeof(RegistryEntry));
+            if (!grown) return false;
+            g_registry = grown;
+            g_registry_capacity = new_capacity;
+        }
+        RegistryEntry* e = &g_registry[g_registry_count++];
+        e->program = program;
+        e->kernel = kernel;
+        strcpy(e->name, name);
+    }
+
+    RegistryEntry* t = &t_kernels.entries[t_kernels.count++];
+    t->program = program;
+    t->kernel = kernel;
+    strcpy(t->name, name);
+    return true;
+}
+
+// --- Dispatch Scratch ---
+//
+// Device temporaries of multi-pass dispatches (split-K partials, ...),
+// owned per program and released with its kernels. Like the kernel copies,
+// each host thread gets its own slots, so concurrent dispatches on the same
+// program do not share partials. A slot that has to grow is reallocated and
+// the old buffer released; that bumps dispatch_scratch_generation(), and a
+// decode graph captured before the bump must not be replayed (it still binds
+// the released buffer).
+
+enum ScratchSlot {
+    SCRATCH_ATTN_PARTIALS = 0,
+    SCRATCH_TOPK_PARTIALS,
+    SCRATCH_LM_HEAD_PARTIALS,
+};
+
+struct ScratchEntry {
+    cl_program program;
+    std::thread::id owner;
+    int slot;
+    cl_mem buffer;
+    size_t size;
+};
+
+static const int SCRATCH_MAX = 64;
+static ScratchEntry g_scratch[SCRATCH_MAX];
+static int g_scratch_count = 0;
+static std::atomic<unsigned> g_scratch_generation{1};
+
+static cl_mem program_scratch(const DeviceInfo* dev, cl_program program, int slot,
+                              size_t size) {
+    const std::thread::id self = std::this_thread::get_id();
+    std::lock_guard<std::mutex> lock(g_registry_lock);
+
+    ScratchEntry* entry = nullptr;
+    for (int i = 0; i < g_scratch_count; i++) {
+        if (g_scratch[i].program == program && g_scratch[i].owner == self &&
+            g_scratch[i].slot == slot) {
+            entry = &g_scratch[i];
+            break;
+        }
+    }
+    if (entry && entry->size >= size) return entry->buffer;
+
+    if (!entry) {
+        if (g_scratch_count == SCRATCH_MAX) return nullptr;
+        entry = &g_scratch[g_scratch_count++];
+        entry->program = program;
+        entry->owner = self;
+        entry->slot = slot;
+    } else {
+        if (entry->buffer) clReleaseMemObject(entry->buffer);
+        g_scratch_generation.fetch_add(1, std::memory_order_release);
+    }
+
+    cl_int err;
+    entry->buffer = clCreateBuffer(dev->context, CL_MEM_READ_WRITE, size, nullptr, &err);
+    entry->size = (err == CL_SUCCESS) ? size : 0;
+    if (err != CL_SUCCESS) {
+        MGPU_ERR("dispatch scratch: failed to allocate %zu bytes (err=%d)\n", size, err);
+        entry->buffer = nullptr;
+    }
+    return entry->buffer;
+}
+
+// Caller holds g_registry_lock
+static void release_program_scratch(cl_program program) {
+    int kept = 0;
+    for (int i = 0; i < g_scratch_count; i++) {
+        if (!program || g_scratch[i].program == program) {
+            if (g_scratch[i].buffer) clReleaseMemObject(g_scratch[i].buffer);
+        } else {
+            g_scratch[kept++] = g_scratch[i];
+        }
+    }
+    if (kept != g_scratch_count) g_scratch_generation.fetch_add(1, std::memory_order_release);
+    g_scratch_count = kept;
+}
+
+unsigned dispatch_scratch_generation() {
+    return g_scratch_generation.load(std::memory_order_acquire);
+}
+
+int kernel_registry_preload(cl_program program) {
+    if (!program || !g_registry_enabled.load(std::memory_order_relaxed)) return 0;
+    thread_table_sync();
+
+    cl_uint num_kernels = 0;
+    cl_int err = clCreateKernelsInProgram(program, 0, nullptr, &num_kernels);
+    if (err != CL_SUCCESS || num_kernels == 0) return 0;
+
+    cl_kernel* kernels = (cl_kernel*)malloc(num_kernels * sizeof(cl_kernel));
+    if (!kernels) return 0;
+    err = clCreateKernelsInProgram(program, num_kernels, kernels, nullptr);
+    if (err != CL_SUCCESS) {
+        free(kernels);
+        return 0;
+    }
+
+    int cached = 0;
+    for (cl_uint i = 0; i < num_kernels; i++) {
+        char name[KERNEL_NAME_MAX] = {0};
+        err = clGetKernelInfo(kernels[i], CL_KERNEL_FUNCTION_NAME,
+                              sizeof(name), name, nullptr);
+        if (err != CL_SUCCESS || thread_table_find(program, name) ||
+            !registry_insert(program, name, kernels[i])) {
+            clReleaseKernel(kernels[i]);
+            continue;
+        }
+        t_stats.kernels_created++;
+        cached++;
+    }
+
+    free(kernels);
+    return cached;
+}
+
+cl_kernel kernel_registry_get(cl_program program, const char* name) {
+    thread_table_sync();
+    cl_kernel kernel = thread_table_find(program, name);
+    if (kernel) return kernel;
+
+    cl_int err;
+    kernel = clCreateKernel(program, name, &err);
+    if (err != CL_SUCCESS) {
+        MGPU_ERR("kernel registry: clCreateKernel(%s) failed (err=%d)\n", name, err);
+        return nullptr;
+    }
+    t_stats.kernels_created++;
+
+    if (!registry_insert(program, name, kernel)) {
+        clReleaseKernel(kernel);
+        return nullptr;
+    }
+    return kernel;
+}
+
+// --- Launch Tuning ---
+//
+// Programs built with non-default KernelTuning defines are registered here;
+// dispatch_* read their launch shapes from the entry of the program they
+// are given (defaults for unregistered programs). Every dispatch asks, so
+// each thread keeps its own copy and only takes the lock on the first
+// dispatch of a program after a registration or release.
+
+static TuningEntry g_tuning[TUNING_ENTRY_MAX];
+static int g_tuning_count = 0;
+
+// Bumped on register / release so other threads drop their stale copies
+static std::atomic<unsigned> g_tuning_epoch{1};
+
+bool kernel_tuning_register(cl_program program, const KernelTuning* tuning) {
+    std::lock_guard<std::mutex> lock(g_registry_lock);
+    for (int i = 0; i < g_tuning_count; i++) {
+        if (g_tuning[i].program == program) {
+            g_tuning[i].tuning = *tuning;
+            g_tuning_epoch.fetch_add(1, std::memory_order_release);
+            return true;
+        }
+    }
+    if (g_tuning_count == TUNING_ENTRY_MAX) return false;
+    g_tuning[g_tuning_count].program = program;
+    g_tuning[g_tuning_count].tuning = *tuning;
+    g_tuning_count++;
+    g_tuning_epoch.fetch_add(1, std::memory_order_release);
+    return true;
+}
+
+static KernelTuning program_tuning(cl_program program) {
+    unsigned epoch = g_tuning_epoch.load(std::memory_order_acquire);
+    if (t_tunings.epoch != epoch) {
+        t_tunings.count = 0;
+        t_tunings.epoch = epoch;
+    }
+    for (int i = 0; i < t_tunings.count; i++) {
+        if (t_tunings.entries[i].program == program) return t_tunings.entries[i].tuning;
+    }
+
+    KernelTuning tuning;
+    {
+        std::lock_guard<std::mutex> lock(g_registry_lock);
+        for (int i = 0; i < g_tuning_count; i++) {
+            if (g_tuning[i].program == program) {
+                tuning = g_tuning[i].tuning;
+                break;
+            }
+        }
+    }
+    if (t_tunings.count < TUNING_ENTRY_MAX) {
+        t_tunings.entries[t_tunings.count].program = program;
+        t_tunings.entries[t_tunings.count].tuning = tuning;
+        t_tunings.count++;
+    }
+    return tuning;
+}
+
+// Caller holds g_registry_lock
+static void release_program_tuning(cl_program program) {
+    int kept = 0;
+    for (int i = 0; i < g_tuning_count; i++) {
+        if (program && g_tuning[i].program != program) g_tuning[kept++] = g_tuning[i];
+    }
+    g_tuning_count = kept;
+    g_tuning_epoch.fetch_add(1, std::memory_order_release);
+}
+
+static void release_epilogue_programs(cl_program base);
+
+void kernel_registry_release(cl_program program) {
+    release_epilogue_programs(program);
+
+    std::lock_guard<std::mutex> lock(g_registry_lock);
+
+    int kept = 0;
+    for (int i = 0; i < g_registry_count; i++) {
+        if (!program || g_registry[i].program == program) {
+            clReleaseKernel(g_registry[i].kernel);
+        } else {
+            g_registry[kept++] = g_registry[i];
+        }
+    }
+    g_registry_count = kept;
+    release_program_scratch(program);
+    release_program_tuning(program);
+    if (kept == 0) {
+        free(g_registry);
+        g_registry = nullptr;
+        g_registry_capacity = 0;
+    }
+    g_registry_epoch.fetch_add(1, std::memory_order_release);
+}
+
+void kernel_registry_set_enabled(bool enabled) {
+    g_registry_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+// --- GEMM Epilogue Builds ---
+//
+// A GemmEpilogue selects its code at compile time, so each combination in
+// use is a separate build of the GEMM program: same source and options as
+// the base program, plus -DGEMM_EPI_* defines. Built on first use and
+// released with the base program's kernels.
+
+struct EpilogueProgram {
+    cl_program base;
+    int key;
+    cl_program program;
+};
+
+static const int EPILOGUE_PROGRAM_MAX = 32;
+static std::mutex g_epilogue_lock;
+static EpilogueProgram g_epilogue_programs[EPILOGUE_PROGRAM_MAX];
+static int g_epilogue_program_count = 0;
+
+// 0 for the plain store (the base program itself)
+static int epilogue_key(const GemmEpilogue* epi) {
+    if (!epi) return 0;
+    return (epi->bias ? 1 : 0) | (epi->residual ? 2 : 0) | ((int)epi->activation << 2);
+}
+
+static cl_program build_epilogue_program(const DeviceInfo* dev, cl_program base,
+                                         const GemmEpilogue* epi) {
+    size_t src_size = 0;
+    size_t opts_size = 0;
+    cl_int err = clGetProgramInfo(base, CL_PROGRAM_SOURCE, 0, nullptr, &src_size);
+    err |= clGetProgramBuildInfo(base, dev->device, CL_PROGRAM_BUILD_OPTIONS,
+                                 0, nullptr, &opts_size);
+    if (err != CL_SUCCESS || src_size <= 1) {
+        MGPU_ERR("gemm epilogue: base program has no source (err=%d)\n", err);
+        return nullptr;
+    }
+
+    char* source = (char*)malloc(src_size);
+    char* base_opts = (char*)malloc(opts_size + 1);
+    if (!source || !base_opts) {
+        free(source);
+        free(base_opts);
+        return nullptr;
+    }
+    clGetProgramInfo(base, CL_PROGRAM_SOURCE, src_size, source, nullptr);
+    clGetProgramBuildInfo(base, dev->device, CL_PROGRAM_BUILD_OPTIONS,
+                          opts_size, base_opts, nullptr);
+    base_opts[opts_size] = '\0';
+
+    char opts[1024];
+    snprintf(opts, sizeof(opts), "%s -DGEMM_EPI_ACT=%d%s%s", base_opts,
+             (int)epi->activation,
+             epi->bias ? " -DGEMM_EPI_BIAS" : "",
+             epi->residual ? " -DGEMM_EPI_RESIDUAL" : "");
+    free(base_opts);
+
+    const char* src = source;
+    size_t src_len = strlen(source);
+    cl_program program = clCreateProgramWithSource(dev->context, 1, &src, &src_len, &err);
+    free(source);
+    if (err != CL_SUCCESS) {
+        MGPU_ERR("gemm epilogue: clCreateProgramWithSource failed (err=%d)\n", err);
+        return nullptr;
+    }
+    err = clBuildProgram(program, 1, &dev->device, opts, nullptr, nullptr);
+    if (err != CL_SUCCESS) {
+        MGPU_ERR("gemm epilogue: build with '%s' failed (err=%d)\n", opts, err);
+        clReleaseProgram(program);
+        return nullptr;
+    }
+    return program;
+}
+
+// Program to take the image GEMM kernels from for `epi`
+static cl_program epilogue_program(const DeviceInfo* dev, cl_program base,
+                                   const GemmEpilogue* epi) {
+    int key = epilogue_key(epi);
+    if (key == 0) return base;
+
+    std::lock_guard<std::mutex> lock(g_epilogue_lock);
+    for (int i = 0; i < g_epilogue_program_count; i++) {
+        if (g_epilogue_programs[i].base == base && g_epilogue_programs[i].key == key)
+            return g_epilogue_programs[i].program;
+    }
+    if (g_epilogue_program_count == EPILOGUE_PROGRAM_MAX) {
+        MGPU_ERR("gemm epilogue: too many variants\n");
+        return nullptr;
+    }
+
+    cl_program program = build_epilogue_program(dev, base, epi);
+    if (!program) return nullptr;
+    EpilogueProgram* e = &g_epilogue_programs[g_epilogue_program_count++];
+    e->base = base;
+    e->key = key;
+    e->program = program;
+    return program;
+}
+
+// Release the epilogue builds of `base` (nullptr = all) and their kernels
+static void release_epilogue_programs(cl_program base) {
+    cl_program released[EPILOGUE_PROGRAM_MAX];
+    int num_released = 0;
+    {
+        std::lock_guard<std::mutex> lock(g_epilogue_lock);
+        int kept = 0;
+        for (int i = 0; i < g_epilogue_program_count; i++) {
+            if (!base || g_epilogue_programs[i].base == base) {
+                released[num_released++] = g_epilogue_programs[i].program;
+            } else {
+                g_epilogue_programs[kept++] = g_epilogue_programs[i];
+            }
+        }
+        g_epilogue_program_count = kept;
+    }
+
+    // With base == nullptr the caller drops every kernel right after; a
+    // kernel keeps its program alive until then
+    for (int i = 0; i < num_released; i++) {
+        if (base) kernel_registry_release(released[i]);
+        clReleaseProgram(released[i]);
+    }
+}
+
+// --- Dispatch Statistics ---
+
+void dispatch_stats_reset() {
+    t_stats = DispatchStats{};
+}
+
+DispatchStats dispatch_stats_get() {
+    return t_stats;
+}
+
+void dispatch_stats_record(uint64_t dispatches, uint64_t host_ns) {
+    t_stats.dispatches += dispatches;
+    t_stats.host_enqueue_ns += host_ns;
+}
+
+// --- Graph Capture ---
+
+void dispatch_capture_begin(DecodeGraph* graph) {
+    t_capture = graph;
+}
+
+void dispatch_capture_end() {
+    t_capture = nullptr;
+}
+
+// Start a dispatch: fetch the calling thread's kernel and start the host timer
+static cl_kernel acquire_kernel(cl_program program, const char* name) {
+    if (t_uncached_kernel) {
+        clReleaseKernel(t_uncached_kernel);
+        t_uncached_kernel = nullptr;
+    }
+    t_dispatch_start_ns = now_ns();
+
+    // A captured launch keeps its arguments bound, so it needs its own kernel
+    if (!t_capture && g_registry_enabled.load(std::memory_order_relaxed)) {
+        cl_kernel kernel = kernel_registry_get(program, name);
+        if (kernel) return kernel;
+    }
+
+    // Registry disabled (or full): per-call kernel, as before the registry
+    cl_int err;
+    cl_kernel kernel = clCreateKernel(program, name, &err);
+    CL_CHECK_NULL(err);
+    t_stats.kernels_created++;
+    t_uncached_kernel = kernel;
+    t_uncached_name = name;
+    return kernel;
+}
+
+// Finish a dispatch: enqueue on the device queue and stop the host timer
+static cl_event enqueue_kernel(const DeviceInfo* dev, cl_kernel kernel, cl_uint work_dim,
+                               const size_t* global, const size_t* local) {
+    cl_event event = nullptr;
+    cl_int err = clEnqueueNDRangeKernel(dev->queue, kernel, work_dim, nullptr,
+                                        global, local, 0, nullptr, &event);
+    if (t_uncached_kernel) {
+        if (t_capture && err == CL_SUCCESS) {
+            decode_graph_add_node(t_capture, t_uncached_kernel, t_uncached_name,
+                                  work_dim, global, local);
+        } else {
+            clReleaseKernel(t_uncached_kernel);
+        }
+        t_uncached_kernel = nullptr;
+    }
+    t_stats.dispatches++;
+    t_stats.host_enqueue_ns += now_ns() - t_dispatch_start_ns;
+    CL_CHECK_NULL(err);
+    return event;
+}
+
 // --- GEMM / GEMV ---
 
 cl_event dispatch_gemm_naive(const DeviceInfo* dev, cl_program program,
                              cl_mem A, cl_mem B, cl_mem C,
                              int M, int N, int K) {
-    cl_int err;
-    cl_kernel kernel = clCreateKernel(program, "gemm_naive", &err);
-    CL_CHECK_NULL(err);
+    cl_kernel kernel = acquire_kernel(program, "gemm_naive");
+    if (!kernel) return nullptr;
 
+    cl_int err;
     err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &A);
     err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &B);
     err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &C);
@@ -40,28 +588,23 @@ cl_event dispatch_gemm_naive(const DeviceInfo* dev, cl_program program,
     err |= clSetKernelArg(kernel, 5, sizeof(int), &K);
     if (err != CL_SUCCESS) {
         MGPU_ERR("gemm_naive: failed to set kernel args (err=%d)\n", err);
-        clReleaseKernel(kernel);
         return nullptr;
     }
 
-    size_t global[2] = { round_up((size_t)M, 16), round_up((size_t)N, 16) };
-    size_t local[2]  = { 16, 16 };
+    const size_t wg = (size_t)program_tuning(program).gemm_naive_wg;
+    size_t global[2] = { round_up((size_t)M, wg), round_up((size_t)N, wg) };
+    size_t local[2]  = { wg, wg };
 
-    cl_event event;
-    err = clEnqueueNDRangeKernel(dev->queue, kernel, 2, nullptr,
-                                 global, local, 0, nullptr, &event);
-    clReleaseKernel(kernel);
-    CL_CHECK_NULL(err);
-    return event;
+    return enqueue_kernel(dev, kernel, 2, global, local);
 }
 
 cl_event dispatch_gemm_tiled(const DeviceInfo* dev, cl_program program,
                              cl_mem A, cl_mem B, cl_mem C,
                              int M, int N, int K) {
-    cl_int err;
-    cl_kernel kernel = clCreateKernel(program, "gemm_tiled", &err);
-    CL_CHECK_NULL(err);
+    cl_kernel kernel = acquire_kernel(program, "gemm_tiled");
+    if (!kernel) return nullptr;
 
+    cl_int err;
     err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &A);
     err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &B);
     err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &C);
@@ -70,85 +613,573 @@ cl_event dispatch_gemm_tiled(const DeviceInfo* dev, cl_program program,
     err |= clSetKernelArg(kernel, 5, sizeof(int), &K);
     if (err != CL_SUCCESS) {
         MGPU_ERR("gemm_tiled: failed to set kernel args (err=%d)\n", err);
-        clReleaseKernel(kernel);
         return nullptr;
     }
 
-    const size_t TILE_M = 8;
-    const size_t TILE_N = 8;
-    size_t global[2] = { round_up((size_t)M, TILE_M), round_up((size_t)N, TILE_N) };
-    size_t local[2]  = { TILE_M, TILE_N };
+    // Square tiles: TILE_M = TILE_N = TILE_K
+    const size_t tile = (size_t)program_tuning(program).gemm_tile;
+    size_t global[2] = { round_up((size_t)M, tile), round_up((size_t)N, tile) };
+    size_t local[2]  = { tile, tile };
 
-    cl_event event;
-    err = clEnqueueNDRangeKernel(dev->queue, kernel, 2, nullptr,
-                                 global, local, 0, nullptr, &event);
-    clReleaseKernel(kernel);
-    CL_CHECK_NULL(err);
-    return event;
+    return enqueue_kernel(dev, kernel, 2, global, local);
 }
 
 cl_event dispatch_gemm_image(const DeviceInfo* dev, cl_program program,
                              cl_mem A, cl_mem B_img, cl_mem C,
                              int M, int N, int K) {
-    cl_int err;
-    cl_kernel kernel = clCreateKernel(program, "gemm_image", &err);
-    CL_CHECK_NULL(err);
+    return dispatch_gemm_image_variant(dev, program, GEMM_IMAGE_AUTO, A, B_img, C, M, N, K);
+}
+
+// Trailing (norm_weight, eps) args of the kernels with an RMSNorm prologue;
+// a null norm_weight means the activations are already normalized.
+static cl_int set_norm_prologue_args(cl_kernel kernel, cl_uint first_arg,
+                                     cl_mem norm_weight, float norm_eps) {
+    cl_int err = clSetKernelArg(kernel, first_arg, sizeof(cl_mem), &norm_weight);
+    err |= clSetKernelArg(kernel, first_arg + 1, sizeof(float), &norm_eps);
+    return err;
+}
 
+// gemv with an optional RMSNorm prologue and output epilogue (below)
+static cl_event gemv_fused(const DeviceInfo* dev, cl_program program,
+                           cl_mem x, cl_mem norm_weight, float norm_eps,
+                           cl_mem W_img, cl_mem y, int N, int K,
+                           const GemmEpilogue* epi);
+
+// gemm_image_blocked workgroup: GIB_WG_N x GIB_WG_M work-items, each
+// GIB_ROWS rows x 8 columns
+static const int GIB_WG_N = 16;
+static const int GIB_WG_M = 8;
+static const int GIB_ROWS = 4;
+
+// gemm_skinny workgroup: SKINNY_COLS4 image columns x k-lanes
+// (SKINNY_WG_SIZE work-items, KernelTuning::skinny_wg_size)
+static const int SKINNY_COLS4 = 4;
+
+// Image GEMM family entry point. norm_weight (GEMV / SKINNY only) and epi
+// may be null.
+static cl_event gemm_image_fused(const DeviceInfo* dev, cl_program program,
+                                GemmImageVariant variant,
+                                cl_mem A, cl_mem norm_weight, float norm_eps,
+                                cl_mem B_img, cl_mem C,
+                                int M, int N, int K, const GemmEpilogue* epi) {
+    if (variant == GEMM_IMAGE_AUTO) {
+        // Few rows are bandwidth-bound on the weights: read each texel once
+        // for all rows. Beyond that, reuse in registers wins.
+        if (M == 1)
+            variant = GEMM_IMAGE_GEMV;
+        else if (M <= GEMM_SKINNY_MAX_M)
+            variant = GEMM_IMAGE_SKINNY;
+        else
+            variant = GEMM_IMAGE_BLOCKED;
+    }
+
+    if (variant == GEMM_IMAGE_GEMV) {
+        if (M != 1) {
+            MGPU_ERR("gemv: M=%d, expected 1\n", M);
+            return nullptr;
+        }
+        return gemv_fused(dev, program, A, norm_weight, norm_eps, B_img, C, N, K, epi);
+    }
+    if (variant == GEMM_IMAGE_SKINNY && M > GEMM_SKINNY_MAX_M) {
+        MGPU_ERR("gemm_skinny: M=%d exceeds %d\n", M, GEMM_SKINNY_MAX_M);
+        return nullptr;
+    }
+    if (norm_weight && variant != GEMM_IMAGE_SKINNY) {
+        MGPU_ERR("gemm_image: RMSNorm prologue needs GEMV or SKINNY (M=%d)\n", M);
+        return nullptr;
+    }
+
+    const char* name = (variant == GEMM_IMAGE_BLOCKED) ? "gemm_image_blocked"
+                     : (variant == GEMM_IMAGE_SKINNY)  ? "gemm_skinny"
+                     : "gemm_image";
+    cl_program epi_program = epilogue_program(dev, program, epi);
+    if (!epi_program) return nullptr;
+    cl_kernel kernel = acquire_kernel(epi_program, name);
+    if (!kernel) return nullptr;
+
+    cl_int err;
     err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &A);
     err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &B_img);
     err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &C);
     err |= clSetKernelArg(kernel, 3, sizeof(int), &M);
     err |= clSetKernelArg(kernel, 4, sizeof(int), &N);
     err |= clSetKernelArg(kernel, 5, sizeof(int), &K);
+    cl_uint bias_arg = 6;
+    if (variant == GEMM_IMAGE_SKINNY) {
+        err |= set_norm_prologue_args(kernel, 6, norm_weight, norm_eps);
+        bias_arg = 8;
+    }
+    cl_mem bias = epi ? epi->bias : nullptr;
+    err |= clSetKernelArg(kernel, bias_arg, sizeof(cl_mem), &bias);
     if (err != CL_SUCCESS) {
-        MGPU_ERR("gemm_image: failed to set kernel args (err=%d)\n", err);
-        clReleaseKernel(kernel);
+        MGPU_ERR("%s: failed to set kernel args (err=%d)\n", name, err);
         return nullptr;
     }
 
+    if (variant == GEMM_IMAGE_BLOCKED) {
+        // global_id(0) = pair of texel columns, global_id(1) = group of GIB_ROWS rows
+        size_t n_div8 = ((size_t)N + 7) / 8;
+        size_t m_tiles = ((size_t)M + GIB_WG_M * GIB_ROWS - 1) / (GIB_WG_M * GIB_ROWS);
+        size_t global[2] = { round_up(n_div8, GIB_WG_N), m_tiles * GIB_WG_M };
+        size_t local[2]  = { (size_t)GIB_WG_N, (size_t)GIB_WG_M };
+
+        return enqueue_kernel(dev, kernel, 2, global, local);
+    }
+
+    if (variant == GEMM_IMAGE_SKINNY) {
+        // One workgroup per SKINNY_COLS4 image columns, all M rows
+        size_t num_groups = ((size_t)N + 4 * SKINNY_COLS4 - 1) / (4 * SKINNY_COLS4);
+        const size_t wg = (size_t)program_tuning(program).skinny_wg_size;
+        size_t global[1] = { num_groups * wg };
+        size_t local[1]  = { wg };
+
+        return enqueue_kernel(dev, kernel, 1, global, local);
+    }
+
     // Each work-item computes 4 output columns; global_id(1) = col4
     size_t n_div4 = ((size_t)N + 3) / 4;
     size_t global[2] = { round_up((size_t)M, 16), round_up(n_div4, 4) };
     size_t local[2]  = { 16, 4 };
 
-    cl_event event;
-    err = clEnqueueNDRangeKernel(dev->queue, kernel, 2, nullptr,
-                                 global, local, 0, nullptr, &event);
-    clReleaseKernel(kernel);
-    CL_CHECK_NULL(err);
-    return event;
+    return enqueue_kernel(dev, kernel, 2, global, local);
+}
+
+cl_event dispatch_gemm_image_variant(const DeviceInfo* dev, cl_program program,
+                                     GemmImageVariant variant,
+                                     cl_mem A, cl_mem B_img, cl_mem C,
+                                     int M, int N, int K) {
+    return gemm_image_fused(dev, program, variant, A, nullptr, 0.0f, B_img, C, M, N, K,
+                            nullptr);
+}
+
+cl_event dispatch_gemm_image_epilogue(const DeviceInfo* dev, cl_program program,
+                                      cl_mem A, cl_mem B_img, cl_mem C,
+                                      int M, int N, int K,
+                                      const GemmEpilogue* epilogue) {
+    return gemm_image_fused(dev, program, GEMM_IMAGE_AUTO, A, nullptr, 0.0f, B_img, C,
+                            M, N, K, epilogue);
+}
+
+cl_event dispatch_gemm_image_rms_norm(const DeviceInfo* dev, cl_program program,
+                                      cl_mem A, cl_mem norm_weight, float norm_eps,
+                                      cl_mem B_img, cl_mem C,
+                                      int M, int N, int K) {
+    return gemm_image_fused(dev, program, GEMM_IMAGE_AUTO, A, norm_weight, norm_eps,
+                            B_img, C, M, N, K, nullptr);
 }
 
 cl_event dispatch_gemv(const DeviceInfo* dev, cl_program program,
                        cl_mem x, cl_mem W_img, cl_mem y,
                        int N, int K) {
-    cl_int err;
-    cl_kernel kernel = clCreateKernel(program, "gemv", &err);
-    CL_CHECK_NULL(err);
+    return gemv_fused(dev, program, x, nullptr, 0.0f, W_img, y, N, K, nullptr);
+}
 
+static cl_event gemv_fused(const DeviceInfo* dev, cl_program program,
+                           cl_mem x, cl_mem norm_weight, float norm_eps,
+                           cl_mem W_img, cl_mem y, int N, int K,
+                           const GemmEpilogue* epi) {
+    cl_program epi_program = epilogue_program(dev, program, epi);
+    if (!epi_program) return nullptr;
+    cl_kernel kernel = acquire_kernel(epi_program, "gemv");
+    if (!kernel) return nullptr;
+
+    cl_mem bias = epi ? epi->bias : nullptr;
+    cl_int err;
     err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &x);
     err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &W_img);
     err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &y);
     err |= clSetKernelArg(kernel, 3, sizeof(int), &N);
     err |= clSetKernelArg(kernel, 4, sizeof(int), &K);
+    err |= set_norm_prologue_args(kernel, 5, norm_weight, norm_eps);
+    err |= clSetKernelArg(kernel, 7, sizeof(cl_mem), &bias);
     if (err != CL_SUCCESS) {
         MGPU_ERR("gemv: failed to set kernel args (err=%d)\n", err);
-        clReleaseKernel(kernel);
         return nullptr;
     }
 
-    // Each workgroup handles 4 output elements (one image column)
-    const size_t WG_SIZE = 256;
-    size_t num_groups = ((size_t)N + 3) / 4;
+    // Each workgroup handles GEMV_COLS4 image columns (4 outputs each)
+    const KernelTuning tuning = program_tuning(program);
+    const size_t cols = 4 * (size_t)tuning.gemv_cols4;
+    size_t num_groups = ((size_t)N + cols - 1) / cols;
+    size_t global[1] = { num_groups * (size_t)tuning.gemv_wg_size };
+    size_t local[1]  = { (size_t)tuning.gemv_wg_size };
+
+    return enqueue_kernel(dev, kernel, 1, global, local);
+}
+
+// gemv_q* workgroup: QGEMV_BLOCKS 32-column groups, K split over the rest
+static const int QGEMV_WG_SIZE = 64;
+static const int QGEMV_BLOCKS = 2;
+static const int QGEMV_GROUP = 32;
+
+struct QuantKernels {
+    WeightFormat format;
+    int block;
+    const char* gemv;
+    const char* gemm;
+};
+
+static const QuantKernels QUANT_KERNELS[] = {
+    { WEIGHT_Q4_0, 32,  "gemv_q4_0", "gemm_q4_0" },
+    { WEIGHT_Q8_0, 32,  "gemv_q8_0", "gemm_q8_0" },
+    { WEIGHT_Q4_K, 256, "gemv_q4_k", "gemm_q4_k" },
+    { WEIGHT_Q5_K, 256, "gemv_q5_k", "gemm_q5_k" },
+    { WEIGHT_Q6_K, 256, "gemv_q6_k", "gemm_q6_k" },
+};
+
+static const QuantKernels* quant_kernels(WeightFormat format) {
+    for (const QuantKernels& q : QUANT_KERNELS) {
+        if (q.format == format) return &q;
+    }
+    return nullptr;
+}
+
+int weight_format_block_size(WeightFormat format) {
+    const QuantKernels* q = quant_kernels(format);
+    return q ? q->block : 0;
+}
+
+cl_event dispatch_gemm_quant(const DeviceInfo* dev, cl_program program,
+                             WeightFormat format,
+                             cl_mem A, cl_mem B_q, cl_mem C,
+                             int M, int N, int K,
+                             const GemmEpilogue* epilogue,
+                             cl_mem norm_weight, float norm_eps) {
+    const QuantKernels* q = quant_kernels(format);
+    if (!q) {
+        MGPU_ERR("gemm_quant: unsupported weight format %d\n", (int)format);
+        return nullptr;
+    }
+    if (N % q->block != 0) {
+        MGPU_ERR("gemm_quant: N=%d is not a multiple of %d\n", N, q->block);
+        return nullptr;
+    }
+    if (norm_weight && M != 1) {
+        MGPU_ERR("gemm_quant: RMSNorm prologue needs M=1 (M=%d)\n", M);
+        return nullptr;
+    }
+
+    const bool gemv = (M == 1);
+    const char* name = gemv ? q->gemv : q->gemm;
+    cl_program epi_program = epilogue_program(dev, program, epilogue);
+    if (!epi_program) return nullptr;
+    cl_kernel kernel = acquire_kernel(epi_program, name);
+    if (!kernel) return nullptr;
+
+    cl_mem bias = epilogue ? epilogue->bias : nullptr;
+    cl_int err;
+    err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &A);
+    err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &B_q);
+    err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &C);
+    if (gemv) {
+        err |= clSetKernelArg(kernel, 3, sizeof(int), &N);
+        err |= clSetKernelArg(kernel, 4, sizeof(int), &K);
+        err |= set_norm_prologue_args(kernel, 5, norm_weight, norm_eps);
+        err |= clSetKernelArg(kernel, 7, sizeof(cl_mem), &bias);
+    } else {
+        err |= clSetKernelArg(kernel, 3, sizeof(int), &M);
+        err |= clSetKernelArg(kernel, 4, sizeof(int), &N);
+        err |= clSetKernelArg(kernel, 5, sizeof(int), &K);
+        err |= clSetKernelArg(kernel, 6, sizeof(cl_mem), &bias);
+    }
+    if (err != CL_SUCCESS) {
+        MGPU_ERR("%s: failed to set kernel args (err=%d)\n", name, err);
+        return nullptr;
+    }
+
+    if (gemv) {
+        const size_t cols = (size_t)QGEMV_BLOCKS * QGEMV_GROUP;
+        size_t global[1] = { ((size_t)N + cols - 1) / cols * QGEMV_WG_SIZE };
+        size_t local[1]  = { (size_t)QGEMV_WG_SIZE };
+        return enqueue_kernel(dev, kernel, 1, global, local);
+    }
+
+    // gemm_image_blocked tiling: global_id(0) = 8 columns
+    size_t m_tiles = ((size_t)M + GIB_WG_M * GIB_ROWS - 1) / (GIB_WG_M * GIB_ROWS);
+    size_t global[2] = { round_up((size_t)N / 8, GIB_WG_N), m_tiles * GIB_WG_M };
+    size_t local[2]  = { (size_t)GIB_WG_N, (size_t)GIB_WG_M };
+    return enqueue_kernel(dev, kernel, 2, global, local);
+}
+
+// W8A8 kernels (gemm.cl v8)
+static const int I8_QUANT_WG_SIZE = 64;
+static const int I8_GEMV_WG_SIZE = 64;
+static const int I8_GEMV_COLS = 4;
+static const int I8_WG_N = 16;
+static const int I8_WG_M = 8;
+static const int I8_TILE_N = I8_WG_N * 4;
+static const int I8_TILE_M = I8_WG_M * 4;
+
+size_t weight_i8_bytes(int K, int N) {
+    return (size_t)K * N + (size_t)N * sizeof(float);
+}
+
+void quantize_weight_i8(const float* W, int K, int N, void* dst) {
+    int8_t* q = (int8_t*)dst;
+    float* scales = (float*)(q + (size_t)K * N);
+    for (int n = 0; n < N; n++) {
+        float amax = 0.0f;
+        for (int k = 0; k < K; k++) amax = std::max(amax, std::fabs(W[(size_t)k * N + n]));
+        const float scale = amax / 127.0f;
+        const float inv = scale > 0.0f ? 1.0f / scale : 0.0f;
+        int8_t* row = q + (size_t)n * K;
+        for (int k = 0; k < K; k++) {
+            const float v = std::nearbyint(W[(size_t)k * N + n] * inv);
+            row[k] = (int8_t)std::min(127.0f, std::max(-127.0f, v));
+        }
+        scales[n] = scale;
+    }
+}
+
+cl_event dispatch_gemm_w8a8(const DeviceInfo* dev, cl_program program,
+                            cl_mem A, cl_mem B_i8, cl_mem C,
+                            int M, int N, int K,
+                            cl_mem A_q, cl_mem a_scales,
+                            const GemmEpilogue* epilogue,
+                            cl_mem norm_weight, float norm_eps) {
+    if (K % 4 != 0 || N % 4 != 0) {
+        MGPU_ERR("gemm_w8a8: K=%d and N=%d must be multiples of 4\n", K, N);
+        return nullptr;
+    }
+
+    // Per-row activation quantization (with the RMSNorm prologue)
+    cl_kernel kernel = acquire_kernel(program, "quantize_rows_i8");
+    if (!kernel) return nullptr;
+    cl_int err;
+    err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &A);
+    err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &A_q);
+    err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &a_scales);
+    err |= clSetKernelArg(kernel, 3, sizeof(int), &K);
+    err |= set_norm_prologue_args(kernel, 4, norm_weight, norm_eps);
+    if (err != CL_SUCCESS) {
+        MGPU_ERR("quantize_rows_i8: failed to set kernel args (err=%d)\n", err);
+        return nullptr;
+    }
+    size_t quant_global[1] = { (size_t)M * I8_QUANT_WG_SIZE };
+    size_t quant_local[1]  = { (size_t)I8_QUANT_WG_SIZE };
+    cl_event quant_event = enqueue_kernel(dev, kernel, 1, quant_global, quant_local);
+    if (!quant_event) return nullptr;
+    clReleaseEvent(quant_event);
+
+    const bool gemv = (M == 1);
+    const char* name = gemv ? "gemv_i8" : "gemm_i8";
+    cl_program epi_program = epilogue_program(dev, program, epilogue);
+    if (!epi_program) return nullptr;
+    kernel = acquire_kernel(epi_program, name);
+    if (!kernel) return nullptr;
+
+    cl_mem bias = epilogue ? epilogue->bias : nullptr;
+    err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &A_q);
+    err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &a_scales);
+    err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &B_i8);
+    err |= clSetKernelArg(kernel, 3, sizeof(cl_mem), &C);
+    if (gemv) {
+        err |= clSetKernelArg(kernel, 4, sizeof(int), &N);
+        err |= clSetKernelArg(kernel, 5, sizeof(int), &K);
+        err |= clSetKernelArg(kernel, 6, sizeof(cl_mem), &bias);
+    } else {
+        err |= clSetKernelArg(kernel, 4, sizeof(int), &M);
+        err |= clSetKernelArg(kernel, 5, sizeof(int), &N);
+        err |= clSetKernelArg(kernel, 6, sizeof(int), &K);
+        err |= clSetKernelArg(kernel, 7, sizeof(cl_mem), &bias);
+    }
+    if (err != CL_SUCCESS) {
+        MGPU_ERR("%s: failed to set kernel args (err=%d)\n", name, err);
+        return nullptr;
+    }
+
+    if (gemv) {
+        size_t global[1] = { ((size_t)N + I8_GEMV_COLS - 1) / I8_GEMV_COLS * I8_GEMV_WG_SIZE };
+        size_t local[1]  = { (size_t)I8_GEMV_WG_SIZE };
+        return enqueue_kernel(dev, kernel, 1, global, local);
+    }
+
+    size_t global[2] = { ((size_t)N + I8_TILE_N - 1) / I8_TILE_N * I8_WG_N,
+                         ((size_t)M + I8_TILE_M - 1) / I8_TILE_M * I8_WG_M };
+    size_t local[2]  = { (size_t)I8_WG_N, (size_t)I8_WG_M };
+    return enqueue_kernel(dev, kernel, 2, global, local);
+}
+
+// Element strides of a K/V cache: (pos, head, d) is at
+// pos * pos_stride + head * head_stride + d
+static void kv_cache_strides(KVLayout layout, int capacity, int num_heads, int head_dim,
+                             int* pos_stride, int* head_stride) {
+    if (layout == KV_LAYOUT_HEAD_MAJOR) {
+        *pos_stride = head_dim;
+        *head_stride = capacity * head_dim;
+    } else {
+        *pos_stride = num_heads * head_dim;
+        *head_stride = head_dim;
+    }
+}
+
+// K/V destination args of qkv_gemv / qkv_gemm: pos stride 0 selects plain
+// [M, N] outputs (same layout as q)
+static cl_int set_qkv_cache_args(cl_kernel kernel, cl_uint first_arg, int N, int head_dim,
+                                 KVLayout kv_layout, int kv_capacity) {
+    int pos_stride = 0;
+    int head_stride = 0;
+    if (kv_capacity > 0) {
+        kv_cache_strides(kv_layout, kv_capacity, N / head_dim, head_dim,
+                         &pos_stride, &head_stride);
+    }
+    cl_int err;
+    err  = clSetKernelArg(kernel, first_arg, sizeof(int), &pos_stride);
+    err |= clSetKernelArg(kernel, first_arg + 1, sizeof(int), &head_stride);
+    return err;
+}
+
+cl_event dispatch_qkv_gemv(const DeviceInfo* dev, cl_program program,
+                           cl_mem x, cl_mem W_qkv_img,
+                           cl_mem q, cl_mem k, cl_mem v,
+                           int N, int K,
+                           cl_mem cos_table, cl_mem sin_table,
+                           int head_dim, int pos_offset,
+                           cl_mem norm_weight, float norm_eps,
+                           KVLayout kv_layout, int kv_capacity) {
+    cl_kernel kernel = acquire_kernel(program, "qkv_gemv");
+    if (!kernel) return nullptr;
+
+    cl_int err;
+    err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &x);
+    err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &W_qkv_img);
+    err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &q);
+    err |= clSetKernelArg(kernel, 3, sizeof(cl_mem), &k);
+    err |= clSetKernelArg(kernel, 4, sizeof(cl_mem), &v);
+    err |= clSetKernelArg(kernel, 5, sizeof(int), &N);
+    err |= clSetKernelArg(kernel, 6, sizeof(int), &K);
+    err |= clSetKernelArg(kernel, 7, sizeof(cl_mem), &cos_table);
+    err |= clSetKernelArg(kernel, 8, sizeof(cl_mem), &sin_table);
+    err |= clSetKernelArg(kernel, 9, sizeof(int), &head_dim);
+    err |= clSetKernelArg(kernel, 10, sizeof(int), &pos_offset);
+    err |= set_norm_prologue_args(kernel, 11, norm_weight, norm_eps);
+    err |= set_qkv_cache_args(kernel, 13, N, head_dim, kv_layout, kv_capacity);
+    if (err != CL_SUCCESS) {
+        MGPU_ERR("qkv_gemv: failed to set kernel args (err=%d)\n", err);
+        return nullptr;
+    }
+
+    // Each workgroup handles GEMV_FUSED_COLS4 texel columns of the fused [K, 3N] weight
+    const KernelTuning tuning = program_tuning(program);
+    const size_t WG_SIZE = (size_t)tuning.fused_gemv_wg_size;
+    const size_t cols = 4 * (size_t)tuning.fused_gemv_cols4;
+    size_t num_groups = ((size_t)N * 3 + cols - 1) / cols;
     size_t global[1] = { num_groups * WG_SIZE };
     size_t local[1]  = { WG_SIZE };
 
-    cl_event event;
-    err = clEnqueueNDRangeKernel(dev->queue, kernel, 1, nullptr,
-                                 global, local, 0, nullptr, &event);
-    clReleaseKernel(kernel);
-    CL_CHECK_NULL(err);
-    return event;
+    return enqueue_kernel(dev, kernel, 1, global, local);
+}
+
+// Launch a fused prefill GEMM over `cols4` texel columns of its weight image
+// with the gemm_skinny shape (one workgroup per SKINNY_COLS4 columns) or the
+// gemm_image_blocked one (two columns x GIB_ROWS rows per work-item)
+static cl_event enqueue_fused_gemm(const DeviceInfo* dev, cl_program program,
+                                   cl_kernel kernel, bool skinny, int M, size_t cols4) {
+    if (skinny) {
+        size_t num_groups = (cols4 + SKINNY_COLS4 - 1) / SKINNY_COLS4;
+        const size_t wg = (size_t)program_tuning(program).skinny_wg_size;
+        size_t global[1] = { num_groups * wg };
+        size_t local[1]  = { wg };
+
+        return enqueue_kernel(dev, kernel, 1, global, local);
+    }
+
+    size_t m_tiles = ((size_t)M + GIB_WG_M * GIB_ROWS - 1) / (GIB_WG_M * GIB_ROWS);
+    size_t global[2] = { round_up((cols4 + 1) / 2, GIB_WG_N), m_tiles * GIB_WG_M };
+    size_t local[2]  = { (size_t)GIB_WG_N, (size_t)GIB_WG_M };
+
+    return enqueue_kernel(dev, kernel, 2, global, local);
+}
+
+cl_event dispatch_qkv_gemm(const DeviceInfo* dev, cl_program program,
+                           cl_mem A, cl_mem W_qkv_img,
+                           cl_mem q, cl_mem k, cl_mem v,
+                           int M, int N, int K,
+                           cl_mem cos_table, cl_mem sin_table,
+                           int head_dim, int pos_offset,
+                           KVLayout kv_layout, int kv_capacity) {
+    // Short chunks read each texel once for all rows, as gemm_image_fused
+    const bool skinny = M <= GEMM_SKINNY_MAX_M;
+    const char* name = skinny ? "qkv_gemm_skinny" : "qkv_gemm";
+    cl_kernel kernel = acquire_kernel(program, name);
+    if (!kernel) return nullptr;
+
+    cl_int err;
+    err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &A);
+    err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &W_qkv_img);
+    err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &q);
+    err |= clSetKernelArg(kernel, 3, sizeof(cl_mem), &k);
+    err |= clSetKernelArg(kernel, 4, sizeof(cl_mem), &v);
+    err |= clSetKernelArg(kernel, 5, sizeof(int), &M);
+    err |= clSetKernelArg(kernel, 6, sizeof(int), &N);
+    err |= clSetKernelArg(kernel, 7, sizeof(int), &K);
+    err |= clSetKernelArg(kernel, 8, sizeof(cl_mem), &cos_table);
+    err |= clSetKernelArg(kernel, 9, sizeof(cl_mem), &sin_table);
+    err |= clSetKernelArg(kernel, 10, sizeof(int), &head_dim);
+    err |= clSetKernelArg(kernel, 11, sizeof(int), &pos_offset);
+    err |= set_qkv_cache_args(kernel, 12, N, head_dim, kv_layout, kv_capacity);
+    if (err != CL_SUCCESS) {
+        MGPU_ERR("%s: failed to set kernel args (err=%d)\n", name, err);
+        return nullptr;
+    }
+
+    // 3N/4 texel columns of the fused [K, 3N] weight
+    return enqueue_fused_gemm(dev, program, kernel, skinny, M, (size_t)N * 3 / 4);
+}
+
+cl_event dispatch_gate_up_silu_gemv(const DeviceInfo* dev, cl_program program,
+                                    cl_mem x, cl_mem W_gate_up_img, cl_mem out,
+                                    int N, int K,
+                                    cl_mem norm_weight, float norm_eps) {
+    cl_kernel kernel = acquire_kernel(program, "gate_up_silu_gemv");
+    if (!kernel) return nullptr;
+
+    cl_int err;
+    err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &x);
+    err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &W_gate_up_img);
+    err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &out);
+    err |= clSetKernelArg(kernel, 3, sizeof(int), &N);
+    err |= clSetKernelArg(kernel, 4, sizeof(int), &K);
+    err |= set_norm_prologue_args(kernel, 5, norm_weight, norm_eps);
+    if (err != CL_SUCCESS) {
+        MGPU_ERR("gate_up_silu_gemv: failed to set kernel args (err=%d)\n", err);
+        return nullptr;
+    }
+
+    // Each workgroup handles GEMV_FUSED_COLS4 groups of 4 output columns
+    // (two interleaved texel columns each)
+    const KernelTuning tuning = program_tuning(program);
+    const size_t WG_SIZE = (size_t)tuning.fused_gemv_wg_size;
+    const size_t cols = 4 * (size_t)tuning.fused_gemv_cols4;
+    size_t num_groups = ((size_t)N + cols - 1) / cols;
+    size_t global[1] = { num_groups * WG_SIZE };
+    size_t local[1]  = { WG_SIZE };
+
+    return enqueue_kernel(dev, kernel, 1, global, local);
+}
+
+cl_event dispatch_gate_up_silu_gemm(const DeviceInfo* dev, cl_program program,
+                                    cl_mem A, cl_mem W_gate_up_img, cl_mem out,
+                                    int M, int N, int K) {
+    const bool skinny = M <= GEMM_SKINNY_MAX_M;
+    const char* name = skinny ? "gate_up_silu_gemm_skinny" : "gate_up_silu_gemm";
+    cl_kernel kernel = acquire_kernel(program, name);
+    if (!kernel) return nullptr;
+
+    cl_int err;
+    err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &A);
+    err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &W_gate_up_img);
+    err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &out);
+    err |= clSetKernelArg(kernel, 3, sizeof(int), &M);
+    err |= clSetKernelArg(kernel, 4, sizeof(int), &N);
+    err |= clSetKernelArg(kernel, 5, sizeof(int), &K);
+    if (err != CL_SUCCESS) {
+        MGPU_ERR("%s: failed to set kernel args (err=%d)\n", name, err);
+        return nullptr;
+    }
+
+    // N/2 texel columns: a (gate, up) pair per 4 output columns
+    return enqueue_fused_gemm(dev, program, kernel, skinny, M, (size_t)N / 2);
 }
 
 // --- Layer Normalization ---
@@ -156,10 +1187,10 @@ cl_event dispatch_gemv(const DeviceInfo* dev, cl_program program,
 cl_event dispatch_rms_norm(const DeviceInfo* dev, cl_program program,
                            cl_mem input, cl_mem output, cl_mem weight,
                            int num_rows, int hidden_size, float eps) {
-    cl_int err;
-    cl_kernel kernel = clCreateKernel(program, "rms_norm", &err);
-    CL_CHECK_NULL(err);
+    cl_kernel kernel = acquire_kernel(program, "rms_norm");
+    if (!kernel) return nullptr;
 
+    cl_int err;
     err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &input);
     err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &output);
     err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &weight);
@@ -167,36 +1198,29 @@ cl_event dispatch_rms_norm(const DeviceInfo* dev, cl_program program,
     err |= clSetKernelArg(kernel, 4, sizeof(float), &eps);
     if (err != CL_SUCCESS) {
         MGPU_ERR("rms_norm: failed to set kernel args (err=%d)\n", err);
-        clReleaseKernel(kernel);
         return nullptr;
     }
 
-    const size_t WG_SIZE = 256;
+    const size_t WG_SIZE = (size_t)program_tuning(program).norm_wg_size;
     size_t global[1] = { (size_t)num_rows * WG_SIZE };
     size_t local[1]  = { WG_SIZE };
 
-    cl_event event;
-    err = clEnqueueNDRangeKernel(dev->queue, kernel, 1, nullptr,
-                                 global, local, 0, nullptr, &event);
-    clReleaseKernel(kernel);
-    CL_CHECK_NULL(err);
-    return event;
+    return enqueue_kernel(dev, kernel, 1, global, local);
 }
 
 // --- Activations ---
 
 cl_event dispatch_silu(const DeviceInfo* dev, cl_program program,
                        cl_mem input, cl_mem output, int n) {
-    cl_int err;
-    cl_kernel kernel = clCreateKernel(program, "silu", &err);
-    CL_CHECK_NULL(err);
+    cl_kernel kernel = acquire_kernel(program, "silu");
+    if (!kernel) return nullptr;
 
+    cl_int err;
     err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &input);
     err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &output);
     err |= clSetKernelArg(kernel, 2, sizeof(int), &n);
     if (err != CL_SUCCESS) {
         MGPU_ERR("silu: failed to set kernel args (err=%d)\n", err);
-        clReleaseKernel(kernel);
         return nullptr;
     }
 
@@ -205,26 +1229,20 @@ cl_event dispatch_silu(const DeviceInfo* dev, cl_program program,
     size_t global[1] = { round_up(num_wis, WG_SIZE) };
     size_t local[1]  = { WG_SIZE };
 
-    cl_event event;
-    err = clEnqueueNDRangeKernel(dev->queue, kernel, 1, nullptr,
-                                 global, local, 0, nullptr, &event);
-    clReleaseKernel(kernel);
-    CL_CHECK_NULL(err);
-    return event;
+    return enqueue_kernel(dev, kernel, 1, global, local);
 }
 
 cl_event dispatch_gelu(const DeviceInfo* dev, cl_program program,
                        cl_mem input, cl_mem output, int n) {
-    cl_int err;
-    cl_kernel kernel = clCreateKernel(program, "gelu", &err);
-    CL_CHECK_NULL(err);
+    cl_kernel kernel = acquire_kernel(program, "gelu");
+    if (!kernel) return nullptr;
 
+    cl_int err;
     err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &input);
     err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &output);
     err |= clSetKernelArg(kernel, 2, sizeof(int), &n);
     if (err != CL_SUCCESS) {
         MGPU_ERR("gelu: failed to set kernel args (err=%d)\n", err);
-        clReleaseKernel(kernel);
         return nullptr;
     }
 
@@ -233,28 +1251,22 @@ cl_event dispatch_gelu(const DeviceInfo* dev, cl_program program,
     size_t global[1] = { round_up(num_wis, WG_SIZE) };
     size_t local[1]  = { WG_SIZE };
 
-    cl_event event;
-    err = clEnqueueNDRangeKernel(dev->queue, kernel, 1, nullptr,
-                                 global, local, 0, nullptr, &event);
-    clReleaseKernel(kernel);
-    CL_CHECK_NULL(err);
-    return event;
+    return enqueue_kernel(dev, kernel, 1, global, local);
 }
 
 cl_event dispatch_softmax(const DeviceInfo* dev, cl_program program,
                           cl_mem input, cl_mem output,
                           int seq_len, int num_elements) {
-    cl_int err;
-    cl_kernel kernel = clCreateKernel(program, "softmax", &err);
-    CL_CHECK_NULL(err);
+    cl_kernel kernel = acquire_kernel(program, "softmax");
+    if (!kernel) return nullptr;
 
+    cl_int err;
     err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &input);
     err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &output);
     err |= clSetKernelArg(kernel, 2, sizeof(int), &seq_len);
     err |= clSetKernelArg(kernel, 3, sizeof(int), &num_elements);
     if (err != CL_SUCCESS) {
         MGPU_ERR("softmax: failed to set kernel args (err=%d)\n", err);
-        clReleaseKernel(kernel);
         return nullptr;
     }
 
@@ -262,28 +1274,22 @@ cl_event dispatch_softmax(const DeviceInfo* dev, cl_program program,
     size_t global[1] = { (size_t)seq_len * WG_SIZE };
     size_t local[1]  = { WG_SIZE };
 
-    cl_event event;
-    err = clEnqueueNDRangeKernel(dev->queue, kernel, 1, nullptr,
-                                 global, local, 0, nullptr, &event);
-    clReleaseKernel(kernel);
-    CL_CHECK_NULL(err);
-    return event;
+    return enqueue_kernel(dev, kernel, 1, global, local);
 }
 
 cl_event dispatch_silu_gate_multiply(const DeviceInfo* dev, cl_program program,
                                      cl_mem gate, cl_mem up, cl_mem output,
                                      int n) {
-    cl_int err;
-    cl_kernel kernel = clCreateKernel(program, "silu_gate_multiply", &err);
-    CL_CHECK_NULL(err);
+    cl_kernel kernel = acquire_kernel(program, "silu_gate_multiply");
+    if (!kernel) return nullptr;
 
+    cl_int err;
     err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &gate);
     err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &up);
     err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &output);
     err |= clSetKernelArg(kernel, 3, sizeof(int), &n);
     if (err != CL_SUCCESS) {
         MGPU_ERR("silu_gate_multiply: failed to set kernel args (err=%d)\n", err);
-        clReleaseKernel(kernel);
         return nullptr;
     }
 
@@ -292,79 +1298,233 @@ cl_event dispatch_silu_gate_multiply(const DeviceInfo* dev, cl_program program,
     size_t global[1] = { round_up(num_wis, WG_SIZE) };
     size_t local[1]  = { WG_SIZE };
 
-    cl_event event;
-    err = clEnqueueNDRangeKernel(dev->queue, kernel, 1, nullptr,
-                                 global, local, 0, nullptr, &event);
-    clReleaseKernel(kernel);
-    CL_CHECK_NULL(err);
-    return event;
+    return enqueue_kernel(dev, kernel, 1, global, local);
 }
 
 // --- Attention ---
 
+// K/V cache addressing args (pos stride, head stride) of the attention kernels
+static cl_int set_kv_cache_args(cl_kernel kernel, cl_uint first_arg, KVLayout layout,
+                                int capacity, int num_heads, int head_dim) {
+    int pos_stride, head_stride;
+    kv_cache_strides(layout, capacity, num_heads, head_dim, &pos_stride, &head_stride);
+    cl_int err;
+    err  = clSetKernelArg(kernel, first_arg, sizeof(int), &pos_stride);
+    err |= clSetKernelArg(kernel, first_arg + 1, sizeof(int), &head_stride);
+    return err;
+}
+
+// Tiled flash-attention prefill: ATTN_BR query rows x ATTN_BC key block
+// per workgroup (KernelTuning::attn_br / attn_bc)
+static const int ATTN_PREFILL_MAX_HEAD_DIM = 128;
+
 cl_event dispatch_attention_prefill(const DeviceInfo* dev, cl_program program,
                                     cl_mem Q, cl_mem K, cl_mem V, cl_mem output,
-                                    int seq_len, int num_heads, int head_dim) {
-    cl_int err;
-    cl_kernel kernel = clCreateKernel(program, "attention_prefill", &err);
-    CL_CHECK_NULL(err);
+                                    int q_len, int kv_len, int num_heads, int head_dim,
+                                    KVLayout kv_layout, int kv_capacity,
+                                    cl_mem k_scales, cl_mem v_scales) {
+    if (head_dim > ATTN_PREFILL_MAX_HEAD_DIM || q_len > kv_len) {
+        MGPU_ERR("attention_prefill: unsupported shape (q_len=%d kv_len=%d head_dim=%d)\n",
+                 q_len, kv_len, head_dim);
+        return nullptr;
+    }
+    if (kv_layout == KV_LAYOUT_HEAD_MAJOR && kv_capacity < kv_len) {
+        MGPU_ERR("attention_prefill: head-major cache of %d positions < kv_len %d\n",
+                 kv_capacity, kv_len);
+        return nullptr;
+    }
+
+    const char* name = k_scales ? "attention_prefill_q8" : "attention_prefill";
+    cl_kernel kernel = acquire_kernel(program, name);
+    if (!kernel) return nullptr;
 
+    cl_int err;
     err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &Q);
     err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &K);
     err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &V);
     err |= clSetKernelArg(kernel, 3, sizeof(cl_mem), &output);
-    err |= clSetKernelArg(kernel, 4, sizeof(int), &seq_len);
-    err |= clSetKernelArg(kernel, 5, sizeof(int), &num_heads);
-    err |= clSetKernelArg(kernel, 6, sizeof(int), &head_dim);
+    err |= clSetKernelArg(kernel, 4, sizeof(int), &q_len);
+    err |= clSetKernelArg(kernel, 5, sizeof(int), &kv_len);
+    err |= clSetKernelArg(kernel, 6, sizeof(int), &num_heads);
+    err |= clSetKernelArg(kernel, 7, sizeof(int), &head_dim);
+    err |= set_kv_cache_args(kernel, 8, kv_layout, kv_capacity, num_heads, head_dim);
+    if (k_scales) {
+        err |= clSetKernelArg(kernel, 10, sizeof(cl_mem), &k_scales);
+        err |= clSetKernelArg(kernel, 11, sizeof(cl_mem), &v_scales);
+    }
     if (err != CL_SUCCESS) {
-        MGPU_ERR("attention_prefill: failed to set kernel args (err=%d)\n", err);
-        clReleaseKernel(kernel);
+        MGPU_ERR("%s: failed to set kernel args (err=%d)\n", name, err);
         return nullptr;
     }
 
-    const size_t WG_SIZE = 256;
-    size_t global[1] = { (size_t)seq_len * (size_t)num_heads * WG_SIZE };
-    size_t local[1]  = { WG_SIZE };
+    const KernelTuning tuning = program_tuning(program);
+    const size_t WG_SIZE = (size_t)tuning.attn_br * tuning.attn_bc;
+    size_t num_q_blocks = ((size_t)q_len + tuning.attn_br - 1) / tuning.attn_br;
+    size_t global[2] = { num_q_blocks * WG_SIZE, (size_t)num_heads };
+    size_t local[2]  = { WG_SIZE, 1 };
 
-    cl_event event;
-    err = clEnqueueNDRangeKernel(dev->queue, kernel, 1, nullptr,
-                                 global, local, 0, nullptr, &event);
-    clReleaseKernel(kernel);
-    CL_CHECK_NULL(err);
-    return event;
+    return enqueue_kernel(dev, kernel, 2, global, local);
 }
 
-cl_event dispatch_attention_decode(const DeviceInfo* dev, cl_program program,
-                                   cl_mem Q, cl_mem K_cache, cl_mem V_cache,
-                                   cl_mem output,
-                                   int cache_len, int num_heads, int head_dim) {
-    cl_int err;
-    cl_kernel kernel = clCreateKernel(program, "attention_decode", &err);
-    CL_CHECK_NULL(err);
+// Split-K decode attention: cache chunks per head run in parallel, then a
+// reduction pass merges them. The split count is fixed (not derived from
+// cache_len) so the launch shape is identical for every decode step.
+static const int ATTN_DECODE_SPLITS = 8;
+static const int ATTN_MAX_HEAD_DIM = 256;
+
+// All decode variants: `split_kernel` takes the K/V caches as buffers or
+// image views, with identical arguments otherwise (int8 caches append their
+// scale buffers)
+static cl_event attention_decode_splitk(const DeviceInfo* dev, cl_program program,
+                                        const char* split_kernel,
+                                        cl_mem Q, cl_mem K_cache, cl_mem V_cache,
+                                        cl_mem output,
+                                        int cache_len, int num_heads, int head_dim,
+                                        KVLayout kv_layout, int kv_capacity,
+                                        cl_mem k_scales, cl_mem v_scales) {
+    if (head_dim > ATTN_MAX_HEAD_DIM) {
+        MGPU_ERR("%s: head_dim %d exceeds %d\n", split_kernel, head_dim, ATTN_MAX_HEAD_DIM);
+        return nullptr;
+    }
+    if (kv_layout == KV_LAYOUT_HEAD_MAJOR && kv_capacity < cache_len) {
+        MGPU_ERR("%s: head-major cache of %d positions < cache_len %d\n",
+                 split_kernel, kv_capacity, cache_len);
+        return nullptr;
+    }
+
+    int num_splits = ATTN_DECODE_SPLITS;
+    size_t partial_bytes = (size_t)num_heads * num_splits * (head_dim + 2) * sizeof(float);
+    cl_mem partials = program_scratch(dev, program, SCRATCH_ATTN_PARTIALS, partial_bytes);
+    if (!partials) return nullptr;
+
+    // Pass 1: per-(head, split) online softmax over one chunk of the cache
+    cl_kernel kernel = acquire_kernel(program, split_kernel);
+    if (!kernel) return nullptr;
 
+    cl_int err;
     err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &Q);
     err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &K_cache);
     err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &V_cache);
-    err |= clSetKernelArg(kernel, 3, sizeof(cl_mem), &output);
+    err |= clSetKernelArg(kernel, 3, sizeof(cl_mem), &partials);
     err |= clSetKernelArg(kernel, 4, sizeof(int), &cache_len);
     err |= clSetKernelArg(kernel, 5, sizeof(int), &num_heads);
     err |= clSetKernelArg(kernel, 6, sizeof(int), &head_dim);
+    err |= set_kv_cache_args(kernel, 7, kv_layout, kv_capacity, num_heads, head_dim);
+    if (k_scales) {
+        err |= clSetKernelArg(kernel, 9, sizeof(cl_mem), &k_scales);
+        err |= clSetKernelArg(kernel, 10, sizeof(cl_mem), &v_scales);
+    }
     if (err != CL_SUCCESS) {
-        MGPU_ERR("attention_decode: failed to set kernel args (err=%d)\n", err);
-        clReleaseKernel(kernel);
+        MGPU_ERR("%s: failed to set kernel args (err=%d)\n", split_kernel, err);
+        return nullptr;
+    }
+
+    const size_t wg = (size_t)program_tuning(program).attn_decode_wg_size;
+    size_t global[2] = { (size_t)num_heads * wg, (size_t)num_splits };
+    size_t local[2]  = { wg, 1 };
+
+    cl_event split_event = enqueue_kernel(dev, kernel, 2, global, local);
+    if (!split_event) return nullptr;
+    clReleaseEvent(split_event);
+
+    // Pass 2: merge the splits of each head
+    kernel = acquire_kernel(program, "attention_decode_reduce");
+    if (!kernel) return nullptr;
+
+    err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &partials);
+    err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &output);
+    err |= clSetKernelArg(kernel, 2, sizeof(int), &num_splits);
+    err |= clSetKernelArg(kernel, 3, sizeof(int), &num_heads);
+    err |= clSetKernelArg(kernel, 4, sizeof(int), &head_dim);
+    if (err != CL_SUCCESS) {
+        MGPU_ERR("attention_decode_reduce: failed to set kernel args (err=%d)\n", err);
+        return nullptr;
+    }
+
+    size_t reduce_global[1] = { round_up((size_t)num_heads * head_dim, 64) };
+    size_t reduce_local[1]  = { 64 };
+
+    return enqueue_kernel(dev, kernel, 1, reduce_global, reduce_local);
+}
+
+cl_event dispatch_attention_decode(const DeviceInfo* dev, cl_program program,
+                                   cl_mem Q, cl_mem K_cache, cl_mem V_cache,
+                                   cl_mem output,
+                                   int cache_len, int num_heads, int head_dim,
+                                   KVLayout kv_layout, int kv_capacity,
+                                   cl_mem k_scales, cl_mem v_scales) {
+    return attention_decode_splitk(dev, program,
+                                   k_scales ? "attention_decode_q8" : "attention_decode",
+                                   Q, K_cache, V_cache, output, cache_len, num_heads, head_dim,
+                                   kv_layout, kv_capacity, k_scales, v_scales);
+}
+
+cl_event dispatch_attention_decode_image(const DeviceInfo* dev, cl_program program,
+                                         cl_mem Q, cl_mem K_image, cl_mem V_image,
+                                         cl_mem output,
+                                         int cache_len, int num_heads, int head_dim,
+                                         KVLayout kv_layout, int kv_capacity) {
+    if (head_dim % 4 != 0) {
+        MGPU_ERR("attention_decode_image: head_dim %d is not a multiple of 4\n", head_dim);
+        return nullptr;
+    }
+    return attention_decode_splitk(dev, program, "attention_decode_image", Q, K_image, V_image,
+                                   output, cache_len, num_heads, head_dim,
+                                   kv_layout, kv_capacity, nullptr, nullptr);
+}
+
+cl_event dispatch_kv_cache_store(const DeviceInfo* dev, cl_program program,
+                                 cl_mem new_k, cl_mem new_v,
+                                 cl_mem k_cache, cl_mem v_cache,
+                                 int seq_len, int num_heads, int head_dim, int pos,
+                                 KVLayout kv_layout, int kv_capacity,
+                                 cl_mem k_scales, cl_mem v_scales) {
+    if (kv_layout == KV_LAYOUT_HEAD_MAJOR && kv_capacity < pos + seq_len) {
+        MGPU_ERR("kv_cache_store: head-major cache of %d positions < %d\n",
+                 kv_capacity, pos + seq_len);
+        return nullptr;
+    }
+
+    const char* name = k_scales ? "kv_cache_store_q8" : "kv_cache_store";
+    cl_kernel kernel = acquire_kernel(program, name);
+    if (!kernel) return nullptr;
+
+    int row_elems = num_heads * head_dim;
+    cl_int err;
+    err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &new_k);
+    err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &new_v);
+    err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &k_cache);
+    err |= clSetKernelArg(kernel, 3, sizeof(cl_mem), &v_cache);
+    err |= clSetKernelArg(kernel, 4, sizeof(int), &row_elems);
+    err |= clSetKernelArg(kernel, 5, sizeof(int), &seq_len);
+    err |= clSetKernelArg(kernel, 6, sizeof(int), &pos);
+    err |= clSetKernelArg(kernel, 7, sizeof(int), &head_dim);
+    err |= set_kv_cache_args(kernel, 8, kv_layout, kv_capacity, num_heads, head_dim);
+    if (k_scales) {
+        err |= clSetKernelArg(kernel, 10, sizeof(cl_mem), &k_scales);
+        err |= clSetKernelArg(kernel, 11, sizeof(cl_mem), &v_scales);
+    }
+    if (err != CL_SUCCESS) {
+        MGPU_ERR("%s: failed to set kernel args (err=%d)\n", name, err);
         return nullptr;
     }
 
+    if (k_scales) {
+        // One workgroup per (KV_Q8_BLOCK block touched, head); the decode
+        // shape (one block) does not depend on pos
+        const size_t wg = (size_t)program_tuning(program).attn_decode_wg_size;
+        size_t blocks = (size_t)((pos + seq_len - 1) / KV_Q8_BLOCK - pos / KV_Q8_BLOCK + 1);
+        size_t global[2] = { blocks * wg, (size_t)num_heads };
+        size_t local[2]  = { wg, 1 };
+        return enqueue_kernel(dev, kernel, 2, global, local);
+    }
+
     const size_t WG_SIZE = 256;
-    size_t global[1] = { (size_t)num_heads * WG_SIZE };
+    size_t num_wis = ((size_t)seq_len * (size_t)row_elems + 3) / 4;
+    size_t global[1] = { round_up(num_wis, WG_SIZE) };
     size_t local[1]  = { WG_SIZE };
 
-    cl_event event;
-    err = clEnqueueNDRangeKernel(dev->queue, kernel, 1, nullptr,
-                                 global, local, 0, nullptr, &event);
-    clReleaseKernel(kernel);
-    CL_CHECK_NULL(err);
-    return event;
+    return enqueue_kernel(dev, kernel, 1, global, local);
 }
 
 // --- RoPE ---
@@ -373,10 +1533,10 @@ cl_event dispatch_rope_apply(const DeviceInfo* dev, cl_program program,
                              cl_mem qk, cl_mem cos_table, cl_mem sin_table,
                              int seq_len, int num_heads, int head_dim,
                              int offset) {
-    cl_int err;
-    cl_kernel kernel = clCreateKernel(program, "rope_apply", &err);
-    CL_CHECK_NULL(err);
+    cl_kernel kernel = acquire_kernel(program, "rope_apply");
+    if (!kernel) return nullptr;
 
+    cl_int err;
     err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &qk);
     err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &cos_table);
     err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &sin_table);
@@ -386,19 +1546,13 @@ cl_event dispatch_rope_apply(const DeviceInfo* dev, cl_program program,
     err |= clSetKernelArg(kernel, 6, sizeof(int), &offset);
     if (err != CL_SUCCESS) {
         MGPU_ERR("rope_apply: failed to set kernel args (err=%d)\n", err);
-        clReleaseKernel(kernel);
         return nullptr;
     }
 
     // 3D dispatch: (seq_len, num_heads, head_dim/2)
     size_t global[3] = { (size_t)seq_len, (size_t)num_heads, (size_t)(head_dim / 2) };
 
-    cl_event event;
-    err = clEnqueueNDRangeKernel(dev->queue, kernel, 3, nullptr,
-                                 global, nullptr, 0, nullptr, &event);
-    clReleaseKernel(kernel);
-    CL_CHECK_NULL(err);
-    return event;
+    return enqueue_kernel(dev, kernel, 3, global, nullptr);
 }
 
 // --- Embedding ---
@@ -407,17 +1561,16 @@ cl_event dispatch_embedding_lookup(const DeviceInfo* dev, cl_program program,
                                    cl_mem embed_table, cl_mem token_ids,
                                    cl_mem output,
                                    int seq_len, int embed_dim) {
-    cl_int err;
-    cl_kernel kernel = clCreateKernel(program, "embedding_lookup", &err);
-    CL_CHECK_NULL(err);
+    cl_kernel kernel = acquire_kernel(program, "embedding_lookup");
+    if (!kernel) return nullptr;
 
+    cl_int err;
     err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &embed_table);
     err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &token_ids);
     err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &output);
     err |= clSetKernelArg(kernel, 3, sizeof(int), &embed_dim);
     if (err != CL_SUCCESS) {
         MGPU_ERR("embedding_lookup: failed to set kernel args (err=%d)\n", err);
-        clReleaseKernel(kernel);
         return nullptr;
     }
 
@@ -425,12 +1578,189 @@ cl_event dispatch_embedding_lookup(const DeviceInfo* dev, cl_program program,
     size_t dim4 = ((size_t)embed_dim + 3) / 4;
     size_t global[2] = { (size_t)seq_len, dim4 };
 
-    cl_event event;
-    err = clEnqueueNDRangeKernel(dev->queue, kernel, 2, nullptr,
-                                 global, nullptr, 0, nullptr, &event);
-    clReleaseKernel(kernel);
-    CL_CHECK_NULL(err);
-    return event;
+    return enqueue_kernel(dev, kernel, 2, global, nullptr);
+}
+
+// --- Sampling ---
+
+// Stage-1 chunk count: enough workgroups to fill the GPU, few enough that
+// the merge stage (one workgroup over TOPK_GROUPS * k candidates) stays cheap.
+static const int TOPK_GROUPS = 64;
+static const int TOPK_WG_SIZE = 256;
+
+cl_event dispatch_topk(const DeviceInfo* dev, cl_program program,
+                       cl_mem x, cl_mem result, int n, int k, float temperature) {
+    if (k < 1 || k > TOPK_MAX) {
+        MGPU_ERR("topk: k=%d out of range [1, %d]\n", k, TOPK_MAX);
+        return nullptr;
+    }
+
+    int num_candidates = TOPK_GROUPS * k;
+    // Chunk softmax sums follow the candidates (temperature > 0)
+    int sum_groups = temperature > 0.0f ? TOPK_GROUPS : 0;
+    float inv_temperature = temperature > 0.0f ? 1.0f / temperature : 0.0f;
+    size_t partial_bytes = ((size_t)num_candidates * 2 + TOPK_GROUPS) * sizeof(int);
+    cl_mem partials = program_scratch(dev, program, SCRATCH_TOPK_PARTIALS, partial_bytes);
+    if (!partials) return nullptr;
+
+    // Stage 1: top-k of each contiguous chunk
+    cl_kernel kernel = acquire_kernel(program, "topk_partial");
+    if (!kernel) return nullptr;
+
+    cl_int err;
+    err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &x);
+    err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &partials);
+    err |= clSetKernelArg(kernel, 2, sizeof(int), &n);
+    err |= clSetKernelArg(kernel, 3, sizeof(int), &k);
+    err |= clSetKernelArg(kernel, 4, sizeof(float), &inv_temperature);
+    if (err != CL_SUCCESS) {
+        MGPU_ERR("topk_partial: failed to set kernel args (err=%d)\n", err);
+        return nullptr;
+    }
+
+    size_t global[1] = { (size_t)TOPK_GROUPS * TOPK_WG_SIZE };
+    size_t local[1]  = { (size_t)TOPK_WG_SIZE };
+
+    cl_event partial_event = enqueue_kernel(dev, kernel, 1, global, local);
+    if (!partial_event) return nullptr;
+    clReleaseEvent(partial_event);
+
+    // Stage 2: merge the candidates in one workgroup
+    kernel = acquire_kernel(program, "topk_merge");
+    if (!kernel) return nullptr;
+
+    err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &partials);
+    err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &result);
+    err |= clSetKernelArg(kernel, 2, sizeof(int), &num_candidates);
+    err |= clSetKernelArg(kernel, 3, sizeof(int), &k);
+    err |= clSetKernelArg(kernel, 4, sizeof(int), &sum_groups);
+    err |= clSetKernelArg(kernel, 5, sizeof(float), &inv_temperature);
+    if (err != CL_SUCCESS) {
+        MGPU_ERR("topk_merge: failed to set kernel args (err=%d)\n", err);
+        return nullptr;
+    }
+
+    size_t merge_global[1] = { (size_t)TOPK_WG_SIZE };
+
+    return enqueue_kernel(dev, kernel, 1, merge_global, local);
+}
+
+// Image columns (4 vocab ids each) per lm_head_argmax workgroup
+static const int LMH_COLS4 = 16;
+
+cl_event dispatch_lm_head_argmax(const DeviceInfo* dev, cl_program program,
+                                 cl_mem x, cl_mem W_img, cl_mem result,
+                                 int N, int K, int x_offset) {
+    int num_groups = (N + 4 * LMH_COLS4 - 1) / (4 * LMH_COLS4);
+    size_t partial_bytes = (size_t)num_groups * 2 * sizeof(int);
+    cl_mem partials = program_scratch(dev, program, SCRATCH_LM_HEAD_PARTIALS, partial_bytes);
+    if (!partials) return nullptr;
+
+    // Pass 1: GEMV over one vocab slice per workgroup, keep the slice winner
+    cl_kernel kernel = acquire_kernel(program, "lm_head_argmax");
+    if (!kernel) return nullptr;
+
+    cl_int err;
+    err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &x);
+    err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &W_img);
+    err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &partials);
+    err |= clSetKernelArg(kernel, 3, sizeof(int), &N);
+    err |= clSetKernelArg(kernel, 4, sizeof(int), &K);
+    err |= clSetKernelArg(kernel, 5, sizeof(int), &x_offset);
+    if (err != CL_SUCCESS) {
+        MGPU_ERR("lm_head_argmax: failed to set kernel args (err=%d)\n", err);
+        return nullptr;
+    }
+
+    size_t global[1] = { (size_t)num_groups * TOPK_WG_SIZE };
+    size_t local[1]  = { (size_t)TOPK_WG_SIZE };
+
+    cl_event slice_event = enqueue_kernel(dev, kernel, 1, global, local);
+    if (!slice_event) return nullptr;
+    clReleaseEvent(slice_event);
+
+    // Pass 2: merge the slice winners
+    kernel = acquire_kernel(program, "topk_merge");
+    if (!kernel) return nullptr;
+
+    int k = 1;
+    int sum_groups = 0;
+    float inv_temperature = 0.0f;
+    err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &partials);
+    err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &result);
+    err |= clSetKernelArg(kernel, 2, sizeof(int), &num_groups);
+    err |= clSetKernelArg(kernel, 3, sizeof(int), &k);
+    err |= clSetKernelArg(kernel, 4, sizeof(int), &sum_groups);
+    err |= clSetKernelArg(kernel, 5, sizeof(float), &inv_temperature);
+    if (err != CL_SUCCESS) {
+        MGPU_ERR("topk_merge: failed to set kernel args (err=%d)\n", err);
+        return nullptr;
+    }
+
+    size_t merge_global[1] = { (size_t)TOPK_WG_SIZE };
+
+    return enqueue_kernel(dev, kernel, 1, merge_global, local);
+}
+
+cl_event dispatch_apply_penalties(const DeviceInfo* dev, cl_program program,
+                                  cl_mem logits, cl_mem history,
+                                  int history_len, int window, int vocab_size,
+                                  float repetition_penalty, float frequency_penalty) {
+    cl_kernel kernel = acquire_kernel(program, "apply_penalties");
+    if (!kernel) return nullptr;
+
+    cl_int err;
+    err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &logits);
+    err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &history);
+    err |= clSetKernelArg(kernel, 2, sizeof(int), &history_len);
+    err |= clSetKernelArg(kernel, 3, sizeof(int), &window);
+    err |= clSetKernelArg(kernel, 4, sizeof(int), &vocab_size);
+    err |= clSetKernelArg(kernel, 5, sizeof(float), &repetition_penalty);
+    err |= clSetKernelArg(kernel, 6, sizeof(float), &frequency_penalty);
+    if (err != CL_SUCCESS) {
+        MGPU_ERR("apply_penalties: failed to set kernel args (err=%d)\n", err);
+        return nullptr;
+    }
+
+    const size_t WG_SIZE = 64;
+    size_t global[1] = { round_up((size_t)window, WG_SIZE) };
+    size_t local[1]  = { WG_SIZE };
+
+    return enqueue_kernel(dev, kernel, 1, global, local);
+}
+
+cl_event dispatch_sample_token(const DeviceInfo* dev, cl_program program,
+                               cl_mem candidates, cl_mem out, cl_mem history,
+                               int k, int history_len, int history_capacity,
+                               float temperature, float top_p, float min_p,
+                               unsigned int seed, unsigned int step) {
+    cl_kernel kernel = acquire_kernel(program, "sample_token");
+    if (!kernel) return nullptr;
+
+    cl_uint seed_arg = seed;
+    cl_uint step_arg = step;
+
+    cl_int err;
+    err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &candidates);
+    err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &out);
+    err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &history);
+    err |= clSetKernelArg(kernel, 3, sizeof(int), &k);
+    err |= clSetKernelArg(kernel, 4, sizeof(int), &history_len);
+    err |= clSetKernelArg(kernel, 5, sizeof(int), &history_capacity);
+    err |= clSetKernelArg(kernel, 6, sizeof(float), &temperature);
+    err |= clSetKernelArg(kernel, 7, sizeof(float), &top_p);
+    err |= clSetKernelArg(kernel, 8, sizeof(float), &min_p);
+    err |= clSetKernelArg(kernel, 9, sizeof(cl_uint), &seed_arg);
+    err |= clSetKernelArg(kernel, 10, sizeof(cl_uint), &step_arg);
+    if (err != CL_SUCCESS) {
+        MGPU_ERR("sample_token: failed to set kernel args (err=%d)\n", err);
+        return nullptr;
+    }
+
+    size_t global[1] = { 1 };
+    size_t local[1]  = { 1 };
+
+    return enqueue_kernel(dev, kernel, 1, global, local);
 }
 
 // --- Vision ---
@@ -440,10 +1770,10 @@ cl_event dispatch_preprocess_image(const DeviceInfo* dev, cl_program program,
                                    int target_h, int target_w,
                                    float mean_r, float mean_g, float mean_b,
                                    float std_r, float std_g, float std_b) {
-    cl_int err;
-    cl_kernel kernel = clCreateKernel(program, "preprocess_image", &err);
-    CL_CHECK_NULL(err);
+    cl_kernel kernel = acquire_kernel(program, "preprocess_image");
+    if (!kernel) return nullptr;
 
+    cl_int err;
     err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &input_image);
     err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &output);
     err |= clSetKernelArg(kernel, 2, sizeof(int), &target_h);
@@ -456,19 +1786,13 @@ cl_event dispatch_preprocess_image(const DeviceInfo* dev, cl_program program,
     err |= clSetKernelArg(kernel, 9, sizeof(float), &std_b);
     if (err != CL_SUCCESS) {
         MGPU_ERR("preprocess_image: failed to set kernel args (err=%d)\n", err);
-        clReleaseKernel(kernel);
         return nullptr;
     }
 
     // 2D dispatch: (target_w, target_h)
     size_t global[2] = { (size_t)target_w, (size_t)target_h };
 
-    cl_event event;
-    err = clEnqueueNDRangeKernel(dev->queue, kernel, 2, nullptr,
-                                 global, nullptr, 0, nullptr, &event);
-    clReleaseKernel(kernel);
-    CL_CHECK_NULL(err);
-    return event;
+    return enqueue_kernel(dev, kernel, 2, global, nullptr);
 }
 
 cl_event dispatch_patch_embed(const DeviceInfo* dev, cl_program program,
@@ -476,10 +1800,10 @@ cl_event dispatch_patch_embed(const DeviceInfo* dev, cl_program program,
                               cl_mem proj_bias, cl_mem patches,
                               int C, int H, int W,
                               int patch_h, int patch_w, int embed_dim) {
-    cl_int err;
-    cl_kernel kernel = clCreateKernel(program, "patch_embed", &err);
-    CL_CHECK_NULL(err);
+    cl_kernel kernel = acquire_kernel(program, "patch_embed");
+    if (!kernel) return nullptr;
 
+    cl_int err;
     err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &image);
     err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &proj_weight);
     err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &proj_bias);
@@ -492,7 +1816,6 @@ cl_event dispatch_patch_embed(const DeviceInfo* dev, cl_program program,
     err |= clSetKernelArg(kernel, 9, sizeof(int), &embed_dim);
     if (err != CL_SUCCESS) {
         MGPU_ERR("patch_embed: failed to set kernel args (err=%d)\n", err);
-        clReleaseKernel(kernel);
         return nullptr;
     }
 
@@ -501,12 +1824,7 @@ cl_event dispatch_patch_embed(const DeviceInfo* dev, cl_program program,
     size_t embed4 = ((size_t)embed_dim + 3) / 4;
     size_t global[2] = { num_patches, embed4 };
 
-    cl_event event;
-    err = clEnqueueNDRangeKernel(dev->queue, kernel, 2, nullptr,
-                                 global, nullptr, 0, nullptr, &event);
-    clReleaseKernel(kernel);
-    CL_CHECK_NULL(err);
-    return event;
+    return enqueue_kernel(dev, kernel, 2, global, nullptr);
 }
 
 // --- Vision RMSNorm ---
@@ -514,10 +1832,10 @@ cl_event dispatch_patch_embed(const DeviceInfo* dev, cl_program program,
 cl_event dispatch_vision_rmsnorm(const DeviceInfo* dev, cl_program program,
                                  cl_mem input, cl_mem output, cl_mem weight,
                                  int num_patches, int hidden_dim, float eps) {
-    cl_int err;
-    cl_kernel kernel = clCreateKernel(program, "vision_rmsnorm", &err);
-    CL_CHECK_NULL(err);
+    cl_kernel kernel = acquire_kernel(program, "vision_rmsnorm");
+    if (!kernel) return nullptr;
 
+    cl_int err;
     err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &input);
     err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &output);
     err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &weight);
@@ -526,19 +1844,13 @@ cl_event dispatch_vision_rmsnorm(const DeviceInfo* dev, cl_program program,
     err |= clSetKernelArg(kernel, 5, sizeof(float), &eps);
     if (err != CL_SUCCESS) {
         MGPU_ERR("vision_rmsnorm: failed to set kernel args (err=%d)\n", err);
-        clReleaseKernel(kernel);
         return nullptr;
     }
 
     size_t hidden4 = ((size_t)hidden_dim + 3) / 4;
     size_t global[2] = { (size_t)num_patches, hidden4 };
 
-    cl_event event;
-    err = clEnqueueNDRangeKernel(dev->queue, kernel, 2, nullptr,
-                                 global, nullptr, 0, nullptr, &event);
-    clReleaseKernel(kernel);
-    CL_CHECK_NULL(err);
-    return event;
+    return enqueue_kernel(dev, kernel, 2, global, nullptr);
 }
 
 // --- Vision Attention ---
@@ -549,10 +1861,10 @@ cl_event dispatch_vision_attention(const DeviceInfo* dev, cl_program program,
                                     cl_mem out_bias, cl_mem output,
                                     int num_patches, int hidden_dim,
                                     int num_heads, float scale) {
-    cl_int err;
-    cl_kernel kernel = clCreateKernel(program, "vision_attention", &err);
-    CL_CHECK_NULL(err);
+    cl_kernel kernel = acquire_kernel(program, "vision_attention");
+    if (!kernel) return nullptr;
 
+    cl_int err;
     err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &input);
     err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &qkv_weight);
     err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &qkv_bias);
@@ -565,19 +1877,13 @@ cl_event dispatch_vision_attention(const DeviceInfo* dev, cl_program program,
     err |= clSetKernelArg(kernel, 9, sizeof(float), &scale);
     if (err != CL_SUCCESS) {
         MGPU_ERR("vision_attention: failed to set kernel args (err=%d)\n", err);
-        clReleaseKernel(kernel);
         return nullptr;
     }
 
     size_t hidden4 = ((size_t)hidden_dim + 3) / 4;
     size_t global[2] = { (size_t)num_patches, hidden4 };
 
-    cl_event event;
-    err = clEnqueueNDRangeKernel(dev->queue, kernel, 2, nullptr,
-                                 global, nullptr, 0, nullptr, &event);
-    clReleaseKernel(kernel);
-    CL_CHECK_NULL(err);
-    return event;
+    return enqueue_kernel(dev, kernel, 2, global, nullptr);
 }
 
 // --- Vision MLP ---
@@ -587,10 +1893,10 @@ cl_event dispatch_vision_mlp(const DeviceInfo* dev, cl_program program,
                               cl_mem up_weight, cl_mem down_weight,
                               cl_mem output,
                               int num_patches, int hidden_dim, int intermediate) {
-    cl_int err;
-    cl_kernel kernel = clCreateKernel(program, "vision_mlp", &err);
-    CL_CHECK_NULL(err);
+    cl_kernel kernel = acquire_kernel(program, "vision_mlp");
+    if (!kernel) return nullptr;
 
+    cl_int err;
     err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &input);
     err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &gate_weight);
     err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &up_weight);
@@ -601,19 +1907,13 @@ cl_event dispatch_vision_mlp(const DeviceInfo* dev, cl_program program,
     err |= clSetKernelArg(kernel, 7, sizeof(int), &intermediate);
     if (err != CL_SUCCESS) {
         MGPU_ERR("vision_mlp: failed to set kernel args (err=%d)\n", err);
-        clReleaseKernel(kernel);
         return nullptr;
     }
 
     size_t hidden4 = ((size_t)hidden_dim + 3) / 4;
     size_t global[2] = { (size_t)num_patches, hidden4 };
 
-    cl_event event;
-    err = clEnqueueNDRangeKernel(dev->queue, kernel, 2, nullptr,
-                                 global, nullptr, 0, nullptr, &event);
-    clReleaseKernel(kernel);
-    CL_CHECK_NULL(err);
-    return event;
+    return enqueue_kernel(dev, kernel, 2, global, nullptr);
 }
 
 // --- Vision Projection ---
@@ -622,10 +1922,10 @@ cl_event dispatch_vision_proj(const DeviceInfo* dev, cl_program program,
                               cl_mem visual_tokens, cl_mem proj_weight,
                               cl_mem proj_bias, cl_mem output,
                               int num_patches, int vision_dim, int llm_dim) {
-    cl_int err;
-    cl_kernel kernel = clCreateKernel(program, "vision_proj", &err);
-    CL_CHECK_NULL(err);
+    cl_kernel kernel = acquire_kernel(program, "vision_proj");
+    if (!kernel) return nullptr;
 
+    cl_int err;
     err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &visual_tokens);
     err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &proj_weight);
     err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &proj_bias);
@@ -635,36 +1935,29 @@ cl_event dispatch_vision_proj(const DeviceInfo* dev, cl_program program,
     err |= clSetKernelArg(kernel, 6, sizeof(int), &llm_dim);
     if (err != CL_SUCCESS) {
         MGPU_ERR("vision_proj: failed to set kernel args (err=%d)\n", err);
-        clReleaseKernel(kernel);
         return nullptr;
     }
 
     size_t llm4 = ((size_t)llm_dim + 3) / 4;
     size_t global[2] = { (size_t)num_patches, llm4 };
 
-    cl_event event;
-    err = clEnqueueNDRangeKernel(dev->queue, kernel, 2, nullptr,
-                                 global, nullptr, 0, nullptr, &event);
-    clReleaseKernel(kernel);
-    CL_CHECK_NULL(err);
-    return event;
+    return enqueue_kernel(dev, kernel, 2, global, nullptr);
 }
 
 // --- Vector Add ---
 
 cl_event dispatch_vector_add(const DeviceInfo* dev, cl_program program,
                              cl_mem a, cl_mem b, cl_mem output, int n) {
-    cl_int err;
-    cl_kernel kernel = clCreateKernel(program, "vector_add", &err);
-    CL_CHECK_NULL(err);
+    cl_kernel kernel = acquire_kernel(program, "vector_add");
+    if (!kernel) return nullptr;
 
+    cl_int err;
     err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &a);
     err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &b);
     err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &output);
     err |= clSetKernelArg(kernel, 3, sizeof(int), &n);
     if (err != CL_SUCCESS) {
         MGPU_ERR("vector_add: failed to set kernel args (err=%d)\n", err);
-        clReleaseKernel(kernel);
         return nullptr;
     }
 
@@ -673,12 +1966,7 @@ cl_event dispatch_vector_add(const DeviceInfo* dev, cl_program program,
     size_t global[1] = { round_up(num_wis, WG_SIZE) };
     size_t local[1]  = { WG_SIZE };
 
-    cl_event event;
-    err = clEnqueueNDRangeKernel(dev->queue, kernel, 1, nullptr,
-                                 global, local, 0, nullptr, &event);
-    clReleaseKernel(kernel);
-    CL_CHECK_NULL(err);
-    return event;
+    return enqueue_kernel(dev, kernel, 1, global, local);
 }
 
 } // namespace mgpu
@@ -7,9 +7,82 @@
 #endif
 
 #include "device.h"
+#include "tuning.h"
+
+#include <cstdint>
 
 namespace mgpu {
 
+// --- Kernel Registry ---
+//
+// Every dispatch_* looks its kernel up by (program, kernel name) instead of
+// calling clCreateKernel per launch. Each host thread gets its own cl_kernel
+// copy, since clSetKernelArg + enqueue on a shared kernel is not thread-safe.
+
+// Create all kernels of `program` for the calling thread (call at load time).
+// Returns the number of kernels cached.
+int kernel_registry_preload(cl_program program);
+
+// Calling thread's kernel for (program, name), created on first use
+cl_kernel kernel_registry_get(cl_program program, const char* name);
+
+// Release every cached kernel (and dispatch scratch buffer) of `program`
+// on all threads (nullptr = all), and the GEMM epilogue builds derived from it
+void kernel_registry_release(cl_program program);
+
+// Disable to fall back to one clCreateKernel per dispatch (for A/B timing)
+void kernel_registry_set_enabled(bool enabled);
+
+// Launch dispatch_* on `program` with the shapes of `tuning` (the program
+// must have been built with kernel_tuning_build_options of the same tuning).
+// Unregistered programs launch with the KernelTuning defaults. Dropped by
+// kernel_registry_release. Returns false if the table is full.
+bool kernel_tuning_register(cl_program program, const KernelTuning* tuning);
+
+// --- Dispatch Statistics ---
+
+// Host-side cost of dispatch_* calls on the calling thread
+struct DispatchStats {
+    uint64_t dispatches;       // kernels enqueued
+    uint64_t kernels_created;  // clCreateKernel calls (registry misses)
+    uint64_t host_enqueue_ns;  // kernel lookup + arg setup + enqueue time
+};
+
+void dispatch_stats_reset();
+DispatchStats dispatch_stats_get();
+
+// Account launches issued outside dispatch_* (e.g. decode graph replay)
+void dispatch_stats_record(uint64_t dispatches, uint64_t host_ns);
+
+// --- Graph Capture ---
+
+struct DecodeGraph;
+
+// While a capture is active, dispatch_* on the calling thread still enqueue
+// as usual, but each launch gets its own kernel object which is handed to
+// `graph` with its bound arguments and launch shape (see pipeline.h).
+void dispatch_capture_begin(DecodeGraph* graph);
+void dispatch_capture_end();
+
+// Changes whenever a dispatch scratch buffer (split-K partials, ...) is
+// reallocated or released. A graph captured under another generation may
+// bind a released buffer and has to be recaptured.
+unsigned dispatch_scratch_generation();
+
+// --- KV-Cache Layout ---
+
+// Element order of a K/V cache of `capacity` positions
+enum KVLayout {
+    KV_LAYOUT_SEQ_MAJOR = 0,  // [capacity, num_heads, head_dim]: one row per position
+    KV_LAYOUT_HEAD_MAJOR,     // [num_heads, capacity, head_dim]: each head's rows contiguous
+};
+
+// Int8 caches store the same elements as char in either layout, plus one
+// fp16 scale per block of KV_Q8_BLOCK positions of each head:
+// scales[ceil(capacity / KV_Q8_BLOCK), num_heads]. The attention and store
+// dispatches take the scale buffers as k_scales / v_scales; null means fp16.
+static const int KV_Q8_BLOCK = 32;
+
 // --- GEMM / GEMV ---
 
 // C[M,N] = A[M,K] * B[K,N] — naive, one work-item per output element
@@ -22,16 +95,163 @@ cl_event dispatch_gemm_tiled(const DeviceInfo* dev, cl_program program,
                              cl_mem A, cl_mem B, cl_mem C,
                              int M, int N, int K);
 
-// C[M,N] = A[M,K] * B_img[K,N] — A buffer, B as image2d_t
+// Kernel behind dispatch_gemm_image
+enum GemmImageVariant {
+    GEMM_IMAGE_AUTO = 0,    // by M: GEMV (1), SKINNY (2..GEMM_SKINNY_MAX_M), BLOCKED
+    GEMM_IMAGE_ROW,         // gemm_image: 1 row x 4 columns per work-item
+    GEMM_IMAGE_BLOCKED,     // gemm_image_blocked: 4 rows x 8 columns, A tiles in local
+    GEMM_IMAGE_SKINNY,      // gemm_skinny: each texel applied to all M rows
+    GEMM_IMAGE_GEMV,        // gemv (M must be 1)
+};
+
+// Largest M handled by gemm_skinny (SKINNY_MAX_M in gemm.cl)
+static const int GEMM_SKINNY_MAX_M = 16;
+
+// Output-write fusion for the image GEMM family (gemm_image, gemm_image_blocked,
+// gemm_skinny, gemv): C = act(A*B + bias), or C += act(A*B + bias) with
+// residual. Each combination in use is its own build of the GEMM program
+// with -DGEMM_EPI_* defines, compiled on first use.
+enum GemmActivation {
+    GEMM_ACT_NONE = 0,
+    GEMM_ACT_SILU,
+    GEMM_ACT_GELU,          // tanh approximation
+};
+
+struct GemmEpilogue {
+    cl_mem bias = nullptr;                    // [N] buffer, or null
+    GemmActivation activation = GEMM_ACT_NONE;
+    bool residual = false;                    // accumulate into C (C must not alias A)
+};
+
+// C[M,N] = A[M,K] * B_img[K,N] — A buffer, B as image2d_t.
+// Picks the kernel by M (see GEMM_IMAGE_AUTO); M = 1 runs the decode GEMV.
 cl_event dispatch_gemm_image(const DeviceInfo* dev, cl_program program,
                              cl_mem A, cl_mem B_img, cl_mem C,
                              int M, int N, int K);
 
+// dispatch_gemm_image with a fused output epilogue (epilogue may be null)
+cl_event dispatch_gemm_image_epilogue(const DeviceInfo* dev, cl_program program,
+                                      cl_mem A, cl_mem B_img, cl_mem C,
+                                      int M, int N, int K,
+                                      const GemmEpilogue* epilogue);
+
+// dispatch_gemm_image with an explicit kernel (benchmarks, A/B tests)
+cl_event dispatch_gemm_image_variant(const DeviceInfo* dev, cl_program program,
+                                     GemmImageVariant variant,
+                                     cl_mem A, cl_mem B_img, cl_mem C,
+                                     int M, int N, int K);
+
+// C = rmsnorm(A; norm_weight, eps) * B_img with the norm computed in the
+// kernel prologue from the raw rows of A (no rms_norm launch or buffer).
+// GEMV / skinny only: M <= GEMM_SKINNY_MAX_M.
+cl_event dispatch_gemm_image_rms_norm(const DeviceInfo* dev, cl_program program,
+                                      cl_mem A, cl_mem norm_weight, float norm_eps,
+                                      cl_mem B_img, cl_mem C,
+                                      int M, int N, int K);
+
 // y[1,N] = x[1,K] * W_img[K,N] — decode-phase GEMV, weights as image
 cl_event dispatch_gemv(const DeviceInfo* dev, cl_program program,
                        cl_mem x, cl_mem W_img, cl_mem y,
                        int N, int K);
 
+// --- Quantized Weights ---
+//
+// GGUF block-quantized [K, N] weights are uploaded unchanged as a buffer:
+// each of the K rows is N / block blocks along N (N % block == 0; 32 for
+// Q4_0 / Q8_0, 256 for the K-quant super-blocks). The kernels dequantize in
+// registers, so decode reads 4.5 (Q4_0, Q4_K) to 8.5 (Q8_0) bits per weight
+// instead of 16.
+
+// Storage of a weight matrix
+enum WeightFormat {
+    WEIGHT_F16 = 0,  // image2d [K, N] (dispatch_gemm_image)
+    WEIGHT_Q4_0,     // 18-byte blocks: fp16 scale + 32 x 4-bit
+    WEIGHT_Q8_0,     // 34-byte blocks: fp16 scale + 32 x int8
+    WEIGHT_Q4_K,     // 144-byte super-blocks: 256 x 4-bit, 6-bit sub-block scales/mins
+    WEIGHT_Q5_K,     // 176-byte super-blocks: 256 x 5-bit, 6-bit sub-block scales/mins
+    WEIGHT_Q6_K,     // 210-byte super-blocks: 256 x 6-bit, int8 scale per 16
+    WEIGHT_I8,       // int8 [N, K] + fp32 scale per output column (dispatch_gemm_w8a8)
+};
+
+// Columns per block of a GGUF-style quantized format (0 for WEIGHT_F16 and
+// the per-column WEIGHT_I8)
+int weight_format_block_size(WeightFormat format);
+
+// Bytes of a WEIGHT_I8 matrix: K * N int8 values, then N float scales
+size_t weight_i8_bytes(int K, int N);
+
+// Quantize W[K, N] (row-major fp32) per output column to WEIGHT_I8 in dst
+// (weight_i8_bytes(K, N) bytes): W_q[n][k] = round(W[k, n] / s[n]),
+// s[n] = max_k |W[k, n]| / 127.
+void quantize_weight_i8(const float* W, int K, int N, void* dst);
+
+// C[M,N] = A[M,K] * B_q[K,N] for a quantized `format`, with the image GEMM
+// family's output epilogue (may be null). M = 1 runs the GEMV kernel, which
+// also takes the RMSNorm prologue (norm_weight non-null: A is the raw row).
+cl_event dispatch_gemm_quant(const DeviceInfo* dev, cl_program program,
+                             WeightFormat format,
+                             cl_mem A, cl_mem B_q, cl_mem C,
+                             int M, int N, int K,
+                             const GemmEpilogue* epilogue = nullptr,
+                             cl_mem norm_weight = nullptr, float norm_eps = 0.0f);
+
+// W8A8: C[M,N] = A[M,K] * B_i8[K,N] with int8 weights (WEIGHT_I8) and int8
+// activations. A is first quantized per row into A_q (M * K bytes) and
+// a_scales (M floats), then multiplied with integer dot products
+// (cl_khr_integer_dot_product if the program was built with -DMGPU_INT_DOT).
+// Requires K % 4 == 0 and N % 4 == 0. Same epilogue as dispatch_gemm_quant;
+// norm_weight non-null RMS-normalizes the rows of A before quantizing them
+// (any M).
+cl_event dispatch_gemm_w8a8(const DeviceInfo* dev, cl_program program,
+                            cl_mem A, cl_mem B_i8, cl_mem C,
+                            int M, int N, int K,
+                            cl_mem A_q, cl_mem a_scales,
+                            const GemmEpilogue* epilogue = nullptr,
+                            cl_mem norm_weight = nullptr, float norm_eps = 0.0f);
+
+// Fused Q/K/V projection: [q | k | v] = x[1,K] * W_qkv_img[K,3N]
+// W_qkv_img holds q_proj, k_proj, v_proj side by side (N % 4 == 0).
+// If cos_table/sin_table are non-null, RoPE is applied to q and k for the
+// token at pos_offset (interleaved pairs, head_dim % 4 == 0).
+// If norm_weight is non-null, x is the raw hidden state and is RMS-normalized
+// in the kernel prologue (see dispatch_gemm_image_rms_norm).
+// With kv_capacity > 0, k and v are the K/V caches (kv_capacity positions,
+// kv_layout) and the new row is stored at position pos_offset, replacing a
+// separate dispatch_kv_cache_store. Otherwise k and v are [1, N] like q.
+cl_event dispatch_qkv_gemv(const DeviceInfo* dev, cl_program program,
+                           cl_mem x, cl_mem W_qkv_img,
+                           cl_mem q, cl_mem k, cl_mem v,
+                           int N, int K,
+                           cl_mem cos_table, cl_mem sin_table,
+                           int head_dim, int pos_offset,
+                           cl_mem norm_weight, float norm_eps,
+                           KVLayout kv_layout = KV_LAYOUT_SEQ_MAJOR, int kv_capacity = 0);
+
+// Prefill variant of dispatch_qkv_gemv over A[M,K]; row r is at pos_offset + r.
+// Skinny (each texel read once for all rows) for M <= GEMM_SKINNY_MAX_M,
+// else register-blocked like GEMM_IMAGE_BLOCKED.
+cl_event dispatch_qkv_gemm(const DeviceInfo* dev, cl_program program,
+                           cl_mem A, cl_mem W_qkv_img,
+                           cl_mem q, cl_mem k, cl_mem v,
+                           int M, int N, int K,
+                           cl_mem cos_table, cl_mem sin_table,
+                           int head_dim, int pos_offset,
+                           KVLayout kv_layout = KV_LAYOUT_SEQ_MAJOR, int kv_capacity = 0);
+
+// Fused SwiGLU input projections: out[1,N] = silu(x * W_gate) * (x * W_up)
+// W_gate_up_img interleaves gate and up per texel column ([K, 2N], N % 4 == 0)
+// Optional RMSNorm prologue as in dispatch_qkv_gemv (norm_weight may be null).
+cl_event dispatch_gate_up_silu_gemv(const DeviceInfo* dev, cl_program program,
+                                    cl_mem x, cl_mem W_gate_up_img, cl_mem out,
+                                    int N, int K,
+                                    cl_mem norm_weight, float norm_eps);
+
+// Prefill variant of dispatch_gate_up_silu_gemv over A[M,K], skinny or
+// blocked by M as dispatch_qkv_gemm
+cl_event dispatch_gate_up_silu_gemm(const DeviceInfo* dev, cl_program program,
+                                    cl_mem A, cl_mem W_gate_up_img, cl_mem out,
+                                    int M, int N, int K);
+
 // --- Layer Normalization ---
 
 // RMSNorm: output = input * rsqrt(mean(input^2) + eps) * weight
@@ -60,17 +280,50 @@ cl_event dispatch_silu_gate_multiply(const DeviceInfo* dev, cl_program program,
                                      int n);
 
 // --- Attention ---
+//
+// Q and the attention output are [tokens, num_heads, head_dim]. K/V caches
+// are in `kv_layout`; a head-major cache also needs its capacity (positions).
+// With k_scales / v_scales the caches are int8 (see KV_Q8_BLOCK).
 
-// Multi-head attention for prefill (full sequence)
+// Causal multi-head attention for prefill (tiled flash-attention).
+// Q holds the q_len newest tokens, K/V all kv_len positions (cache + new);
+// query i is at position kv_len - q_len + i.
 cl_event dispatch_attention_prefill(const DeviceInfo* dev, cl_program program,
                                     cl_mem Q, cl_mem K, cl_mem V, cl_mem output,
-                                    int seq_len, int num_heads, int head_dim);
+                                    int q_len, int kv_len, int num_heads, int head_dim,
+                                    KVLayout kv_layout = KV_LAYOUT_SEQ_MAJOR,
+                                    int kv_capacity = 0,
+                                    cl_mem k_scales = nullptr, cl_mem v_scales = nullptr);
 
-// Single-token decode attention against KV-cache
+// Single-token decode attention against KV-cache (split-K flash-decoding:
+// two launches, partials kept in a scratch buffer owned by `program`)
 cl_event dispatch_attention_decode(const DeviceInfo* dev, cl_program program,
                                    cl_mem Q, cl_mem K_cache, cl_mem V_cache,
                                    cl_mem output,
-                                   int cache_len, int num_heads, int head_dim);
+                                   int cache_len, int num_heads, int head_dim,
+                                   KVLayout kv_layout = KV_LAYOUT_SEQ_MAJOR,
+                                   int kv_capacity = 0,
+                                   cl_mem k_scales = nullptr, cl_mem v_scales = nullptr);
+
+// Same, reading K/V on the texture path: K_image / V_image are
+// create_buffer_image_view views of the caches (head_dim % 4 == 0)
+cl_event dispatch_attention_decode_image(const DeviceInfo* dev, cl_program program,
+                                         cl_mem Q, cl_mem K_image, cl_mem V_image,
+                                         cl_mem output,
+                                         int cache_len, int num_heads, int head_dim,
+                                         KVLayout kv_layout = KV_LAYOUT_SEQ_MAJOR,
+                                         int kv_capacity = 0);
+
+// Write seq_len new K/V rows ([seq_len, num_heads, head_dim]) into the cache
+// starting at position `pos`. Int8 caches are quantized on write; a block
+// whose scale grows has its earlier rows requantized.
+cl_event dispatch_kv_cache_store(const DeviceInfo* dev, cl_program program,
+                                 cl_mem new_k, cl_mem new_v,
+                                 cl_mem k_cache, cl_mem v_cache,
+                                 int seq_len, int num_heads, int head_dim, int pos,
+                                 KVLayout kv_layout = KV_LAYOUT_SEQ_MAJOR,
+                                 int kv_capacity = 0,
+                                 cl_mem k_scales = nullptr, cl_mem v_scales = nullptr);
 
 // --- RoPE ---
 
@@ -88,6 +341,47 @@ cl_event dispatch_embedding_lookup(const DeviceInfo* dev, cl_program program,
                                    cl_mem output,
                                    int seq_len, int embed_dim);
 
+// --- Sampling ---
+
+// Largest k accepted by dispatch_topk
+static const int TOPK_MAX = 64;
+
+// Top-k of x[n] (fp16) on the GPU in two launches (per-chunk top-k, then a
+// single-workgroup merge). result receives k ids (int) followed by their k
+// values (float), best first; k = 1 is argmax. Ties go to the lower id.
+// With temperature > 0, result[2k] also gets the softmax normalizer over all
+// n elements, sum exp((x_i - x_max) / temperature) (float).
+cl_event dispatch_topk(const DeviceInfo* dev, cl_program program,
+                       cl_mem x, cl_mem result, int n, int k,
+                       float temperature = 0.0f);
+
+// Greedy LM head: argmax over (x[x_offset .. x_offset + K) * W[K, N]) without
+// storing the logits. Each workgroup keeps the winner of its vocab slice, a
+// second launch merges them. result gets the id at [0] and its logit
+// (float) at [1], as dispatch_topk with k = 1.
+cl_event dispatch_lm_head_argmax(const DeviceInfo* dev, cl_program program,
+                                 cl_mem x, cl_mem W_img, cl_mem result,
+                                 int N, int K, int x_offset);
+
+// Repetition/frequency penalty on logits[vocab_size] (in place) for the
+// tokens in history[max(0, history_len - window), history_len)
+cl_event dispatch_apply_penalties(const DeviceInfo* dev, cl_program program,
+                                  cl_mem logits, cl_mem history,
+                                  int history_len, int window, int vocab_size,
+                                  float repetition_penalty, float frequency_penalty);
+
+// Draw one token from dispatch_topk candidates (temperature, top-p, min-p,
+// seeded RNG; temperature <= 0 is greedy). The candidates must come from
+// dispatch_topk with the same temperature: probabilities are normalized over
+// the whole vocabulary, and top-p stops at the k candidates at the latest.
+// Writes the id to out[0] and appends it to history[history_len] when
+// history is non-null.
+cl_event dispatch_sample_token(const DeviceInfo* dev, cl_program program,
+                               cl_mem candidates, cl_mem out, cl_mem history,
+                               int k, int history_len, int history_capacity,
+                               float temperature, float top_p, float min_p,
+                               unsigned int seed, unsigned int step);
+
 // --- Vision ---
 
 // Preprocess image: resize + normalize RGBA → fp16 CHW
@@ -223,6 +223,13 @@ bool init_device(DeviceInfo* info) {
                           sizeof(info->max_image2d_height), &info->max_image2d_height, nullptr);
     CL_CHECK(err);
 
+    // OpenCL 1.2 query: image1d_buffer views are simply unavailable without it
+    if (clGetDeviceInfo(info->device, CL_DEVICE_IMAGE_MAX_BUFFER_SIZE,
+                        sizeof(info->max_image_buffer_size), &info->max_image_buffer_size,
+                        nullptr) != CL_SUCCESS) {
+        info->max_image_buffer_size = 0;
+    }
+
     // Check extensions
     info->has_fp16 = has_extension(info->device, "cl_khr_fp16");
     info->has_subgroups = has_extension(info->device, "cl_khr_subgroups");
@@ -233,6 +240,9 @@ bool init_device(DeviceInfo* info) {
     info->has_qcom_dot_product8 = has_extension(info->device, "cl_qcom_dot_product8");
     info->has_qcom_ahb = has_extension(info->device, "cl_qcom_android_ahardwarebuffer_host_ptr");
     info->has_int_dot_product = has_extension(info->device, "cl_khr_integer_dot_product");
+    info->has_khr_command_buffer = has_extension(info->device, "cl_khr_command_buffer");
+    info->has_khr_command_buffer_mutable_dispatch =
+        has_extension(info->device, "cl_khr_command_buffer_mutable_dispatch");
     info->has_image = (info->image_support == CL_TRUE);
 
     // Query preferred subgroup size (if subgroups supported)
@@ -353,6 +363,8 @@ void print_device_info(const DeviceInfo* info) {
     PRINT_EXT("cl_qcom_perf_hint", info->has_qcom_perf_hint);
     PRINT_EXT("cl_qcom_dot_product8", info->has_qcom_dot_product8);
     PRINT_EXT("cl_qcom_android_ahb", info->has_qcom_ahb);
+    PRINT_EXT("cl_khr_command_buffer", info->has_khr_command_buffer);
+    PRINT_EXT("cl_khr_command_buffer_mutable_dispatch", info->has_khr_command_buffer_mutable_dispatch);
 
     #undef PRINT_EXT
 
@@ -35,6 +35,7 @@ struct DeviceInfo {
 
     size_t max_image2d_width;
     size_t max_image2d_height;
+    size_t max_image_buffer_size;  // image1d_buffer texels (0: not supported)
     cl_bool image_support;
 
     // Extension flags
@@ -48,6 +49,8 @@ struct DeviceInfo {
     bool has_qcom_dot_product8;
     bool has_qcom_ahb;
     bool has_int_dot_product;
+    bool has_khr_command_buffer;
+    bool has_khr_command_buffer_mutable_dispatch;
 
     // Adreno-specific capabilities
     size_t preferred_subgroup_size;
@@ -78,6 +78,34 @@ cl_mem create_weight_image(const DeviceInfo* info, int rows, int cols, const cl_
     return image;
 }
 
+cl_mem create_buffer_image_view(const DeviceInfo* info, cl_mem buffer, size_t num_halves) {
+    size_t texels = num_halves / 4;
+    if (!info->has_image || num_halves % 4 != 0 || texels > info->max_image_buffer_size) {
+        MGPU_ERR("image1d_buffer view of %zu texels not supported (max %zu)\n",
+                 texels, info->max_image_buffer_size);
+        return nullptr;
+    }
+
+    cl_image_format fmt;
+    fmt.image_channel_order = CL_RGBA;
+    fmt.image_channel_data_type = CL_HALF_FLOAT;
+
+    cl_image_desc desc;
+    memset(&desc, 0, sizeof(desc));
+    desc.image_type = CL_MEM_OBJECT_IMAGE1D_BUFFER;
+    desc.image_width = texels;
+    desc.buffer = buffer;
+
+    cl_int err;
+    cl_mem image = clCreateImage(info->context, CL_MEM_READ_ONLY, &fmt, &desc, nullptr, &err);
+    if (err != CL_SUCCESS) {
+        MGPU_ERR("clCreateImage failed for image1d_buffer view (%zu texels, err=%d)\n",
+                 texels, err);
+        return nullptr;
+    }
+    return image;
+}
+
 cl_mem create_buffer(const DeviceInfo* info, size_t size_bytes, cl_mem_flags flags, void* host_ptr) {
     cl_int err;
     cl_mem buf = clCreateBuffer(info->context, flags, size_bytes, host_ptr, &err);
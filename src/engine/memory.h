@@ -15,6 +15,11 @@ struct DeviceInfo;
 // Create a 2D image object from a weight matrix (for texture cache path)
 cl_mem create_weight_image(const DeviceInfo* info, int rows, int cols, const cl_half* data);
 
+// Create an image1d_buffer view (RGBA half texels) of the first `num_halves`
+// fp16 values of `buffer`. Writes to the buffer are visible through the view,
+// so kernels can read it on the texture path. nullptr if unsupported.
+cl_mem create_buffer_image_view(const DeviceInfo* info, cl_mem buffer, size_t num_halves);
+
 // Create a regular buffer
 cl_mem create_buffer(const DeviceInfo* info, size_t size_bytes, cl_mem_flags flags, void* host_ptr = nullptr);
 
@@ -1,5 +1,6 @@
 #include "pipeline.h"
 #include "device.h"
+#include "compute.h"
 
 #ifdef __APPLE__
 #include <OpenCL/cl.h>
@@ -12,6 +13,7 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <ctime>
 
 namespace mgpu {
 
@@ -124,11 +126,480 @@ bool replay_recording(RecordableQueue* queue,
     return true;
 }
 
+// ============================================================================
+// Decode Graph Implementation
+// ============================================================================
+
+// Extension entry points are resolved at runtime, and their types are
+// declared locally, so the engine builds against any cl_ext.h revision.
+
+#ifndef CL_QUEUE_RECORDABLE_QCOM
+#define CL_QUEUE_RECORDABLE_QCOM (1u << 30)
+#endif
+#ifndef CL_COMMAND_BUFFER_FLAGS_KHR
+#define CL_COMMAND_BUFFER_FLAGS_KHR 0x1293
+#endif
+#ifndef CL_COMMAND_BUFFER_MUTABLE_KHR
+#define CL_COMMAND_BUFFER_MUTABLE_KHR (1 << 1)
+#endif
+#ifndef CL_MUTABLE_DISPATCH_UPDATABLE_FIELDS_KHR
+#define CL_MUTABLE_DISPATCH_UPDATABLE_FIELDS_KHR 0x12B1
+#endif
+#ifndef CL_MUTABLE_DISPATCH_ARGUMENTS_KHR
+#define CL_MUTABLE_DISPATCH_ARGUMENTS_KHR (1 << 1)
+#endif
+#ifndef CL_STRUCTURE_TYPE_MUTABLE_DISPATCH_CONFIG_KHR
+#define CL_STRUCTURE_TYPE_MUTABLE_DISPATCH_CONFIG_KHR 0
+#endif
+
+// cl_qcom_recordable_queues
+struct RecordingArgQCOM {          // cl_array_arg_qcom
+    cl_uint dispatch_index;
+    cl_uint arg_index;
+    size_t arg_size;
+    const void* arg_value;
+};
+typedef void* (*PFN_NewRecordingQCOM)(cl_command_queue, cl_int*);
+typedef cl_int (*PFN_EndRecordingQCOM)(void*);
+typedef cl_int (*PFN_ReleaseRecordingQCOM)(void*);
+typedef cl_int (*PFN_EnqueueRecordingQCOM)(cl_command_queue, void*,
+                                           size_t, const RecordingArgQCOM*,
+                                           size_t, const void*,
+                                           size_t, const void*,
+                                           size_t, const void*,
+                                           cl_uint, const cl_event*, cl_event*);
+
+// cl_khr_command_buffer + cl_khr_command_buffer_mutable_dispatch (final API)
+struct MutableDispatchArgKHR {     // cl_mutable_dispatch_arg_khr
+    cl_uint arg_index;
+    size_t arg_size;
+    const void* arg_value;
+};
+struct MutableDispatchConfigKHR {  // cl_mutable_dispatch_config_khr
+    void* command;
+    cl_uint num_args;
+    cl_uint num_svm_args;
+    cl_uint num_exec_infos;
+    cl_uint work_dim;
+    const MutableDispatchArgKHR* arg_list;
+    const void* arg_svm_list;
+    const void* exec_info_list;
+    const size_t* global_work_offset;
+    const size_t* global_work_size;
+    const size_t* local_work_size;
+};
+typedef void* (*PFN_CreateCommandBufferKHR)(cl_uint, const cl_command_queue*,
+                                            const cl_bitfield*, cl_int*);
+typedef cl_int (*PFN_CommandNDRangeKernelKHR)(void*, cl_command_queue, const cl_ulong*,
+                                              cl_kernel, cl_uint, const size_t*,
+                                              const size_t*, const size_t*,
+                                              cl_uint, const cl_uint*, cl_uint*, void**);
+typedef cl_int (*PFN_FinalizeCommandBufferKHR)(void*);
+typedef cl_int (*PFN_EnqueueCommandBufferKHR)(cl_uint, cl_command_queue*, void*,
+                                              cl_uint, const cl_event*, cl_event*);
+typedef cl_int (*PFN_ReleaseCommandBufferKHR)(void*);
+typedef cl_int (*PFN_UpdateMutableCommandsKHR)(void*, cl_uint, const cl_uint*, const void**);
+
+struct DecodeGraphBackendState {
+    // QCOM recording
+    cl_command_queue record_queue;
+    void* recording;
+    RecordingArgQCOM* qcom_args;
+    PFN_EndRecordingQCOM end_recording;
+    PFN_ReleaseRecordingQCOM release_recording;
+    PFN_EnqueueRecordingQCOM enqueue_recording;
+
+    // KHR command buffer
+    void* command_buffer;
+    MutableDispatchConfigKHR* khr_configs;
+    MutableDispatchArgKHR* khr_args;
+    cl_uint* khr_config_types;
+    const void** khr_config_ptrs;
+    int num_khr_configs;
+    PFN_EnqueueCommandBufferKHR enqueue_command_buffer;
+    PFN_ReleaseCommandBufferKHR release_command_buffer;
+    PFN_UpdateMutableCommandsKHR update_mutable_commands;
+};
+
+static inline uint64_t graph_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void* get_extension_fn(const DeviceInfo* info, const char* name) {
+    return clGetExtensionFunctionAddressForPlatform(info->platform, name);
+}
+
+static void release_backend_state(DecodeGraph* graph) {
+    DecodeGraphBackendState* st = graph->state;
+    if (!st) return;
+
+    if (st->recording && st->release_recording) st->release_recording(st->recording);
+    if (st->record_queue) clReleaseCommandQueue(st->record_queue);
+    if (st->command_buffer && st->release_command_buffer)
+        st->release_command_buffer(st->command_buffer);
+
+    free(st->qcom_args);
+    free(st->khr_configs);
+    free(st->khr_args);
+    free(st->khr_config_types);
+    free(st->khr_config_ptrs);
+    free(st);
+    graph->state = nullptr;
+}
+
+// Record every node into a Qualcomm recording; patches become
+// cl_array_arg_qcom updates indexed by dispatch.
+static bool build_qcom_recording(DecodeGraph* graph) {
+    const DeviceInfo* info = graph->device;
+    DecodeGraphBackendState* st = graph->state;
+
+    PFN_NewRecordingQCOM new_recording =
+        (PFN_NewRecordingQCOM)get_extension_fn(info, "clNewRecordingQCOM");
+    st->end_recording = (PFN_EndRecordingQCOM)get_extension_fn(info, "clEndRecordingQCOM");
+    st->release_recording =
+        (PFN_ReleaseRecordingQCOM)get_extension_fn(info, "clReleaseRecordingQCOM");
+    st->enqueue_recording =
+        (PFN_EnqueueRecordingQCOM)get_extension_fn(info, "clEnqueueRecordingQCOM");
+    if (!new_recording || !st->end_recording || !st->release_recording ||
+        !st->enqueue_recording) {
+        return false;
+    }
+
+    cl_int err;
+    st->record_queue = clCreateCommandQueue(info->context, info->device,
+                                            CL_QUEUE_RECORDABLE_QCOM, &err);
+    if (err != CL_SUCCESS || !st->record_queue) {
+        st->record_queue = nullptr;
+        return false;
+    }
+
+    st->recording = new_recording(st->record_queue, &err);
+    if (err != CL_SUCCESS || !st->recording) {
+        st->recording = nullptr;
+        return false;
+    }
+
+    for (int i = 0; i < graph->num_nodes; i++) {
+        const DecodeGraphNode* n = &graph->nodes[i];
+        err = clEnqueueNDRangeKernel(st->record_queue, n->kernel, n->work_dim, nullptr,
+                                     n->global, n->has_local ? n->local : nullptr,
+                                     0, nullptr, nullptr);
+        if (err != CL_SUCCESS) return false;
+    }
+    if (st->end_recording(st->recording) != CL_SUCCESS) return false;
+
+    st->qcom_args = (RecordingArgQCOM*)calloc(graph->num_patches > 0 ? graph->num_patches : 1,
+                                              sizeof(RecordingArgQCOM));
+    if (!st->qcom_args) return false;
+    for (int i = 0; i < graph->num_patches; i++) {
+        st->qcom_args[i].dispatch_index = (cl_uint)graph->patches[i].node;
+        st->qcom_args[i].arg_index = graph->patches[i].arg_index;
+        st->qcom_args[i].arg_size = sizeof(int);
+        st->qcom_args[i].arg_value = &graph->patch_values[i];
+    }
+    return true;
+}
+
+// Record every node into a mutable command buffer; each patched node gets one
+// mutable-dispatch config listing its patched arguments.
+static bool build_khr_command_buffer(DecodeGraph* graph) {
+    const DeviceInfo* info = graph->device;
+    DecodeGraphBackendState* st = graph->state;
+
+    PFN_CreateCommandBufferKHR create_command_buffer =
+        (PFN_CreateCommandBufferKHR)get_extension_fn(info, "clCreateCommandBufferKHR");
+    PFN_CommandNDRangeKernelKHR command_ndrange =
+        (PFN_CommandNDRangeKernelKHR)get_extension_fn(info, "clCommandNDRangeKernelKHR");
+    PFN_FinalizeCommandBufferKHR finalize =
+        (PFN_FinalizeCommandBufferKHR)get_extension_fn(info, "clFinalizeCommandBufferKHR");
+    st->enqueue_command_buffer =
+        (PFN_EnqueueCommandBufferKHR)get_extension_fn(info, "clEnqueueCommandBufferKHR");
+    st->release_command_buffer =
+        (PFN_ReleaseCommandBufferKHR)get_extension_fn(info, "clReleaseCommandBufferKHR");
+    st->update_mutable_commands =
+        (PFN_UpdateMutableCommandsKHR)get_extension_fn(info, "clUpdateMutableCommandsKHR");
+    if (!create_command_buffer || !command_ndrange || !finalize ||
+        !st->enqueue_command_buffer || !st->release_command_buffer ||
+        !st->update_mutable_commands) {
+        return false;
+    }
+
+    cl_int err;
+    cl_bitfield props[] = { CL_COMMAND_BUFFER_FLAGS_KHR, CL_COMMAND_BUFFER_MUTABLE_KHR, 0 };
+    st->command_buffer = create_command_buffer(1, &info->queue, props, &err);
+    if (err != CL_SUCCESS || !st->command_buffer) {
+        st->command_buffer = nullptr;
+        return false;
+    }
+
+    // Chain sync points so execution order never depends on queue semantics
+    cl_ulong patched_props[] = {
+        CL_MUTABLE_DISPATCH_UPDATABLE_FIELDS_KHR, CL_MUTABLE_DISPATCH_ARGUMENTS_KHR, 0
+    };
+    cl_uint prev_sync = 0;
+    for (int i = 0; i < graph->num_nodes; i++) {
+        DecodeGraphNode* n = &graph->nodes[i];
+        bool patched = false;
+        for (int p = 0; p < graph->num_patches; p++)
+            if (graph->patches[p].node == i) { patched = true; break; }
+
+        cl_uint sync = 0;
+        err = command_ndrange(st->command_buffer, nullptr,
+                              patched ? patched_props : nullptr,
+                              n->kernel, n->work_dim, nullptr, n->global,
+                              n->has_local ? n->local : nullptr,
+                              i > 0 ? 1 : 0, i > 0 ? &prev_sync : nullptr, &sync,
+                              patched ? &n->mutable_command : nullptr);
+        if (err != CL_SUCCESS) return false;
+        prev_sync = sync;
+    }
+    if (finalize(st->command_buffer) != CL_SUCCESS) return false;
+
+    // Patches are appended in capture order, so a node's patches are adjacent
+    int n_patches = graph->num_patches > 0 ? graph->num_patches : 1;
+    st->khr_args = (MutableDispatchArgKHR*)calloc(n_patches, sizeof(MutableDispatchArgKHR));
+    st->khr_configs = (MutableDispatchConfigKHR*)calloc(n_patches, sizeof(MutableDispatchConfigKHR));
+    st->khr_config_types = (cl_uint*)calloc(n_patches, sizeof(cl_uint));
+    st->khr_config_ptrs = (const void**)calloc(n_patches, sizeof(void*));
+    if (!st->khr_args || !st->khr_configs || !st->khr_config_types || !st->khr_config_ptrs)
+        return false;
+
+    int num_configs = 0;
+    for (int p = 0; p < graph->num_patches; p++) {
+        const DecodeGraphPatch* patch = &graph->patches[p];
+        st->khr_args[p].arg_index = patch->arg_index;
+        st->khr_args[p].arg_size = sizeof(int);
+        st->khr_args[p].arg_value = &graph->patch_values[p];
+
+        MutableDispatchConfigKHR* cfg = num_configs > 0 ? &st->khr_configs[num_configs - 1] : nullptr;
+        if (!cfg || cfg->command != graph->nodes[patch->node].mutable_command) {
+            cfg = &st->khr_configs[num_configs];
+            cfg->command = graph->nodes[patch->node].mutable_command;
+            cfg->arg_list = &st->khr_args[p];
+            st->khr_config_types[num_configs] = CL_STRUCTURE_TYPE_MUTABLE_DISPATCH_CONFIG_KHR;
+            st->khr_config_ptrs[num_configs] = cfg;
+            num_configs++;
+        }
+        cfg->num_args++;
+    }
+    st->num_khr_configs = num_configs;
+    return true;
+}
+
+bool decode_graph_begin_capture(DecodeGraph* graph, const DeviceInfo* info) {
+    if (!graph || !info) return false;
+    decode_graph_destroy(graph);
+
+    graph->device = info;
+    graph->capturing = true;
+    dispatch_capture_begin(graph);
+    return true;
+}
+
+bool decode_graph_add_node(DecodeGraph* graph, cl_kernel kernel, const char* name,
+                           cl_uint work_dim, const size_t* global, const size_t* local) {
+    if (!graph->capturing || graph->failed || work_dim > 3) {
+        clReleaseKernel(kernel);
+        graph->failed = true;
+        return false;
+    }
+
+    if (graph->num_nodes == graph->node_capacity) {
+        int new_capacity = graph->node_capacity ? graph->node_capacity * 2 : 256;
+        DecodeGraphNode* grown = (DecodeGraphNode*)realloc(
+            graph->nodes, (size_t)new_capacity * sizeof(DecodeGraphNode));
+        if (!grown) {
+            clReleaseKernel(kernel);
+            graph->failed = true;
+            return false;
+        }
+        graph->nodes = grown;
+        graph->node_capacity = new_capacity;
+    }
+
+    DecodeGraphNode* n = &graph->nodes[graph->num_nodes++];
+    memset(n, 0, sizeof(DecodeGraphNode));
+    n->kernel = kernel;
+    snprintf(n->name, sizeof(n->name), "%s", name);
+    n->work_dim = work_dim;
+    for (cl_uint d = 0; d < work_dim; d++) {
+        n->global[d] = global[d];
+        n->local[d] = local ? local[d] : 0;
+    }
+    n->has_local = (local != nullptr);
+    return true;
+}
+
+bool decode_graph_patch_last(DecodeGraph* graph, const char* kernel_name,
+                             cl_uint arg_index, int bias) {
+    if (!graph->capturing || graph->failed) return false;
+
+    int node = -1;
+    for (int i = graph->num_nodes - 1; i >= 0; i--) {
+        if (strcmp(graph->nodes[i].name, kernel_name) == 0) { node = i; break; }
+    }
+    if (node < 0) {
+        printf("[pipeline] decode graph: no captured '%s' launch to patch\n", kernel_name);
+        graph->failed = true;
+        return false;
+    }
+
+    if (graph->num_patches == graph->patch_capacity) {
+        int new_capacity = graph->patch_capacity ? graph->patch_capacity * 2 : 64;
+        DecodeGraphPatch* grown = (DecodeGraphPatch*)realloc(
+            graph->patches, (size_t)new_capacity * sizeof(DecodeGraphPatch));
+        int* values = grown ? (int*)realloc(graph->patch_values,
+                                            (size_t)new_capacity * sizeof(int)) : nullptr;
+        if (grown) graph->patches = grown;
+        if (!grown || !values) {
+            graph->failed = true;
+            return false;
+        }
+        graph->patch_values = values;
+        graph->patch_capacity = new_capacity;
+    }
+
+    DecodeGraphPatch* p = &graph->patches[graph->num_patches];
+    p->node = node;
+    p->arg_index = arg_index;
+    p->bias = bias;
+    graph->patch_values[graph->num_patches] = 0;
+    graph->num_patches++;
+    return true;
+}
+
+bool decode_graph_end_capture(DecodeGraph* graph) {
+    dispatch_capture_end();
+    if (!graph->capturing) return false;
+    graph->capturing = false;
+
+    if (graph->failed || graph->num_nodes == 0) {
+        printf("[pipeline] decode graph capture failed, using eager dispatch\n");
+        decode_graph_destroy(graph);
+        return false;
+    }
+
+    graph->state = (DecodeGraphBackendState*)calloc(1, sizeof(DecodeGraphBackendState));
+    if (!graph->state) {
+        decode_graph_destroy(graph);
+        return false;
+    }
+
+    graph->backend = DecodeGraphBackend::KERNEL_LIST;
+    const DeviceInfo* info = graph->device;
+    if (info->has_khr_command_buffer_mutable_dispatch && build_khr_command_buffer(graph)) {
+        graph->backend = DecodeGraphBackend::KHR_COMMAND_BUFFER;
+    } else {
+        release_backend_state(graph);
+        graph->state = (DecodeGraphBackendState*)calloc(1, sizeof(DecodeGraphBackendState));
+        if (info->has_qcom_recordable_queues && graph->state && build_qcom_recording(graph)) {
+            graph->backend = DecodeGraphBackend::QCOM_RECORDING;
+        } else {
+            release_backend_state(graph);
+        }
+    }
+
+    graph->ready = true;
+    printf("[pipeline] decode graph captured: %d launches, %d patched args (%s)\n",
+           graph->num_nodes, graph->num_patches, decode_graph_backend_name(graph->backend));
+    return true;
+}
+
+static bool replay_kernel_list(DecodeGraph* graph) {
+    cl_int err = CL_SUCCESS;
+    for (int i = 0; i < graph->num_patches; i++) {
+        const DecodeGraphPatch* p = &graph->patches[i];
+        err |= clSetKernelArg(graph->nodes[p->node].kernel, p->arg_index,
+                              sizeof(int), &graph->patch_values[i]);
+    }
+    if (err != CL_SUCCESS) return false;
+
+    cl_command_queue queue = graph->device->queue;
+    for (int i = 0; i < graph->num_nodes; i++) {
+        const DecodeGraphNode* n = &graph->nodes[i];
+        err = clEnqueueNDRangeKernel(queue, n->kernel, n->work_dim, nullptr,
+                                     n->global, n->has_local ? n->local : nullptr,
+                                     0, nullptr, nullptr);
+        if (err != CL_SUCCESS) return false;
+    }
+    return true;
+}
+
+bool decode_graph_replay(DecodeGraph* graph, int pos) {
+    if (!graph || !graph->ready) return false;
+
+    uint64_t t0 = graph_now_ns();
+    for (int i = 0; i < graph->num_patches; i++)
+        graph->patch_values[i] = pos + graph->patches[i].bias;
+
+    DecodeGraphBackendState* st = graph->state;
+    cl_command_queue queue = graph->device->queue;
+    bool ok = false;
+
+    if (graph->backend == DecodeGraphBackend::KHR_COMMAND_BUFFER) {
+        cl_int err = CL_SUCCESS;
+        if (st->num_khr_configs > 0) {
+            err = st->update_mutable_commands(st->command_buffer, (cl_uint)st->num_khr_configs,
+                                              st->khr_config_types, st->khr_config_ptrs);
+        }
+        if (err == CL_SUCCESS)
+            err = st->enqueue_command_buffer(1, &queue, st->command_buffer, 0, nullptr, nullptr);
+        ok = (err == CL_SUCCESS);
+    } else if (graph->backend == DecodeGraphBackend::QCOM_RECORDING) {
+        cl_int err = st->enqueue_recording(queue, st->recording,
+                                           (size_t)graph->num_patches, st->qcom_args,
+                                           0, nullptr, 0, nullptr, 0, nullptr,
+                                           0, nullptr, nullptr);
+        ok = (err == CL_SUCCESS);
+    }
+
+    if (!ok && graph->backend != DecodeGraphBackend::KERNEL_LIST) {
+        // Driver rejected the recorded form: keep going with the kernel list
+        printf("[pipeline] decode graph: %s replay failed, falling back to %s\n",
+               decode_graph_backend_name(graph->backend),
+               decode_graph_backend_name(DecodeGraphBackend::KERNEL_LIST));
+        release_backend_state(graph);
+        graph->backend = DecodeGraphBackend::KERNEL_LIST;
+    }
+    if (!ok) ok = replay_kernel_list(graph);
+
+    dispatch_stats_record((uint64_t)graph->num_nodes, graph_now_ns() - t0);
+    return ok;
+}
+
+void decode_graph_destroy(DecodeGraph* graph) {
+    if (!graph) return;
+    if (graph->capturing) dispatch_capture_end();
+
+    release_backend_state(graph);
+    for (int i = 0; i < graph->num_nodes; i++) {
+        if (graph->nodes[i].kernel) clReleaseKernel(graph->nodes[i].kernel);
+    }
+    free(graph->nodes);
+    free(graph->patches);
+    free(graph->patch_values);
+
+    const DeviceInfo* info = graph->device;
+    memset(graph, 0, sizeof(DecodeGraph));
+    graph->device = info;
+}
+
+const char* decode_graph_backend_name(DecodeGraphBackend backend) {
+    switch (backend) {
+        case DecodeGraphBackend::KHR_COMMAND_BUFFER: return "cl_khr_command_buffer";
+        case DecodeGraphBackend::QCOM_RECORDING:     return "cl_qcom_recordable_queues";
+        case DecodeGraphBackend::KERNEL_LIST:        return "pre-bound kernel list";
+    }
+    return "unknown";
+}
+
 // ============================================================================
 // On-Chip Memory Implementation
 // ============================================================================
 
-OnChipBuffer create_onchip_buffer(const DeviceInfo* info, size_t size_bytes) {
+OnChipBuffer alloc_onchip_buffer(const DeviceInfo* info, size_t size_bytes) {
     OnChipBuffer buf = {nullptr, 0, false};
 
     if (!info || !info->has_qcom_onchip_global_memory) {
@@ -314,13 +785,13 @@ bool init_pipeline(InferencePipeline* pipeline, DeviceInfo* device) {
         // Rough estimate: 24 layers * 2048 * 32 * 32 * 2 bytes = ~100MB
         size_t kv_size = 128 * 1024 * 1024;  // 128MB
         if (kv_size < onchip_size) {
-            pipeline->kv_cache = create_onchip_buffer(device, kv_size);
+            pipeline->kv_cache = alloc_onchip_buffer(device, kv_size);
         }
 
         // Activations: another ~64MB
         size_t act_size = 64 * 1024 * 1024;
         if (act_size < onchip_size - kv_size) {
-            pipeline->activations = create_onchip_buffer(device, act_size);
+            pipeline->activations = alloc_onchip_buffer(device, act_size);
         }
     }
 
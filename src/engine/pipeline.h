@@ -86,6 +86,90 @@ bool replay_recording(RecordableQueue* queue,
                      const void** arg_values,
                      const size_t* arg_sizes);
 
+// ============================================================================
+// Decode Graph (portable capture / replay)
+// ============================================================================
+
+// Captures the whole per-token kernel sequence of a decode step once, then
+// replays it with only the position-dependent arguments rewritten.
+//
+// Capture piggybacks on a real decode step: while capturing, every dispatch_*
+// still executes but gets a private kernel object whose arguments stay bound
+// (see dispatch_capture_begin in compute.h). Replay backends, best first:
+//   - cl_khr_command_buffer + mutable dispatch: one enqueue per token
+//   - cl_qcom_recordable_queues: one clEnqueueRecordingQCOM per token
+//   - pre-bound kernel list: one clEnqueueNDRangeKernel per node, no
+//     clCreateKernel / clSetKernelArg except for the patched arguments
+
+enum class DecodeGraphBackend {
+    KERNEL_LIST = 0,
+    QCOM_RECORDING,
+    KHR_COMMAND_BUFFER,
+};
+
+struct DecodeGraphNode {
+    cl_kernel kernel;          // owned; arguments bound at capture
+    char name[64];             // kernel function name
+    cl_uint work_dim;
+    size_t global[3];
+    size_t local[3];
+    bool has_local;
+    void* mutable_command;     // cl_mutable_command_khr (KHR backend)
+};
+
+// Integer kernel argument rewritten on every replay: value = pos + bias
+// (pos = index of the token being decoded)
+struct DecodeGraphPatch {
+    int node;
+    cl_uint arg_index;
+    int bias;
+};
+
+struct DecodeGraphBackendState;
+
+struct DecodeGraph {
+    const DeviceInfo* device;
+    DecodeGraphBackend backend;
+
+    DecodeGraphNode* nodes;
+    int num_nodes;
+    int node_capacity;
+
+    DecodeGraphPatch* patches;
+    int* patch_values;         // storage the backends point at during replay
+    int num_patches;
+    int patch_capacity;
+
+    bool capturing;
+    bool failed;               // a capture step went wrong; graph unusable
+    bool ready;
+
+    DecodeGraphBackendState* state;
+};
+
+// Start capturing dispatch_* launches on the calling thread
+bool decode_graph_begin_capture(DecodeGraph* graph, const DeviceInfo* info);
+
+// Stop capturing and build the best available replay backend
+bool decode_graph_end_capture(DecodeGraph* graph);
+
+// Append a launch (called from compute.cpp; takes ownership of `kernel`)
+bool decode_graph_add_node(DecodeGraph* graph, cl_kernel kernel, const char* name,
+                           cl_uint work_dim, const size_t* global, const size_t* local);
+
+// Mark an int argument of the most recent `kernel_name` launch as
+// position-dependent (value = pos + bias on replay)
+bool decode_graph_patch_last(DecodeGraph* graph, const char* kernel_name,
+                             cl_uint arg_index, int bias);
+
+// Enqueue the captured sequence for the token at position `pos`
+bool decode_graph_replay(DecodeGraph* graph, int pos);
+
+// Release kernels, recordings and command buffers
+void decode_graph_destroy(DecodeGraph* graph);
+
+const char* decode_graph_backend_name(DecodeGraphBackend backend);
+
 // ============================================================================
 // Qualcomm On-Chip Global Memory Extension
 // ============================================================================
@@ -103,7 +187,7 @@ struct OnChipBuffer {
 
 // Create on-chip memory buffer (if extension available)
 // Returns buffer in on-chip memory, falls back to regular if not
-OnChipBuffer create_onchip_buffer(const DeviceInfo* info, size_t size_bytes);
+OnChipBuffer alloc_onchip_buffer(const DeviceInfo* info, size_t size_bytes);
 
 // Free on-chip buffer
 void destroy_onchip_buffer(OnChipBuffer* buf);
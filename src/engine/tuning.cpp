@@ -0,0 +1,237 @@
+#include "tuning.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef MGPU_ANDROID
+#include <android/log.h>
+#define MGPU_ERR(...) __android_log_print(ANDROID_LOG_ERROR, "MGPU", __VA_ARGS__)
+#else
+#define MGPU_ERR(...) fprintf(stderr, __VA_ARGS__)
+#endif
+
+namespace mgpu {
+
+// KernelTuning fields by name (database keys)
+struct TuningField {
+    const char* key;
+    size_t offset;
+};
+
+static const TuningField TUNING_FIELDS[] = {
+    { "gemm_naive_wg",       offsetof(KernelTuning, gemm_naive_wg) },
+    { "gemm_tile",           offsetof(KernelTuning, gemm_tile) },
+    { "gemv_wg_size",        offsetof(KernelTuning, gemv_wg_size) },
+    { "gemv_cols4",          offsetof(KernelTuning, gemv_cols4) },
+    { "fused_gemv_wg_size",  offsetof(KernelTuning, fused_gemv_wg_size) },
+    { "fused_gemv_cols4",    offsetof(KernelTuning, fused_gemv_cols4) },
+    { "skinny_wg_size",      offsetof(KernelTuning, skinny_wg_size) },
+    { "norm_wg_size",        offsetof(KernelTuning, norm_wg_size) },
+    { "attn_br",             offsetof(KernelTuning, attn_br) },
+    { "attn_bc",             offsetof(KernelTuning, attn_bc) },
+    { "attn_decode_wg_size", offsetof(KernelTuning, attn_decode_wg_size) },
+};
+static const int NUM_TUNING_FIELDS = sizeof(TUNING_FIELDS) / sizeof(TUNING_FIELDS[0]);
+
+static int* tuning_field(KernelTuning* tuning, int i) {
+    return (int*)((char*)tuning + TUNING_FIELDS[i].offset);
+}
+
+static int tuning_value(const KernelTuning* tuning, int i) {
+    return *(const int*)((const char*)tuning + TUNING_FIELDS[i].offset);
+}
+
+static bool is_pow2(int v) {
+    return v > 0 && (v & (v - 1)) == 0;
+}
+
+bool kernel_tuning_build_options(const KernelTuning* t, char* opts, size_t size) {
+    int n = snprintf(opts, size,
+                     "-DTILE_M=%d -DTILE_N=%d -DTILE_K=%d"
+                     " -DGEMV_BLOCK_WG_SIZE=%d -DGEMV_COLS4=%d"
+                     " -DGEMV_WG_SIZE=%d -DGEMV_FUSED_COLS4=%d"
+                     " -DSKINNY_WG_SIZE=%d -DNORM_WG_SIZE=%d"
+                     " -DATTN_BR=%d -DATTN_BC=%d -DATTN_DECODE_WG_SIZE=%d",
+                     t->gemm_tile, t->gemm_tile, t->gemm_tile,
+                     t->gemv_wg_size, t->gemv_cols4,
+                     t->fused_gemv_wg_size, t->fused_gemv_cols4,
+                     t->skinny_wg_size, t->norm_wg_size,
+                     t->attn_br, t->attn_bc, t->attn_decode_wg_size);
+    return n > 0 && (size_t)n < size;
+}
+
+bool kernel_tuning_valid(const KernelTuning* t, const DeviceInfo* device) {
+    const int max_wg = (int)device->max_workgroup_size;
+    const size_t local_mem = (size_t)device->local_mem_size;
+
+    // Tree reductions halve the workgroup each step
+    if (!is_pow2(t->gemv_wg_size) || !is_pow2(t->fused_gemv_wg_size) ||
+        !is_pow2(t->skinny_wg_size) || !is_pow2(t->norm_wg_size) ||
+        !is_pow2(t->attn_decode_wg_size))
+        return false;
+    if (t->gemv_wg_size > max_wg || t->fused_gemv_wg_size > max_wg ||
+        t->skinny_wg_size > max_wg || t->norm_wg_size > max_wg ||
+        t->attn_decode_wg_size > max_wg)
+        return false;
+
+    // gemv: COLS4 result lanes; the tree fallback keeps COLS4 x WG float4
+    if (!is_pow2(t->gemv_cols4) || t->gemv_cols4 > t->gemv_wg_size ||
+        (size_t)t->gemv_cols4 * t->gemv_wg_size * 16 > local_mem)
+        return false;
+
+    // qkv_gemv / gate_up_silu_gemv: same reduction over up to 2 x COLS4
+    // columns (gate and up), plus the float norm_red[WG] of the prologue
+    if (!is_pow2(t->fused_gemv_cols4) || 2 * t->fused_gemv_cols4 > t->fused_gemv_wg_size ||
+        (size_t)t->fused_gemv_wg_size * (2 * t->fused_gemv_cols4 * 16 + 4) > local_mem)
+        return false;
+
+    // gemm_skinny: 4 texel columns, one norm lane per row (SKINNY_MAX_M = 16);
+    // half a_tile[16][WG] + float norm_red[WG] + float4 red[WG]
+    if (t->skinny_wg_size < 16) return false;
+    if ((size_t)t->skinny_wg_size * (16 * 2 + 4 + 16) + 16 * 4 > local_mem) return false;
+
+    // rms_norm: at most 32 subgroups per workgroup (sub_sums[32])
+    size_t subgroup = device->preferred_subgroup_size ? device->preferred_subgroup_size : 8;
+    if ((size_t)t->norm_wg_size / subgroup > 32) return false;
+
+    // gemm_tiled loads both tiles with the same (row, col) grid: square
+    if (t->gemm_tile < 1 || t->gemm_tile * t->gemm_tile > max_wg) return false;
+    if (t->gemm_naive_wg < 1 || t->gemm_naive_wg * t->gemm_naive_wg > max_wg) return false;
+
+    // attention_prefill: head dims 0..127 split over ATTN_BC lanes
+    if (!is_pow2(t->attn_br) || !is_pow2(t->attn_bc) || t->attn_bc > 128 ||
+        t->attn_br * t->attn_bc > max_wg)
+        return false;
+    size_t prefill_local = (size_t)(t->attn_br + 2 * t->attn_bc) * 128 * 2 +
+                           (size_t)t->attn_br * t->attn_bc * 4;
+    if (prefill_local > local_mem) return false;
+
+    return true;
+}
+
+void kernel_tuning_format(const KernelTuning* tuning, char* buf, size_t size) {
+    size_t used = 0;
+    if (size) buf[0] = '\0';
+    for (int i = 0; i < NUM_TUNING_FIELDS && used < size; i++) {
+        int n = snprintf(buf + used, size - used, "%s%s=%d", i ? " " : "",
+                         TUNING_FIELDS[i].key, tuning_value(tuning, i));
+        if (n < 0) break;
+        used += (size_t)n;
+    }
+}
+
+// --- Tuning Database ---
+
+static const int TUNING_LINE_MAX = 1024;
+
+// "<device name>|<driver version>" with the separator and newlines blanked
+// out of both parts
+static void tuning_db_key(const DeviceInfo* device, char* key, size_t size) {
+    snprintf(key, size, "%s|%s", device->device_name, device->driver_version);
+    char* sep = key + strlen(device->device_name);
+    for (char* p = key; *p; p++) {
+        if (p != sep && (*p == '|' || *p == '\n' || *p == '\r')) *p = ' ';
+    }
+}
+
+// If `line` belongs to `key`, return its "key=value ..." part
+static const char* tuning_db_match(const char* line, const char* key) {
+    size_t key_len = strlen(key);
+    if (strncmp(line, key, key_len) != 0 || line[key_len] != '|') return nullptr;
+    return line + key_len + 1;
+}
+
+static void tuning_parse_values(const char* values, KernelTuning* tuning) {
+    char buf[TUNING_LINE_MAX];
+    snprintf(buf, sizeof(buf), "%s", values);
+
+    char* save = nullptr;
+    for (char* tok = strtok_r(buf, " \t\r\n", &save); tok;
+         tok = strtok_r(nullptr, " \t\r\n", &save)) {
+        char* eq = strchr(tok, '=');
+        if (!eq) continue;
+        *eq = '\0';
+        for (int i = 0; i < NUM_TUNING_FIELDS; i++) {
+            if (strcmp(tok, TUNING_FIELDS[i].key) == 0) {
+                *tuning_field(tuning, i) = atoi(eq + 1);
+                break;
+            }
+        }
+    }
+}
+
+bool tuning_db_load(const char* path, const DeviceInfo* device, KernelTuning* tuning) {
+    *tuning = KernelTuning{};
+
+    FILE* f = fopen(path, "r");
+    if (!f) return false;
+
+    char key[2 * 256 + 2];
+    tuning_db_key(device, key, sizeof(key));
+
+    bool found = false;
+    char line[TUNING_LINE_MAX];
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] == '#') continue;
+        const char* values = tuning_db_match(line, key);
+        if (!values) continue;
+
+        KernelTuning parsed;
+        tuning_parse_values(values, &parsed);
+        if (kernel_tuning_valid(&parsed, device)) {
+            *tuning = parsed;
+            found = true;
+        } else {
+            MGPU_ERR("tuning: ignoring invalid entry for %s in %s\n", device->device_name, path);
+        }
+        break;
+    }
+    fclose(f);
+    return found;
+}
+
+bool tuning_db_store(const char* path, const DeviceInfo* device, const KernelTuning* tuning) {
+    char key[2 * 256 + 2];
+    tuning_db_key(device, key, sizeof(key));
+
+    // Keep every line of the other devices (and drivers)
+    char* kept = nullptr;
+    size_t kept_len = 0;
+    FILE* f = fopen(path, "r");
+    if (f) {
+        char line[TUNING_LINE_MAX];
+        while (fgets(line, sizeof(line), f)) {
+            if (line[0] == '#' || tuning_db_match(line, key)) continue;
+            size_t n = strlen(line);
+            char* grown = (char*)realloc(kept, kept_len + n + 1);
+            if (!grown) {
+                free(kept);
+                fclose(f);
+                return false;
+            }
+            kept = grown;
+            memcpy(kept + kept_len, line, n + 1);
+            kept_len += n;
+        }
+        fclose(f);
+    }
+
+    f = fopen(path, "w");
+    if (!f) {
+        MGPU_ERR("tuning: cannot write %s\n", path);
+        free(kept);
+        return false;
+    }
+
+    char values[TUNING_LINE_MAX];
+    kernel_tuning_format(tuning, values, sizeof(values));
+    fprintf(f, "# MGPU kernel tuning: <device>|<driver>|key=value ... (written by mgpu_tune)\n");
+    if (kept) fputs(kept, f);
+    fprintf(f, "%s|%s\n", key, values);
+    free(kept);
+    return fclose(f) == 0;
+}
+
+} // namespace mgpu
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "device.h"
+
+#include <cstddef>
+
+namespace mgpu {
+
+// --- Kernel Tuning ---
+//
+// Launch shapes of the kernels whose work-group / tile sizes are tunable.
+// Each field mirrors a #ifndef default in the kernel sources, and the
+// defaults here are those same values, so an untuned device runs exactly
+// the shapes it always did. A program built with other values must be
+// registered with kernel_tuning_register (compute.h) so dispatch_* launch
+// the matching shapes.
+
+struct KernelTuning {
+    int gemm_naive_wg = 16;         // gemm_naive: wg x wg work-items (launch only)
+    int gemm_tile = 8;              // gemm_tiled: TILE_M = TILE_N = TILE_K
+    int gemv_wg_size = 128;         // gemv: GEMV_BLOCK_WG_SIZE
+    int gemv_cols4 = 4;             // gemv: GEMV_COLS4 texel columns per workgroup
+    int fused_gemv_wg_size = 128;   // qkv_gemv, gate_up_silu_gemv: GEMV_WG_SIZE
+    int fused_gemv_cols4 = 4;       // qkv_gemv, gate_up_silu_gemv: GEMV_FUSED_COLS4 per workgroup
+    int skinny_wg_size = 128;       // gemm_skinny: SKINNY_WG_SIZE
+    int norm_wg_size = 256;         // rms_norm: NORM_WG_SIZE
+    int attn_br = 16;               // attention_prefill: ATTN_BR query rows
+    int attn_bc = 16;               // attention_prefill: ATTN_BC keys per block
+    int attn_decode_wg_size = 64;   // attention_decode: ATTN_DECODE_WG_SIZE
+};
+
+// Tuning file moondream2_load looks for in the kernel directory
+static const char* const TUNING_DB_FILENAME = "mgpu_tuning.txt";
+
+// Write the -D defines selecting `tuning` into `opts` (each kernel file uses
+// the ones it knows). Returns false if they do not fit.
+bool kernel_tuning_build_options(const KernelTuning* tuning, char* opts, size_t size);
+
+// Check `tuning` against the kernels' constraints (power-of-two reductions,
+// square tiles) and the device's work-group and local memory limits
+bool kernel_tuning_valid(const KernelTuning* tuning, const DeviceInfo* device);
+
+// --- Tuning Database ---
+//
+// Text file, one line per device:
+//   <device name>|<driver version>|key=value key=value ...
+// Keys are the KernelTuning field names. Unknown keys are ignored and
+// missing ones keep their defaults, so old files stay readable. A driver
+// update changes the key and sends the device back to the defaults.
+
+// Look up `device`. Returns false, with *tuning at the defaults, if the file
+// has no valid entry for this device and driver.
+bool tuning_db_load(const char* path, const DeviceInfo* device, KernelTuning* tuning);
+
+// Insert or replace the entry of `device`, keeping every other line
+bool tuning_db_store(const char* path, const DeviceInfo* device, const KernelTuning* tuning);
+
+// One-line "key=value ..." summary (for logs)
+void kernel_tuning_format(const KernelTuning* tuning, char* buf, size_t size);
+
+} // namespace mgpu
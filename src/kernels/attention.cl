@@ -26,270 +26,795 @@
 #define ATTN_WG_SIZE 256
 #endif
 
+/* Shape specialization: moondream2_load passes the model config as -D
+ * constants. With HEAD_DIM defined, every kernel here uses it in place of
+ * the head_dim argument: the q.k dot products unroll fully, index divisions
+ * by head_dim become shifts and the local tiles are sized to the head
+ * rather than the largest supported one. */
+/* K/V caches come in two layouts (KVLayout on the host), both described by
+ * two strides so the kernels need no layout branches:
+ *   (pos, head, d) at pos * kv_pos_stride + head * kv_head_stride + d
+ *   seq-major  [capacity, num_heads, head_dim]: kv_pos_stride = num_heads * head_dim,
+ *                                              kv_head_stride = head_dim
+ *   head-major [num_heads, capacity, head_dim]: kv_pos_stride = head_dim,
+ *                                              kv_head_stride = capacity * head_dim
+ * Head-major keeps all positions of a head in one contiguous run, so a
+ * decode workgroup streams its head's K/V instead of striding across rows
+ * shared with the other heads. Rows are contiguous in both. */
+/* Int8 caches (KV_CACHE_INT8 on the host) hold the same elements as char,
+ * same strides, with one fp16 scale per block of KV_Q8_BLOCK positions of
+ * a head:
+ *   value = q * scales[(pos / KV_Q8_BLOCK) * num_heads + head]
+ * kv_cache_store_q8 quantizes rows as they are appended; the *_q8
+ * attention kernels dequantize as they read. */
+
+#define KV_Q8_BLOCK 32
+
+inline int kv_q8_scale_index(const int pos, const int num_heads, const int head)
+{
+    return mad24(pos / KV_Q8_BLOCK, num_heads, head);
+}
+
+#ifdef HEAD_DIM
+#define ATTN_HEAD_DIM(head_dim) HEAD_DIM
+#define ATTN_UNROLL _Pragma("unroll")
+#else
+#define ATTN_HEAD_DIM(head_dim) (head_dim)
+#define ATTN_UNROLL
+#endif
+
 /* ============================================================================
- * Prefill Attention: standard multi-head attention for a batch of tokens
+ * Prefill Attention: tiled causal flash-attention for a batch of tokens
+ *
+ * Q holds q_len new tokens; K/V hold all kv_len positions (cache + new), so
+ * query i sits at absolute position kv_len - q_len + i and may attend to
+ * keys 0 ..= that position.
  *
- * Computes the full attention for all positions simultaneously. This is
- * compute-bound (dominated by the Q @ K^T GEMM and score @ V GEMM).
+ * Each workgroup owns ATTN_BR query rows of one head and walks the keys in
+ * blocks of ATTN_BC:
+ *   - the Q block is staged in local memory once;
+ *   - each K/V block is loaded into local memory once and shared by all
+ *     ATTN_BR rows (instead of every query re-reading all of K/V);
+ *   - scores live only for the current block (no seq_len-sized buffer), and
+ *     an online softmax (running max m, sum l) rescales the output;
+ *   - key blocks entirely above the causal diagonal of the query block are
+ *     never visited.
  *
- * Each workgroup handles one (head, query_position) pair.
- * Within the workgroup, work-items cooperatively compute the dot product
- * against all key positions, apply causal mask + softmax, then compute
- * the weighted sum over V.
+ * Work-item (r, c) scores query row r against key c of the block, and
+ * accumulates output dimensions c, c + ATTN_BC, ... of row r in registers.
  *
  * Dispatch:
- *   global_work_size  = { seq_len * num_heads * ATTN_WG_SIZE }
- *   local_work_size   = { ATTN_WG_SIZE }
+ *   global_work_size  = { ceil(q_len / ATTN_BR) * ATTN_BR * ATTN_BC, num_heads }
+ *   local_work_size   = { ATTN_BR * ATTN_BC, 1 }
  *
- * Layout:  Q/K/V[seq_pos * num_heads * head_dim + head * head_dim + d]
+ * Layout:  Q/output[seq_pos * num_heads * head_dim + head * head_dim + d],
+ *          K/V by (kv_pos_stride, kv_head_stride)
  * ========================================================================= */
-__kernel void attention_prefill(
-    __global const half* restrict Q,       // [seq_len, num_heads, head_dim]
-    __global const half* restrict K,       // [seq_len, num_heads, head_dim]
-    __global const half* restrict V,       // [seq_len, num_heads, head_dim]
-    __global half* restrict output,        // [seq_len, num_heads, head_dim]
-    const int seq_len,
+
+#ifndef ATTN_BR
+#define ATTN_BR 16
+#endif
+#ifndef ATTN_BC
+#define ATTN_BC 16
+#endif
+#ifndef ATTN_PREFILL_MAX_HEAD_DIM
+#if defined(HEAD_DIM) && HEAD_DIM <= 128
+#define ATTN_PREFILL_MAX_HEAD_DIM HEAD_DIM
+#else
+#define ATTN_PREFILL_MAX_HEAD_DIM 128
+#endif
+#endif
+
+#define ATTN_PREFILL_WG (ATTN_BR * ATTN_BC)
+#define ATTN_O_PER_WI   ((ATTN_PREFILL_MAX_HEAD_DIM + ATTN_BC - 1) / ATTN_BC)
+
+// Finite "minus infinity": -cl-fast-relaxed-math does not honour inf
+#define ATTN_MASKED (-1.0e30f)
+
+// K/V are fp16 caches (K8/V8 NULL) or int8 caches with their scales (K/V
+// NULL); each kernel passes constant NULLs, so the other path folds away
+inline void attention_prefill_impl(
+    __global const half* restrict Q,
+    __global const half* restrict K,
+    __global const half* restrict V,
+    __global const char* restrict K8,
+    __global const char* restrict V8,
+    __global const half* restrict k_scales,
+    __global const half* restrict v_scales,
+    __global half* restrict output,
+    const int q_len,
+    const int kv_len,
     const int num_heads,
-    const int head_dim)
+    const int head_dim_arg,
+    const int kv_pos_stride,
+    const int kv_head_stride,
+    __local half* q_tile,
+    __local half* k_tile,
+    __local half* v_tile,
+    __local float* s_tile)
 {
+    const int head_dim = ATTN_HEAD_DIM(head_dim_arg);
     const int lid = get_local_id(0);
-    const int group_idx = get_group_id(0);
-
-    // Decode group_idx → (query_pos, head)
-    const int query_pos = group_idx / num_heads;
-    const int head = group_idx - mul24(query_pos, num_heads);
-
-    if (query_pos >= seq_len) return;
+    const int r = lid / ATTN_BC;            // query row within the block
+    const int c = lid - mul24(r, ATTN_BC);  // key column / output dim lane
+    const int q_block = get_group_id(0);
+    const int head = get_group_id(1);
 
     const int head_stride = mul24(num_heads, head_dim);
-    const int q_offset = mad24(query_pos, head_stride, mul24(head, head_dim));
-
-    // Scaling factor: 1 / sqrt(head_dim)
+    const int head_offset = mul24(head, head_dim);
+    const int kv_base = mul24(head, kv_head_stride);
     const float scale = native_rsqrt((float)head_dim);
 
-    // --- Phase 1: Compute attention scores for all key positions ---
-    // Each work-item handles a subset of key positions
-    // We need seq_len scores, stored in local memory for softmax
+    const int q_first = mul24(q_block, ATTN_BR);
+    const int q_row = q_first + r;
+    const int past = kv_len - q_len;        // positions already in the cache
+    const int q_pos = past + q_row;         // absolute position of this query
+
+    // Stage the Q block (rows past q_len read as zero)
+    const int block_elems = mul24(ATTN_BR, head_dim);
+    for (int i = lid; i < block_elems; i += ATTN_PREFILL_WG) {
+        const int row = i / head_dim;
+        const int d = i - mul24(row, head_dim);
+        const int src_row = q_first + row;
+        q_tile[i] = (src_row < q_len) ? Q[mad24(src_row, head_stride, head_offset + d)]
+                                      : (half)0.0h;
+    }
 
-    __local float scores[ATTN_WG_SIZE];  // Reused for different passes
-    __local float shared_max;
-    __local float shared_sum;
+    float o[ATTN_O_PER_WI];
+    for (int i = 0; i < ATTN_O_PER_WI; ++i) o[i] = 0.0f;
+    float m_run = ATTN_MASKED;
+    float l_run = 0.0f;
 
-    // --- Pass 1a: Compute Q·K^T scores and find max (for stable softmax) ---
-    float local_max = -INFINITY;
+    // Causal skip: the block's last query is at past + min(q_first + BR, q_len) - 1
+    const int last_key = past + min(q_first + ATTN_BR, q_len) - 1;
+    const int num_key_blocks = min(last_key, kv_len - 1) / ATTN_BC + 1;
 
-    for (int kv_pos = lid; kv_pos < seq_len; kv_pos += ATTN_WG_SIZE) {
-        const int k_offset = mad24(kv_pos, head_stride, mul24(head, head_dim));
+    for (int kb = 0; kb < num_key_blocks; ++kb) {
+        const int k_first = mul24(kb, ATTN_BC);
 
-        // Dot product: Q[query_pos, head, :] · K[kv_pos, head, :]
-        float dot = 0.0f;
-        for (int d = 0; d < head_dim; ++d) {
-            dot = fma((float)Q[q_offset + d], (float)K[k_offset + d], dot);
+        // Load the K/V block once for all ATTN_BR query rows
+        barrier(CLK_LOCAL_MEM_FENCE);
+        const int kv_elems = mul24(ATTN_BC, head_dim);
+        for (int i = lid; i < kv_elems; i += ATTN_PREFILL_WG) {
+            const int row = i / head_dim;
+            const int d = i - mul24(row, head_dim);
+            const int key = k_first + row;
+            const bool ok = key < kv_len;
+            const int src = mad24(key, kv_pos_stride, kv_base + d);
+            if (K8) {
+                const int si = kv_q8_scale_index(key, num_heads, head);
+                k_tile[i] = ok ? (half)((float)K8[src] * (float)k_scales[si]) : (half)0.0h;
+                v_tile[i] = ok ? (half)((float)V8[src] * (float)v_scales[si]) : (half)0.0h;
+            } else {
+                k_tile[i] = ok ? K[src] : (half)0.0h;
+                v_tile[i] = ok ? V[src] : (half)0.0h;
+            }
         }
+        barrier(CLK_LOCAL_MEM_FENCE);
 
-        // Scale and apply causal mask
-        // Causal: future positions (kv_pos > query_pos) get -inf
-        // Branch-free: use fmin with a mask value
-        float score = dot * scale;
-        // If kv_pos > query_pos, mask = -INFINITY, else mask = 0.0f
-        // select(a, b, cond): returns b if cond is true (non-zero), a otherwise
-        const float mask = (kv_pos > query_pos) ? -INFINITY : 0.0f;
-        score += mask;
-
-        local_max = fmax(local_max, score);
-    }
-
-    // Reduce to find global max across workgroup
-    scores[lid] = local_max;
-    barrier(CLK_LOCAL_MEM_FENCE);
-
-    for (int stride = ATTN_WG_SIZE >> 1; stride > 0; stride >>= 1) {
-        if (lid < stride) {
-            scores[lid] = fmax(scores[lid], scores[lid + stride]);
+        // S[r][c] = q_r . k_c * scale, causal / bounds masked
+        const int key = k_first + c;
+        float score = ATTN_MASKED;
+        if (q_row < q_len && key < kv_len && key <= q_pos) {
+            const int qo = mul24(r, head_dim);
+            const int ko = mul24(c, head_dim);
+            float dot = 0.0f;
+            ATTN_UNROLL
+            for (int d = 0; d < head_dim; ++d) {
+                dot = fma((float)q_tile[qo + d], (float)k_tile[ko + d], dot);
+            }
+            score = dot * scale;
         }
+        s_tile[lid] = score;
         barrier(CLK_LOCAL_MEM_FENCE);
+
+        // Online softmax over row r of the block (each lane of the row keeps
+        // an identical copy of m and l)
+        __local const float* s_row = s_tile + mul24(r, ATTN_BC);
+        float m_tile = ATTN_MASKED;
+        for (int j = 0; j < ATTN_BC; ++j) m_tile = fmax(m_tile, s_row[j]);
+
+        const float m_new = fmax(m_run, m_tile);
+        const float correction = native_exp(m_run - m_new);
+        l_run *= correction;
+        for (int i = 0; i < ATTN_O_PER_WI; ++i) o[i] *= correction;
+
+        for (int j = 0; j < ATTN_BC; ++j) {
+            const float s = s_row[j];
+            const float p = (s > 0.5f * ATTN_MASKED) ? native_exp(s - m_new) : 0.0f;
+            l_run += p;
+            const int vo = mul24(j, head_dim);
+            for (int i = 0; i < ATTN_O_PER_WI; ++i) {
+                const int d = mad24(i, ATTN_BC, c);
+                if (d < head_dim) o[i] = fma(p, (float)v_tile[vo + d], o[i]);
+            }
+        }
+        m_run = m_new;
     }
 
-    if (lid == 0) shared_max = scores[0];
-    barrier(CLK_LOCAL_MEM_FENCE);
+    if (q_row >= q_len) return;
 
-    const float row_max = shared_max;
+    const float inv_l = (l_run > 0.0f) ? native_recip(l_run) : 0.0f;
+    const int out_base = mad24(q_row, head_stride, head_offset);
+    for (int i = 0; i < ATTN_O_PER_WI; ++i) {
+        const int d = mad24(i, ATTN_BC, c);
+        if (d < head_dim) output[out_base + d] = (half)(o[i] * inv_l);
+    }
+}
 
-    // --- Pass 1b: Compute exp(score - max) and sum ---
-    float local_sum = 0.0f;
+__kernel void attention_prefill(
+    __global const half* restrict Q,       // [q_len, num_heads, head_dim]
+    __global const half* restrict K,       // cache, >= kv_len positions
+    __global const half* restrict V,       // cache, >= kv_len positions
+    __global half* restrict output,        // [q_len, num_heads, head_dim]
+    const int q_len,
+    const int kv_len,
+    const int num_heads,
+    const int head_dim_arg,
+    const int kv_pos_stride,
+    const int kv_head_stride)
+{
+    __local half q_tile[ATTN_BR * ATTN_PREFILL_MAX_HEAD_DIM];
+    __local half k_tile[ATTN_BC * ATTN_PREFILL_MAX_HEAD_DIM];
+    __local half v_tile[ATTN_BC * ATTN_PREFILL_MAX_HEAD_DIM];
+    __local float s_tile[ATTN_BR * ATTN_BC];
+    attention_prefill_impl(Q, K, V, NULL, NULL, NULL, NULL, output,
+                           q_len, kv_len, num_heads, head_dim_arg,
+                           kv_pos_stride, kv_head_stride,
+                           q_tile, k_tile, v_tile, s_tile);
+}
 
-    for (int kv_pos = lid; kv_pos < seq_len; kv_pos += ATTN_WG_SIZE) {
-        const int k_offset = mad24(kv_pos, head_stride, mul24(head, head_dim));
+// Int8 cache variant: K/V tiles are dequantized as they are staged
+__kernel void attention_prefill_q8(
+    __global const half* restrict Q,       // [q_len, num_heads, head_dim]
+    __global const char* restrict K,       // int8 cache, >= kv_len positions
+    __global const char* restrict V,       // int8 cache, >= kv_len positions
+    __global half* restrict output,        // [q_len, num_heads, head_dim]
+    const int q_len,
+    const int kv_len,
+    const int num_heads,
+    const int head_dim_arg,
+    const int kv_pos_stride,
+    const int kv_head_stride,
+    __global const half* restrict k_scales, // [capacity / KV_Q8_BLOCK, num_heads]
+    __global const half* restrict v_scales) // [capacity / KV_Q8_BLOCK, num_heads]
+{
+    __local half q_tile[ATTN_BR * ATTN_PREFILL_MAX_HEAD_DIM];
+    __local half k_tile[ATTN_BC * ATTN_PREFILL_MAX_HEAD_DIM];
+    __local half v_tile[ATTN_BC * ATTN_PREFILL_MAX_HEAD_DIM];
+    __local float s_tile[ATTN_BR * ATTN_BC];
+    attention_prefill_impl(Q, NULL, NULL, K, V, k_scales, v_scales, output,
+                           q_len, kv_len, num_heads, head_dim_arg,
+                           kv_pos_stride, kv_head_stride,
+                           q_tile, k_tile, v_tile, s_tile);
+}
 
-        float dot = 0.0f;
-        for (int d = 0; d < head_dim; ++d) {
-            dot = fma((float)Q[q_offset + d], (float)K[k_offset + d], dot);
-        }
+/* ============================================================================
+ * Decode Attention: single query token against KV-cache (split-K flash-decoding)
+ *
+ * During autoregressive decode, we generate one token at a time. The query
+ * is a single vector Q[1, num_heads, head_dim] that attends to the entire
+ * KV-cache K_cache[cache_len, num_heads, head_dim].
+ *
+ * This is memory-bound: every K/V row must be read once, and only once.
+ * The cache is split into num_splits contiguous chunks per head, each
+ * handled by its own workgroup, so long contexts fill the GPU even with few
+ * heads. Within a chunk, positions are processed in tiles of
+ * ATTN_DECODE_WG_SIZE with an online softmax (running max m and sum l):
+ *
+ *   m' = max(m, max_j s_j),  c = exp(m - m')
+ *   l' = l * c + sum_j exp(s_j - m')
+ *   o' = o * c + sum_j exp(s_j - m') * V_j
+ *
+ * Each split writes its unnormalized (o, m, l) to `partials`;
+ * attention_decode_reduce rescales the splits to a common max and divides
+ * by the total sum.
+ *
+ * The chunk size is derived from cache_len in the kernel, so the launch
+ * shape does not depend on cache_len (decode graphs patch only cache_len).
+ *
+ * Scores read each K row as contiguous half8 vectors (head_dim % 8 == 0,
+ * scalar tail otherwise).
+ *
+ * Dispatch:
+ *   global_work_size  = { num_heads * ATTN_DECODE_WG_SIZE, num_splits }
+ *   local_work_size   = { ATTN_DECODE_WG_SIZE, 1 }
+ *
+ * Partials layout: [num_heads, num_splits, head_dim + 2] floats
+ *   (o[0..head_dim), m, l)
+ * ========================================================================= */
 
-        float score = dot * scale;
-        const float mask = (kv_pos > query_pos) ? -INFINITY : 0.0f;
-        score += mask;
+#ifndef ATTN_DECODE_WG_SIZE
+#define ATTN_DECODE_WG_SIZE 64
+#endif
+#ifndef ATTN_MAX_HEAD_DIM
+#if defined(HEAD_DIM) && HEAD_DIM <= 256
+#define ATTN_MAX_HEAD_DIM HEAD_DIM
+#else
+#define ATTN_MAX_HEAD_DIM 256
+#endif
+#endif
 
-        local_sum += native_exp(score - row_max);
+// Workgroup-wide max / sum of one value per work-item; `buf` is reused
+inline float wg_reduce_max(__local float* buf, float v)
+{
+    const int lid = get_local_id(0);
+    buf[lid] = v;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for (int stride = ATTN_DECODE_WG_SIZE >> 1; stride > 0; stride >>= 1) {
+        if (lid < stride) buf[lid] = fmax(buf[lid], buf[lid + stride]);
+        barrier(CLK_LOCAL_MEM_FENCE);
     }
-
-    scores[lid] = local_sum;
+    const float result = buf[0];
     barrier(CLK_LOCAL_MEM_FENCE);
+    return result;
+}
 
-    for (int stride = ATTN_WG_SIZE >> 1; stride > 0; stride >>= 1) {
-        if (lid < stride) {
-            scores[lid] += scores[lid + stride];
-        }
+inline float wg_reduce_sum(__local float* buf, float v)
+{
+    const int lid = get_local_id(0);
+    buf[lid] = v;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for (int stride = ATTN_DECODE_WG_SIZE >> 1; stride > 0; stride >>= 1) {
+        if (lid < stride) buf[lid] += buf[lid + stride];
         barrier(CLK_LOCAL_MEM_FENCE);
     }
-
-    if (lid == 0) shared_sum = scores[0];
+    const float result = buf[0];
     barrier(CLK_LOCAL_MEM_FENCE);
+    return result;
+}
 
-    const float inv_sum = native_recip(shared_sum);
-
-    // --- Phase 2: Compute weighted sum of V ---
-    // Each work-item computes a subset of the head_dim output dimensions
-    // For each output dimension d, sum over all kv_pos: weight[kv_pos] * V[kv_pos, head, d]
+// fp16 (K8/V8 NULL) or int8 (K_cache/V_cache NULL) caches, as in
+// attention_prefill_impl
+inline void attention_decode_impl(
+    __global const half* restrict Q,
+    __global const half* restrict K_cache,
+    __global const half* restrict V_cache,
+    __global const char* restrict K8,
+    __global const char* restrict V8,
+    __global const half* restrict k_scales,
+    __global const half* restrict v_scales,
+    __global float* restrict partials,
+    const int cache_len,
+    const int num_heads,
+    const int head_dim_arg,
+    const int kv_pos_stride,
+    const int kv_head_stride,
+    __local float* q_local,
+    __local float* o_acc,
+    __local float* probs,
+    __local float* red)
+{
+    const int head_dim = ATTN_HEAD_DIM(head_dim_arg);
+    const int lid = get_local_id(0);
+    const int head = get_group_id(0);
+    const int split = get_group_id(1);
+    const int num_splits = get_num_groups(1);
 
-    for (int d = lid; d < head_dim; d += ATTN_WG_SIZE) {
-        float acc = 0.0f;
+    if (head >= num_heads) return;
 
-        for (int kv_pos = 0; kv_pos < seq_len; ++kv_pos) {
-            // Recompute attention weight for this kv_pos
-            const int k_offset = mad24(kv_pos, head_stride, mul24(head, head_dim));
+    const int q_offset = mul24(head, head_dim);
+    const int kv_base = mul24(head, kv_head_stride);
+    const float scale = native_rsqrt((float)head_dim);
 
-            float dot = 0.0f;
-            for (int dd = 0; dd < head_dim; ++dd) {
-                dot = fma((float)Q[q_offset + dd], (float)K[k_offset + dd], dot);
-            }
+    // This split's chunk of the cache
+    const int chunk = (cache_len + num_splits - 1) / num_splits;
+    const int start = mul24(split, chunk);
+    const int end = min(start + chunk, cache_len);
 
-            float score = dot * scale;
-            const float mask = (kv_pos > query_pos) ? -INFINITY : 0.0f;
-            score += mask;
+    // Q is read by every position: stage it once, pre-scaled
+    for (int d = lid; d < head_dim; d += ATTN_DECODE_WG_SIZE) {
+        q_local[d] = (float)Q[q_offset + d] * scale;
+        o_acc[d] = 0.0f;
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
 
-            const float weight = native_exp(score - row_max) * inv_sum;
+    float m_run = ATTN_MASKED;
+    float l_run = 0.0f;
+
+    for (int tile = start; tile < end; tile += ATTN_DECODE_WG_SIZE) {
+        // One position per work-item: K row read once
+        const int pos = tile + lid;
+        float score = ATTN_MASKED;
+        float v_scale = 1.0f;
+        if (pos < end) {
+            const int k_offset = mad24(pos, kv_pos_stride, kv_base);
+            const int d8_end = head_dim & ~7;
+            float8 acc8 = (float8)(0.0f);
+            ATTN_UNROLL
+            for (int d = 0; d < d8_end; d += 8) {
+                const float8 k8 = K8 ? convert_float8(vload8(0, K8 + k_offset + d))
+                                     : convert_float8(vload8(0, K_cache + k_offset + d));
+                acc8 = fma(vload8(0, q_local + d), k8, acc8);
+            }
+            const float4 acc4 = acc8.lo + acc8.hi;
+            float dot = (acc4.x + acc4.y) + (acc4.z + acc4.w);
+            for (int d = d8_end; d < head_dim; ++d) {
+                const float k = K8 ? (float)K8[k_offset + d] : (float)K_cache[k_offset + d];
+                dot = fma(q_local[d], k, dot);
+            }
+            score = dot;
+            if (K8) {
+                // One scale per row of the head: applied to the dot product,
+                // and folded into the probability that weights the V row
+                const int si = kv_q8_scale_index(pos, num_heads, head);
+                score *= (float)k_scales[si];
+                v_scale = (float)v_scales[si];
+            }
+        }
 
-            const int v_offset = mad24(kv_pos, head_stride, mul24(head, head_dim));
-            acc = fma(weight, (float)V[v_offset + d], acc);
+        const float m_new = fmax(m_run, wg_reduce_max(red, score));
+        const float p = (pos < end) ? native_exp(score - m_new) : 0.0f;
+        probs[lid] = p * v_scale;
+        const float correction = (tile == start) ? 0.0f : native_exp(m_run - m_new);
+        l_run = fma(l_run, correction, wg_reduce_sum(red, p));
+        m_run = m_new;
+
+        // V rows of the tile, read once: work-items own output dimensions
+        const int tile_len = min(ATTN_DECODE_WG_SIZE, end - tile);
+        for (int d = lid; d < head_dim; d += ATTN_DECODE_WG_SIZE) {
+            float acc = o_acc[d] * correction;
+            int v_offset = mad24(tile, kv_pos_stride, kv_base + d);
+            for (int j = 0; j < tile_len; ++j) {
+                const float v = V8 ? (float)V8[v_offset] : (float)V_cache[v_offset];
+                acc = fma(probs[j], v, acc);
+                v_offset += kv_pos_stride;
+            }
+            o_acc[d] = acc;
         }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
 
-        output[q_offset + d] = (half)acc;
+    // Unnormalized partial result of this split (empty split: m = ATTN_MASKED, l = 0)
+    __global float* out = partials + mul24(mad24(head, num_splits, split), head_dim + 2);
+    for (int d = lid; d < head_dim; d += ATTN_DECODE_WG_SIZE) {
+        out[d] = o_acc[d];
+    }
+    if (lid == 0) {
+        out[head_dim] = m_run;
+        out[head_dim + 1] = l_run;
     }
 }
 
-/* ============================================================================
- * Decode Attention: single query token against KV-cache
- *
- * During autoregressive decode, we generate one token at a time. The query
- * is a single vector Q[1, num_heads, head_dim] that attends to the entire
- * KV-cache K_cache[cache_len, num_heads, head_dim].
+__kernel void attention_decode(
+    __global const half* restrict Q,         // [1, num_heads, head_dim]
+    __global const half* restrict K_cache,   // >= cache_len positions
+    __global const half* restrict V_cache,   // >= cache_len positions
+    __global float* restrict partials,       // [num_heads, num_splits, head_dim + 2]
+    const int cache_len,
+    const int num_heads,
+    const int head_dim_arg,
+    const int kv_pos_stride,
+    const int kv_head_stride)
+{
+    __local float q_local[ATTN_MAX_HEAD_DIM];
+    __local float o_acc[ATTN_MAX_HEAD_DIM];
+    __local float probs[ATTN_DECODE_WG_SIZE];
+    __local float red[ATTN_DECODE_WG_SIZE];
+    attention_decode_impl(Q, K_cache, V_cache, NULL, NULL, NULL, NULL, partials,
+                          cache_len, num_heads, head_dim_arg, kv_pos_stride, kv_head_stride,
+                          q_local, o_acc, probs, red);
+}
+
+/*
+ * Int8 cache variant: K rows are read as char8 (half the bytes of fp16)
+ * and the per-block scales applied once per position. Same split layout,
+ * same partials, same reduce.
  *
- * This is memory-bound: we read the entire KV-cache for each token.
- * Strategy: each workgroup handles one attention head. Work-items cooperatively
- * compute dot products with all cache positions, reduce for softmax, then
- * compute the weighted V sum.
+ * Dispatch: as attention_decode
+ */
+__kernel void attention_decode_q8(
+    __global const half* restrict Q,         // [1, num_heads, head_dim]
+    __global const char* restrict K_cache,   // int8, >= cache_len positions
+    __global const char* restrict V_cache,   // int8, >= cache_len positions
+    __global float* restrict partials,       // [num_heads, num_splits, head_dim + 2]
+    const int cache_len,
+    const int num_heads,
+    const int head_dim_arg,
+    const int kv_pos_stride,
+    const int kv_head_stride,
+    __global const half* restrict k_scales,  // [capacity / KV_Q8_BLOCK, num_heads]
+    __global const half* restrict v_scales)  // [capacity / KV_Q8_BLOCK, num_heads]
+{
+    __local float q_local[ATTN_MAX_HEAD_DIM];
+    __local float o_acc[ATTN_MAX_HEAD_DIM];
+    __local float probs[ATTN_DECODE_WG_SIZE];
+    __local float red[ATTN_DECODE_WG_SIZE];
+    attention_decode_impl(Q, NULL, NULL, K_cache, V_cache, k_scales, v_scales, partials,
+                          cache_len, num_heads, head_dim_arg, kv_pos_stride, kv_head_stride,
+                          q_local, o_acc, probs, red);
+}
+
+/*
+ * Texture-path variant (experimental): K/V caches are read through
+ * image1d_buffer views (RGBA half texels) of the same cache buffers, with
+ * read_imageh instead of buffer loads. Same split layout, same partials,
+ * same reduce. Requires head_dim % 4 == 0; strides stay in halves.
  *
- * Dispatch:
- *   global_work_size  = { num_heads * ATTN_WG_SIZE }
- *   local_work_size   = { ATTN_WG_SIZE }
- * ========================================================================= */
-__kernel void attention_decode(
+ * Dispatch: as attention_decode
+ */
+__kernel void attention_decode_image(
     __global const half* restrict Q,         // [1, num_heads, head_dim]
-    __global const half* restrict K_cache,   // [cache_len, num_heads, head_dim]
-    __global const half* restrict V_cache,   // [cache_len, num_heads, head_dim]
-    __global half* restrict output,          // [1, num_heads, head_dim]
+    __read_only image1d_buffer_t K_cache,    // texel view, >= cache_len positions
+    __read_only image1d_buffer_t V_cache,    // texel view, >= cache_len positions
+    __global float* restrict partials,       // [num_heads, num_splits, head_dim + 2]
     const int cache_len,
     const int num_heads,
-    const int head_dim)
+    const int head_dim_arg,
+    const int kv_pos_stride,
+    const int kv_head_stride)
 {
+    const int head_dim = ATTN_HEAD_DIM(head_dim_arg);
+    const int head_dim4 = head_dim >> 2;
     const int lid = get_local_id(0);
     const int head = get_group_id(0);
+    const int split = get_group_id(1);
+    const int num_splits = get_num_groups(1);
 
     if (head >= num_heads) return;
 
-    const int head_stride = mul24(num_heads, head_dim);
     const int q_offset = mul24(head, head_dim);
-
-    // Load Q vector for this head into registers (small, reused many times)
-    // head_dim is typically 64 or 128 — fits in register file
+    const int kv_base4 = mul24(head, kv_head_stride) >> 2;
+    const int pos_stride4 = kv_pos_stride >> 2;
     const float scale = native_rsqrt((float)head_dim);
 
-    // --- Pass 1: Compute scores and find max ---
-    __local float scratch[ATTN_WG_SIZE];
-    float local_max = -INFINITY;
+    const int chunk = (cache_len + num_splits - 1) / num_splits;
+    const int start = mul24(split, chunk);
+    const int end = min(start + chunk, cache_len);
 
-    for (int pos = lid; pos < cache_len; pos += ATTN_WG_SIZE) {
-        const int k_offset = mad24(pos, head_stride, q_offset);
-
-        float dot = 0.0f;
-        for (int d = 0; d < head_dim; ++d) {
-            dot = fma((float)Q[q_offset + d], (float)K_cache[k_offset + d], dot);
-        }
+    __local float q_local[ATTN_MAX_HEAD_DIM];
+    __local float o_acc[ATTN_MAX_HEAD_DIM];
+    __local float probs[ATTN_DECODE_WG_SIZE];
+    __local float red[ATTN_DECODE_WG_SIZE];
 
-        local_max = fmax(local_max, dot * scale);
+    for (int d = lid; d < head_dim; d += ATTN_DECODE_WG_SIZE) {
+        q_local[d] = (float)Q[q_offset + d] * scale;
+        o_acc[d] = 0.0f;
     }
-
-    scratch[lid] = local_max;
     barrier(CLK_LOCAL_MEM_FENCE);
 
-    for (int stride = ATTN_WG_SIZE >> 1; stride > 0; stride >>= 1) {
-        if (lid < stride) {
-            scratch[lid] = fmax(scratch[lid], scratch[lid + stride]);
+    float m_run = ATTN_MASKED;
+    float l_run = 0.0f;
+
+    for (int tile = start; tile < end; tile += ATTN_DECODE_WG_SIZE) {
+        const int pos = tile + lid;
+        float score = ATTN_MASKED;
+        if (pos < end) {
+            const int k_texel = mad24(pos, pos_stride4, kv_base4);
+            float4 acc4 = (float4)(0.0f);
+            ATTN_UNROLL
+            for (int d4 = 0; d4 < head_dim4; ++d4) {
+                acc4 = fma(vload4(d4, q_local),
+                           convert_float4(read_imageh(K_cache, k_texel + d4)), acc4);
+            }
+            score = (acc4.x + acc4.y) + (acc4.z + acc4.w);
         }
-        barrier(CLK_LOCAL_MEM_FENCE);
-    }
-
-    const float row_max = scratch[0];
-    barrier(CLK_LOCAL_MEM_FENCE);
 
-    // --- Pass 2: Compute exp(score - max) and sum ---
-    float local_sum = 0.0f;
-
-    for (int pos = lid; pos < cache_len; pos += ATTN_WG_SIZE) {
-        const int k_offset = mad24(pos, head_stride, q_offset);
-
-        float dot = 0.0f;
-        for (int d = 0; d < head_dim; ++d) {
-            dot = fma((float)Q[q_offset + d], (float)K_cache[k_offset + d], dot);
+        const float m_new = fmax(m_run, wg_reduce_max(red, score));
+        const float p = (pos < end) ? native_exp(score - m_new) : 0.0f;
+        probs[lid] = p;
+        const float correction = (tile == start) ? 0.0f : native_exp(m_run - m_new);
+        l_run = fma(l_run, correction, wg_reduce_sum(red, p));
+        m_run = m_new;
+
+        // Work-items own output texels (4 dimensions each)
+        const int tile_len = min(ATTN_DECODE_WG_SIZE, end - tile);
+        for (int d4 = lid; d4 < head_dim4; d4 += ATTN_DECODE_WG_SIZE) {
+            float4 acc = vload4(d4, o_acc) * correction;
+            int v_texel = mad24(tile, pos_stride4, kv_base4 + d4);
+            for (int j = 0; j < tile_len; ++j) {
+                acc = fma((float4)(probs[j]), convert_float4(read_imageh(V_cache, v_texel)), acc);
+                v_texel += pos_stride4;
+            }
+            vstore4(acc, d4, o_acc);
         }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
 
-        local_sum += native_exp(dot * scale - row_max);
+    __global float* out = partials + mul24(mad24(head, num_splits, split), head_dim + 2);
+    for (int d = lid; d < head_dim; d += ATTN_DECODE_WG_SIZE) {
+        out[d] = o_acc[d];
     }
+    if (lid == 0) {
+        out[head_dim] = m_run;
+        out[head_dim + 1] = l_run;
+    }
+}
 
-    scratch[lid] = local_sum;
-    barrier(CLK_LOCAL_MEM_FENCE);
+/*
+ * Split-K reduction: combine the per-split (o, m, l) of each head.
+ *
+ * Dispatch: global_work_size = { num_heads * head_dim } (rounded up)
+ */
+__kernel void attention_decode_reduce(
+    __global const float* restrict partials,  // [num_heads, num_splits, head_dim + 2]
+    __global half* restrict output,           // [1, num_heads, head_dim]
+    const int num_splits,
+    const int num_heads,
+    const int head_dim_arg)
+{
+    const int head_dim = ATTN_HEAD_DIM(head_dim_arg);
+    const int gid = get_global_id(0);
+    if (gid >= mul24(num_heads, head_dim)) return;
+
+    const int head = gid / head_dim;
+    const int d = gid - mul24(head, head_dim);
+    const int stride = head_dim + 2;
+    __global const float* p = partials + mul24(mul24(head, num_splits), stride);
+
+    float m_max = ATTN_MASKED;
+    for (int s = 0; s < num_splits; ++s) {
+        m_max = fmax(m_max, p[mad24(s, stride, head_dim)]);
+    }
 
-    for (int stride = ATTN_WG_SIZE >> 1; stride > 0; stride >>= 1) {
-        if (lid < stride) {
-            scratch[lid] += scratch[lid + stride];
-        }
-        barrier(CLK_LOCAL_MEM_FENCE);
+    float sum = 0.0f;
+    float acc = 0.0f;
+    for (int s = 0; s < num_splits; ++s) {
+        // Empty splits (l == 0) carry m = ATTN_MASKED; skip them without exp
+        const float l = p[mad24(s, stride, head_dim + 1)];
+        const float w = (l > 0.0f) ? native_exp(p[mad24(s, stride, head_dim)] - m_max) : 0.0f;
+        sum = fma(l, w, sum);
+        acc = fma(p[mad24(s, stride, d)], w, acc);
     }
 
-    const float inv_sum = native_recip(scratch[0]);
-    barrier(CLK_LOCAL_MEM_FENCE);
+    output[gid] = (half)(sum > 0.0f ? acc / sum : 0.0f);
+}
 
-    // --- Pass 3: Weighted sum of V ---
-    // Each work-item handles a subset of head_dim output dimensions
-    for (int d = lid; d < head_dim; d += ATTN_WG_SIZE) {
-        float acc = 0.0f;
+/* ============================================================================
+ * KV-Cache Store: write new K/V rows into the cache at position `pos`
+ *
+ * Replaces a pair of clEnqueueCopyBuffer calls with one kernel so the write
+ * offset is an ordinary kernel argument. A captured decode graph can then
+ * patch it per token (copy commands cannot be recorded or patched).
+ *
+ * Only the unfused projection path needs it: qkv_gemv / qkv_gemm write K/V
+ * straight into the cache from their epilogue.
+ *
+ * Dispatch: global_work_size = ceil(seq_len * row_elems / 4)
+ *
+ * Layout: new rows [seq_len, row_elems], row_elems = num_heads * head_dim;
+ *         cache by (kv_pos_stride, kv_head_stride)
+ * ========================================================================= */
 
-        for (int pos = 0; pos < cache_len; ++pos) {
-            const int k_offset = mad24(pos, head_stride, q_offset);
+// Cache offset of element i of the new rows (row r at position pos + r)
+inline int kv_store_offset(const int i, const int row_elems, const int head_dim,
+                           const int pos, const int kv_pos_stride, const int kv_head_stride)
+{
+    const int r = i / row_elems;
+    const int col = i - mul24(r, row_elems);
+    const int head = col / head_dim;
+    const int d = col - mul24(head, head_dim);
+    return mad24(pos + r, kv_pos_stride, mad24(head, kv_head_stride, d));
+}
 
-            // Recompute attention weight for this position
-            float dot = 0.0f;
-            for (int dd = 0; dd < head_dim; ++dd) {
-                dot = fma((float)Q[q_offset + dd], (float)K_cache[k_offset + dd], dot);
-            }
+__kernel void kv_cache_store(
+    __global const half* restrict new_k,     // [seq_len, row_elems]
+    __global const half* restrict new_v,     // [seq_len, row_elems]
+    __global half* restrict k_cache,         // cache, >= pos + seq_len positions
+    __global half* restrict v_cache,         // cache, >= pos + seq_len positions
+    const int row_elems,
+    const int seq_len,
+    const int pos,
+    const int head_dim,
+    const int kv_pos_stride,
+    const int kv_head_stride)
+{
+    const int idx = get_global_id(0) << 2;
+    const int n = mul24(seq_len, row_elems);
+
+    if (idx >= n) return;
+
+    const int dst = kv_store_offset(idx, row_elems, head_dim, pos,
+                                    kv_pos_stride, kv_head_stride);
+    const int d = (idx % row_elems) % head_dim;
+
+    // 4 elements of one head row: contiguous in the cache too
+    if (idx + 4 <= n && d + 4 <= head_dim) {
+        vstore_half4(vload_half4(0, new_k + idx), 0, k_cache + dst);
+        vstore_half4(vload_half4(0, new_v + idx), 0, v_cache + dst);
+    } else {
+        for (int i = idx; i < min(idx + 4, n); ++i) {
+            const int o = kv_store_offset(i, row_elems, head_dim, pos,
+                                          kv_pos_stride, kv_head_stride);
+            k_cache[o] = new_k[i];
+            v_cache[o] = new_v[i];
+        }
+    }
+}
 
-            const float weight = native_exp(dot * scale - row_max) * inv_sum;
+/* ============================================================================
+ * Int8 KV-Cache Store: quantize seq_len new K/V rows into an int8 cache
+ *
+ * One workgroup per (block of KV_Q8_BLOCK positions the new rows touch,
+ * head). A block's scale is absmax / 127 over every row written to it so
+ * far: decode appends one row at a time, so when a new row raises the
+ * block's absmax, the rows already in the block are requantized to the new
+ * scale before the new rows are written. Scales are rounded to fp16 before
+ * use so writes and reads agree.
+ *
+ * Dispatch:
+ *   global_work_size  = { num_blocks * ATTN_DECODE_WG_SIZE, num_heads },
+ *     num_blocks = (pos + seq_len - 1) / KV_Q8_BLOCK - pos / KV_Q8_BLOCK + 1
+ *   local_work_size   = { ATTN_DECODE_WG_SIZE, 1 }
+ *
+ * Layout: new rows [seq_len, row_elems]; cache by (kv_pos_stride,
+ *         kv_head_stride), scales [capacity / KV_Q8_BLOCK, num_heads]
+ * ========================================================================= */
 
-            const int v_offset = mad24(pos, head_stride, q_offset);
-            acc = fma(weight, (float)V_cache[v_offset + d], acc);
+// Append the new rows of one head to one block of one cache (K or V)
+inline void kv_store_q8_block(__global const half* restrict src,
+                              __global char* restrict cache,
+                              __global half* restrict scales,
+                              const int row_elems, const int seq_len, const int pos,
+                              const int head_dim, const int kv_pos_stride,
+                              const int kv_head_stride, const int head, const int block,
+                              __local float* red)
+{
+    const int lid = get_local_id(0);
+    const int num_heads = row_elems / head_dim;
+    const int b0 = mul24(block, KV_Q8_BLOCK);
+    const int n0 = max(pos, b0);                             // first new row
+    const int n1 = min(pos + seq_len, b0 + KV_Q8_BLOCK);    // end of new rows
+    const int si = mad24(block, num_heads, head);
+    const int cache_base = mul24(head, kv_head_stride);
+
+    // Read before the reduction's barriers: work-item 0 rewrites it below
+    const float old_scale = (n0 > b0) ? vload_half(si, scales) : 0.0f;
+
+    float amax = 0.0f;
+    const int new_elems = mul24(n1 - n0, head_dim);
+    for (int i = lid; i < new_elems; i += ATTN_DECODE_WG_SIZE) {
+        const int r = i / head_dim;
+        const int d = i - mul24(r, head_dim);
+        amax = fmax(amax, fabs(vload_half(mad24(n0 - pos + r, row_elems,
+                                                mad24(head, head_dim, d)), src)));
+    }
+    amax = wg_reduce_max(red, amax);
+    const float scale = fmax(old_scale, (float)(half)(amax * (1.0f / 127.0f)));
+
+    // Earlier rows of the block move to the larger scale
+    if (scale > old_scale && old_scale > 0.0f) {
+        const float ratio = old_scale / scale;
+        const int old_elems = mul24(n0 - b0, head_dim);
+        for (int i = lid; i < old_elems; i += ATTN_DECODE_WG_SIZE) {
+            const int r = i / head_dim;
+            const int d = i - mul24(r, head_dim);
+            const int o = mad24(b0 + r, kv_pos_stride, cache_base + d);
+            cache[o] = convert_char_sat_rte((float)cache[o] * ratio);
         }
+    }
 
-        output[q_offset + d] = (half)acc;
+    const float inv_scale = (scale > 0.0f) ? 1.0f / scale : 0.0f;
+    for (int i = lid; i < new_elems; i += ATTN_DECODE_WG_SIZE) {
+        const int r = i / head_dim;
+        const int d = i - mul24(r, head_dim);
+        const float v = vload_half(mad24(n0 - pos + r, row_elems, mad24(head, head_dim, d)), src);
+        cache[mad24(n0 + r, kv_pos_stride, cache_base + d)] = convert_char_sat_rte(v * inv_scale);
     }
+
+    if (lid == 0) vstore_half(scale, si, scales);
+}
+
+__kernel void kv_cache_store_q8(
+    __global const half* restrict new_k,     // [seq_len, row_elems]
+    __global const half* restrict new_v,     // [seq_len, row_elems]
+    __global char* restrict k_cache,         // int8 cache, >= pos + seq_len positions
+    __global char* restrict v_cache,         // int8 cache, >= pos + seq_len positions
+    const int row_elems,
+    const int seq_len,
+    const int pos,
+    const int head_dim,
+    const int kv_pos_stride,
+    const int kv_head_stride,
+    __global half* restrict k_scales,        // [capacity / KV_Q8_BLOCK, num_heads]
+    __global half* restrict v_scales)        // [capacity / KV_Q8_BLOCK, num_heads]
+{
+    __local float red[ATTN_DECODE_WG_SIZE];
+    const int block = pos / KV_Q8_BLOCK + (int)get_group_id(0);
+    const int head = get_group_id(1);
+
+    kv_store_q8_block(new_k, k_cache, k_scales, row_elems, seq_len, pos, head_dim,
+                      kv_pos_stride, kv_head_stride, head, block, red);
+    kv_store_q8_block(new_v, v_cache, v_scales, row_elems, seq_len, pos, head_dim,
+                      kv_pos_stride, kv_head_stride, head, block, red);
 }
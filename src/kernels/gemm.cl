@@ -6,7 +6,21 @@
  *   v1: Naive GEMM — correctness baseline
  *   v2: Tiled GEMM — workgroup-level tiling with local memory
  *   v3: Image-based GEMM — weights in 2D image for TP/L1 cache hits
+ *   v3b: Register-blocked image GEMM — 4 rows x 8 cols per work-item (prefill)
  *   v4: GEMV — optimized for M=1 single-token decode (memory-bound)
+ *   v4b: Skinny GEMM — M = 2..16, each weight texel read once for all rows
+ *   v5: Fused QKV — Q/K/V projections from one concatenated weight image
+ *   v6: Fused gate/up — SwiGLU MLP input projections with SiLU epilogue
+ *   v7: Quantized GEMV / GEMM — GGUF Q4_0 / Q8_0 / Q4_K / Q5_K / Q6_K blocks
+ *       dequantized in registers
+ *   v8: W8A8 GEMV / GEMM — int8 weights x int8 activations, integer dot
+ *       products (cl_khr_integer_dot_product when available)
+ *
+ * The decode-side kernels (v4, v4b, v5, v6) take an optional RMSNorm
+ * prologue: given norm_weight they read the raw residual stream and
+ * normalize it on the fly, so no rms_norm output is written and re-read.
+ * The image GEMM family (v3, v3b, v4, v4b) shares a build-time output
+ * epilogue: bias, SiLU/GELU and residual accumulate (GEMM_EPI_* defines).
  *
  * Adreno optimization conventions used throughout:
  *   - int/uint indexing instead of size_t (saves 2 regs per variable, §8.7)
@@ -154,13 +168,72 @@ __constant sampler_t weight_sampler =
     CLK_ADDRESS_CLAMP_TO_EDGE |     // Clamp OOB reads
     CLK_FILTER_NEAREST;             // No interpolation — exact texel fetch
 
+/* ============================================================================
+ * Output epilogue of the image GEMM family (v3, v3b, v4, v4b)
+ *
+ * Chosen at build time; the host builds one variant of this file per
+ * combination in use (GemmEpilogue in compute.h):
+ *   -DGEMM_EPI_BIAS         + bias[col]  (kernel arg `bias`, [N])
+ *   -DGEMM_EPI_ACT=1 | 2    then SiLU | GELU (tanh approximation)
+ *   -DGEMM_EPI_RESIDUAL     C += result instead of C = result
+ * By default the store is C = acc and `bias` is never read (may be NULL).
+ * With GEMM_EPI_RESIDUAL, C must not alias A.
+ * ========================================================================= */
+
+#define GEMM_ACT_NONE 0
+#define GEMM_ACT_SILU 1
+#define GEMM_ACT_GELU 2
+#ifndef GEMM_EPI_ACT
+#define GEMM_EPI_ACT GEMM_ACT_NONE
+#endif
+
+// Store 4 consecutive outputs of row `row` through the epilogue, clipped at N
+inline void store4_epilogue(float4 v, __global const half* restrict bias,
+                            __global half* restrict C,
+                            const int row, const int col, const int N)
+{
+    const int remaining = N - col;
+    __global half* dst = C + mad24(row, N, col);
+
+#ifdef GEMM_EPI_BIAS
+    if (remaining >= 4) {
+        v += vload_half4(0, bias + col);
+    } else {
+        for (int i = 0; i < remaining; ++i) v[i] += vload_half(col + i, bias);
+    }
+#endif
+#if GEMM_EPI_ACT == GEMM_ACT_SILU
+    v = v * native_recip(1.0f + native_exp(-v));
+#elif GEMM_EPI_ACT == GEMM_ACT_GELU
+    // 0.5 * v * (1 + tanh(u)) = v * sigmoid(2u), u = sqrt(2/pi) * (v + 0.044715 v^3)
+    const float4 u = 0.7978845608f * fma((float4)(0.044715f), v * v * v, v);
+    v = v * native_recip(1.0f + native_exp(-2.0f * u));
+#endif
+
+    if (remaining >= 4) {
+#ifdef GEMM_EPI_RESIDUAL
+        v += vload_half4(0, dst);
+#endif
+        vstore_half4(v, 0, dst);
+    } else {
+        for (int i = 0; i < remaining; ++i) {
+            float e = v[i];
+#ifdef GEMM_EPI_RESIDUAL
+            e += vload_half(i, dst);
+#endif
+            vstore_half(e, i, dst);
+        }
+    }
+}
+
 __kernel void gemm_image(
     __global const half* restrict A,   // [M, K] activations (buffer)
     __read_only image2d_t B_img,       // [K, N] weights as image (N/4 wide, K tall)
     __global half* restrict C,         // [M, N] output
     const int M,
     const int N,
-    const int K)
+    const int K,
+    __global const half* restrict bias) // [N] epilogue bias (GEMM_EPI_BIAS)
 {
     const int row = get_global_id(0);  // output row
     const int col4 = get_global_id(1); // output column / 4 (each WI computes 4 cols)
@@ -186,16 +259,118 @@ __kernel void gemm_image(
     }
 
     // Write 4 output elements (or fewer at the boundary)
-    const int out_offset = mad24(row, N, col_base);
-    const int remaining = N - col_base;
+    store4_epilogue(acc, bias, C, row, col_base, N);
+}
 
-    if (remaining >= 4) {
-        vstore_half4(acc, 0, C + out_offset);
-    } else {
-        // Edge case: fewer than 4 columns remaining
-        for (int i = 0; i < remaining; ++i) {
-            vstore_half(acc[i], 0, C + out_offset + i);
+/* ============================================================================
+ * v3b: Register-blocked image GEMM — C[M,N] = A[M,K] * B_img[K,N], M > 1
+ *
+ * gemm_image fetches one B texel per k per output row and reads A as
+ * scalars from global memory. Here each work-item computes GIB_ROWS rows x
+ * 8 columns (two texels), so every B texel feeds GIB_ROWS FMAs and every A
+ * value feeds 8. A tiles [GIB_TILE_M, GIB_TILE_K] are staged in local memory
+ * with one vload8 per work-item, and shared by the GIB_WG_N column groups.
+ *
+ * Workgroup tile: GIB_TILE_M = 32 rows x 128 columns.
+ *
+ * Dispatch:
+ *   global_work_size  = { round_up(ceil(N / 8), GIB_WG_N),
+ *                         ceil(M / GIB_TILE_M) * GIB_WG_M }
+ *   local_work_size   = { GIB_WG_N, GIB_WG_M }
+ * ========================================================================= */
+
+#ifndef GIB_ROWS
+#define GIB_ROWS 4
+#endif
+#define GIB_WG_N 16
+#define GIB_WG_M 8
+#define GIB_TILE_K 32
+#define GIB_TILE_M (GIB_WG_M * GIB_ROWS)
+
+// One half8 of the A tile per work-item: GIB_TILE_M * GIB_TILE_K / 8 must
+// equal GIB_WG_N * GIB_WG_M
+#if GIB_TILE_M * GIB_TILE_K != 8 * GIB_WG_N * GIB_WG_M
+#error "gemm_image_blocked: A tile does not match the workgroup size"
+#endif
+
+// Accumulate this work-item's GIB_ROWS x 8 block over all of K: acc0 / acc1
+// hold texel columns col4 / col4 + 1 of rows ly * GIB_ROWS + r of the tile.
+// a_tile is the workgroup's [GIB_TILE_M][GIB_TILE_K] local staging buffer.
+// Shared by gemm_image_blocked and the fused prefill kernels (v5, v6).
+inline void gib_accumulate(__global const half* restrict A, __read_only image2d_t B_img,
+                           const int M, const int K, const int col4, const int tile_row,
+                           __local half (*a_tile)[GIB_TILE_K],
+                           float4* acc0, float4* acc1)
+{
+    const int ly = get_local_id(1);
+    const int lid = mad24(ly, GIB_WG_N, (int)get_local_id(0));
+
+    for (int r = 0; r < GIB_ROWS; ++r) {
+        acc0[r] = (float4)(0.0f);
+        acc1[r] = (float4)(0.0f);
+    }
+
+    // This work-item's half8 of the A tile
+    const int ar = lid >> 2;
+    const int ak = (lid & 3) << 3;
+    const int a_row = tile_row + ar;
+
+    for (int k0 = 0; k0 < K; k0 += GIB_TILE_K) {
+        const int gk = k0 + ak;
+        if (a_row < M && gk + 8 <= K) {
+            vstore8(vload8(0, A + mad24(a_row, K, gk)), 0, &a_tile[ar][ak]);
+        } else {
+            // Ragged edge: zero-fill so the k loop below needs no bounds
+            for (int i = 0; i < 8; ++i)
+                a_tile[ar][ak + i] = (a_row < M && gk + i < K)
+                                   ? A[mad24(a_row, K, gk + i)] : (half)0.0h;
         }
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        // k past K reads a clamped texel, multiplied by the zero-filled A
+        #pragma unroll 8
+        for (int kk = 0; kk < GIB_TILE_K; ++kk) {
+            const float4 b0 = convert_float4(read_imageh(B_img, weight_sampler,
+                                                         (int2)(col4, k0 + kk)));
+            const float4 b1 = convert_float4(read_imageh(B_img, weight_sampler,
+                                                         (int2)(col4 + 1, k0 + kk)));
+            for (int r = 0; r < GIB_ROWS; ++r) {
+                const float a = (float)a_tile[mad24(ly, GIB_ROWS, r)][kk];
+                acc0[r] = fma((float4)(a), b0, acc0[r]);
+                acc1[r] = fma((float4)(a), b1, acc1[r]);
+            }
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+}
+
+__kernel __attribute__((reqd_work_group_size(GIB_WG_N, GIB_WG_M, 1)))
+void gemm_image_blocked(
+    __global const half* restrict A,   // [M, K] activations (buffer)
+    __read_only image2d_t B_img,       // [K, N] weights as image (N/4 wide, K tall)
+    __global half* restrict C,         // [M, N] output
+    const int M,
+    const int N,
+    const int K,
+    __global const half* restrict bias) // [N] epilogue bias (GEMM_EPI_BIAS)
+{
+    const int col4 = get_global_id(0) << 1;              // first of two texels
+    const int tile_row = mul24((int)get_group_id(1), GIB_TILE_M);
+    const int row = mad24((int)get_local_id(1), GIB_ROWS, tile_row);
+
+    __local half a_tile[GIB_TILE_M][GIB_TILE_K];
+
+    float4 acc0[GIB_ROWS];
+    float4 acc1[GIB_ROWS];
+    gib_accumulate(A, B_img, M, K, col4, tile_row, a_tile, acc0, acc1);
+
+    const int col = col4 << 2;
+    if (col >= N) return;
+
+    for (int r = 0; r < GIB_ROWS; ++r) {
+        if (row + r >= M) break;
+        store4_epilogue(acc0[r], bias, C, row + r, col, N);
+        if (col + 4 < N) store4_epilogue(acc1[r], bias, C, row + r, col + 4, N);
     }
 }
 
@@ -204,67 +379,1400 @@ __kernel void gemm_image(
  *
  * y[1, N] = x[1, K] * W[K, N]
  *
- * This is memory-bound (bandwidth-limited), not compute-bound.
- * Strategy: each workgroup computes one output element. Work-items within
- * the group cooperatively load chunks of the K dimension, do partial
- * dot products, then reduce via local memory.
+ * This is memory-bound (bandwidth-limited), not compute-bound. Every weight
+ * byte is read exactly once, so the kernel is organized around keeping as
+ * many texel fetches in flight as possible with little else in the way:
+ *   - A workgroup owns GEMV_COLS4 adjacent image columns (4*GEMV_COLS4
+ *     outputs), not one, so per-output reduction overhead is amortized.
+ *   - Each work-item walks 8 consecutive k per step: one half8 activation
+ *     load (vload_half8), then an 8 x GEMV_COLS4 block of texels — a
+ *     compact 2D footprint for the texture cache.
+ *   - Partial sums are reduced with sub_group_reduce_add when built with
+ *     -DMGPU_SUBGROUPS (one local-memory step across subgroups), else with a
+ *     local-memory tree that reduces all columns per barrier.
+ * gemv_accumulate / gemv_reduce_cols hold that structure; the fused decode
+ * kernels (v5, v6) use them too.
  *
  * Weights stored as image for TP/L1 cache bandwidth.
+ *
+ * With norm_weight non-NULL, x is the raw hidden state and the kernel
+ * computes y = rmsnorm(x) * W (row_inv_rms prologue, scaling on load).
+ *
+ * Dispatch:
+ *   global_work_size  = { ceil(N / (4 * GEMV_COLS4)) * GEMV_BLOCK_WG_SIZE }
+ *   local_work_size   = { GEMV_BLOCK_WG_SIZE }
  * ========================================================================= */
 
 #ifndef GEMV_WG_SIZE
-#define GEMV_WG_SIZE 256
+#define GEMV_WG_SIZE 128          // fused decode kernels (v5, v6)
+#endif
+#ifndef GEMV_FUSED_COLS4
+#define GEMV_FUSED_COLS4 4        // v5: texel columns, v6: output groups per workgroup
+#endif
+#ifndef GEMV_BLOCK_WG_SIZE
+#define GEMV_BLOCK_WG_SIZE 128
 #endif
+#ifndef GEMV_COLS4
+#define GEMV_COLS4 4
+#endif
+
+#if defined(MGPU_SUBGROUPS) && defined(cl_khr_subgroups)
+#pragma OPENCL EXTENSION cl_khr_subgroups : enable
+#define GEMV_USE_SUBGROUPS 1
+// Per-column partial sums in gemv_reduce_cols: one per subgroup (subgroups
+// have at least 4 lanes on every target we build for)
+#define GEMV_RED_STRIDE(wg_size) ((wg_size) / 4)
+#else
+#define GEMV_RED_STRIDE(wg_size) (wg_size)
+#endif
+
+// RMSNorm prologue: 1 / rms(x[0:K]) computed cooperatively by the whole
+// workgroup (red holds wg_size floats). Every work-item gets the result.
+// x is a single row, so the extra read per workgroup comes from cache.
+inline float row_inv_rms(__global const half* restrict x, const int K, const float eps,
+                         __local float* red, const int lid, const int wg_size)
+{
+    float sum_sq = 0.0f;
+    for (int k = lid; k < K; k += wg_size) {
+        const float v = vload_half(k, x);
+        sum_sq = fma(v, v, sum_sq);
+    }
+    red[lid] = sum_sq;
+    barrier(CLK_LOCAL_MEM_FENCE);
 
-__kernel void gemv(
+    for (int stride = wg_size >> 1; stride > 0; stride >>= 1) {
+        if (lid < stride) red[lid] += red[lid + stride];
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    const float inv_rms = native_rsqrt(red[0] / (float)K + eps);
+    barrier(CLK_LOCAL_MEM_FENCE);  // red may be reused by the caller
+    return inv_rms;
+}
+
+// acc[c] = x[0:K] * W[0:K, col4_base + c] for the n texel columns of a
+// workgroup (this work-item's share). Work-items are interleaved by 8-row
+// blocks: one half8 activation load, then an 8 x n block of texels. With
+// norm_weight, x is scaled on load (RMSNorm prologue, see row_inv_rms).
+inline void gemv_accumulate(__global const half* restrict x, __read_only image2d_t W_img,
+                            const int col4_base, const int n, const int K,
+                            __global const half* restrict norm_weight, const float inv_rms,
+                            float4* acc, const int lid, const int wg_size)
+{
+    for (int c = 0; c < n; ++c) acc[c] = (float4)(0.0f);
+
+    const int K8 = K & ~7;
+    for (int k = lid << 3; k < K8; k += wg_size << 3) {
+        float8 xv = vload_half8(0, x + k);
+        if (norm_weight) xv *= vload_half8(0, norm_weight + k) * inv_rms;
+        const float xs[8] = { xv.s0, xv.s1, xv.s2, xv.s3, xv.s4, xv.s5, xv.s6, xv.s7 };
+        for (int i = 0; i < 8; ++i) {
+            for (int c = 0; c < n; ++c) {
+                const half4 w = read_imageh(W_img, weight_sampler, (int2)(col4_base + c, k + i));
+                acc[c] = fma((float4)(xs[i]), convert_float4(w), acc[c]);
+            }
+        }
+    }
+    // K % 8 tail
+    for (int k = K8 + lid; k < K; k += wg_size) {
+        float xk = vload_half(k, x);
+        if (norm_weight) xk *= vload_half(k, norm_weight) * inv_rms;
+        for (int c = 0; c < n; ++c) {
+            const half4 w = read_imageh(W_img, weight_sampler, (int2)(col4_base + c, k));
+            acc[c] = fma((float4)(xk), convert_float4(w), acc[c]);
+        }
+    }
+}
+
+// Sum acc[0:n] over the workgroup. Afterwards sums[c * stride] holds the
+// total of column c, visible to every work-item. sums has n * stride
+// float4, stride = GEMV_RED_STRIDE(wg_size); requires n <= wg_size.
+inline void gemv_reduce_cols(const float4* acc, const int n, __local float4* sums,
+                             const int stride, const int lid, const int wg_size)
+{
+#ifdef GEMV_USE_SUBGROUPS
+    // Reduce within each subgroup, then across the (few) subgroups
+    const int sg = get_sub_group_id();
+    const int num_sg = get_num_sub_groups();
+    for (int c = 0; c < n; ++c) {
+        const float4 v = (float4)(sub_group_reduce_add(acc[c].x), sub_group_reduce_add(acc[c].y),
+                                  sub_group_reduce_add(acc[c].z), sub_group_reduce_add(acc[c].w));
+        if (get_sub_group_local_id() == 0) sums[mad24(c, stride, sg)] = v;
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // Work-item c owns row c of sums
+    if (lid < n) {
+        float4 total = sums[mul24(lid, stride)];
+        for (int s = 1; s < num_sg; ++s) total += sums[mad24(lid, stride, s)];
+        sums[mul24(lid, stride)] = total;
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+#else
+    // Tree reduction of all n columns at once: log2(wg_size) barriers
+    for (int c = 0; c < n; ++c) sums[mad24(c, stride, lid)] = acc[c];
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (int half_wg = wg_size >> 1; half_wg > 0; half_wg >>= 1) {
+        if (lid < half_wg) {
+            for (int c = 0; c < n; ++c)
+                sums[mad24(c, stride, lid)] += sums[mad24(c, stride, lid + half_wg)];
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+#endif
+}
+
+__kernel __attribute__((reqd_work_group_size(GEMV_BLOCK_WG_SIZE, 1, 1)))
+void gemv(
     __global const half* restrict x,     // [1, K] input vector
     __read_only image2d_t W_img,         // [K, N] weights as image (N/4 wide, K tall)
     __global half* restrict y,           // [1, N] output vector
     const int N,
-    const int K)
+    const int K,
+    __global const half* restrict norm_weight,  // [K] RMSNorm prologue, or NULL
+    const float norm_eps,
+    __global const half* restrict bias)         // [N] epilogue bias (GEMM_EPI_BIAS)
 {
-    // Each workgroup handles 4 adjacent output elements (one image column)
-    const int col4 = get_group_id(0);    // which group of 4 output columns
-    const int lid = get_local_id(0);     // local work-item ID within group
+    const int lid = get_local_id(0);
+    const int col4_base = mul24((int)get_group_id(0), GEMV_COLS4);
 
-    const int col_base = col4 << 2;
-    if (col_base >= N) return;
+    __local float norm_red[GEMV_BLOCK_WG_SIZE];
+    const float inv_rms = norm_weight
+        ? row_inv_rms(x, K, norm_eps, norm_red, lid, GEMV_BLOCK_WG_SIZE) : 1.0f;
+
+    float4 acc[GEMV_COLS4];
+    gemv_accumulate(x, W_img, col4_base, GEMV_COLS4, K, norm_weight, inv_rms,
+                    acc, lid, GEMV_BLOCK_WG_SIZE);
+
+    const int stride = GEMV_RED_STRIDE(GEMV_BLOCK_WG_SIZE);
+    __local float4 sums[GEMV_COLS4 * GEMV_RED_STRIDE(GEMV_BLOCK_WG_SIZE)];
+    gemv_reduce_cols(acc, GEMV_COLS4, sums, stride, lid, GEMV_BLOCK_WG_SIZE);
 
-    // Each work-item accumulates a partial sum over a stride of the K dimension
-    // Stride access pattern: WI 0 does k=0, WG_SIZE, 2*WG_SIZE, ...
-    //                       WI 1 does k=1, WG_SIZE+1, 2*WG_SIZE+1, ...
-    float4 partial = (float4)(0.0f);
+    // Work-item c writes image column col4_base + c
+    if (lid < GEMV_COLS4)
+        store4_epilogue(sums[mul24(lid, stride)], bias, y, 0, (col4_base + lid) << 2, N);
+}
+
+/* ============================================================================
+ * v4b: Skinny GEMM — C[M,N] = A[M,K] * B_img[K,N] for 2 <= M <= SKINNY_MAX_M
+ *
+ * Short prompt chunks and multi-token verification are still bandwidth-bound
+ * on the weights, like GEMV, but gemm_image would re-read every texel per
+ * row. Here each texel is fetched once and applied to all M rows:
+ *   - Work-item (c, lane) = (lid % SKINNY_COLS4, lid / SKINNY_COLS4): adjacent
+ *     work-items read adjacent texels of one image row.
+ *   - The A rows for a SKINNY_TILE_K slice of K are staged in local memory
+ *     (zero-filled past M and K), so all rows cost one local read each.
+ *   - Accumulators for all SKINNY_MAX_M rows live in registers; the k-lanes
+ *     are then reduced in local memory one row at a time.
+ *   - Optional RMSNorm prologue (norm_weight non-NULL): the inverse RMS of
+ *     each row is computed up front, SKINNY_NORM_LANES work-items per row,
+ *     and applied while staging A.
+ *
+ * Dispatch:
+ *   global_work_size  = { ceil(N / (4 * SKINNY_COLS4)) * SKINNY_WG_SIZE }
+ *   local_work_size   = { SKINNY_WG_SIZE }
+ * ========================================================================= */
+
+#ifndef SKINNY_MAX_M
+#define SKINNY_MAX_M 16
+#endif
+#ifndef SKINNY_WG_SIZE
+#define SKINNY_WG_SIZE 128                             // power of two, >= SKINNY_MAX_M
+#endif
+#define SKINNY_COLS4 4
+#define SKINNY_LANES (SKINNY_WG_SIZE / SKINNY_COLS4)   // 32 k-lanes
+#define SKINNY_TILE_K (4 * SKINNY_LANES)               // 4 k per lane per tile
+#define SKINNY_NORM_LANES (SKINNY_WG_SIZE / SKINNY_MAX_M)
+
+// Accumulate texel column col4 of A * B_img for all SKINNY_MAX_M rows over
+// this work-item's k-lanes (acc[r] = 0 for r >= M). a_tile is the
+// workgroup's [SKINNY_MAX_M][SKINNY_TILE_K] staging buffer; with norm_weight
+// non-NULL, A is scaled by inv_rms[r] * norm_weight[k] while staging.
+// Shared by gemm_skinny and the fused prefill kernels (v5, v6).
+inline void skinny_accumulate(__global const half* restrict A, __read_only image2d_t B_img,
+                              const int M, const int K, const int col4,
+                              __global const half* restrict norm_weight,
+                              __local const float* inv_rms,
+                              __local half (*a_tile)[SKINNY_TILE_K],
+                              float4* acc)
+{
+    const int lid = get_local_id(0);
+    const int lane = lid / SKINNY_COLS4;
 
-    for (int k = lid; k < K; k += GEMV_WG_SIZE) {
-        const float x_val = (float)x[k];
-        const half4 w_val = read_imageh(W_img, weight_sampler, (int2)(col4, k));
-        partial = fma((float4)(x_val), convert_float4(w_val), partial);
+    for (int r = 0; r < SKINNY_MAX_M; ++r) acc[r] = (float4)(0.0f);
+
+    for (int k0 = 0; k0 < K; k0 += SKINNY_TILE_K) {
+        // Stage A[0:SKINNY_MAX_M, k0:k0+SKINNY_TILE_K]
+        for (int i = lid; i < SKINNY_MAX_M * SKINNY_TILE_K; i += SKINNY_WG_SIZE) {
+            const int r = i / SKINNY_TILE_K;
+            const int kk = i % SKINNY_TILE_K;
+            half a = (half)0.0h;
+            if (r < M && k0 + kk < K) {
+                a = A[mad24(r, K, k0 + kk)];
+                if (norm_weight) a = (half)((float)a * inv_rms[r] * (float)norm_weight[k0 + kk]);
+            }
+            a_tile[r][kk] = a;
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        for (int kk = lane; kk < SKINNY_TILE_K; kk += SKINNY_LANES) {
+            const float4 w = convert_float4(read_imageh(B_img, weight_sampler,
+                                                        (int2)(col4, k0 + kk)));
+            for (int r = 0; r < SKINNY_MAX_M; ++r) {
+                if (r < M) acc[r] = fma((float4)((float)a_tile[r][kk]), w, acc[r]);
+            }
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
     }
+}
 
-    // Reduction via local memory — sum partial results across all work-items
-    __local float4 scratch[GEMV_WG_SIZE];
-    scratch[lid] = partial;
+// Reduce one row's k-lanes: on return red[c] (c < SKINNY_COLS4) holds the
+// total for texel column c of the workgroup. The caller reads it, then
+// barriers before the next row.
+inline void skinny_reduce_row(const float4 v, __local float4* red, const int lid)
+{
+    // lid and lid + stride share c
+    red[lid] = v;
     barrier(CLK_LOCAL_MEM_FENCE);
+    for (int stride = SKINNY_WG_SIZE >> 1; stride >= SKINNY_COLS4; stride >>= 1) {
+        if (lid < stride) red[lid] += red[lid + stride];
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+}
+
+__kernel __attribute__((reqd_work_group_size(SKINNY_WG_SIZE, 1, 1)))
+void gemm_skinny(
+    __global const half* restrict A,   // [M, K] activations
+    __read_only image2d_t B_img,       // [K, N] weights as image (N/4 wide, K tall)
+    __global half* restrict C,         // [M, N] output
+    const int M,
+    const int N,
+    const int K,
+    __global const half* restrict norm_weight,  // [K] RMSNorm prologue, or NULL
+    const float norm_eps,
+    __global const half* restrict bias)         // [N] epilogue bias (GEMM_EPI_BIAS)
+{
+    const int lid = get_local_id(0);
+    const int col4 = mad24((int)get_group_id(0), SKINNY_COLS4, lid % SKINNY_COLS4);
+
+    __local half a_tile[SKINNY_MAX_M][SKINNY_TILE_K];
+    __local float norm_red[SKINNY_WG_SIZE];
+    __local float inv_rms[SKINNY_MAX_M];
+
+    if (norm_weight) {
+        // Work-item (nr, nj): row nr, k = nj, nj + SKINNY_NORM_LANES, ...
+        const int nr = lid / SKINNY_NORM_LANES;
+        const int nj = lid % SKINNY_NORM_LANES;
+        float sum_sq = 0.0f;
+        if (nr < M) {
+            for (int k = nj; k < K; k += SKINNY_NORM_LANES) {
+                const float v = vload_half(mad24(nr, K, k), A);
+                sum_sq = fma(v, v, sum_sq);
+            }
+        }
+        norm_red[lid] = sum_sq;
+        barrier(CLK_LOCAL_MEM_FENCE);
+        if (nj == 0 && nr < M) {
+            for (int i = 1; i < SKINNY_NORM_LANES; ++i) sum_sq += norm_red[lid + i];
+            inv_rms[nr] = native_rsqrt(sum_sq / (float)K + norm_eps);
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    float4 acc[SKINNY_MAX_M];
+    skinny_accumulate(A, B_img, M, K, col4, norm_weight, inv_rms, a_tile, acc);
+
+    __local float4 red[SKINNY_WG_SIZE];
+    const int col = col4 << 2;
+    for (int r = 0; r < SKINNY_MAX_M; ++r) {
+        if (r >= M) break;  // uniform across the workgroup
+        skinny_reduce_row(acc[r], red, lid);
+        if (lid < SKINNY_COLS4 && col < N) store4_epilogue(red[lid], bias, C, r, col, N);
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+}
+
+/* ============================================================================
+ * Shape specialization for v5 / v6
+ *
+ * moondream2_load passes the model config as -D constants. The fused QKV
+ * and gate/up kernels only run the LLM's own projections, so when
+ * LLM_DIM / INTERMEDIATE / HEAD_DIM are defined they replace the K, N and
+ * head_dim arguments: the decode K loops get a fixed trip count and unroll,
+ * and the RoPE `col % head_dim` becomes a mask. The kernels above also
+ * serve the vision encoder and benchmarks at other shapes, so they stay
+ * generic.
+ * ========================================================================= */
+
+#ifdef LLM_DIM
+#define FUSED_DIM(arg) LLM_DIM
+#else
+#define FUSED_DIM(arg) (arg)
+#endif
+#ifdef INTERMEDIATE
+#define FUSED_FFN_DIM(arg) INTERMEDIATE
+#else
+#define FUSED_FFN_DIM(arg) (arg)
+#endif
+#ifdef HEAD_DIM
+#define FUSED_HEAD_DIM(arg) HEAD_DIM
+#else
+#define FUSED_HEAD_DIM(arg) (arg)
+#endif
+
+/* ============================================================================
+ * v5: Fused QKV projection — one pass over the activations for Q, K and V
+ *
+ * W_img holds q_proj | k_proj | v_proj side by side: [K, 3N], so image
+ * column col4 < N/4 is Q, < 2N/4 is K, the rest V. Each 4-column group lands
+ * entirely in one projection (N % 4 == 0), so the epilogue just picks the
+ * destination buffer.
+ *
+ * Optional RoPE epilogue: when cos_table is non-NULL, Q and K columns are
+ * rotated before the store. Pairs are interleaved (2i, 2i+1) as in
+ * rope_apply, so both pairs of a 4-column group are already in registers.
+ * Requires head_dim % 4 == 0.
+ *
+ * K/V destination: with kv_pos_stride == 0, k_out / v_out are [M, N] like
+ * q_out. Otherwise they are the K/V caches and each row is written straight
+ * into its cache position (no scratch round-trip, no kv_cache_store launch):
+ *   (pos, head, d) at pos * kv_pos_stride + head * kv_head_stride + d
+ * which covers both the seq-major and head-major cache layouts.
+ *
+ * qkv_gemv also takes the RMSNorm prologue (see row_inv_rms). Prefill picks
+ * qkv_gemm_skinny for M <= SKINNY_MAX_M, else qkv_gemm, mirroring the
+ * skinny / blocked split of the plain image GEMM.
+ * ========================================================================= */
+
+// Rotate the pairs (x, y) and (z, w) of a 4-column group.
+// d = offset of the group's first column within its head.
+inline float4 rope_rotate4(const float4 v,
+                           __global const half* restrict cos_table,
+                           __global const half* restrict sin_table,
+                           const int pos, const int d, const int head_dim)
+{
+    const int t = mad24(pos, head_dim >> 1, d >> 1);
+    const float c0 = vload_half(t, cos_table);
+    const float s0 = vload_half(t, sin_table);
+    const float c1 = vload_half(t + 1, cos_table);
+    const float s1 = vload_half(t + 1, sin_table);
+
+    return (float4)(fma(v.x, c0, -(v.y * s0)), fma(v.x, s0, v.y * c0),
+                    fma(v.z, c1, -(v.w * s1)), fma(v.z, s1, v.w * c1));
+}
+
+// Store one 4-column group of the fused [*, 3N] result into q/k/v
+inline void qkv_store4(float4 val, const int row, const int col_base, const int N,
+                       __global half* restrict q_out,
+                       __global half* restrict k_out,
+                       __global half* restrict v_out,
+                       __global const half* restrict cos_table,
+                       __global const half* restrict sin_table,
+                       const int head_dim, const int pos,
+                       const int kv_pos_stride, const int kv_head_stride)
+{
+    const int section = col_base / N;            // 0 = Q, 1 = K, 2 = V
+    const int col = col_base - mul24(section, N);
+    const int head = col / head_dim;
+    const int d = col - mul24(head, head_dim);
+
+    if (cos_table && section < 2) {
+        val = rope_rotate4(val, cos_table, sin_table, pos, d, head_dim);
+    }
+
+    int offset = mad24(row, N, col);
+    if (section > 0 && kv_pos_stride) {
+        offset = mad24(pos, kv_pos_stride, mad24(head, kv_head_stride, d));
+    }
+
+    __global half* dst = (section == 0) ? q_out : (section == 1) ? k_out : v_out;
+    vstore_half4(val, 0, dst + offset);
+}
+
+/*
+ * Decode: y = x[1, K] * W[K, 3N] with the gemv (v4) structure, one workgroup
+ * per GEMV_FUSED_COLS4 texel columns (4-column groups).
+ * Dispatch: global = { ceil(3N / (4 * GEMV_FUSED_COLS4)) * GEMV_WG_SIZE },
+ *           local  = { GEMV_WG_SIZE }
+ */
+__kernel __attribute__((reqd_work_group_size(GEMV_WG_SIZE, 1, 1)))
+void qkv_gemv(
+    __global const half* restrict x,            // [1, K]
+    __read_only image2d_t W_img,                // [K, 3N] (3N/4 wide, K tall)
+    __global half* restrict q_out,              // [1, N]
+    __global half* restrict k_out,              // [1, N], or K cache
+    __global half* restrict v_out,              // [1, N], or V cache
+    const int N_arg,
+    const int K_arg,
+    __global const half* restrict cos_table,    // [max_seq_len, head_dim/2] or NULL
+    __global const half* restrict sin_table,    // [max_seq_len, head_dim/2] or NULL
+    const int head_dim_arg,
+    const int pos_offset,                       // position of the token
+    __global const half* restrict norm_weight,  // [K] RMSNorm prologue, or NULL
+    const float norm_eps,
+    const int kv_pos_stride,                    // 0: k_out / v_out are [1, N]
+    const int kv_head_stride)
+{
+    const int N = FUSED_DIM(N_arg);
+    const int K = FUSED_DIM(K_arg);
+    const int head_dim = FUSED_HEAD_DIM(head_dim_arg);
+    const int lid = get_local_id(0);
+    const int col4_base = mul24((int)get_group_id(0), GEMV_FUSED_COLS4);
+
+    __local float norm_red[GEMV_WG_SIZE];
+    const float inv_rms = norm_weight
+        ? row_inv_rms(x, K, norm_eps, norm_red, lid, GEMV_WG_SIZE) : 1.0f;
+
+    float4 acc[GEMV_FUSED_COLS4];
+    gemv_accumulate(x, W_img, col4_base, GEMV_FUSED_COLS4, K, norm_weight, inv_rms,
+                    acc, lid, GEMV_WG_SIZE);
+
+    const int stride = GEMV_RED_STRIDE(GEMV_WG_SIZE);
+    __local float4 sums[GEMV_FUSED_COLS4 * GEMV_RED_STRIDE(GEMV_WG_SIZE)];
+    gemv_reduce_cols(acc, GEMV_FUSED_COLS4, sums, stride, lid, GEMV_WG_SIZE);
+
+    // Work-item c stores 4-column group col4_base + c
+    const int col_base = (col4_base + lid) << 2;
+    if (lid < GEMV_FUSED_COLS4 && col_base < mul24(3, N)) {
+        qkv_store4(sums[mul24(lid, stride)], 0, col_base, N, q_out, k_out, v_out,
+                   cos_table, sin_table, head_dim, pos_offset,
+                   kv_pos_stride, kv_head_stride);
+    }
+}
+
+/*
+ * Prefill: Y = A[M, K] * W[K, 3N] with the gemm_image_blocked (v3b)
+ * structure, GIB_ROWS rows x 8 columns (two 4-column groups) per work-item.
+ * Row r is the token at position pos_offset + r.
+ * Dispatch: global = { round_up(ceil(3N / 8), GIB_WG_N),
+ *                      ceil(M / GIB_TILE_M) * GIB_WG_M },
+ *           local  = { GIB_WG_N, GIB_WG_M }
+ */
+__kernel __attribute__((reqd_work_group_size(GIB_WG_N, GIB_WG_M, 1)))
+void qkv_gemm(
+    __global const half* restrict A,            // [M, K]
+    __read_only image2d_t W_img,                // [K, 3N] (3N/4 wide, K tall)
+    __global half* restrict q_out,              // [M, N]
+    __global half* restrict k_out,              // [M, N], or K cache
+    __global half* restrict v_out,              // [M, N], or V cache
+    const int M,
+    const int N_arg,
+    const int K_arg,
+    __global const half* restrict cos_table,    // [max_seq_len, head_dim/2] or NULL
+    __global const half* restrict sin_table,    // [max_seq_len, head_dim/2] or NULL
+    const int head_dim_arg,
+    const int pos_offset,                       // position of row 0
+    const int kv_pos_stride,                    // 0: k_out / v_out are [M, N]
+    const int kv_head_stride)
+{
+    const int N = FUSED_DIM(N_arg);
+    const int K = FUSED_DIM(K_arg);
+    const int head_dim = FUSED_HEAD_DIM(head_dim_arg);
+    const int col4 = get_global_id(0) << 1;
+    const int tile_row = mul24((int)get_group_id(1), GIB_TILE_M);
+    const int row = mad24((int)get_local_id(1), GIB_ROWS, tile_row);
+
+    __local half a_tile[GIB_TILE_M][GIB_TILE_K];
+
+    float4 acc0[GIB_ROWS];
+    float4 acc1[GIB_ROWS];
+    gib_accumulate(A, W_img, M, K, col4, tile_row, a_tile, acc0, acc1);
+
+    const int col = col4 << 2;
+    const int N3 = mul24(3, N);
+    if (col >= N3) return;
+
+    for (int r = 0; r < GIB_ROWS; ++r) {
+        if (row + r >= M) break;
+        qkv_store4(acc0[r], row + r, col, N, q_out, k_out, v_out,
+                   cos_table, sin_table, head_dim, pos_offset + row + r,
+                   kv_pos_stride, kv_head_stride);
+        if (col + 4 < N3) {
+            qkv_store4(acc1[r], row + r, col + 4, N, q_out, k_out, v_out,
+                       cos_table, sin_table, head_dim, pos_offset + row + r,
+                       kv_pos_stride, kv_head_stride);
+        }
+    }
+}
+
+/*
+ * Short prefill chunks (M <= SKINNY_MAX_M) with the gemm_skinny (v4b)
+ * structure: each texel is fetched once for all rows. Same arguments as
+ * qkv_gemm.
+ * Dispatch: global = { ceil(3N / (4 * SKINNY_COLS4)) * SKINNY_WG_SIZE },
+ *           local  = { SKINNY_WG_SIZE }
+ */
+__kernel __attribute__((reqd_work_group_size(SKINNY_WG_SIZE, 1, 1)))
+void qkv_gemm_skinny(
+    __global const half* restrict A,            // [M, K]
+    __read_only image2d_t W_img,                // [K, 3N] (3N/4 wide, K tall)
+    __global half* restrict q_out,              // [M, N]
+    __global half* restrict k_out,              // [M, N], or K cache
+    __global half* restrict v_out,              // [M, N], or V cache
+    const int M,
+    const int N_arg,
+    const int K_arg,
+    __global const half* restrict cos_table,    // [max_seq_len, head_dim/2] or NULL
+    __global const half* restrict sin_table,    // [max_seq_len, head_dim/2] or NULL
+    const int head_dim_arg,
+    const int pos_offset,                       // position of row 0
+    const int kv_pos_stride,                    // 0: k_out / v_out are [M, N]
+    const int kv_head_stride)
+{
+    const int N = FUSED_DIM(N_arg);
+    const int K = FUSED_DIM(K_arg);
+    const int head_dim = FUSED_HEAD_DIM(head_dim_arg);
+    const int lid = get_local_id(0);
+    const int col4 = mad24((int)get_group_id(0), SKINNY_COLS4, lid % SKINNY_COLS4);
+
+    __local half a_tile[SKINNY_MAX_M][SKINNY_TILE_K];
+    __local float4 red[SKINNY_WG_SIZE];
+
+    float4 acc[SKINNY_MAX_M];
+    skinny_accumulate(A, W_img, M, K, col4, 0, 0, a_tile, acc);
+
+    const int col = col4 << 2;
+    for (int r = 0; r < SKINNY_MAX_M; ++r) {
+        if (r >= M) break;  // uniform across the workgroup
+        skinny_reduce_row(acc[r], red, lid);
+        if (lid < SKINNY_COLS4 && col < mul24(3, N)) {
+            qkv_store4(red[lid], r, col, N, q_out, k_out, v_out,
+                       cos_table, sin_table, head_dim, pos_offset + r,
+                       kv_pos_stride, kv_head_stride);
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+}
+
+/* ============================================================================
+ * v6: Fused gate/up projection with SiLU-multiply epilogue (SwiGLU MLP)
+ *
+ * out[*, N] = silu(x * W_gate) * (x * W_up)
+ *
+ * W_img interleaves the two weights per texel column: image column 2j holds
+ * gate columns 4j..4j+3 and column 2j+1 the matching up columns, so one
+ * work-item fetches both operands of its output group from adjacent texels
+ * and the intermediate is written exactly once (no gate/up scratch
+ * round-trip, no separate silu_gate_multiply launch).
+ * Prefill is split skinny / blocked by M like v5.
+ * Requires N % 4 == 0.
+ * ========================================================================= */
+
+inline float4 silu_mul4(const float4 g, const float4 u)
+{
+    // silu(g) * u = g * sigmoid(g) * u
+    const float4 sigmoid_g = (float4)(
+        native_recip(1.0f + native_exp(-g.x)), native_recip(1.0f + native_exp(-g.y)),
+        native_recip(1.0f + native_exp(-g.z)), native_recip(1.0f + native_exp(-g.w)));
+    return g * sigmoid_g * u;
+}
+
+/*
+ * Decode with the gemv (v4) structure: one workgroup per GEMV_FUSED_COLS4
+ * output groups, i.e. 2 * GEMV_FUSED_COLS4 adjacent texel columns (gate,
+ * up, gate, ...). Optional RMSNorm prologue.
+ * Dispatch: global = { ceil(N / (4 * GEMV_FUSED_COLS4)) * GEMV_WG_SIZE },
+ *           local  = { GEMV_WG_SIZE }
+ */
+__kernel __attribute__((reqd_work_group_size(GEMV_WG_SIZE, 1, 1)))
+void gate_up_silu_gemv(
+    __global const half* restrict x,     // [1, K]
+    __read_only image2d_t W_img,         // [K, 2N] interleaved gate/up (N/2 wide, K tall)
+    __global half* restrict out,         // [1, N]
+    const int N_arg,
+    const int K_arg,
+    __global const half* restrict norm_weight,  // [K] RMSNorm prologue, or NULL
+    const float norm_eps)
+{
+    const int N = FUSED_FFN_DIM(N_arg);
+    const int K = FUSED_DIM(K_arg);
+    const int lid = get_local_id(0);
+    const int group_base = mul24((int)get_group_id(0), GEMV_FUSED_COLS4);
+
+    __local float norm_red[GEMV_WG_SIZE];
+    const float inv_rms = norm_weight
+        ? row_inv_rms(x, K, norm_eps, norm_red, lid, GEMV_WG_SIZE) : 1.0f;
 
-    // Tree reduction: log2(GEMV_WG_SIZE) steps
-    for (int stride = GEMV_WG_SIZE >> 1; stride > 0; stride >>= 1) {
-        if (lid < stride) {
-            scratch[lid] += scratch[lid + stride];
+    // acc[2g] = gate, acc[2g + 1] = up of output group group_base + g
+    float4 acc[2 * GEMV_FUSED_COLS4];
+    gemv_accumulate(x, W_img, group_base << 1, 2 * GEMV_FUSED_COLS4, K, norm_weight, inv_rms,
+                    acc, lid, GEMV_WG_SIZE);
+
+    const int stride = GEMV_RED_STRIDE(GEMV_WG_SIZE);
+    __local float4 sums[2 * GEMV_FUSED_COLS4 * GEMV_RED_STRIDE(GEMV_WG_SIZE)];
+    gemv_reduce_cols(acc, 2 * GEMV_FUSED_COLS4, sums, stride, lid, GEMV_WG_SIZE);
+
+    // Work-item g stores output group group_base + g
+    const int col_base = (group_base + lid) << 2;
+    if (lid < GEMV_FUSED_COLS4 && col_base < N) {
+        const float4 gate = sums[mul24(lid << 1, stride)];
+        const float4 up = sums[mad24(lid << 1, stride, stride)];
+        vstore_half4(silu_mul4(gate, up), 0, out + col_base);
+    }
+}
+
+/*
+ * Prefill with the gemm_image_blocked (v3b) structure: a work-item's texel
+ * pair (2g, 2g + 1) is the gate and up of output group g, so it holds
+ * GIB_ROWS rows x 4 output columns of both and applies the SiLU-multiply
+ * in registers.
+ * Dispatch: global = { round_up(N / 4, GIB_WG_N), ceil(M / GIB_TILE_M) * GIB_WG_M },
+ *           local  = { GIB_WG_N, GIB_WG_M }
+ */
+__kernel __attribute__((reqd_work_group_size(GIB_WG_N, GIB_WG_M, 1)))
+void gate_up_silu_gemm(
+    __global const half* restrict A,     // [M, K]
+    __read_only image2d_t W_img,         // [K, 2N] interleaved gate/up (N/2 wide, K tall)
+    __global half* restrict out,         // [M, N]
+    const int M,
+    const int N_arg,
+    const int K_arg)
+{
+    const int N = FUSED_FFN_DIM(N_arg);
+    const int K = FUSED_DIM(K_arg);
+    const int gate_x = get_global_id(0) << 1;
+    const int tile_row = mul24((int)get_group_id(1), GIB_TILE_M);
+    const int row = mad24((int)get_local_id(1), GIB_ROWS, tile_row);
+
+    __local half a_tile[GIB_TILE_M][GIB_TILE_K];
+
+    float4 gate[GIB_ROWS];
+    float4 up[GIB_ROWS];
+    gib_accumulate(A, W_img, M, K, gate_x, tile_row, a_tile, gate, up);
+
+    const int col_base = gate_x << 1;
+    if (col_base >= N) return;
+
+    for (int r = 0; r < GIB_ROWS; ++r) {
+        if (row + r >= M) break;
+        vstore_half4(silu_mul4(gate[r], up[r]), 0, out + mad24(row + r, N, col_base));
+    }
+}
+
+/*
+ * Short prefill chunks (M <= SKINNY_MAX_M) with the gemm_skinny (v4b)
+ * structure: a workgroup's SKINNY_COLS4 texel columns are SKINNY_COLS4 / 2
+ * (gate, up) pairs.
+ * Dispatch: global = { ceil(N / (2 * SKINNY_COLS4)) * SKINNY_WG_SIZE },
+ *           local  = { SKINNY_WG_SIZE }
+ */
+__kernel __attribute__((reqd_work_group_size(SKINNY_WG_SIZE, 1, 1)))
+void gate_up_silu_gemm_skinny(
+    __global const half* restrict A,     // [M, K]
+    __read_only image2d_t W_img,         // [K, 2N] interleaved gate/up (N/2 wide, K tall)
+    __global half* restrict out,         // [M, N]
+    const int M,
+    const int N_arg,
+    const int K_arg)
+{
+    const int N = FUSED_FFN_DIM(N_arg);
+    const int K = FUSED_DIM(K_arg);
+    const int lid = get_local_id(0);
+    const int col4 = mad24((int)get_group_id(0), SKINNY_COLS4, lid % SKINNY_COLS4);
+
+    __local half a_tile[SKINNY_MAX_M][SKINNY_TILE_K];
+    __local float4 red[SKINNY_WG_SIZE];
+
+    float4 acc[SKINNY_MAX_M];
+    skinny_accumulate(A, W_img, M, K, col4, 0, 0, a_tile, acc);
+
+    // Work-item g stores output group get_group_id(0) * SKINNY_COLS4 / 2 + g
+    const int col_base = mad24((int)get_group_id(0), SKINNY_COLS4 / 2, lid) << 2;
+    for (int r = 0; r < SKINNY_MAX_M; ++r) {
+        if (r >= M) break;  // uniform across the workgroup
+        skinny_reduce_row(acc[r], red, lid);
+        if (lid < SKINNY_COLS4 / 2 && col_base < N) {
+            vstore_half4(silu_mul4(red[lid << 1], red[(lid << 1) + 1]), 0,
+                         out + mad24(r, N, col_base));
         }
         barrier(CLK_LOCAL_MEM_FENCE);
     }
+}
+
+/* ============================================================================
+ * v7: Quantized GEMV / GEMM — GGUF block-quantized weights, dequantized in
+ * registers
+ *
+ * B_q is the GGUF tensor unchanged, in a buffer: [K, N] with each of the K
+ * rows stored as blocks along N (N a multiple of the block size). A block
+ * holds consecutive columns of one row:
+ *   Q4_0 (32 columns, 18 bytes):  half d, uchar qs[16]; column j < 16 =
+ *                                 (qs[j] & 15) - 8, j >= 16 = (qs[j - 16] >> 4) - 8,
+ *                                 times d
+ *   Q8_0 (32 columns, 34 bytes):  half d, char qs[32]; column j = qs[j] * d
+ * and the K-quant super-blocks of 8 sub-blocks of 32 columns:
+ *   Q4_K (256 columns, 144 bytes): half d, half dmin, uchar scales[12],
+ *                                 uchar qs[128]. Sub-block s has a 6-bit
+ *                                 scale sc and min m (qk_scale_min); its
+ *                                 column l is d * sc * q - dmin * m, q the
+ *                                 low (s even) or high (s odd) nibble of
+ *                                 qs[32 * (s / 2) + l]
+ *   Q5_K (256 columns, 176 bytes): half d, half dmin, uchar scales[12],
+ *                                 uchar qh[32], uchar qs[128]; as Q4_K with
+ *                                 bit s of qh[l] as the fifth bit of q
+ *   Q6_K (256 columns, 210 bytes): uchar ql[128], uchar qh[64],
+ *                                 char scales[16], half d. Half n = s / 4,
+ *                                 quarter t = s % 4: q = the (t / 2) nibble
+ *                                 of ql[64n + 32(t & 1) + l] | bits 2t..2t+1
+ *                                 of qh[32n + l] << 4, column l is
+ *                                 d * scales[8n + 2t + l / 16] * (q - 32)
+ * Decode reads 4.5 / 8.5 / 4.5 / 5.5 / 6.6 bits per weight instead of 16.
+ * All kernels share the image family's output epilogue (store4_epilogue).
+ * ========================================================================= */
+
+#define QK 32
+#define QK_K 256
+#define QTYPE_Q4_0 0
+#define QTYPE_Q8_0 1
+#define QTYPE_Q4_K 2
+#define QTYPE_Q5_K 3
+#define QTYPE_Q6_K 4
+#define Q4_0_BYTES 18
+#define Q8_0_BYTES 34
+#define Q4_K_BYTES 144
+#define Q5_K_BYTES 176
+#define Q6_K_BYTES 210
+
+// Columns and bytes per block (constant-folded: qtype is a literal)
+inline int q_block_cols(const int qtype)
+{
+    return (qtype == QTYPE_Q4_0 || qtype == QTYPE_Q8_0) ? QK : QK_K;
+}
+
+inline int q_block_bytes(const int qtype)
+{
+    switch (qtype) {
+    case QTYPE_Q4_0: return Q4_0_BYTES;
+    case QTYPE_Q8_0: return Q8_0_BYTES;
+    case QTYPE_Q4_K: return Q4_K_BYTES;
+    case QTYPE_Q5_K: return Q5_K_BYTES;
+    default:         return Q6_K_BYTES;
+    }
+}
+
+// Block of row k holding column col
+inline __global const uchar* q_block(const int qtype, __global const uchar* B_q,
+                                     const int k, const int N, const int col)
+{
+    const int bs = q_block_cols(qtype);
+    return B_q + (size_t)mad24(k, N / bs, col / bs) * q_block_bytes(qtype);
+}
+
+// 6-bit scale and min of sub-block j of a Q4_K / Q5_K super-block: the
+// low 6 bits of bytes 0..7 for j < 4, else nibbles of bytes 8..11 with the
+// top 2 bits of bytes 0..7 above them
+inline float2 qk_scale_min(__global const uchar* sc, const int j)
+{
+    if (j < 4) return (float2)((float)(sc[j] & 63), (float)(sc[j + 4] & 63));
+    return (float2)((float)((sc[j + 4] & 0xF) | ((sc[j - 4] >> 6) << 4)),
+                    (float)((sc[j + 4] >> 4) | ((sc[j] >> 6) << 4)));
+}
+
+// Columns col..col+31 of row k (col % 32 == 0), scaled: lo = the first 16
+inline void q_cols32(const int qtype, __global const uchar* B_q,
+                     const int k, const int N, const int col,
+                     float16* lo, float16* hi)
+{
+    __global const uchar* blk = q_block(qtype, B_q, k, N, col);
+    const int s = (col % QK_K) >> 5;  // K-quant sub-block
+
+    if (qtype == QTYPE_Q4_0) {
+        const float d = vload_half(0, (__global const half*)blk);
+        const uchar16 q = vload16(0, blk + 2);
+        *lo = (convert_float16(q & (uchar16)(0xF)) - 8.0f) * d;
+        *hi = (convert_float16(q >> (uchar16)(4)) - 8.0f) * d;
+    } else if (qtype == QTYPE_Q8_0) {
+        const float d = vload_half(0, (__global const half*)blk);
+        *lo = convert_float16(vload16(0, (__global const char*)(blk + 2))) * d;
+        *hi = convert_float16(vload16(1, (__global const char*)(blk + 2))) * d;
+    } else if (qtype == QTYPE_Q4_K || qtype == QTYPE_Q5_K) {
+        const float2 sm = qk_scale_min(blk + 4, s);
+        const float scale = vload_half(0, (__global const half*)blk) * sm.x;
+        const float m = vload_half(1, (__global const half*)blk) * sm.y;
+        __global const uchar* qs = blk + ((qtype == QTYPE_Q4_K) ? 16 : 48) + 32 * (s >> 1);
+        const uchar shift = (uchar)((s & 1) << 2);
+        uchar16 q_lo = (vload16(0, qs) >> (uchar16)(shift)) & (uchar16)(0xF);
+        uchar16 q_hi = (vload16(1, qs) >> (uchar16)(shift)) & (uchar16)(0xF);
+        if (qtype == QTYPE_Q5_K) {
+            __global const uchar* qh = blk + 16;
+            q_lo |= ((vload16(0, qh) >> (uchar16)((uchar)s)) & (uchar16)(1)) << (uchar16)(4);
+            q_hi |= ((vload16(1, qh) >> (uchar16)((uchar)s)) & (uchar16)(1)) << (uchar16)(4);
+        }
+        *lo = convert_float16(q_lo) * scale - m;
+        *hi = convert_float16(q_hi) * scale - m;
+    } else {
+        const int n = s >> 2;
+        const int t = s & 3;
+        __global const uchar* ql = blk + 64 * n + 32 * (t & 1);
+        __global const uchar* qh = blk + 128 + 32 * n;
+        __global const char* sc = (__global const char*)(blk + 192) + 8 * n + 2 * t;
+        const float d = vload_half(104, (__global const half*)blk);
+        const uchar l_shift = (uchar)((t >> 1) << 2);
+        const uchar h_shift = (uchar)(t << 1);
+        const uchar16 q_lo = ((vload16(0, ql) >> (uchar16)(l_shift)) & (uchar16)(0xF)) |
+                             (((vload16(0, qh) >> (uchar16)(h_shift)) & (uchar16)(3)) << (uchar16)(4));
+        const uchar16 q_hi = ((vload16(1, ql) >> (uchar16)(l_shift)) & (uchar16)(0xF)) |
+                             (((vload16(1, qh) >> (uchar16)(h_shift)) & (uchar16)(3)) << (uchar16)(4));
+        *lo = (convert_float16(q_lo) - 32.0f) * (d * (float)sc[0]);
+        *hi = (convert_float16(q_hi) - 32.0f) * (d * (float)sc[1]);
+    }
+}
+
+// Columns col..col+7 of row k (col % 8 == 0), scaled
+inline float8 q_cols8(const int qtype, __global const uchar* B_q,
+                      const int k, const int N, const int col)
+{
+    __global const uchar* blk = q_block(qtype, B_q, k, N, col);
+    const int s = (col % QK_K) >> 5;
+    const int l = col & 31;  // column within the (sub-)block
+
+    if (qtype == QTYPE_Q4_0) {
+        // Columns 0..15 are the low nibbles of qs[0..15], 16..31 the high ones
+        const float d = vload_half(0, (__global const half*)blk);
+        const uchar8 q = vload8(0, blk + 2 + (l & 15));
+        const uchar8 n = (l & 16) ? (q >> (uchar8)(4)) : (q & (uchar8)(0xF));
+        return (convert_float8(n) - 8.0f) * d;
+    }
+    if (qtype == QTYPE_Q8_0) {
+        const float d = vload_half(0, (__global const half*)blk);
+        return convert_float8(vload8(0, (__global const char*)(blk + 2 + l))) * d;
+    }
+    if (qtype == QTYPE_Q4_K || qtype == QTYPE_Q5_K) {
+        const float2 sm = qk_scale_min(blk + 4, s);
+        const float scale = vload_half(0, (__global const half*)blk) * sm.x;
+        const float m = vload_half(1, (__global const half*)blk) * sm.y;
+        __global const uchar* qs = blk + ((qtype == QTYPE_Q4_K) ? 16 : 48) + 32 * (s >> 1);
+        uchar8 q = (vload8(0, qs + l) >> (uchar8)((uchar)((s & 1) << 2))) & (uchar8)(0xF);
+        if (qtype == QTYPE_Q5_K)
+            q |= ((vload8(0, blk + 16 + l) >> (uchar8)((uchar)s)) & (uchar8)(1)) << (uchar8)(4);
+        return convert_float8(q) * scale - m;
+    }
+    const int n = s >> 2;
+    const int t = s & 3;
+    const uchar8 ql = vload8(0, blk + 64 * n + 32 * (t & 1) + l);
+    const uchar8 qh = vload8(0, blk + 128 + 32 * n + l);
+    const uchar8 q = ((ql >> (uchar8)((uchar)((t >> 1) << 2))) & (uchar8)(0xF)) |
+                     (((qh >> (uchar8)((uchar)(t << 1))) & (uchar8)(3)) << (uchar8)(4));
+    const float sc = (float)((__global const char*)(blk + 192))[8 * n + 2 * t + (l >> 4)];
+    return (convert_float8(q) - 32.0f) * (vload_half(104, (__global const half*)blk) * sc);
+}
+
+/*
+ * Decode: y[1, N] = x[1, K] * B_q[K, N]
+ *
+ * A workgroup owns QGEMV_BLOCKS adjacent 32-column groups (blocks, or
+ * K-quant sub-blocks; QGEMV_BLOCKS * 32 outputs) and splits K over
+ * QGEMV_K_LANES lanes; adjacent work-items read adjacent groups of one row.
+ * Each work-item keeps 32 partial sums. Lanes are reduced in local memory.
+ * Optional RMSNorm prologue as in gemv (norm_weight non-NULL).
+ *
+ * Dispatch:
+ *   global_work_size  = { ceil(N / (QGEMV_BLOCKS * 32)) * QGEMV_WG_SIZE }
+ *   local_work_size   = { QGEMV_WG_SIZE }
+ */
+#define QGEMV_WG_SIZE 64
+#define QGEMV_BLOCKS 2
+#define QGEMV_K_LANES (QGEMV_WG_SIZE / QGEMV_BLOCKS)
+#define QGEMV_COLS (QGEMV_BLOCKS * QK)
+
+#if QGEMV_COLS > 4 * QGEMV_WG_SIZE
+#error "gemv_q: not enough work-items to store the outputs"
+#endif
+
+inline void gemv_q(const int qtype,
+                   __global const half* restrict x,
+                   __global const uchar* restrict B_q,
+                   __global half* restrict y,
+                   const int N, const int K,
+                   __global const half* restrict norm_weight, const float norm_eps,
+                   __global const half* restrict bias,
+                   __local float* norm_red,
+                   __local float (*red)[QGEMV_COLS])
+{
+    const int lid = get_local_id(0);
+    const int bc = lid % QGEMV_BLOCKS;
+    const int lane = lid / QGEMV_BLOCKS;
+    const int col32 = mul24(mad24((int)get_group_id(0), QGEMV_BLOCKS, bc), QK);
+
+    const float inv_rms = norm_weight
+        ? row_inv_rms(x, K, norm_eps, norm_red, lid, QGEMV_WG_SIZE) : 1.0f;
+
+    float16 acc_lo = (float16)(0.0f);
+    float16 acc_hi = (float16)(0.0f);
+    if (col32 < N) {
+        for (int k = lane; k < K; k += QGEMV_K_LANES) {
+            float xk = vload_half(k, x);
+            if (norm_weight) xk *= vload_half(k, norm_weight) * inv_rms;
+            float16 lo, hi;
+            q_cols32(qtype, B_q, k, N, col32, &lo, &hi);
+            acc_lo = fma((float16)(xk), lo, acc_lo);
+            acc_hi = fma((float16)(xk), hi, acc_hi);
+        }
+    }
+
+    vstore16(acc_lo, 0, &red[lane][bc * QK]);
+    vstore16(acc_hi, 0, &red[lane][bc * QK + 16]);
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // Work-item c finishes outputs 4c..4c+3 of the workgroup
+    const int c = lid << 2;
+    if (c >= QGEMV_COLS) return;
+    float4 sum = (float4)(0.0f);
+    for (int l = 0; l < QGEMV_K_LANES; ++l) sum += vload4(0, &red[l][c]);
+
+    const int col = mad24((int)get_group_id(0), QGEMV_COLS, c);
+    if (col < N) store4_epilogue(sum, bias, y, 0, col, N);
+}
+
+__kernel __attribute__((reqd_work_group_size(QGEMV_WG_SIZE, 1, 1)))
+void gemv_q4_0(
+    __global const half* restrict x,            // [1, K]
+    __global const uchar* restrict B_q,         // [K, N] Q4_0 blocks
+    __global half* restrict y,                  // [1, N]
+    const int N,
+    const int K,
+    __global const half* restrict norm_weight,  // [K] RMSNorm prologue, or NULL
+    const float norm_eps,
+    __global const half* restrict bias)         // [N] epilogue bias (GEMM_EPI_BIAS)
+{
+    __local float norm_red[QGEMV_WG_SIZE];
+    __local float red[QGEMV_K_LANES][QGEMV_COLS];
+    gemv_q(QTYPE_Q4_0, x, B_q, y, N, K, norm_weight, norm_eps, bias, norm_red, red);
+}
+
+__kernel __attribute__((reqd_work_group_size(QGEMV_WG_SIZE, 1, 1)))
+void gemv_q8_0(
+    __global const half* restrict x,            // [1, K]
+    __global const uchar* restrict B_q,         // [K, N] Q8_0 blocks
+    __global half* restrict y,                  // [1, N]
+    const int N,
+    const int K,
+    __global const half* restrict norm_weight,  // [K] RMSNorm prologue, or NULL
+    const float norm_eps,
+    __global const half* restrict bias)         // [N] epilogue bias (GEMM_EPI_BIAS)
+{
+    __local float norm_red[QGEMV_WG_SIZE];
+    __local float red[QGEMV_K_LANES][QGEMV_COLS];
+    gemv_q(QTYPE_Q8_0, x, B_q, y, N, K, norm_weight, norm_eps, bias, norm_red, red);
+}
+
+__kernel __attribute__((reqd_work_group_size(QGEMV_WG_SIZE, 1, 1)))
+void gemv_q4_k(
+    __global const half* restrict x,            // [1, K]
+    __global const uchar* restrict B_q,         // [K, N] Q4_K blocks
+    __global half* restrict y,                  // [1, N]
+    const int N,
+    const int K,
+    __global const half* restrict norm_weight,  // [K] RMSNorm prologue, or NULL
+    const float norm_eps,
+    __global const half* restrict bias)         // [N] epilogue bias (GEMM_EPI_BIAS)
+{
+    __local float norm_red[QGEMV_WG_SIZE];
+    __local float red[QGEMV_K_LANES][QGEMV_COLS];
+    gemv_q(QTYPE_Q4_K, x, B_q, y, N, K, norm_weight, norm_eps, bias, norm_red, red);
+}
+
+__kernel __attribute__((reqd_work_group_size(QGEMV_WG_SIZE, 1, 1)))
+void gemv_q5_k(
+    __global const half* restrict x,            // [1, K]
+    __global const uchar* restrict B_q,         // [K, N] Q5_K blocks
+    __global half* restrict y,                  // [1, N]
+    const int N,
+    const int K,
+    __global const half* restrict norm_weight,  // [K] RMSNorm prologue, or NULL
+    const float norm_eps,
+    __global const half* restrict bias)         // [N] epilogue bias (GEMM_EPI_BIAS)
+{
+    __local float norm_red[QGEMV_WG_SIZE];
+    __local float red[QGEMV_K_LANES][QGEMV_COLS];
+    gemv_q(QTYPE_Q5_K, x, B_q, y, N, K, norm_weight, norm_eps, bias, norm_red, red);
+}
+
+__kernel __attribute__((reqd_work_group_size(QGEMV_WG_SIZE, 1, 1)))
+void gemv_q6_k(
+    __global const half* restrict x,            // [1, K]
+    __global const uchar* restrict B_q,         // [K, N] Q6_K blocks
+    __global half* restrict y,                  // [1, N]
+    const int N,
+    const int K,
+    __global const half* restrict norm_weight,  // [K] RMSNorm prologue, or NULL
+    const float norm_eps,
+    __global const half* restrict bias)         // [N] epilogue bias (GEMM_EPI_BIAS)
+{
+    __local float norm_red[QGEMV_WG_SIZE];
+    __local float red[QGEMV_K_LANES][QGEMV_COLS];
+    gemv_q(QTYPE_Q6_K, x, B_q, y, N, K, norm_weight, norm_eps, bias, norm_red, red);
+}
 
-    // Work-item 0 writes the final result
-    if (lid == 0) {
-        const float4 result = scratch[0];
-        const int remaining = N - col_base;
+/*
+ * Prefill: C[M, N] = A[M, K] * B_q[K, N], M > 1
+ *
+ * Same tiling as gemm_image_blocked (v3b): each work-item computes GIB_ROWS
+ * rows x 8 columns, A tiles staged in local memory. The 8 columns
+ * (q_cols8) are dequantized once per k and applied to all GIB_ROWS rows.
+ *
+ * Dispatch:
+ *   global_work_size  = { round_up(N / 8, GIB_WG_N),
+ *                         ceil(M / GIB_TILE_M) * GIB_WG_M }
+ *   local_work_size   = { GIB_WG_N, GIB_WG_M }
+ */
+inline void gemm_q(const int qtype,
+                   __global const half* restrict A,
+                   __global const uchar* restrict B_q,
+                   __global half* restrict C,
+                   const int M, const int N, const int K,
+                   __global const half* restrict bias,
+                   __local half (*a_tile)[GIB_TILE_K])
+{
+    const int lx = get_local_id(0);
+    const int ly = get_local_id(1);
+    const int lid = mad24(ly, GIB_WG_N, lx);
+
+    const int col = (int)get_global_id(0) << 3;
+    const int tile_row = mul24((int)get_group_id(1), GIB_TILE_M);
+    const int row = mad24(ly, GIB_ROWS, tile_row);
+
+    float8 acc[GIB_ROWS];
+    for (int r = 0; r < GIB_ROWS; ++r) acc[r] = (float8)(0.0f);
 
-        if (remaining >= 4) {
-            vstore_half4(result, 0, y + col_base);
+    const int ar = lid >> 2;
+    const int ak = (lid & 3) << 3;
+    const int a_row = tile_row + ar;
+
+    for (int k0 = 0; k0 < K; k0 += GIB_TILE_K) {
+        const int gk = k0 + ak;
+        if (a_row < M && gk + 8 <= K) {
+            vstore8(vload8(0, A + mad24(a_row, K, gk)), 0, &a_tile[ar][ak]);
         } else {
-            for (int i = 0; i < remaining; ++i) {
-                vstore_half(result[i], 0, y + col_base + i);
+            for (int i = 0; i < 8; ++i)
+                a_tile[ar][ak + i] = (a_row < M && gk + i < K)
+                                   ? A[mad24(a_row, K, gk + i)] : (half)0.0h;
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        // Unlike the image path there is no clamped read past K or N
+        const int kk_end = (col < N) ? min(GIB_TILE_K, K - k0) : 0;
+        for (int kk = 0; kk < kk_end; ++kk) {
+            const float8 w = q_cols8(qtype, B_q, k0 + kk, N, col);
+            for (int r = 0; r < GIB_ROWS; ++r) {
+                const float a = (float)a_tile[mad24(ly, GIB_ROWS, r)][kk];
+                acc[r] = fma((float8)(a), w, acc[r]);
             }
         }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    if (col >= N) return;
+
+    for (int r = 0; r < GIB_ROWS; ++r) {
+        if (row + r >= M) break;
+        store4_epilogue(acc[r].lo, bias, C, row + r, col, N);
+        store4_epilogue(acc[r].hi, bias, C, row + r, col + 4, N);
+    }
+}
+
+__kernel __attribute__((reqd_work_group_size(GIB_WG_N, GIB_WG_M, 1)))
+void gemm_q4_0(
+    __global const half* restrict A,    // [M, K]
+    __global const uchar* restrict B_q, // [K, N] Q4_0 blocks
+    __global half* restrict C,          // [M, N]
+    const int M,
+    const int N,
+    const int K,
+    __global const half* restrict bias) // [N] epilogue bias (GEMM_EPI_BIAS)
+{
+    __local half a_tile[GIB_TILE_M][GIB_TILE_K];
+    gemm_q(QTYPE_Q4_0, A, B_q, C, M, N, K, bias, a_tile);
+}
+
+__kernel __attribute__((reqd_work_group_size(GIB_WG_N, GIB_WG_M, 1)))
+void gemm_q8_0(
+    __global const half* restrict A,    // [M, K]
+    __global const uchar* restrict B_q, // [K, N] Q8_0 blocks
+    __global half* restrict C,          // [M, N]
+    const int M,
+    const int N,
+    const int K,
+    __global const half* restrict bias) // [N] epilogue bias (GEMM_EPI_BIAS)
+{
+    __local half a_tile[GIB_TILE_M][GIB_TILE_K];
+    gemm_q(QTYPE_Q8_0, A, B_q, C, M, N, K, bias, a_tile);
+}
+
+__kernel __attribute__((reqd_work_group_size(GIB_WG_N, GIB_WG_M, 1)))
+void gemm_q4_k(
+    __global const half* restrict A,    // [M, K]
+    __global const uchar* restrict B_q, // [K, N] Q4_K blocks
+    __global half* restrict C,          // [M, N]
+    const int M,
+    const int N,
+    const int K,
+    __global const half* restrict bias) // [N] epilogue bias (GEMM_EPI_BIAS)
+{
+    __local half a_tile[GIB_TILE_M][GIB_TILE_K];
+    gemm_q(QTYPE_Q4_K, A, B_q, C, M, N, K, bias, a_tile);
+}
+
+__kernel __attribute__((reqd_work_group_size(GIB_WG_N, GIB_WG_M, 1)))
+void gemm_q5_k(
+    __global const half* restrict A,    // [M, K]
+    __global const uchar* restrict B_q, // [K, N] Q5_K blocks
+    __global half* restrict C,          // [M, N]
+    const int M,
+    const int N,
+    const int K,
+    __global const half* restrict bias) // [N] epilogue bias (GEMM_EPI_BIAS)
+{
+    __local half a_tile[GIB_TILE_M][GIB_TILE_K];
+    gemm_q(QTYPE_Q5_K, A, B_q, C, M, N, K, bias, a_tile);
+}
+
+__kernel __attribute__((reqd_work_group_size(GIB_WG_N, GIB_WG_M, 1)))
+void gemm_q6_k(
+    __global const half* restrict A,    // [M, K]
+    __global const uchar* restrict B_q, // [K, N] Q6_K blocks
+    __global half* restrict C,          // [M, N]
+    const int M,
+    const int N,
+    const int K,
+    __global const half* restrict bias) // [N] epilogue bias (GEMM_EPI_BIAS)
+{
+    __local half a_tile[GIB_TILE_M][GIB_TILE_K];
+    gemm_q(QTYPE_Q6_K, A, B_q, C, M, N, K, bias, a_tile);
+}
+
+/* ============================================================================
+ * v8: W8A8 — int8 weights x int8 activations, integer dot products
+ *
+ * Weights (WEIGHT_I8) are quantized per output channel and stored
+ * transposed, so a column's K values are contiguous and pack four to a uint:
+ *   char W_q[N][K]  then  float w_scale[N]      (one buffer, K % 4 == 0)
+ *   W[k, n] = W_q[n][k] * w_scale[n]
+ * Activations are quantized per row right before the product
+ * (quantize_rows_i8, which also applies the RMSNorm of the decode path):
+ *   A[m, k] = A_q[m][k] * a_scale[m]
+ * so C[m, n] = a_scale[m] * w_scale[n] * sum_k A_q[m][k] * W_q[n][k], the
+ * sum exact in int32 (|A_q * W_q| <= 127^2, K < 2^17).
+ *
+ * Four products per instruction: dot_acc_sat_4x8packed_ss_int where the
+ * device supports cl_khr_integer_dot_product (host passes -DMGPU_INT_DOT),
+ * otherwise a portable char4 fallback with the same result.
+ * ========================================================================= */
+
+#if defined(MGPU_INT_DOT) && defined(__opencl_c_integer_dot_product_input_4x8bit_packed)
+#define I8_DOT4(a, b, acc) dot_acc_sat_4x8packed_ss_int((a), (b), (acc))
+#else
+inline int i8_dot4(const uint a, const uint b, const int acc)
+{
+    const int4 p = convert_int4(as_char4(a)) * convert_int4(as_char4(b));
+    return acc + p.x + p.y + p.z + p.w;
+}
+#define I8_DOT4(a, b, acc) i8_dot4((a), (b), (acc))
+#endif
+
+/*
+ * A_q[M, K] = round(A / a_scale), a_scale[m] = max_k |A[m, k]| / 127
+ *
+ * One workgroup per row. With norm_weight non-NULL, A is the raw residual
+ * stream and rows are RMS-normalized first (row_inv_rms), so the decode
+ * path quantizes straight from the hidden state.
+ *
+ * Dispatch:
+ *   global_work_size  = { M * I8_QUANT_WG_SIZE }
+ *   local_work_size   = { I8_QUANT_WG_SIZE }
+ */
+#define I8_QUANT_WG_SIZE 64
+
+__kernel __attribute__((reqd_work_group_size(I8_QUANT_WG_SIZE, 1, 1)))
+void quantize_rows_i8(
+    __global const half* restrict A,            // [M, K]
+    __global char* restrict A_q,                // [M, K]
+    __global float* restrict a_scale,           // [M]
+    const int K,
+    __global const half* restrict norm_weight,  // [K] RMSNorm weight, or NULL
+    const float norm_eps)
+{
+    __local float red[I8_QUANT_WG_SIZE];
+    const int lid = get_local_id(0);
+    const int row = get_group_id(0);
+    __global const half* x = A + row * K;
+    __global char* xq = A_q + row * K;
+
+    const float inv_rms = norm_weight
+        ? row_inv_rms(x, K, norm_eps, red, lid, I8_QUANT_WG_SIZE) : 1.0f;
+
+    float amax = 0.0f;
+    for (int k = lid; k < K; k += I8_QUANT_WG_SIZE) {
+        float v = vload_half(k, x);
+        if (norm_weight) v *= vload_half(k, norm_weight) * inv_rms;
+        amax = fmax(amax, fabs(v));
+    }
+    red[lid] = amax;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (int stride = I8_QUANT_WG_SIZE >> 1; stride > 0; stride >>= 1) {
+        if (lid < stride) red[lid] = fmax(red[lid], red[lid + stride]);
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    const float scale = red[0] * (1.0f / 127.0f);
+    const float inv_scale = scale > 0.0f ? 1.0f / scale : 0.0f;
+    for (int k = lid; k < K; k += I8_QUANT_WG_SIZE) {
+        float v = vload_half(k, x);
+        if (norm_weight) v *= vload_half(k, norm_weight) * inv_rms;
+        xq[k] = convert_char_sat_rte(v * inv_scale);
+    }
+    if (lid == 0) a_scale[row] = scale;
+}
+
+/*
+ * Decode: y[1, N] = dequant(x_q[1, K] * W_q^T)
+ *
+ * A workgroup owns I8_GEMV_COLS adjacent output columns and splits each
+ * column's K over I8_GEMV_LANES lanes; adjacent work-items read adjacent
+ * 16-byte chunks of one weight row. Lanes are reduced in local memory.
+ *
+ * Dispatch:
+ *   global_work_size  = { ceil(N / I8_GEMV_COLS) * I8_GEMV_WG_SIZE }
+ *   local_work_size   = { I8_GEMV_WG_SIZE }
+ */
+#define I8_GEMV_WG_SIZE 64
+#define I8_GEMV_COLS 4
+#define I8_GEMV_LANES (I8_GEMV_WG_SIZE / I8_GEMV_COLS)
+
+__kernel __attribute__((reqd_work_group_size(I8_GEMV_WG_SIZE, 1, 1)))
+void gemv_i8(
+    __global const char* restrict x_q,      // [1, K]
+    __global const float* restrict x_scale, // [1]
+    __global const char* restrict B,        // W_q [N, K], then w_scale [N]
+    __global half* restrict y,              // [1, N]
+    const int N,
+    const int K,
+    __global const half* restrict bias)     // [N] epilogue bias (GEMM_EPI_BIAS)
+{
+    __local int red[I8_GEMV_LANES][I8_GEMV_COLS];
+    const int lid = get_local_id(0);
+    const int c = lid / I8_GEMV_LANES;
+    const int lane = lid % I8_GEMV_LANES;
+    const int col4 = mul24((int)get_group_id(0), I8_GEMV_COLS);
+    const int col = col4 + c;
+    const int K4 = K >> 2;
+
+    int acc = 0;
+    if (col < N) {
+        __global const uint* x = (__global const uint*)x_q;
+        __global const uint* w = (__global const uint*)(B + col * K);
+        const int K16 = K4 >> 2;
+        for (int k = lane; k < K16; k += I8_GEMV_LANES) {
+            const uint4 xv = vload4(k, x);
+            const uint4 wv = vload4(k, w);
+            acc = I8_DOT4(xv.s0, wv.s0, acc);
+            acc = I8_DOT4(xv.s1, wv.s1, acc);
+            acc = I8_DOT4(xv.s2, wv.s2, acc);
+            acc = I8_DOT4(xv.s3, wv.s3, acc);
+        }
+        for (int k = (K16 << 2) + lane; k < K4; k += I8_GEMV_LANES)
+            acc = I8_DOT4(x[k], w[k], acc);
+    }
+    red[lane][c] = acc;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (int stride = I8_GEMV_LANES >> 1; stride > 0; stride >>= 1) {
+        if (lane < stride) red[lane][c] += red[lane + stride][c];
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    if (lid != 0 || col4 >= N) return;
+    const float4 w_scale = vload4(0, (__global const float*)(B + N * K) + col4);
+    const float4 sum = convert_float4(vload4(0, red[0]));
+    store4_epilogue(sum * (w_scale * x_scale[0]), bias, y, 0, col4, N);
+}
+
+/*
+ * Prefill: C[M, N] = dequant(A_q[M, K] * W_q^T)
+ *
+ * gemm_image_blocked's tiling with int accumulators: each work-item owns
+ * I8_ROWS rows x I8_COLS columns, A and W tiles of I8_TILE_K bytes of K are
+ * staged in local memory as packed uints (zero-padded past M, N and K).
+ *
+ * Dispatch:
+ *   global_work_size  = { ceil(N / I8_TILE_N) * I8_WG_N, ceil(M / I8_TILE_M) * I8_WG_M }
+ *   local_work_size   = { I8_WG_N, I8_WG_M }
+ */
+#define I8_ROWS 4
+#define I8_COLS 4
+#define I8_WG_N 16
+#define I8_WG_M 8
+#define I8_TILE_K 32
+#define I8_TILE_K4 (I8_TILE_K / 4)
+#define I8_TILE_M (I8_WG_M * I8_ROWS)
+#define I8_TILE_N (I8_WG_N * I8_COLS)
+#define I8_WG_SIZE (I8_WG_N * I8_WG_M)
+
+__kernel __attribute__((reqd_work_group_size(I8_WG_N, I8_WG_M, 1)))
+void gemm_i8(
+    __global const char* restrict A_q,      // [M, K]
+    __global const float* restrict a_scale, // [M]
+    __global const char* restrict B,        // W_q [N, K], then w_scale [N]
+    __global half* restrict C,              // [M, N]
+    const int M,
+    const int N,
+    const int K,
+    __global const half* restrict bias)     // [N] epilogue bias (GEMM_EPI_BIAS)
+{
+    __local uint a_tile[I8_TILE_M][I8_TILE_K4];
+    __local uint b_tile[I8_TILE_N][I8_TILE_K4 + 1];  // +1: no bank conflicts on columns
+
+    const int lx = get_local_id(0);
+    const int ly = get_local_id(1);
+    const int lid = mad24(ly, I8_WG_N, lx);
+    const int tile_row = mul24((int)get_group_id(1), I8_TILE_M);
+    const int tile_col = mul24((int)get_group_id(0), I8_TILE_N);
+    const int K4 = K >> 2;
+
+    int acc[I8_ROWS][I8_COLS];
+    for (int r = 0; r < I8_ROWS; ++r)
+        for (int c = 0; c < I8_COLS; ++c) acc[r][c] = 0;
+
+    for (int k0 = 0; k0 < K4; k0 += I8_TILE_K4) {
+        for (int i = lid; i < I8_TILE_M * I8_TILE_K4; i += I8_WG_SIZE) {
+            const int r = i / I8_TILE_K4;
+            const int kk = i % I8_TILE_K4;
+            const int gr = tile_row + r;
+            a_tile[r][kk] = (gr < M && k0 + kk < K4)
+                ? ((__global const uint*)(A_q + gr * K))[k0 + kk] : 0u;
+        }
+        for (int i = lid; i < I8_TILE_N * I8_TILE_K4; i += I8_WG_SIZE) {
+            const int c = i / I8_TILE_K4;
+            const int kk = i % I8_TILE_K4;
+            const int gc = tile_col + c;
+            b_tile[c][kk] = (gc < N && k0 + kk < K4)
+                ? ((__global const uint*)(B + gc * K))[k0 + kk] : 0u;
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        for (int kk = 0; kk < I8_TILE_K4; ++kk) {
+            uint a[I8_ROWS];
+            uint b[I8_COLS];
+            for (int r = 0; r < I8_ROWS; ++r) a[r] = a_tile[mad24(ly, I8_ROWS, r)][kk];
+            for (int c = 0; c < I8_COLS; ++c) b[c] = b_tile[mad24(lx, I8_COLS, c)][kk];
+            for (int r = 0; r < I8_ROWS; ++r)
+                for (int c = 0; c < I8_COLS; ++c) acc[r][c] = I8_DOT4(a[r], b[c], acc[r][c]);
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    const int col = mad24(lx, I8_COLS, tile_col);
+    if (col >= N) return;
+    const float4 w_scale = vload4(0, (__global const float*)(B + N * K) + col);
+
+    for (int r = 0; r < I8_ROWS; ++r) {
+        const int row = mad24(ly, I8_ROWS, tile_row + r);
+        if (row >= M) break;
+        const float4 v = (float4)((float)acc[r][0], (float)acc[r][1],
+                                  (float)acc[r][2], (float)acc[r][3]);
+        store4_epilogue(v * (w_scale * a_scale[row]), bias, C, row, col, N);
     }
 }
@@ -23,10 +23,26 @@
 #define NORM_WG_SIZE 256
 #endif
 
+/* Shape specialization: moondream2_load passes the model config as -D
+ * constants. Every LLM norm runs over LLM_DIM, so with it defined the row
+ * length is a compile-time constant and the row loops below have a fixed
+ * trip count and unroll fully. Without it, hidden_size is used. */
+#ifdef LLM_DIM
+#define NORM_ROW_LEN(hidden_size) LLM_DIM
+#define NORM_UNROLL _Pragma("unroll")
+#else
+#define NORM_ROW_LEN(hidden_size) (hidden_size)
+#define NORM_UNROLL
+#endif
+
+// Row loop iterations of one work-item (element i = it * NORM_WG_SIZE + lid)
+#define NORM_ROW_ITERS(n) (((n) + NORM_WG_SIZE - 1) / NORM_WG_SIZE)
+
 /* ============================================================================
  * RMSNorm: y[i] = x[i] * rsqrt(mean(x^2) + eps) * weight[i]
  *
- * Dispatch: one workgroup per row (each row is `hidden_size` elements).
+ * Dispatch: one workgroup per row (each row is `hidden_size` elements,
+ * LLM_DIM in specialized builds).
  *   global_work_size  = { num_rows * NORM_WG_SIZE }
  *   local_work_size   = { NORM_WG_SIZE }
  *
@@ -47,12 +63,16 @@ __kernel void rms_norm(
 {
     const int lid = get_local_id(0);
     const int row = get_group_id(0);
-    const int row_offset = mul24(row, hidden_size);
+    const int n = NORM_ROW_LEN(hidden_size);
+    const int row_offset = mul24(row, n);
 
     // --- Pass 1: Compute sum of squares ---
     // Each work-item accumulates over a strided portion of the row
     float sum_sq = 0.0f;
-    for (int i = lid; i < hidden_size; i += NORM_WG_SIZE) {
+    NORM_UNROLL
+    for (int it = 0; it < NORM_ROW_ITERS(n); ++it) {
+        const int i = mad24(it, NORM_WG_SIZE, lid);
+        if (i >= n) break;
         const float val = (float)input[row_offset + i];
         sum_sq = fma(val, val, sum_sq);
     }
@@ -80,12 +100,21 @@ __kernel void rms_norm(
     }
     sum_sq = sub_group_reduce_add(sum_sq);
 
-    // Broadcast the final RMS scaling factor to all work-items
+    // Only subgroup 0 holds the row total: broadcast it through local memory
+    __local float row_sum_sq;
+    if (sub_id == 0 && sub_lid == 0) {
+        row_sum_sq = sum_sq;
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
     // rms_scale = rsqrt(mean(x^2) + eps)
-    const float rms_scale = native_rsqrt(sum_sq / (float)hidden_size + eps);
+    const float rms_scale = native_rsqrt(row_sum_sq / (float)n + eps);
 
     // --- Pass 2: Normalize and scale ---
-    for (int i = lid; i < hidden_size; i += NORM_WG_SIZE) {
+    NORM_UNROLL
+    for (int it = 0; it < NORM_ROW_ITERS(n); ++it) {
+        const int i = mad24(it, NORM_WG_SIZE, lid);
+        if (i >= n) break;
         const float val = (float)input[row_offset + i];
         const float w = (float)weight[i];
         const float normed = val * rms_scale * w;
@@ -107,11 +136,15 @@ __kernel void rms_norm(
 {
     const int lid = get_local_id(0);
     const int row = get_group_id(0);
-    const int row_offset = mul24(row, hidden_size);
+    const int n = NORM_ROW_LEN(hidden_size);
+    const int row_offset = mul24(row, n);
 
     // --- Pass 1: Compute sum of squares via local memory reduction ---
     float sum_sq = 0.0f;
-    for (int i = lid; i < hidden_size; i += NORM_WG_SIZE) {
+    NORM_UNROLL
+    for (int it = 0; it < NORM_ROW_ITERS(n); ++it) {
+        const int i = mad24(it, NORM_WG_SIZE, lid);
+        if (i >= n) break;
         const float val = (float)input[row_offset + i];
         sum_sq = fma(val, val, sum_sq);
     }
@@ -129,13 +162,16 @@ __kernel void rms_norm(
     }
 
     // rms_scale = rsqrt(mean(x^2) + eps)
-    const float rms_scale = native_rsqrt(scratch[0] / (float)hidden_size + eps);
+    const float rms_scale = native_rsqrt(scratch[0] / (float)n + eps);
 
     // Barrier to ensure rms_scale is visible before all WIs read scratch[0]
     barrier(CLK_LOCAL_MEM_FENCE);
 
     // --- Pass 2: Normalize and scale ---
-    for (int i = lid; i < hidden_size; i += NORM_WG_SIZE) {
+    NORM_UNROLL
+    for (int it = 0; it < NORM_ROW_ITERS(n); ++it) {
+        const int i = mad24(it, NORM_WG_SIZE, lid);
+        if (i >= n) break;
         const float val = (float)input[row_offset + i];
         const float w = (float)weight[i];
         const float normed = val * rms_scale * w;
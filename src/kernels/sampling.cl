@@ -0,0 +1,413 @@
+/*
+ * MVLM - Token Selection Kernels for Adreno GPUs
+ * Phase 4: Decode Loop
+ *
+ * Picks the next token from the logits on the GPU so only a few bytes
+ * (ids + values) cross the bus per token instead of the whole vocabulary.
+ *
+ * Top-k is computed as k rounds of a workgroup argmax under a strict total
+ * order (higher value first, lower index on ties): round t returns the best
+ * element that ranks below the one chosen in round t-1. No sorting and no
+ * k-sized local buffers are needed, and k = 1 is a plain argmax.
+ *
+ * Sampling chain per token:
+ *   apply_penalties (optional) -> topk_partial -> topk_merge -> sample_token
+ * The token history lives on the GPU and sample_token appends to it. Along
+ * the way the top-k stages also sum softmax(x / T) over the whole vocabulary,
+ * so sample_token normalizes the candidates by the full distribution.
+ *
+ * Greedy decode skips the logits entirely:
+ *   lm_head_argmax -> topk_merge (k = 1)
+ *
+ * Adreno optimizations:
+ *   - int/uint indexing (saves registers vs size_t)
+ *   - Local-memory tree reductions, one (value, index) pair per work-item
+ *   - The logits chunk of a workgroup is small (<= 2 KB) and stays in L1
+ *     across rounds
+ */
+
+#pragma OPENCL EXTENSION cl_khr_fp16 : enable
+
+#ifndef TOPK_WG_SIZE
+#define TOPK_WG_SIZE 256
+#endif
+
+// (value, index) strictly ranks before (v2, i2)
+inline bool topk_before(const float v, const int i, const float v2, const int i2)
+{
+    return v > v2 || (v == v2 && i < i2);
+}
+
+// Workgroup argmax of one (value, index) pair per work-item; ties to the
+// lower index. Returns the winner in *val / *idx on every work-item.
+inline void wg_argmax(__local float* vals, __local int* ids, float* val, int* idx)
+{
+    const int lid = get_local_id(0);
+    vals[lid] = *val;
+    ids[lid] = *idx;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (int stride = TOPK_WG_SIZE >> 1; stride > 0; stride >>= 1) {
+        if (lid < stride &&
+            topk_before(vals[lid + stride], ids[lid + stride], vals[lid], ids[lid])) {
+            vals[lid] = vals[lid + stride];
+            ids[lid] = ids[lid + stride];
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    *val = vals[0];
+    *idx = ids[0];
+    barrier(CLK_LOCAL_MEM_FENCE);
+}
+
+// Workgroup sum of one value per work-item, returned on every work-item
+inline float wg_sum(__local float* vals, float v)
+{
+    const int lid = get_local_id(0);
+    vals[lid] = v;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (int stride = TOPK_WG_SIZE >> 1; stride > 0; stride >>= 1) {
+        if (lid < stride) vals[lid] += vals[lid + stride];
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    v = vals[0];
+    barrier(CLK_LOCAL_MEM_FENCE);
+    return v;
+}
+
+/* ============================================================================
+ * Top-k stage 1: per-workgroup top-k of a contiguous chunk of x
+ *
+ * Dispatch:
+ *   global_work_size  = { num_groups * TOPK_WG_SIZE }
+ *   local_work_size   = { TOPK_WG_SIZE }
+ *
+ * partials layout: [num_groups, k] ids, then [num_groups, k] float values
+ * stored as int bits (id -1 when the chunk has fewer than k elements).
+ * With inv_temperature > 0, then [num_groups] float sums of
+ * exp((x_i - chunk max) * inv_temperature) over each chunk (for topk_merge).
+ * ========================================================================= */
+__kernel void topk_partial(
+    __global const half* restrict x,       // [n]
+    __global int* restrict partials,       // [2 * num_groups * k (+ num_groups)]
+    const int n,
+    const int k,
+    const float inv_temperature)           // > 0: also sum the chunk's softmax
+{
+    const int lid = get_local_id(0);
+    const int group = get_group_id(0);
+    const int num_groups = get_num_groups(0);
+
+    const int chunk = (n + num_groups - 1) / num_groups;
+    const int start = mul24(group, chunk);
+    const int end = min(start + chunk, n);
+
+    __local float red_vals[TOPK_WG_SIZE];
+    __local int red_ids[TOPK_WG_SIZE];
+
+    // Element chosen in the previous round: everything must rank below it
+    float prev_val = FLT_MAX;
+    int prev_idx = -1;
+    float chunk_max = -FLT_MAX;
+
+    for (int t = 0; t < k; ++t) {
+        float best_val = -FLT_MAX;
+        int best_idx = -1;
+        for (int i = start + lid; i < end; i += TOPK_WG_SIZE) {
+            const float v = vload_half(i, x);
+            if (topk_before(prev_val, prev_idx, v, i) &&
+                (best_idx < 0 || topk_before(v, i, best_val, best_idx))) {
+                best_val = v;
+                best_idx = i;
+            }
+        }
+
+        wg_argmax(red_vals, red_ids, &best_val, &best_idx);
+        if (lid == 0) {
+            partials[mad24(group, k, t)] = best_idx;
+            partials[mad24(num_groups + group, k, t)] = as_int(best_val);
+        }
+        if (t == 0) chunk_max = best_val;
+        prev_val = best_val;
+        prev_idx = best_idx;
+    }
+
+    if (inv_temperature > 0.0f) {
+        float sum = 0.0f;
+        for (int i = start + lid; i < end; i += TOPK_WG_SIZE)
+            sum += exp((vload_half(i, x) - chunk_max) * inv_temperature);
+        sum = wg_sum(red_vals, sum);
+        if (lid == 0) partials[mad24(2 * num_groups, k, group)] = as_int(sum);
+    }
+}
+
+/* ============================================================================
+ * Top-k stage 2: merge the num_groups * k stage-1 candidates (one workgroup)
+ *
+ * Dispatch: global_work_size = local_work_size = { TOPK_WG_SIZE }
+ *
+ * result layout: k ids (int), then k values (float), best first. With
+ * num_groups > 0 the chunk sums of topk_partial are rescaled to the overall
+ * max and added up: result[2k] = sum_i exp((x_i - x_max) * inv_temperature)
+ * over the whole input (float).
+ * ========================================================================= */
+__kernel void topk_merge(
+    __global const int* restrict partials, // [2 * num_candidates (+ num_groups)]
+    __global int* restrict result,         // [2 * k (+ 1)]: ids, float values (, sum)
+    const int num_candidates,
+    const int k,
+    const int num_groups,                  // chunks with a softmax sum; 0 = none
+    const float inv_temperature)
+{
+    const int lid = get_local_id(0);
+
+    __local float red_vals[TOPK_WG_SIZE];
+    __local int red_ids[TOPK_WG_SIZE];
+
+    float prev_val = FLT_MAX;
+    int prev_idx = -1;
+    float top_val = -FLT_MAX;
+
+    for (int t = 0; t < k; ++t) {
+        float best_val = -FLT_MAX;
+        int best_idx = -1;
+        for (int c = lid; c < num_candidates; c += TOPK_WG_SIZE) {
+            const int i = partials[c];
+            const float v = as_float(partials[num_candidates + c]);
+            if (i >= 0 && topk_before(prev_val, prev_idx, v, i) &&
+                (best_idx < 0 || topk_before(v, i, best_val, best_idx))) {
+                best_val = v;
+                best_idx = i;
+            }
+        }
+
+        wg_argmax(red_vals, red_ids, &best_val, &best_idx);
+        if (lid == 0) {
+            result[t] = best_idx;
+            result[k + t] = as_int(best_val);
+        }
+        if (t == 0) top_val = best_val;
+        prev_val = best_val;
+        prev_idx = best_idx;
+    }
+
+    if (num_groups > 0) {
+        const int group_k = num_candidates / num_groups;
+        float sum = 0.0f;
+        for (int g = lid; g < num_groups; g += TOPK_WG_SIZE) {
+            const float s = as_float(partials[2 * num_candidates + g]);
+            const float chunk_max = as_float(partials[mad24(g, group_k, num_candidates)]);
+            if (s > 0.0f) sum += s * exp((chunk_max - top_val) * inv_temperature);
+        }
+        sum = wg_sum(red_vals, sum);
+        if (lid == 0) result[2 * k] = as_int(sum);
+    }
+}
+
+/* ============================================================================
+ * Fused LM head + argmax: y = x[1, K] * W[K, N] without storing y
+ *
+ * Each workgroup owns LMH_COLS4 adjacent image columns (4 * LMH_COLS4 vocab
+ * ids). Work-item lid handles column (lid % LMH_COLS4) for the k-lanes
+ * k = lid / LMH_COLS4 (mod TOPK_WG_SIZE / LMH_COLS4), so a row of the slice
+ * is fetched by adjacent work-items. The lanes are reduced in local memory,
+ * then the slice winner is written as a stage-1 candidate for topk_merge.
+ *
+ * Dispatch:
+ *   global_work_size  = { num_groups * TOPK_WG_SIZE }
+ *   local_work_size   = { TOPK_WG_SIZE }
+ *   num_groups        = ceil(N / (4 * LMH_COLS4))
+ *
+ * partials layout: [num_groups] ids, then [num_groups] float values as int
+ * bits (same as topk_partial with k = 1)
+ * ========================================================================= */
+
+#ifndef LMH_COLS4
+#define LMH_COLS4 16
+#endif
+
+#define LMH_LANES (TOPK_WG_SIZE / LMH_COLS4)
+
+__constant sampler_t weight_sampler =
+    CLK_NORMALIZED_COORDS_FALSE |
+    CLK_ADDRESS_CLAMP_TO_EDGE |
+    CLK_FILTER_NEAREST;
+
+__kernel void lm_head_argmax(
+    __global const half* restrict x,     // [1, K] (final-norm hidden state)
+    __read_only image2d_t W_img,         // [K, N] lm_head as image (N/4 wide)
+    __global int* restrict partials,     // [2 * num_groups]
+    const int N,
+    const int K,
+    const int x_offset)                  // element offset of the row in x
+{
+    const int lid = get_local_id(0);
+    const int group = get_group_id(0);
+    const int num_groups = get_num_groups(0);
+
+    const int c = lid % LMH_COLS4;
+    const int lane = lid / LMH_COLS4;
+    const int col4 = mad24(group, LMH_COLS4, c);
+
+    x += x_offset;
+
+    float4 partial = (float4)(0.0f);
+    for (int k = lane; k < K; k += LMH_LANES) {
+        const float x_val = vload_half(k, x);
+        const half4 w_val = read_imageh(W_img, weight_sampler, (int2)(col4, k));
+        partial = fma((float4)(x_val), convert_float4(w_val), partial);
+    }
+
+    // Sum the k-lanes of each column: lid and lid + stride share c
+    __local float4 sums[TOPK_WG_SIZE];
+    sums[lid] = partial;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for (int stride = TOPK_WG_SIZE >> 1; stride >= LMH_COLS4; stride >>= 1) {
+        if (lid < stride) sums[lid] += sums[lid + stride];
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    // Best of the 4 ids of each column, then of the slice
+    float best_val = -FLT_MAX;
+    int best_idx = -1;
+    if (lid < LMH_COLS4) {
+        const float4 y = sums[lid];
+        const int base = col4 << 2;
+        const float v[4] = { y.x, y.y, y.z, y.w };
+        for (int i = 0; i < 4; ++i) {
+            if (base + i < N && (best_idx < 0 || v[i] > best_val)) {
+                best_val = v[i];
+                best_idx = base + i;
+            }
+        }
+    }
+
+    __local float red_vals[TOPK_WG_SIZE];
+    __local int red_ids[TOPK_WG_SIZE];
+    wg_argmax(red_vals, red_ids, &best_val, &best_idx);
+
+    if (lid == 0) {
+        partials[group] = best_idx;
+        partials[num_groups + group] = as_int(best_val);
+    }
+}
+
+/* ============================================================================
+ * Repetition / frequency penalty over the last `window` history tokens
+ *
+ * Dispatch: global_work_size = { round_up(window, 64) }, local = { 64 }
+ *
+ * Work-item j owns history[start + j]; only the first occurrence of a token
+ * in the window updates its logit (in place), so there are no write races.
+ *   l' = (l > 0 ? l / repetition_penalty : l * repetition_penalty)
+ *        - frequency_penalty * count
+ * ========================================================================= */
+__kernel void apply_penalties(
+    __global half* restrict logits,        // [vocab_size], modified in place
+    __global const int* restrict history,  // [history_len]
+    const int history_len,
+    const int window,
+    const int vocab_size,
+    const float repetition_penalty,
+    const float frequency_penalty)
+{
+    const int start = max(history_len - window, 0);
+    const int pos = start + get_global_id(0);
+    if (pos >= history_len) return;
+
+    const int tok = history[pos];
+    if (tok < 0 || tok >= vocab_size) return;
+
+    int count = 0;
+    for (int p = start; p < history_len; ++p) {
+        if (history[p] == tok) {
+            if (p < pos) return;  // an earlier occurrence owns this token
+            ++count;
+        }
+    }
+
+    float l = vload_half(tok, logits);
+    l = (l > 0.0f) ? l / repetition_penalty : l * repetition_penalty;
+    l -= frequency_penalty * (float)count;
+    vstore_half(l, tok, logits);
+}
+
+// Counter-based RNG (PCG hash of seed and step): uniform float in [0, 1)
+inline float rng_uniform(const uint seed, const uint counter)
+{
+    uint state = (counter ^ seed) * 747796405u + 2891336453u;
+    state = state * 747796405u + (seed | 1u);
+    uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    word = (word >> 22u) ^ word;
+    return (float)(word >> 8) * (1.0f / 16777216.0f);
+}
+
+/* ============================================================================
+ * Draw one token from the top-k candidates (output of topk_merge)
+ *
+ * Dispatch: global_work_size = local_work_size = { 1 }
+ *   (at most TOPK_MAX sorted candidates — a serial loop is cheapest)
+ *
+ * temperature <= 0 picks candidate 0 (greedy). Otherwise p = softmax(v / T)
+ * normalized over the whole vocabulary (sum from topk_merge at
+ * candidates[2k]), then keep the longest prefix of the candidates with
+ * cumulative probability < top_p and probability >= min_p * p_max (the best
+ * candidate always stays), and draw from it with rng_uniform(seed, step).
+ * The prefix never extends past the k candidates.
+ * The chosen id is written to out[0] and appended to history[history_len].
+ * ========================================================================= */
+__kernel void sample_token(
+    __global const int* restrict candidates, // [2 * k + 1]: ids, float values, sum
+    __global int* restrict out,              // [1]
+    __global int* restrict history,          // [history_capacity] (may be NULL)
+    const int k,
+    const int history_len,
+    const int history_capacity,
+    const float temperature,
+    const float top_p,
+    const float min_p,
+    const uint seed,
+    const uint step)
+{
+    if (get_global_id(0) != 0) return;
+
+    int chosen = candidates[0];
+
+    if (temperature > 0.0f && k > 1) {
+        const float inv_t = 1.0f / temperature;
+        const float max_v = as_float(candidates[k]);
+
+        // Candidates are sorted, so every filter cuts a suffix
+        int n = 0;
+        float total = 0.0f;
+        for (; n < k && candidates[n] >= 0; ++n)
+            total += exp((as_float(candidates[k + n]) - max_v) * inv_t);
+        // The vocabulary sum covers the candidates too; max() only absorbs rounding
+        total = max(total, as_float(candidates[2 * k]));
+
+        const float inv_total = 1.0f / total;
+        int keep = 1;
+        float cum = inv_total;  // p of candidate 0 (exp(0) / total)
+        for (; keep < n; ++keep) {
+            const float p = exp((as_float(candidates[k + keep]) - max_v) * inv_t) * inv_total;
+            if (cum >= top_p || p < min_p * inv_total) break;
+            cum += p;
+        }
+
+        float r = rng_uniform(seed, step) * cum;
+        chosen = candidates[keep - 1];
+        for (int i = 0; i < keep; ++i) {
+            r -= exp((as_float(candidates[k + i]) - max_v) * inv_t) * inv_total;
+            if (r < 0.0f) {
+                chosen = candidates[i];
+                break;
+            }
+        }
+    }
+
+    out[0] = chosen;
+    if (history && history_len < history_capacity) history[history_len] = chosen;
+}
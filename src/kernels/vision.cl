@@ -210,14 +210,23 @@ __kernel void patch_embed(
  *   global_work_size = { num_patches, hidden_dim / 4 }
  * ========================================================================= */
 
+// Shape specialization: with the model config passed as -D constants
+// (moondream2_load), the row length is VISION_DIM and the tail paths fold away
+#ifdef VISION_DIM
+#define VISION_ROW_LEN(arg) VISION_DIM
+#else
+#define VISION_ROW_LEN(arg) (arg)
+#endif
+
 __kernel void vision_rmsnorm(
     __global const half* restrict input,     // [num_patches, hidden_dim]
     __global half* restrict output,          // [num_patches, hidden_dim]
     __global const half* restrict weight,   // [hidden_dim]
     const int num_patches,
-    const int hidden_dim,
+    const int hidden_dim_arg,
     const float eps)
 {
+    const int hidden_dim = VISION_ROW_LEN(hidden_dim_arg);
     const int patch_idx = get_global_id(0);
     const int dim4 = get_global_id(1);  // group of 4
 
@@ -1,5 +1,6 @@
 #include "gguf_loader.h"
 
+#include <cmath>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
@@ -54,6 +55,193 @@ int ggml_type_block_size(GGMLType type) {
     }
 }
 
+float ggml_fp16_to_fp32(uint16_t h) {
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t exp = (h >> 10) & 0x1F;
+    uint32_t mant = h & 0x3FF;
+    uint32_t bits;
+    if (exp == 0) {
+        if (mant == 0) {
+            bits = sign;
+        } else {
+            // Subnormal: normalize the mantissa
+            exp = 127 - 15 + 1;
+            while (!(mant & 0x400)) {
+                mant <<= 1;
+                exp--;
+            }
+            bits = sign | (exp << 23) | ((mant & 0x3FF) << 13);
+        }
+    } else if (exp == 31) {
+        bits = sign | 0x7F800000 | (mant << 13);
+    } else {
+        bits = sign | ((exp - 15 + 127) << 23) | (mant << 13);
+    }
+    float f;
+    memcpy(&f, &bits, 4);
+    return f;
+}
+
+uint16_t ggml_fp32_to_fp16(float f) {
+    uint32_t bits;
+    memcpy(&bits, &f, 4);
+    uint16_t sign = (uint16_t)((bits >> 16) & 0x8000);
+    int32_t exp = (int32_t)((bits >> 23) & 0xFF) - 127 + 15;
+    uint32_t mant = bits & 0x7FFFFF;
+
+    if (((bits >> 23) & 0xFF) == 0xFF)  // inf / nan
+        return (uint16_t)(sign | 0x7C00 | (mant ? 0x200 : 0));
+    if (exp >= 31) return (uint16_t)(sign | 0x7C00);
+    if (exp <= 0) {
+        if (exp < -10) return sign;
+        // Subnormal: shift in the implicit bit, round to nearest even
+        mant |= 0x800000;
+        int shift = 14 - exp;
+        uint32_t half_mant = mant >> shift;
+        uint32_t rest = mant & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half_mant & 1))) half_mant++;
+        return (uint16_t)(sign | half_mant);
+    }
+    uint32_t h = ((uint32_t)exp << 10) | (mant >> 13);
+    uint32_t rest = mant & 0x1FFF;
+    if (rest > 0x1000 || (rest == 0x1000 && (h & 1))) h++;  // may carry into exp
+    return (uint16_t)(sign | h);
+}
+
+static float load_fp16(const uint8_t* p) {
+    uint16_t h;
+    memcpy(&h, p, 2);
+    return ggml_fp16_to_fp32(h);
+}
+
+// 6-bit scale and min of sub-block j of a Q4_K / Q5_K super-block
+static void k_scale_min(const uint8_t* q, int j, int* sc, int* m) {
+    if (j < 4) {
+        *sc = q[j] & 63;
+        *m = q[j + 4] & 63;
+    } else {
+        *sc = (q[j + 4] & 0x0F) | ((q[j - 4] >> 6) << 4);
+        *m = (q[j + 4] >> 4) | ((q[j] >> 6) << 4);
+    }
+}
+
+bool ggml_dequantize(GGMLType type, const void* src, float* dst, size_t n) {
+    const uint8_t* p = (const uint8_t*)src;
+    switch (type) {
+        case GGMLType::F32:
+            memcpy(dst, src, n * sizeof(float));
+            return true;
+        case GGMLType::F16:
+            for (size_t i = 0; i < n; i++) {
+                uint16_t h;
+                memcpy(&h, p + 2 * i, 2);
+                dst[i] = ggml_fp16_to_fp32(h);
+            }
+            return true;
+        case GGMLType::Q4_0:
+            // half d, 16 bytes: low nibbles are elements 0..15, high 16..31
+            for (size_t b = 0; b < n / 32; b++, p += 18, dst += 32) {
+                uint16_t dh;
+                memcpy(&dh, p, 2);
+                float d = ggml_fp16_to_fp32(dh);
+                for (int j = 0; j < 16; j++) {
+                    dst[j] = (float)((p[2 + j] & 0x0F) - 8) * d;
+                    dst[j + 16] = (float)((p[2 + j] >> 4) - 8) * d;
+                }
+            }
+            return n % 32 == 0;
+        case GGMLType::Q8_0:
+            // half d, 32 x int8
+            for (size_t b = 0; b < n / 32; b++, p += 34, dst += 32) {
+                uint16_t dh;
+                memcpy(&dh, p, 2);
+                float d = ggml_fp16_to_fp32(dh);
+                for (int j = 0; j < 32; j++) dst[j] = (float)(int8_t)p[2 + j] * d;
+            }
+            return n % 32 == 0;
+        case GGMLType::Q4_K:
+            // half d, half dmin, 12 bytes of 6-bit scales/mins, 128 bytes:
+            // 64-element chunks, low nibbles first
+            for (size_t b = 0; b < n / 256; b++, p += 144, dst += 256) {
+                float d = load_fp16(p);
+                float dmin = load_fp16(p + 2);
+                const uint8_t* qs = p + 16;
+                for (int s = 0; s < 8; s++) {
+                    int sc, m;
+                    k_scale_min(p + 4, s, &sc, &m);
+                    for (int l = 0; l < 32; l++) {
+                        int q = (qs[32 * (s / 2) + l] >> (4 * (s & 1))) & 0x0F;
+                        dst[32 * s + l] = d * sc * q - dmin * m;
+                    }
+                }
+            }
+            return n % 256 == 0;
+        case GGMLType::Q5_K:
+            // As Q4_K plus 32 bytes of high bits: bit s of qh[l] for sub-block s
+            for (size_t b = 0; b < n / 256; b++, p += 176, dst += 256) {
+                float d = load_fp16(p);
+                float dmin = load_fp16(p + 2);
+                const uint8_t* qh = p + 16;
+                const uint8_t* qs = p + 48;
+                for (int s = 0; s < 8; s++) {
+                    int sc, m;
+                    k_scale_min(p + 4, s, &sc, &m);
+                    for (int l = 0; l < 32; l++) {
+                        int q = ((qs[32 * (s / 2) + l] >> (4 * (s & 1))) & 0x0F) |
+                                (((qh[l] >> s) & 1) << 4);
+                        dst[32 * s + l] = d * sc * q - dmin * m;
+                    }
+                }
+            }
+            return n % 256 == 0;
+        case GGMLType::Q6_K:
+            // 128 bytes low nibbles, 64 bytes 2-bit highs, 16 int8 scales
+            // (one per 16 elements), half d; two 128-element halves
+            for (size_t b = 0; b < n / 256; b++, p += 210, dst += 256) {
+                float d = load_fp16(p + 208);
+                for (int h = 0; h < 2; h++) {
+                    const uint8_t* ql = p + 64 * h;
+                    const uint8_t* qh = p + 128 + 32 * h;
+                    const int8_t* sc = (const int8_t*)(p + 192) + 8 * h;
+                    float* y = dst + 128 * h;
+                    for (int l = 0; l < 32; l++) {
+                        int is = l / 16;
+                        int q1 = ((ql[l] & 0x0F) | (((qh[l] >> 0) & 3) << 4)) - 32;
+                        int q2 = ((ql[l + 32] & 0x0F) | (((qh[l] >> 2) & 3) << 4)) - 32;
+                        int q3 = ((ql[l] >> 4) | (((qh[l] >> 4) & 3) << 4)) - 32;
+                        int q4 = ((ql[l + 32] >> 4) | (((qh[l] >> 6) & 3) << 4)) - 32;
+                        y[l] = d * sc[is] * q1;
+                        y[l + 32] = d * sc[is + 2] * q2;
+                        y[l + 64] = d * sc[is + 4] * q3;
+                        y[l + 96] = d * sc[is + 6] * q4;
+                    }
+                }
+            }
+            return n % 256 == 0;
+        default:
+            return false;
+    }
+}
+
+bool ggml_quantize_q8_0(const float* src, void* dst, size_t n) {
+    if (n % 32 != 0) return false;
+    uint8_t* p = (uint8_t*)dst;
+    for (size_t b = 0; b < n / 32; b++, p += 34, src += 32) {
+        float amax = 0.0f;
+        for (int j = 0; j < 32; j++) amax = fmaxf(amax, fabsf(src[j]));
+        uint16_t dh = ggml_fp32_to_fp16(amax / 127.0f);
+        memcpy(p, &dh, 2);
+        float d = ggml_fp16_to_fp32(dh);
+        float id = d > 0.0f ? 1.0f / d : 0.0f;
+        for (int j = 0; j < 32; j++) {
+            float q = roundf(src[j] * id);
+            p[2 + j] = (uint8_t)(int8_t)(q > 127.0f ? 127.0f : (q < -127.0f ? -127.0f : q));
+        }
+    }
+    return true;
+}
+
 static const char* ggml_type_name(GGMLType type) {
     switch (type) {
         case GGMLType::F32:  return "F32";
@@ -81,6 +81,19 @@ size_t ggml_type_size(GGMLType type);
 // Get block size for quantized types (number of elements per block)
 int ggml_type_block_size(GGMLType type);
 
+// IEEE fp16 <-> fp32 (round to nearest even, subnormals kept)
+float ggml_fp16_to_fp32(uint16_t h);
+uint16_t ggml_fp32_to_fp16(float f);
+
+// Dequantize n elements of `type` data (n a multiple of the block size) to
+// fp32: the CPU reference for the GPU dequant kernels. Supports F32, F16,
+// Q4_0, Q8_0, Q4_K, Q5_K and Q6_K; returns false for other types.
+bool ggml_dequantize(GGMLType type, const void* src, float* dst, size_t n);
+
+// Quantize n fp32 values (n a multiple of 32) to Q8_0 blocks: per block
+// d = absmax / 127 (fp16), q = round(x / d). Inverse of ggml_dequantize.
+bool ggml_quantize_q8_0(const float* src, void* dst, size_t n);
+
 // Close and unmap the file
 void gguf_close(GGUFFile* file);
 
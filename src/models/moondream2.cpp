@@ -3,6 +3,7 @@
 #include "../engine/compute.h"
 
 #include <cmath>
+#include <cstdint>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
@@ -22,6 +23,52 @@ static cl_program load_kernel(const DeviceInfo* device, const char* kernel_dir,
     return prog;
 }
 
+// Build options of one kernel file, most specialized first. The shape
+// constants tie a program to this model's dimensions (see the #ifdef
+// HEAD_DIM / LLM_DIM blocks in the kernels); the generic build takes every
+// shape as an argument.
+struct KernelBuildOptions {
+    const char* generic;        // device capabilities only
+    const char* specialized;    // + model shape constants
+    const char* tuned;          // + tuned launch shapes, or null
+    const KernelTuning* tuning; // shapes of `tuned`
+};
+
+// Build `filename` with the most specialized options that compile: tuned
+// (if `tunable` and there is a tuning), specialized, then generic. A tuned
+// program is registered with its tuning.
+static cl_program load_specialized_kernel(const DeviceInfo* device, const char* kernel_dir,
+                                          const char* filename, const KernelBuildOptions* opts,
+                                          bool tunable) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", kernel_dir, filename);
+
+    if (tunable && opts->tuned) {
+        cl_program prog = build_program_from_file(device, path, opts->tuned);
+        if (prog && kernel_tuning_register(prog, opts->tuning)) return prog;
+        if (prog) clReleaseProgram(prog);
+        fprintf(stderr, "Warning: tuned build of %s failed, using default shapes\n", path);
+    }
+
+    cl_program prog = build_program_from_file(device, path, opts->specialized);
+    if (prog) return prog;
+    fprintf(stderr, "Warning: specialized build of %s failed, using generic kernels\n", path);
+    return load_kernel(device, kernel_dir, filename, opts->generic);
+}
+
+// Device capabilities select kernel variants at build time, and the model
+// config is compiled in as constants (shape-specialized kernels)
+void moondream2_build_options(const DeviceInfo* device, const Moondream2Config& cfg,
+                              char* base, size_t base_size,
+                              char* specialized, size_t specialized_size) {
+    snprintf(base, base_size, "-cl-mad-enable -cl-fast-relaxed-math%s%s",
+             device->has_subgroups ? " -DMGPU_SUBGROUPS" : "",
+             device->has_int_dot_product ? " -DMGPU_INT_DOT" : "");
+    snprintf(specialized, specialized_size,
+             "%s -DHEAD_DIM=%d -DLLM_DIM=%d -DINTERMEDIATE=%d -DVISION_DIM=%d",
+             base, cfg.head_dim, cfg.llm_dim, cfg.llm_intermediate, cfg.vision_dim);
+}
+
 // Try several naming conventions for GGUF tensor lookup
 static const TensorInfo* find_weight(const GGUFFile* file, const char* name) {
     const TensorInfo* t = gguf_find_tensor(file, name);
@@ -58,14 +105,51 @@ static const TensorInfo* find_layer_weight(const GGUFFile* file, int layer,
     return gguf_find_tensor(file, name);
 }
 
-// Upload a 2D weight matrix as an image object (for fp16 data)
+// Dequantize a whole tensor to a malloc'd fp16 copy (nullptr on failure)
+static cl_half* dequantize_f16(const GGUFFile* file, const TensorInfo* tensor) {
+    size_t n = 1;
+    for (uint32_t i = 0; i < tensor->n_dims; i++) n *= (size_t)tensor->dims[i];
+
+    float* f32 = (float*)malloc(n * sizeof(float));
+    cl_half* f16 = (cl_half*)malloc(n * sizeof(cl_half));
+    if (!f32 || !f16 || !ggml_dequantize(tensor->type, gguf_tensor_data(file, tensor), f32, n)) {
+        fprintf(stderr, "Error: cannot convert tensor '%s' (type=%d) to F16\n",
+                tensor->name, (int)tensor->type);
+        free(f32);
+        free(f16);
+        return nullptr;
+    }
+    for (size_t i = 0; i < n; i++) f16[i] = ggml_fp32_to_fp16(f32[i]);
+    free(f32);
+    return f16;
+}
+
+// Quantized kernel format of a GGUF tensor type (WEIGHT_F16: none)
+static WeightFormat quant_weight_format(GGMLType type) {
+    switch (type) {
+        case GGMLType::Q4_0: return WEIGHT_Q4_0;
+        case GGMLType::Q8_0: return WEIGHT_Q8_0;
+        case GGMLType::Q4_K: return WEIGHT_Q4_K;
+        case GGMLType::Q5_K: return WEIGHT_Q5_K;
+        case GGMLType::Q6_K: return WEIGHT_Q6_K;
+        default:             return WEIGHT_F16;
+    }
+}
+
+// Upload a 2D weight matrix. F16 goes to an image object (texture cache
+// path). With `format`, tensors of a type the quantized kernels execute
+// (Q4_0, Q8_0, Q4_K, Q5_K, Q6_K) stay in their GGUF blocks in a buffer and
+// *format says which; anything else (or any non-F16 tensor when `format` is
+// null) is converted to an F16 image.
 static cl_mem upload_weight_image(const DeviceInfo* device, const GGUFFile* file,
-                                  const TensorInfo* tensor) {
+                                  const TensorInfo* tensor, WeightFormat* format = nullptr) {
+    if (format) *format = WEIGHT_F16;
     if (!tensor) return nullptr;
 
-    if (tensor->type != GGMLType::F16) {
-        fprintf(stderr, "  Warning: tensor '%s' is not F16 (type=%d), storing as buffer\n",
-                tensor->name, (int)tensor->type);
+    WeightFormat quant = quant_weight_format(tensor->type);
+    if (format && quant != WEIGHT_F16 && tensor->n_dims == 2 &&
+        tensor->dims[0] % weight_format_block_size(quant) == 0) {
+        *format = quant;
         const void* data = gguf_tensor_data(file, tensor);
         return create_buffer(device, tensor->data_size,
                              CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
@@ -79,10 +163,149 @@ static cl_mem upload_weight_image(const DeviceInfo* device, const GGUFFile* file
         cols = (int)tensor->dims[0];
     }
 
+    if (tensor->type != GGMLType::F16) {
+        cl_half* converted = dequantize_f16(file, tensor);
+        if (!converted) return nullptr;
+        cl_mem img = create_weight_image(device, rows, cols, converted);
+        free(converted);
+        return img;
+    }
+
     const cl_half* data = (const cl_half*)gguf_tensor_data(file, tensor);
     return create_weight_image(device, rows, cols, data);
 }
 
+// Upload a 2D projection as WEIGHT_I8 (per-output-column int8) for the W8A8
+// kernels, from any GGUF type. Shapes the kernels cannot take (K or N not a
+// multiple of 4) go through upload_weight_image instead.
+static cl_mem upload_weight_i8(const DeviceInfo* device, const GGUFFile* file,
+                               const TensorInfo* tensor, WeightFormat* format) {
+    if (!tensor || tensor->n_dims != 2 || tensor->dims[0] % 4 != 0 || tensor->dims[1] % 4 != 0)
+        return upload_weight_image(device, file, tensor, format);
+
+    const int N = (int)tensor->dims[0];
+    const int K = (int)tensor->dims[1];
+    const size_t n = (size_t)K * N;
+    float* f32 = (float*)malloc(n * sizeof(float));
+    void* q = malloc(weight_i8_bytes(K, N));
+    if (!f32 || !q || !ggml_dequantize(tensor->type, gguf_tensor_data(file, tensor), f32, n)) {
+        fprintf(stderr, "Error: cannot convert tensor '%s' (type=%d) to int8\n",
+                tensor->name, (int)tensor->type);
+        free(f32);
+        free(q);
+        return nullptr;
+    }
+    quantize_weight_i8(f32, K, N, q);
+    free(f32);
+
+    cl_mem buf = create_buffer(device, weight_i8_bytes(K, N),
+                               CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, q);
+    free(q);
+    if (buf) *format = WEIGHT_I8;
+    return buf;
+}
+
+// Several F16 matrices with the same row count, their columns side by side:
+// [rows, cols_0 + cols_1 + ...] (malloc'd). Each part's column count must be
+// a multiple of 4 so no texel straddles two parts, and the result at most
+// `max_texels` texels wide. Returns nullptr if the parts cannot be fused.
+static cl_half* fuse_weight_columns(const GGUFFile* file, const TensorInfo* const* parts,
+                                    int num_parts, size_t max_texels,
+                                    int* out_rows, int* out_cols) {
+    int rows = 0;
+    int total_cols = 0;
+    for (int p = 0; p < num_parts; p++) {
+        const TensorInfo* t = parts[p];
+        if (!t || t->type != GGMLType::F16 || t->n_dims != 2) return nullptr;
+        if (p == 0) rows = (int)t->dims[1];
+        if ((int)t->dims[1] != rows || t->dims[0] % 4 != 0) return nullptr;
+        total_cols += (int)t->dims[0];
+    }
+    if ((size_t)(total_cols / 4) > max_texels) return nullptr;
+
+    cl_half* fused = (cl_half*)malloc((size_t)rows * total_cols * sizeof(cl_half));
+    if (!fused) return nullptr;
+
+    int col_offset = 0;
+    for (int p = 0; p < num_parts; p++) {
+        const cl_half* src = (const cl_half*)gguf_tensor_data(file, parts[p]);
+        int cols = (int)parts[p]->dims[0];
+        for (int r = 0; r < rows; r++) {
+            memcpy(fused + (size_t)r * total_cols + col_offset,
+                   src + (size_t)r * cols, (size_t)cols * sizeof(cl_half));
+        }
+        col_offset += cols;
+    }
+
+    *out_rows = rows;
+    *out_cols = total_cols;
+    return fused;
+}
+
+// Upload several F16 matrices with the same row count as one image (see
+// fuse_weight_columns). Returns nullptr if the parts cannot be fused; the
+// caller then uploads them separately.
+static cl_mem upload_fused_weight_image(const DeviceInfo* device, const GGUFFile* file,
+                                        const TensorInfo* const* parts, int num_parts) {
+    int rows, cols;
+    cl_half* fused = fuse_weight_columns(file, parts, num_parts, device->max_image2d_width,
+                                         &rows, &cols);
+    if (!fused) return nullptr;
+    cl_mem img = create_weight_image(device, rows, cols, fused);
+    free(fused);
+    return img;
+}
+
+// Two F16 matrices of the same shape [rows, cols] as one [rows, 2 * cols]
+// matrix (malloc'd) whose texel columns alternate between them: texel
+// column 2j = a[:, 4j..4j+3], 2j+1 = b[:, 4j..4j+3]. Used for the fused
+// gate/up MLP kernels. Returns nullptr if the pair cannot be interleaved.
+static cl_half* interleave_weight_columns(const GGUFFile* file, const TensorInfo* a,
+                                          const TensorInfo* b, size_t max_texels,
+                                          int* out_rows, int* out_cols) {
+    if (!a || !b) return nullptr;
+    if (a->type != GGMLType::F16 || b->type != GGMLType::F16) return nullptr;
+    if (a->n_dims != 2 || b->n_dims != 2) return nullptr;
+    if (a->dims[0] != b->dims[0] || a->dims[1] != b->dims[1] || a->dims[0] % 4 != 0)
+        return nullptr;
+
+    int rows = (int)a->dims[1];
+    int cols = (int)a->dims[0];
+    if ((size_t)(cols / 2) > max_texels) return nullptr;
+
+    cl_half* packed = (cl_half*)malloc((size_t)rows * cols * 2 * sizeof(cl_half));
+    if (!packed) return nullptr;
+
+    const cl_half* src_a = (const cl_half*)gguf_tensor_data(file, a);
+    const cl_half* src_b = (const cl_half*)gguf_tensor_data(file, b);
+    for (int r = 0; r < rows; r++) {
+        cl_half* dst = packed + (size_t)r * cols * 2;
+        const cl_half* ra = src_a + (size_t)r * cols;
+        const cl_half* rb = src_b + (size_t)r * cols;
+        for (int c = 0; c < cols; c += 4) {
+            memcpy(dst + 2 * c,     ra + c, 4 * sizeof(cl_half));
+            memcpy(dst + 2 * c + 4, rb + c, 4 * sizeof(cl_half));
+        }
+    }
+
+    *out_rows = rows;
+    *out_cols = cols * 2;
+    return packed;
+}
+
+// Upload a gate/up pair as one interleaved image (see
+// interleave_weight_columns), or nullptr if it cannot be interleaved
+static cl_mem upload_interleaved_weight_image(const DeviceInfo* device, const GGUFFile* file,
+                                              const TensorInfo* a, const TensorInfo* b) {
+    int rows, cols;
+    cl_half* packed = interleave_weight_columns(file, a, b, device->max_image2d_width,
+                                                &rows, &cols);
+    if (!packed) return nullptr;
+    cl_mem img = create_weight_image(device, rows, cols, packed);
+    free(packed);
+    return img;
+}
+
 // Upload a 1D weight vector as a buffer
 static cl_mem upload_weight_buffer(const DeviceInfo* device, const GGUFFile* file,
                                    const TensorInfo* tensor) {
@@ -94,6 +317,98 @@ static cl_mem upload_weight_buffer(const DeviceInfo* device, const GGUFFile* fil
                          (void*)data);
 }
 
+// --- Weight Lookup ---
+
+// GGUF tensors of the LLM (any may be null), under the naming conventions
+// of the converters we have seen
+struct LLMTensors {
+    const TensorInfo* embed;
+    const TensorInfo* final_norm;
+    const TensorInfo* lm_head;
+};
+
+struct LayerTensors {
+    const TensorInfo* q;
+    const TensorInfo* k;
+    const TensorInfo* v;
+    const TensorInfo* o;
+    const TensorInfo* gate;
+    const TensorInfo* up;
+    const TensorInfo* down;
+    const TensorInfo* input_norm;
+    const TensorInfo* post_norm;
+};
+
+static void find_llm_tensors(const GGUFFile* f, LLMTensors* t) {
+    t->embed = find_weight(f, "embed_tokens.weight");
+    if (!t->embed) t->embed = find_weight(f, "token_embd.weight");
+
+    t->final_norm = find_weight(f, "norm.weight");
+    if (!t->final_norm) t->final_norm = find_weight(f, "output_norm.weight");
+
+    t->lm_head = find_weight(f, "lm_head.weight");
+    if (!t->lm_head) t->lm_head = find_weight(f, "output.weight");
+}
+
+static void find_layer_tensors(const GGUFFile* f, int i, LayerTensors* t) {
+    t->q = find_layer_weight(f, i, "self_attn.q_proj.weight");
+    if (!t->q) t->q = find_layer_weight(f, i, "attn.q_proj.weight");
+    if (!t->q) t->q = find_layer_weight(f, i, "attn_q.weight");
+
+    t->k = find_layer_weight(f, i, "self_attn.k_proj.weight");
+    if (!t->k) t->k = find_layer_weight(f, i, "attn.k_proj.weight");
+    if (!t->k) t->k = find_layer_weight(f, i, "attn_k.weight");
+
+    t->v = find_layer_weight(f, i, "self_attn.v_proj.weight");
+    if (!t->v) t->v = find_layer_weight(f, i, "attn.v_proj.weight");
+    if (!t->v) t->v = find_layer_weight(f, i, "attn_v.weight");
+
+    t->o = find_layer_weight(f, i, "self_attn.dense.weight");
+    if (!t->o) t->o = find_layer_weight(f, i, "self_attn.o_proj.weight");
+    if (!t->o) t->o = find_layer_weight(f, i, "attn_output.weight");
+
+    t->gate = find_layer_weight(f, i, "mlp.fc1.weight");
+    if (!t->gate) t->gate = find_layer_weight(f, i, "mlp.gate_proj.weight");
+    if (!t->gate) t->gate = find_layer_weight(f, i, "ffn_gate.weight");
+
+    t->up = find_layer_weight(f, i, "mlp.fc1.weight"); // Phi uses single fc1 for gate+up packed
+    if (!t->up) t->up = find_layer_weight(f, i, "mlp.up_proj.weight");
+    if (!t->up) t->up = find_layer_weight(f, i, "ffn_up.weight");
+
+    t->down = find_layer_weight(f, i, "mlp.fc2.weight");
+    if (!t->down) t->down = find_layer_weight(f, i, "mlp.down_proj.weight");
+    if (!t->down) t->down = find_layer_weight(f, i, "ffn_down.weight");
+
+    t->input_norm = find_layer_weight(f, i, "input_layernorm.weight");
+    if (!t->input_norm) t->input_norm = find_layer_weight(f, i, "attn_norm.weight");
+
+    t->post_norm = find_layer_weight(f, i, "post_attention_layernorm.weight");
+    if (!t->post_norm) t->post_norm = find_layer_weight(f, i, "ffn_norm.weight");
+}
+
+// The fused QKV kernels need three [dim, dim] projections and whole texels
+// per head
+static bool qkv_fusable(const Moondream2Config& cfg, const LayerTensors* t) {
+    return t->q && t->k && t->v && (int)t->q->dims[0] == cfg.llm_dim &&
+           (int)t->k->dims[0] == cfg.llm_dim && (int)t->v->dims[0] == cfg.llm_dim &&
+           cfg.head_dim % 4 == 0;
+}
+
+static bool gate_up_fusable(const Moondream2Config& cfg, const LayerTensors* t) {
+    return t->gate && (int)t->gate->dims[0] == cfg.llm_intermediate;
+}
+
+// The embedding kernel gathers F16 rows: a malloc'd F16 copy of a table of
+// another type (nullptr for F16 or on failure; see *failed)
+static cl_half* embed_table_f16(const GGUFFile* f, const TensorInfo* embed, size_t* bytes,
+                                bool* failed) {
+    cl_half* converted = (embed->type != GGMLType::F16) ? dequantize_f16(f, embed) : nullptr;
+    *failed = embed->type != GGMLType::F16 && !converted;
+    *bytes = converted ? (size_t)embed->dims[0] * embed->dims[1] * sizeof(cl_half)
+                       : embed->data_size;
+    return converted;
+}
+
 // --- Weight Upload ---
 
 bool moondream2_upload_weights(Moondream2Model* model, const DeviceInfo* device) {
@@ -103,14 +418,21 @@ bool moondream2_upload_weights(Moondream2Model* model, const DeviceInfo* device)
 
     printf("Uploading weights to GPU...\n");
 
+    LLMTensors lt;
+    find_llm_tensors(f, &lt);
+
     // Token embeddings — large matrix, use buffer
-    const TensorInfo* embed = find_weight(f, "embed_tokens.weight");
-    if (!embed) embed = find_weight(f, "token_embd.weight");
+    const TensorInfo* embed = lt.embed;
     if (embed) {
-        const void* data = gguf_tensor_data(f, embed);
-        w->token_embed = create_buffer(device, embed->data_size,
+        size_t embed_bytes;
+        bool failed;
+        cl_half* converted = embed_table_f16(f, embed, &embed_bytes, &failed);
+        if (failed) return false;
+        const void* data = converted ? (const void*)converted : gguf_tensor_data(f, embed);
+        w->token_embed = create_buffer(device, embed_bytes,
                                        CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
                                        (void*)data);
+        free(converted);
         printf("  token_embed: %llu x %llu (%.1f MB)\n",
                (unsigned long long)embed->dims[1], (unsigned long long)embed->dims[0],
                (double)embed->data_size / (1024.0 * 1024.0));
@@ -120,76 +442,373 @@ bool moondream2_upload_weights(Moondream2Model* model, const DeviceInfo* device)
     }
 
     // Final norm
-    const TensorInfo* fnorm = find_weight(f, "norm.weight");
-    if (!fnorm) fnorm = find_weight(f, "output_norm.weight");
-    if (fnorm) w->final_norm_weight = upload_weight_buffer(device, f, fnorm);
+    if (lt.final_norm) w->final_norm_weight = upload_weight_buffer(device, f, lt.final_norm);
 
-    // LM head
-    const TensorInfo* lmh = find_weight(f, "lm_head.weight");
-    if (!lmh) lmh = find_weight(f, "output.weight");
-    if (lmh) w->lm_head_weight = upload_weight_image(device, f, lmh);
+    // LM head (always F16: the fused argmax kernel reads an image)
+    if (lt.lm_head) w->lm_head_weight = upload_weight_image(device, f, lt.lm_head);
 
     // Transformer layers
     w->num_layers = cfg.llm_layers;
     w->layers = (TransformerLayerWeights*)calloc(w->num_layers, sizeof(TransformerLayerWeights));
     if (!w->layers) return false;
 
+    // W8A8: every projection unfused as WEIGHT_I8 (the fused kernels are F16)
+    auto upload_proj = [&](const TensorInfo* t, WeightFormat* format) {
+        return cfg.w8a8 ? upload_weight_i8(device, f, t, format)
+                        : upload_weight_image(device, f, t, format);
+    };
+
     int loaded = 0;
+    int fused_qkv = 0;
+    int fused_mlp = 0;
+    int quantized = 0;
     for (int i = 0; i < w->num_layers; i++) {
         TransformerLayerWeights* lw = &w->layers[i];
+        LayerTensors t;
+        find_layer_tensors(f, i, &t);
+
+        // One [dim, 3*dim] image for the fused QKV kernels; separate images
+        // only if the tensors cannot be concatenated (type / shape mismatch)
+        const TensorInfo* qkv[3] = { t.q, t.k, t.v };
+        if (!cfg.w8a8 && qkv_fusable(cfg, &t))
+            lw->qkv_proj_weight = upload_fused_weight_image(device, f, qkv, 3);
+        if (lw->qkv_proj_weight) fused_qkv++;
+        if (!lw->qkv_proj_weight) {
+            lw->q_proj_weight = upload_proj(t.q, &lw->q_proj_format);
+            lw->k_proj_weight = upload_proj(t.k, &lw->k_proj_format);
+            lw->v_proj_weight = upload_proj(t.v, &lw->v_proj_format);
+        }
+
+        lw->o_proj_weight = upload_proj(t.o, &lw->o_proj_format);
+
+        // Interleaved gate/up image for the fused SiLU-multiply kernels
+        if (!cfg.w8a8 && gate_up_fusable(cfg, &t))
+            lw->gate_up_weight = upload_interleaved_weight_image(device, f, t.gate, t.up);
+        if (lw->gate_up_weight) {
+            fused_mlp++;
+        } else {
+            lw->gate_proj_weight = upload_proj(t.gate, &lw->gate_proj_format);
+            lw->up_proj_weight = upload_proj(t.up, &lw->up_proj_format);
+        }
 
-        // Attention projections
-        const TensorInfo* t;
-
-        t = find_layer_weight(f, i, "self_attn.q_proj.weight");
-        if (!t) t = find_layer_weight(f, i, "attn.q_proj.weight");
-        if (!t) t = find_layer_weight(f, i, "attn_q.weight");
-        lw->q_proj_weight = upload_weight_image(device, f, t);
-
-        t = find_layer_weight(f, i, "self_attn.k_proj.weight");
-        if (!t) t = find_layer_weight(f, i, "attn.k_proj.weight");
-        if (!t) t = find_layer_weight(f, i, "attn_k.weight");
-        lw->k_proj_weight = upload_weight_image(device, f, t);
-
-        t = find_layer_weight(f, i, "self_attn.v_proj.weight");
-        if (!t) t = find_layer_weight(f, i, "attn.v_proj.weight");
-        if (!t) t = find_layer_weight(f, i, "attn_v.weight");
-        lw->v_proj_weight = upload_weight_image(device, f, t);
-
-        t = find_layer_weight(f, i, "self_attn.dense.weight");
-        if (!t) t = find_layer_weight(f, i, "self_attn.o_proj.weight");
-        if (!t) t = find_layer_weight(f, i, "attn_output.weight");
-        lw->o_proj_weight = upload_weight_image(device, f, t);
-
-        // MLP projections
-        t = find_layer_weight(f, i, "mlp.fc1.weight");
-        if (!t) t = find_layer_weight(f, i, "mlp.gate_proj.weight");
-        if (!t) t = find_layer_weight(f, i, "ffn_gate.weight");
-        lw->gate_proj_weight = upload_weight_image(device, f, t);
-
-        t = find_layer_weight(f, i, "mlp.fc1.weight"); // Phi uses single fc1 for gate+up packed
-        if (!t) t = find_layer_weight(f, i, "mlp.up_proj.weight");
-        if (!t) t = find_layer_weight(f, i, "ffn_up.weight");
-        lw->up_proj_weight = upload_weight_image(device, f, t);
-
-        t = find_layer_weight(f, i, "mlp.fc2.weight");
-        if (!t) t = find_layer_weight(f, i, "mlp.down_proj.weight");
-        if (!t) t = find_layer_weight(f, i, "ffn_down.weight");
-        lw->down_proj_weight = upload_weight_image(device, f, t);
+        lw->down_proj_weight = upload_proj(t.down, &lw->down_proj_format);
 
         // Norms
-        t = find_layer_weight(f, i, "input_layernorm.weight");
-        if (!t) t = find_layer_weight(f, i, "attn_norm.weight");
-        lw->input_norm_weight = upload_weight_buffer(device, f, t);
+        lw->input_norm_weight = upload_weight_buffer(device, f, t.input_norm);
+        lw->post_norm_weight = upload_weight_buffer(device, f, t.post_norm);
 
-        t = find_layer_weight(f, i, "post_attention_layernorm.weight");
-        if (!t) t = find_layer_weight(f, i, "ffn_norm.weight");
-        lw->post_norm_weight = upload_weight_buffer(device, f, t);
+        const WeightFormat formats[] = {
+            lw->q_proj_format, lw->k_proj_format, lw->v_proj_format, lw->o_proj_format,
+            lw->gate_proj_format, lw->up_proj_format, lw->down_proj_format,
+        };
+        for (WeightFormat fmt : formats) quantized += (fmt != WEIGHT_F16);
 
         loaded++;
     }
 
-    printf("  Uploaded %d/%d transformer layers\n", loaded, w->num_layers);
+    printf("  Uploaded %d/%d transformer layers (%d with fused QKV, %d with fused gate/up, "
+           "%d quantized projections)\n",
+           loaded, w->num_layers, fused_qkv, fused_mlp, quantized);
+    return true;
+}
+
+// --- Weight Pack ---
+//
+// Tensor names of a pack (see weight_pack.h), in the GGUF "blk.N." style.
+// A layer has either attn_qkv or attn_q/k/v, and ffn_gate_up or
+// ffn_gate/up, mirroring what moondream2_upload_weights builds.
+
+void moondream2_pack_path(const char* gguf_path, char* out, size_t size) {
+    size_t len = strlen(gguf_path);
+    if (len >= 5 && strcmp(gguf_path + len - 5, ".gguf") == 0) len -= 5;
+    snprintf(out, size, "%.*s.mgpu", (int)len, gguf_path);
+}
+
+// A 2D weight as F16 rows padded to whole texels: [rows, round_up(cols, 4)]
+static bool pack_weight_image(PackWriter* pw, const GGUFFile* f, const char* name,
+                              const TensorInfo* t) {
+    int rows = t->n_dims == 1 ? 1 : (int)t->dims[1];
+    int cols = (int)t->dims[0];
+    int padded_cols = (cols + 3) / 4 * 4;
+
+    cl_half* converted = (t->type != GGMLType::F16) ? dequantize_f16(f, t) : nullptr;
+    if (t->type != GGMLType::F16 && !converted) return false;
+    const cl_half* src = converted ? converted : (const cl_half*)gguf_tensor_data(f, t);
+
+    cl_half* padded = (cl_half*)calloc((size_t)rows * padded_cols, sizeof(cl_half));
+    bool ok = padded != nullptr;
+    for (int r = 0; ok && r < rows; r++) {
+        memcpy(padded + (size_t)r * padded_cols, src + (size_t)r * cols,
+               (size_t)cols * sizeof(cl_half));
+    }
+    ok = ok && pack_writer_add(pw, name, PACK_IMAGE_F16, WEIGHT_F16, rows, padded_cols,
+                               padded, (uint64_t)rows * padded_cols * sizeof(cl_half));
+    free(padded);
+    free(converted);
+    return ok;
+}
+
+// A projection as upload_weight_image stores it: blocks the quantized kernels
+// execute stay as they are, F16 becomes `quantize` blocks if requested (only
+// WEIGHT_Q8_0), anything else an F16 image
+static bool pack_projection(PackWriter* pw, const GGUFFile* f, const char* name,
+                            const TensorInfo* t, WeightFormat quantize, int* quantized) {
+    if (!t) return true;
+
+    WeightFormat format = quant_weight_format(t->type);
+    if (format != WEIGHT_F16 && t->n_dims == 2 &&
+        t->dims[0] % weight_format_block_size(format) == 0) {
+        (*quantized)++;
+        return pack_writer_add(pw, name, PACK_BUFFER, format, (uint32_t)t->dims[1],
+                               (uint32_t)t->dims[0], gguf_tensor_data(f, t), t->data_size);
+    }
+
+    if (quantize == WEIGHT_Q8_0 && t->n_dims == 2 && t->dims[0] % 32 == 0) {
+        size_t n = (size_t)t->dims[0] * t->dims[1];
+        size_t bytes = n / 32 * ggml_type_size(GGMLType::Q8_0);
+        float* f32 = (float*)malloc(n * sizeof(float));
+        void* blocks = malloc(bytes);
+        bool ok = f32 && blocks && ggml_dequantize(t->type, gguf_tensor_data(f, t), f32, n) &&
+                  ggml_quantize_q8_0(f32, blocks, n) &&
+                  pack_writer_add(pw, name, PACK_BUFFER, WEIGHT_Q8_0, (uint32_t)t->dims[1],
+                                  (uint32_t)t->dims[0], blocks, bytes);
+        free(f32);
+        free(blocks);
+        (*quantized)++;
+        return ok;
+    }
+
+    return pack_weight_image(pw, f, name, t);
+}
+
+static bool pack_raw(PackWriter* pw, const GGUFFile* f, const char* name, const TensorInfo* t) {
+    if (!t) return true;
+    uint32_t rows = t->n_dims > 1 ? (uint32_t)t->dims[1] : 1;
+    return pack_writer_add(pw, name, PACK_BUFFER, WEIGHT_F16, rows, (uint32_t)t->dims[0],
+                           gguf_tensor_data(f, t), t->data_size);
+}
+
+bool pack_matches_config(const PackFile* pack, const Moondream2Config& config) {
+    const PackHeader* h = pack->header;
+    return h && (int)h->llm_layers == config.llm_layers && (int)h->llm_dim == config.llm_dim &&
+           (int)h->llm_intermediate == config.llm_intermediate &&
+           (int)h->head_dim == config.head_dim;
+}
+
+bool moondream2_pack(const char* gguf_path, const char* pack_path, WeightFormat quantize,
+                     const Moondream2Config* config) {
+    const Moondream2Config cfg = config ? *config : Moondream2Config{};
+    GGUFFile file;
+    if (!gguf_open(&file, gguf_path)) return false;
+    const GGUFFile* f = &file;
+
+    uint64_t source_size;
+    int64_t source_mtime;
+    PackWriter pw;
+    if (!pack_source_stat(gguf_path, &source_size, &source_mtime) ||
+        !pack_writer_open(&pw, pack_path, source_size, source_mtime)) {
+        gguf_close(&file);
+        return false;
+    }
+    pw.header.llm_layers = (uint32_t)cfg.llm_layers;
+    pw.header.llm_dim = (uint32_t)cfg.llm_dim;
+    pw.header.llm_intermediate = (uint32_t)cfg.llm_intermediate;
+    pw.header.head_dim = (uint32_t)cfg.head_dim;
+
+    LLMTensors lt;
+    find_llm_tensors(f, &lt);
+    bool ok = lt.embed != nullptr;
+    if (!ok) fprintf(stderr, "Error: token embedding weight not found\n");
+
+    if (ok) {
+        size_t embed_bytes;
+        bool failed;
+        cl_half* converted = embed_table_f16(f, lt.embed, &embed_bytes, &failed);
+        ok = !failed &&
+             pack_writer_add(&pw, "token_embd", PACK_BUFFER, WEIGHT_F16,
+                             (uint32_t)lt.embed->dims[1], (uint32_t)lt.embed->dims[0],
+                             converted ? (const void*)converted : gguf_tensor_data(f, lt.embed),
+                             embed_bytes);
+        free(converted);
+    }
+    ok = ok && pack_raw(&pw, f, "output_norm", lt.final_norm);
+    ok = ok && (!lt.lm_head || pack_weight_image(&pw, f, "output", lt.lm_head));
+
+    int fused_qkv = 0;
+    int fused_mlp = 0;
+    int quantized = 0;
+    for (int i = 0; ok && i < cfg.llm_layers; i++) {
+        LayerTensors t;
+        find_layer_tensors(f, i, &t);
+        char name[64];
+        auto layer_name = [&](const char* suffix) {
+            snprintf(name, sizeof(name), "blk.%d.%s", i, suffix);
+            return name;
+        };
+
+        // Fused F16 layouts unless the projections are to be quantized
+        int rows, cols;
+        const TensorInfo* qkv[3] = { t.q, t.k, t.v };
+        cl_half* fused = (quantize == WEIGHT_F16 && qkv_fusable(cfg, &t))
+            ? fuse_weight_columns(f, qkv, 3, SIZE_MAX, &rows, &cols) : nullptr;
+        if (fused) {
+            ok = pack_writer_add(&pw, layer_name("attn_qkv"), PACK_IMAGE_F16, WEIGHT_F16,
+                                 rows, cols, fused, (uint64_t)rows * cols * sizeof(cl_half));
+            free(fused);
+            fused_qkv++;
+        } else {
+            ok = pack_projection(&pw, f, layer_name("attn_q"), t.q, quantize, &quantized) &&
+                 pack_projection(&pw, f, layer_name("attn_k"), t.k, quantize, &quantized) &&
+                 pack_projection(&pw, f, layer_name("attn_v"), t.v, quantize, &quantized);
+        }
+        ok = ok && pack_projection(&pw, f, layer_name("attn_output"), t.o, quantize, &quantized);
+
+        cl_half* gate_up = (ok && quantize == WEIGHT_F16 && gate_up_fusable(cfg, &t))
+            ? interleave_weight_columns(f, t.gate, t.up, SIZE_MAX, &rows, &cols) : nullptr;
+        if (gate_up) {
+            ok = pack_writer_add(&pw, layer_name("ffn_gate_up"), PACK_IMAGE_F16, WEIGHT_F16,
+                                 rows, cols, gate_up, (uint64_t)rows * cols * sizeof(cl_half));
+            free(gate_up);
+            fused_mlp++;
+        } else {
+            ok = ok &&
+                 pack_projection(&pw, f, layer_name("ffn_gate"), t.gate, quantize, &quantized) &&
+                 pack_projection(&pw, f, layer_name("ffn_up"), t.up, quantize, &quantized);
+        }
+        ok = ok && pack_projection(&pw, f, layer_name("ffn_down"), t.down, quantize, &quantized);
+
+        ok = ok && pack_raw(&pw, f, layer_name("attn_norm"), t.input_norm) &&
+             pack_raw(&pw, f, layer_name("ffn_norm"), t.post_norm);
+    }
+
+    uint64_t tensor_count = pw.header.tensor_count;
+    uint64_t pack_bytes = pw.data_end;
+    ok = pack_writer_close(&pw) && ok;
+    gguf_close(&file);
+    if (!ok) {
+        fprintf(stderr, "Error: Failed to write weight pack: %s\n", pack_path);
+        remove(pack_path);
+        return false;
+    }
+    printf("Packed %llu tensors (%.1f MB): %d layers with fused QKV, %d with fused gate/up, "
+           "%d quantized projections\n",
+           (unsigned long long)tensor_count, (double)pack_bytes / (1024.0 * 1024.0),
+           fused_qkv, fused_mlp, quantized);
+    return true;
+}
+
+// Upload one pack tensor: an image for PACK_IMAGE_F16 (already texel-padded,
+// so straight from the mapping), a buffer otherwise. *format gets the
+// buffer's quantized format.
+static cl_mem upload_pack_tensor(const DeviceInfo* device, const PackFile* pack,
+                                 const PackTensor* t, WeightFormat* format = nullptr) {
+    if (format) *format = WEIGHT_F16;
+    if (!t) return nullptr;
+
+    const void* data = pack_tensor_data(pack, t);
+    if (t->kind == PACK_IMAGE_F16) {
+        if (t->cols % 4 != 0 || t->cols / 4 > device->max_image2d_width) {
+            fprintf(stderr, "Error: pack tensor '%s' (%u texels wide) does not fit an image\n",
+                    t->name, t->cols / 4);
+            return nullptr;
+        }
+        return create_weight_image(device, (int)t->rows, (int)t->cols, (const cl_half*)data);
+    }
+    if (format) *format = (WeightFormat)t->format;
+    return create_buffer(device, t->size, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                         (void*)data);
+}
+
+bool moondream2_upload_packed_weights(Moondream2Model* model, const DeviceInfo* device,
+                                      const PackFile* pack) {
+    Moondream2Weights* w = &model->gpu_weights;
+    const Moondream2Config& cfg = model->config;
+
+    printf("Uploading packed weights to GPU...\n");
+
+    if (!pack_matches_config(pack, cfg)) {
+        const PackHeader* h = pack->header;
+        fprintf(stderr, "Error: weight pack was built for %u layers, dim=%u, intermediate=%u, "
+                "head_dim=%u (model: %d, %d, %d, %d)\n",
+                h->llm_layers, h->llm_dim, h->llm_intermediate, h->head_dim,
+                cfg.llm_layers, cfg.llm_dim, cfg.llm_intermediate, cfg.head_dim);
+        return false;
+    }
+
+    const PackTensor* embed = pack_find_tensor(pack, "token_embd");
+    w->token_embed = upload_pack_tensor(device, pack, embed);
+    if (!w->token_embed) {
+        fprintf(stderr, "Error: token embedding weight not found\n");
+        return false;
+    }
+    w->final_norm_weight = upload_pack_tensor(device, pack, pack_find_tensor(pack, "output_norm"));
+    const PackTensor* lmh = pack_find_tensor(pack, "output");
+    w->lm_head_weight = upload_pack_tensor(device, pack, lmh);
+    if (lmh && !w->lm_head_weight) return false;
+
+    w->num_layers = cfg.llm_layers;
+    w->layers = (TransformerLayerWeights*)calloc(w->num_layers, sizeof(TransformerLayerWeights));
+    if (!w->layers) return false;
+
+    int fused_qkv = 0;
+    int fused_mlp = 0;
+    int quantized = 0;
+    for (int i = 0; i < w->num_layers; i++) {
+        TransformerLayerWeights* lw = &w->layers[i];
+        char name[64];
+        auto find = [&](const char* suffix) {
+            snprintf(name, sizeof(name), "blk.%d.%s", i, suffix);
+            return pack_find_tensor(pack, name);
+        };
+
+        const PackTensor* qkv = find("attn_qkv");
+        if (qkv) {
+            if ((int)qkv->cols != 3 * cfg.llm_dim) {
+                fprintf(stderr, "Error: pack tensor '%s' is not [dim, 3*dim]\n", qkv->name);
+                return false;
+            }
+            lw->qkv_proj_weight = upload_pack_tensor(device, pack, qkv);
+            if (!lw->qkv_proj_weight) return false;
+            fused_qkv++;
+        } else {
+            lw->q_proj_weight = upload_pack_tensor(device, pack, find("attn_q"), &lw->q_proj_format);
+            lw->k_proj_weight = upload_pack_tensor(device, pack, find("attn_k"), &lw->k_proj_format);
+            lw->v_proj_weight = upload_pack_tensor(device, pack, find("attn_v"), &lw->v_proj_format);
+        }
+        lw->o_proj_weight = upload_pack_tensor(device, pack, find("attn_output"), &lw->o_proj_format);
+
+        const PackTensor* gate_up = find("ffn_gate_up");
+        if (gate_up) {
+            if ((int)gate_up->cols != 2 * cfg.llm_intermediate) {
+                fprintf(stderr, "Error: pack tensor '%s' is not [dim, 2*intermediate]\n",
+                        gate_up->name);
+                return false;
+            }
+            lw->gate_up_weight = upload_pack_tensor(device, pack, gate_up);
+            if (!lw->gate_up_weight) return false;
+            fused_mlp++;
+        } else {
+            lw->gate_proj_weight = upload_pack_tensor(device, pack, find("ffn_gate"),
+                                                      &lw->gate_proj_format);
+            lw->up_proj_weight = upload_pack_tensor(device, pack, find("ffn_up"),
+                                                    &lw->up_proj_format);
+        }
+        lw->down_proj_weight = upload_pack_tensor(device, pack, find("ffn_down"),
+                                                  &lw->down_proj_format);
+
+        lw->input_norm_weight = upload_pack_tensor(device, pack, find("attn_norm"));
+        lw->post_norm_weight = upload_pack_tensor(device, pack, find("ffn_norm"));
+
+        const WeightFormat formats[] = {
+            lw->q_proj_format, lw->k_proj_format, lw->v_proj_format, lw->o_proj_format,
+            lw->gate_proj_format, lw->up_proj_format, lw->down_proj_format,
+        };
+        for (WeightFormat fmt : formats) quantized += (fmt != WEIGHT_F16);
+    }
+
+    printf("  Uploaded %d transformer layers from pack (%d with fused QKV, %d with fused "
+           "gate/up, %d quantized projections)\n",
+           w->num_layers, fused_qkv, fused_mlp, quantized);
     return true;
 }
 
@@ -258,18 +877,39 @@ bool moondream2_alloc_buffers(Moondream2Model* model, const DeviceInfo* device)
     const Moondream2Config& cfg = model->config;
     size_t half_size = sizeof(cl_half);
 
-    // KV-cache: [max_seq_len * num_heads * head_dim]
-    size_t kv_size = (size_t)cfg.max_seq_len * cfg.llm_heads * cfg.head_dim * half_size;
-    model->kv_cache.k_cache = create_buffer(device, kv_size, CL_MEM_READ_WRITE);
-    model->kv_cache.v_cache = create_buffer(device, kv_size, CL_MEM_READ_WRITE);
-    model->kv_cache.length = 0;
-    model->kv_cache.capacity = cfg.max_seq_len;
-
-    if (!model->kv_cache.k_cache || !model->kv_cache.v_cache) {
-        fprintf(stderr, "Error: Failed to allocate KV-cache (%.1f MB each)\n",
-                (double)kv_size / (1024.0 * 1024.0));
-        return false;
+    // KV-cache, per layer: [max_seq_len * num_heads * head_dim] K and V, plus
+    // their block scales when int8
+    KVCache* kv = &model->kv_cache;
+    kv->type = cfg.kv_cache_type;
+    kv->length = 0;
+    kv->capacity = cfg.max_seq_len;
+    kv->layout = cfg.kv_layout;
+    kv->layers = (KVLayerCache*)calloc(cfg.llm_layers, sizeof(KVLayerCache));
+    if (!kv->layers) return false;
+    kv->num_layers = cfg.llm_layers;
+
+    bool int8 = (kv->type == KV_CACHE_INT8);
+    size_t kv_elems = (size_t)cfg.max_seq_len * cfg.llm_heads * cfg.head_dim;
+    size_t kv_size = kv_elems * (int8 ? 1 : half_size);
+    size_t scale_size = int8 ? (size_t)((cfg.max_seq_len + KV_Q8_BLOCK - 1) / KV_Q8_BLOCK) *
+                               cfg.llm_heads * half_size : 0;
+    for (int i = 0; i < kv->num_layers; i++) {
+        KVLayerCache* lc = &kv->layers[i];
+        lc->k_cache = create_buffer(device, kv_size, CL_MEM_READ_WRITE);
+        lc->v_cache = create_buffer(device, kv_size, CL_MEM_READ_WRITE);
+        bool ok = lc->k_cache && lc->v_cache;
+        if (int8) {
+            lc->k_scales = create_buffer(device, scale_size, CL_MEM_READ_WRITE);
+            lc->v_scales = create_buffer(device, scale_size, CL_MEM_READ_WRITE);
+            ok = ok && lc->k_scales && lc->v_scales;
+        }
+        if (!ok) {
+            fprintf(stderr, "Error: Failed to allocate KV-cache of layer %d (%.1f MB each)\n",
+                    i, (double)kv_size / (1024.0 * 1024.0));
+            return false;
+        }
     }
+    size_t kv_total = (kv_size + scale_size) * 2 * kv->num_layers;
 
     // Scratch buffers for activations
     size_t act_size = (size_t)cfg.max_seq_len * cfg.llm_dim * half_size;
@@ -284,319 +924,598 @@ bool moondream2_alloc_buffers(Moondream2Model* model, const DeviceInfo* device)
     model->scratch_gate = create_buffer(device, mlp_size, CL_MEM_READ_WRITE);
     model->scratch_up   = create_buffer(device, mlp_size, CL_MEM_READ_WRITE);
 
-    printf("  KV-cache: %.1f MB, scratch: %.1f MB\n",
-           (double)(kv_size * 2) / (1024.0 * 1024.0),
-           (double)(act_size * 6 + mlp_size * 2) / (1024.0 * 1024.0));
+    // W8A8: int8 copy of a projection's input rows and their scales
+    size_t act_q_size = 0;
+    if (cfg.w8a8) {
+        act_q_size = (size_t)cfg.max_seq_len * cfg.llm_intermediate;
+        size_t scales_size = (size_t)cfg.max_seq_len * sizeof(float);
+        model->scratch_act_q      = create_buffer(device, act_q_size, CL_MEM_READ_WRITE);
+        model->scratch_act_scales = create_buffer(device, scales_size, CL_MEM_READ_WRITE);
+        if (!model->scratch_act_q || !model->scratch_act_scales) return false;
+        act_q_size += scales_size;
+    }
+
+    // Per-token I/O kept bound across decode steps (see decode_graph)
+    model->logits       = create_buffer(device, (size_t)cfg.vocab_size * half_size,
+                                        CL_MEM_READ_WRITE);
+    model->decode_token = create_buffer(device, sizeof(int), CL_MEM_READ_ONLY);
+    model->topk_result  = create_buffer(device, (size_t)2 * TOPK_MAX * sizeof(int),
+                                        CL_MEM_WRITE_ONLY | CL_MEM_ALLOC_HOST_PTR);
+    model->sample_candidates = create_buffer(device, (size_t)(2 * TOPK_MAX + 1) * sizeof(int),
+                                             CL_MEM_READ_WRITE);
+    model->token_history = create_buffer(device, (size_t)cfg.max_seq_len * sizeof(int),
+                                         CL_MEM_READ_WRITE);
+
+    printf("  KV-cache: %.1f MB (%s, %d layers), scratch: %.1f MB\n",
+           (double)kv_total / (1024.0 * 1024.0), int8 ? "int8" : "fp16", kv->num_layers,
+           (double)(act_size * 6 + mlp_size * 2 + act_q_size) / (1024.0 * 1024.0));
 
     return model->scratch_a && model->scratch_b && model->scratch_q &&
            model->scratch_k && model->scratch_v && model->scratch_attn &&
-           model->scratch_gate && model->scratch_up;
+           model->scratch_gate && model->scratch_up &&
+           model->logits && model->decode_token && model->topk_result &&
+           model->sample_candidates && model->token_history;
 }
 
-// --- Residual Add ---
+// --- Normalized projections ---
+
+// A projection of RMSNorm(hidden). In decode the norm runs in the GEMV
+// prologue from the raw hidden state; otherwise `normed` already holds the
+// rms_norm output. W is in `format` (image or quantized blocks). WEIGHT_I8
+// quantizes the activations per row first, from the raw hidden state with the
+// norm fused in decode.
+static cl_event project_normed(const Moondream2Model* model, const DeviceInfo* device,
+                               bool is_decode, cl_mem hidden, cl_mem normed,
+                               cl_mem norm_weight, cl_mem W_img, WeightFormat format,
+                               cl_mem out, int seq_len, int N, int K) {
+    if (format == WEIGHT_I8) {
+        return dispatch_gemm_w8a8(device, model->gemm_program,
+                                  is_decode ? hidden : normed, W_img, out, seq_len, N, K,
+                                  model->scratch_act_q, model->scratch_act_scales, nullptr,
+                                  is_decode ? norm_weight : nullptr, 1e-5f);
+    }
+    if (format != WEIGHT_F16) {
+        if (is_decode) {
+            return dispatch_gemm_quant(device, model->gemm_program, format,
+                                       hidden, W_img, out, seq_len, N, K,
+                                       nullptr, norm_weight, 1e-5f);
+        }
+        return dispatch_gemm_quant(device, model->gemm_program, format,
+                                   normed, W_img, out, seq_len, N, K);
+    }
+    if (is_decode) {
+        return dispatch_gemm_image_rms_norm(device, model->gemm_program,
+                                            hidden, norm_weight, 1e-5f,
+                                            W_img, out, seq_len, N, K);
+    }
+    return dispatch_gemm_image(device, model->gemm_program, normed, W_img, out,
+                               seq_len, N, K);
+}
 
-static cl_event dispatch_residual_add(const DeviceInfo* dev, cl_program act_program,
-                                       cl_mem a, cl_mem b, cl_mem out, int n) {
-    return dispatch_vector_add(dev, act_program, a, b, out, n);
+// hidden += A @ W, accumulated by the GEMM epilogue; W is in `format`
+static cl_event project_residual(const Moondream2Model* model, const DeviceInfo* device,
+                                 cl_mem A, cl_mem W, WeightFormat format, cl_mem hidden,
+                                 int seq_len, int N, int K) {
+    GemmEpilogue residual_epi;
+    residual_epi.residual = true;
+    if (format == WEIGHT_I8) {
+        return dispatch_gemm_w8a8(device, model->gemm_program, A, W, hidden, seq_len, N, K,
+                                  model->scratch_act_q, model->scratch_act_scales,
+                                  &residual_epi);
+    }
+    if (format != WEIGHT_F16) {
+        return dispatch_gemm_quant(device, model->gemm_program, format,
+                                   A, W, hidden, seq_len, N, K, &residual_epi);
+    }
+    return dispatch_gemm_image_epilogue(device, model->gemm_program, A, W, hidden,
+                                        seq_len, N, K, &residual_epi);
 }
 
-// --- KV-cache append ---
+// --- Op completion ---
+
+// Retire a dispatch event. The queue is in-order, so every later kernel
+// already sees this op's results and no host wait is needed; the host blocks
+// only when it reads the next token back. sync_each_op restores lockstep
+// execution for debugging (a failing kernel then shows up at its own op).
+static void finish_op(const Moondream2Model* model, cl_event* ev) {
+    if (!*ev) return;
+    if (model->sync_each_op) clWaitForEvents(1, ev);
+    clReleaseEvent(*ev);
+    *ev = nullptr;
+}
 
-static void kv_cache_append(const DeviceInfo* dev, KVCache* cache,
-                            cl_mem new_k, cl_mem new_v,
-                            int seq_len, int num_heads, int head_dim) {
-    size_t row_bytes = (size_t)num_heads * head_dim * sizeof(cl_half);
-    size_t offset = (size_t)cache->length * row_bytes;
-    size_t copy_bytes = (size_t)seq_len * row_bytes;
+// --- Decode graph ---
 
-    clEnqueueCopyBuffer(dev->queue, new_k, cache->k_cache, 0, offset,
-                        copy_bytes, 0, nullptr, nullptr);
-    clEnqueueCopyBuffer(dev->queue, new_v, cache->v_cache, 0, offset,
-                        copy_bytes, 0, nullptr, nullptr);
-    cache->length += seq_len;
+// While the decode graph is capturing, mark an int argument of the launch just
+// issued as position-dependent: replay rewrites it to pos + bias.
+static void graph_patch(Moondream2Model* model, const char* kernel_name,
+                        cl_uint arg_index, int bias) {
+    if (model->decode_graph.capturing)
+        decode_graph_patch_last(&model->decode_graph, kernel_name, arg_index, bias);
 }
 
 // --- Forward Pass ---
 
-cl_mem moondream2_forward(Moondream2Model* model, const DeviceInfo* device,
-                          const int* tokens, int seq_len) {
+// Enqueue the LLM forward pass; the LM head writes model->logits or, in
+// LM_HEAD_ARGMAX mode, the greedy token into model->topk_result.
+static bool forward_pass(Moondream2Model* model, const DeviceInfo* device,
+                         const int* tokens, int seq_len, LmHeadMode lm_head_mode) {
     if (!model->initialized) {
         fprintf(stderr, "Error: model not initialized\n");
-        return nullptr;
+        return false;
     }
 
     const Moondream2Config& cfg = model->config;
     Moondream2Weights* w = &model->gpu_weights;
     int pos_offset = model->kv_cache.length;
 
-    printf("[forward] seq_len=%d, pos_offset=%d\n", seq_len, pos_offset);
+    bool is_decode = (seq_len == 1);
 
-    // 1. Upload token IDs to GPU
+    if (pos_offset + seq_len > model->kv_cache.capacity) {
+        fprintf(stderr, "Error: KV-cache full (%d + %d > %d)\n",
+                pos_offset, seq_len, model->kv_cache.capacity);
+        return false;
+    }
+
+    // Decode steps run from a captured graph: the first one is recorded while
+    // it executes, later ones replay it with only the position rewritten.
+    bool use_graph = is_decode && !model->no_decode_graph && !model->sync_each_op;
+
+    // A graph ends in the LM head it was captured with; recapture on change
+    if (use_graph && model->decode_graph.ready && model->decode_graph_mode != lm_head_mode)
+        decode_graph_destroy(&model->decode_graph);
+    // ... and binds the dispatch scratch buffers that existed back then
+    if (use_graph && model->decode_graph.ready &&
+        model->decode_graph_scratch != dispatch_scratch_generation())
+        decode_graph_destroy(&model->decode_graph);
+
+    // 1. Upload token IDs to GPU (decode reuses one persistent buffer so the
+    // graph can keep it bound)
     cl_int err;
-    cl_mem d_tokens = clCreateBuffer(device->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
-                                     (size_t)seq_len * sizeof(int), (void*)tokens, &err);
+    cl_mem d_tokens = nullptr;
+    if (is_decode) {
+        model->decode_token_host = tokens[0];
+        err = clEnqueueWriteBuffer(device->queue, model->decode_token, CL_FALSE, 0,
+                                   sizeof(int), &model->decode_token_host,
+                                   0, nullptr, nullptr);
+        d_tokens = model->decode_token;
+    } else {
+        d_tokens = clCreateBuffer(device->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                  (size_t)seq_len * sizeof(int), (void*)tokens, &err);
+    }
     if (err != CL_SUCCESS) {
-        fprintf(stderr, "Error: failed to create token buffer\n");
-        return nullptr;
+        fprintf(stderr, "Error: failed to upload token ids\n");
+        return false;
+    }
+
+    if (use_graph && model->decode_graph.ready) {
+        if (!decode_graph_replay(&model->decode_graph, pos_offset)) {
+            fprintf(stderr, "Error: decode graph replay failed\n");
+            return false;
+        }
+        model->kv_cache.length += seq_len;
+        clFlush(device->queue);
+        return true;
+    }
+
+    printf("[forward] seq_len=%d, pos_offset=%d\n", seq_len, pos_offset);
+
+    if (use_graph) {
+        decode_graph_begin_capture(&model->decode_graph, device);
+        model->decode_graph_mode = lm_head_mode;
     }
 
     // 2. Embedding lookup: tokens → scratch_a [seq_len, dim]
     cl_event ev = dispatch_embedding_lookup(device, model->embedding_program,
                                             w->token_embed, d_tokens,
                                             model->scratch_a, seq_len, cfg.llm_dim);
-    if (ev) { clWaitForEvents(1, &ev); clReleaseEvent(ev); }
-    clReleaseMemObject(d_tokens);
+    finish_op(model, &ev);
+    if (!is_decode) clReleaseMemObject(d_tokens);
 
-    printf("[forward] embedding lookup done\n");
+    printf("[forward] embedding lookup enqueued\n");
 
     // Current hidden state is in scratch_a
     cl_mem hidden = model->scratch_a;
     cl_mem residual_buf = model->scratch_b;
 
+    // Prefill: layer 0 input RMSNorm(hidden) → scratch_b; the residual adds
+    // happen in the o_proj / down_proj GEMM epilogues.
+    // Decode: the projections normalize hidden in their prologue, so only
+    // the final norm (for the LM head) is materialized.
+    if (!is_decode) {
+        ev = dispatch_rms_norm(device, model->norm_program,
+                               hidden, residual_buf, w->layers[0].input_norm_weight,
+                               seq_len, cfg.llm_dim, 1e-5f);
+        finish_op(model, &ev);
+    }
+
     // 3. Transformer layers
     for (int layer = 0; layer < cfg.llm_layers; layer++) {
         TransformerLayerWeights* lw = &w->layers[layer];
-        bool is_decode = (seq_len == 1);
 
         // --- Attention block ---
+        // On entry (prefill) scratch_b holds RMSNorm(hidden) with this
+        // layer's input norm
+
+        // Q, K, V = norm_out @ [q_proj | k_proj | v_proj]  [seq_len, dim] each.
+        // The fused kernel reads the activations once, applies RoPE to Q and
+        // K in its epilogue and writes K, V straight into this layer's
+        // fp16 KV-cache at rows [pos_offset, pos_offset + seq_len). An int8
+        // cache is quantized by kv_cache_store instead, from scratch_k/v.
+        const KVCache* kv = &model->kv_cache;
+        const KVLayerCache* lc = &kv->layers[layer];
+        bool store_direct = lw->qkv_proj_weight && !lc->k_scales;
+        cl_mem k_dst = store_direct ? lc->k_cache : model->scratch_k;
+        cl_mem v_dst = store_direct ? lc->v_cache : model->scratch_v;
+        int dst_capacity = store_direct ? kv->capacity : 0;
+        if (lw->qkv_proj_weight) {
+            cl_mem rope_cos = model->rope_program ? w->cos_table : nullptr;
+            cl_mem rope_sin = model->rope_program ? w->sin_table : nullptr;
+            if (is_decode) {
+                ev = dispatch_qkv_gemv(device, model->gemm_program,
+                                       hidden, lw->qkv_proj_weight,
+                                       model->scratch_q, k_dst, v_dst,
+                                       cfg.llm_dim, cfg.llm_dim,
+                                       rope_cos, rope_sin, cfg.head_dim, pos_offset,
+                                       lw->input_norm_weight, 1e-5f,
+                                       kv->layout, dst_capacity);
+                graph_patch(model, "qkv_gemv", 10, 0);
+            } else {
+                ev = dispatch_qkv_gemm(device, model->gemm_program,
+                                       residual_buf, lw->qkv_proj_weight,
+                                       model->scratch_q, k_dst, v_dst,
+                                       seq_len, cfg.llm_dim, cfg.llm_dim,
+                                       rope_cos, rope_sin, cfg.head_dim, pos_offset,
+                                       kv->layout, dst_capacity);
+            }
+            finish_op(model, &ev);
+        } else {
+            // Q = norm_out @ q_proj  [seq_len, dim]
+            // (dispatch_gemm_image picks GEMV / skinny / blocked by seq_len;
+            // in decode the GEMV applies the input norm itself)
+            if (lw->q_proj_weight) {
+                ev = project_normed(model, device, is_decode, hidden, residual_buf,
+                                    lw->input_norm_weight, lw->q_proj_weight,
+                                    lw->q_proj_format, model->scratch_q, seq_len, cfg.llm_dim, cfg.llm_dim);
+            }
+            finish_op(model, &ev);
 
-        // RMSNorm(hidden) → scratch_b
-        ev = dispatch_rms_norm(device, model->norm_program,
-                               hidden, residual_buf, lw->input_norm_weight,
-                               seq_len, cfg.llm_dim, 1e-5f);
-        if (ev) { clWaitForEvents(1, &ev); clReleaseEvent(ev); }
-
-        // Q = norm_out @ q_proj  [seq_len, dim]
-        if (is_decode && lw->q_proj_weight) {
-            ev = dispatch_gemv(device, model->gemm_program,
-                               residual_buf, lw->q_proj_weight,
-                               model->scratch_q, cfg.llm_dim, cfg.llm_dim);
-        } else if (lw->q_proj_weight) {
-            ev = dispatch_gemm_image(device, model->gemm_program,
-                                     residual_buf, lw->q_proj_weight,
-                                     model->scratch_q, seq_len, cfg.llm_dim, cfg.llm_dim);
-        }
-        if (ev) { clWaitForEvents(1, &ev); clReleaseEvent(ev); }
-
-        // K = norm_out @ k_proj  [seq_len, dim]
-        if (is_decode && lw->k_proj_weight) {
-            ev = dispatch_gemv(device, model->gemm_program,
-                               residual_buf, lw->k_proj_weight,
-                               model->scratch_k, cfg.llm_dim, cfg.llm_dim);
-        } else if (lw->k_proj_weight) {
-            ev = dispatch_gemm_image(device, model->gemm_program,
-                                     residual_buf, lw->k_proj_weight,
-                                     model->scratch_k, seq_len, cfg.llm_dim, cfg.llm_dim);
-        }
-        if (ev) { clWaitForEvents(1, &ev); clReleaseEvent(ev); }
+            // K = norm_out @ k_proj  [seq_len, dim]
+            if (lw->k_proj_weight) {
+                ev = project_normed(model, device, is_decode, hidden, residual_buf,
+                                    lw->input_norm_weight, lw->k_proj_weight,
+                                    lw->k_proj_format, model->scratch_k, seq_len, cfg.llm_dim, cfg.llm_dim);
+            }
+            finish_op(model, &ev);
 
-        // V = norm_out @ v_proj  [seq_len, dim]
-        if (is_decode && lw->v_proj_weight) {
-            ev = dispatch_gemv(device, model->gemm_program,
-                               residual_buf, lw->v_proj_weight,
-                               model->scratch_v, cfg.llm_dim, cfg.llm_dim);
-        } else if (lw->v_proj_weight) {
-            ev = dispatch_gemm_image(device, model->gemm_program,
-                                     residual_buf, lw->v_proj_weight,
-                                     model->scratch_v, seq_len, cfg.llm_dim, cfg.llm_dim);
+            // V = norm_out @ v_proj  [seq_len, dim]
+            if (lw->v_proj_weight) {
+                ev = project_normed(model, device, is_decode, hidden, residual_buf,
+                                    lw->input_norm_weight, lw->v_proj_weight,
+                                    lw->v_proj_format, model->scratch_v, seq_len, cfg.llm_dim, cfg.llm_dim);
+            }
+            finish_op(model, &ev);
         }
-        if (ev) { clWaitForEvents(1, &ev); clReleaseEvent(ev); }
 
         // RoPE on Q and K
-        if (model->rope_program) {
+        if (model->rope_program && !lw->qkv_proj_weight) {
             ev = dispatch_rope_apply(device, model->rope_program,
                                      model->scratch_q, w->cos_table, w->sin_table,
                                      seq_len, cfg.llm_heads, cfg.head_dim, pos_offset);
-            if (ev) { clWaitForEvents(1, &ev); clReleaseEvent(ev); }
+            graph_patch(model, "rope_apply", 6, 0);
+            finish_op(model, &ev);
 
             ev = dispatch_rope_apply(device, model->rope_program,
                                      model->scratch_k, w->cos_table, w->sin_table,
                                      seq_len, cfg.llm_heads, cfg.head_dim, pos_offset);
-            if (ev) { clWaitForEvents(1, &ev); clReleaseEvent(ev); }
+            graph_patch(model, "rope_apply", 6, 0);
+            finish_op(model, &ev);
         }
 
-        // Append K, V to KV-cache
-        kv_cache_append(device, &model->kv_cache, model->scratch_k, model->scratch_v,
-                        seq_len, cfg.llm_heads, cfg.head_dim);
+        // Separate projections or int8 cache: write K, V into the KV-cache
+        // at rows [pos_offset, pos_offset + seq_len)
+        if (!store_direct) {
+            ev = dispatch_kv_cache_store(device, model->attention_program,
+                                         model->scratch_k, model->scratch_v,
+                                         lc->k_cache, lc->v_cache,
+                                         seq_len, cfg.llm_heads, cfg.head_dim, pos_offset,
+                                         kv->layout, kv->capacity,
+                                         lc->k_scales, lc->v_scales);
+            graph_patch(model, lc->k_scales ? "kv_cache_store_q8" : "kv_cache_store", 6, 0);
+            finish_op(model, &ev);
+        }
 
         // Attention: Q against full KV-cache → scratch_attn
-        int cache_len = model->kv_cache.length;
-        if (is_decode) {
+        int cache_len = pos_offset + seq_len;
+        if (is_decode && lc->k_image) {
+            ev = dispatch_attention_decode_image(device, model->attention_program,
+                                                 model->scratch_q, lc->k_image, lc->v_image,
+                                                 model->scratch_attn,
+                                                 cache_len, cfg.llm_heads, cfg.head_dim,
+                                                 kv->layout, kv->capacity);
+            graph_patch(model, "attention_decode_image", 4, 1);
+        } else if (is_decode) {
             ev = dispatch_attention_decode(device, model->attention_program,
-                                           model->scratch_q,
-                                           model->kv_cache.k_cache,
-                                           model->kv_cache.v_cache,
+                                           model->scratch_q, lc->k_cache, lc->v_cache,
                                            model->scratch_attn,
-                                           cache_len, cfg.llm_heads, cfg.head_dim);
+                                           cache_len, cfg.llm_heads, cfg.head_dim,
+                                           kv->layout, kv->capacity,
+                                           lc->k_scales, lc->v_scales);
+            graph_patch(model, lc->k_scales ? "attention_decode_q8" : "attention_decode", 4, 1);
         } else {
             ev = dispatch_attention_prefill(device, model->attention_program,
-                                            model->scratch_q,
-                                            model->kv_cache.k_cache,
-                                            model->kv_cache.v_cache,
+                                            model->scratch_q, lc->k_cache, lc->v_cache,
                                             model->scratch_attn,
-                                            cache_len, cfg.llm_heads, cfg.head_dim);
+                                            seq_len, cache_len, cfg.llm_heads, cfg.head_dim,
+                                            kv->layout, kv->capacity,
+                                            lc->k_scales, lc->v_scales);
         }
-        if (ev) { clWaitForEvents(1, &ev); clReleaseEvent(ev); }
-
-        // Output projection: attn_out @ o_proj → scratch_b
-        if (is_decode && lw->o_proj_weight) {
-            ev = dispatch_gemv(device, model->gemm_program,
-                               model->scratch_attn, lw->o_proj_weight,
-                               residual_buf, cfg.llm_dim, cfg.llm_dim);
-        } else if (lw->o_proj_weight) {
-            ev = dispatch_gemm_image(device, model->gemm_program,
-                                     model->scratch_attn, lw->o_proj_weight,
-                                     residual_buf, seq_len, cfg.llm_dim, cfg.llm_dim);
+        finish_op(model, &ev);
+
+        // Output projection, accumulated into the residual stream by the
+        // GEMM epilogue: hidden += attn_out @ o_proj
+        if (lw->o_proj_weight) {
+            ev = project_residual(model, device, model->scratch_attn,
+                                  lw->o_proj_weight, lw->o_proj_format,
+                                  hidden, seq_len, cfg.llm_dim, cfg.llm_dim);
         }
-        if (ev) { clWaitForEvents(1, &ev); clReleaseEvent(ev); }
-
-        // Residual: hidden = hidden + attn_output
-        dispatch_residual_add(device, model->activation_program, hidden, residual_buf, hidden,
-                               seq_len * cfg.llm_dim);
+        finish_op(model, &ev);
 
         // --- MLP block ---
 
-        // RMSNorm(hidden) → scratch_b
-        ev = dispatch_rms_norm(device, model->norm_program,
-                               hidden, residual_buf, lw->post_norm_weight,
-                               seq_len, cfg.llm_dim, 1e-5f);
-        if (ev) { clWaitForEvents(1, &ev); clReleaseEvent(ev); }
-
-        // Gate projection: norm_out @ gate_proj → scratch_gate
-        if (is_decode && lw->gate_proj_weight) {
-            ev = dispatch_gemv(device, model->gemm_program,
-                               residual_buf, lw->gate_proj_weight,
-                               model->scratch_gate, cfg.llm_intermediate, cfg.llm_dim);
-        } else if (lw->gate_proj_weight) {
-            ev = dispatch_gemm_image(device, model->gemm_program,
-                                     residual_buf, lw->gate_proj_weight,
-                                     model->scratch_gate,
-                                     seq_len, cfg.llm_intermediate, cfg.llm_dim);
-        }
-        if (ev) { clWaitForEvents(1, &ev); clReleaseEvent(ev); }
-
-        // Up projection: norm_out @ up_proj → scratch_up
-        if (is_decode && lw->up_proj_weight) {
-            ev = dispatch_gemv(device, model->gemm_program,
-                               residual_buf, lw->up_proj_weight,
-                               model->scratch_up, cfg.llm_intermediate, cfg.llm_dim);
-        } else if (lw->up_proj_weight) {
-            ev = dispatch_gemm_image(device, model->gemm_program,
-                                     residual_buf, lw->up_proj_weight,
-                                     model->scratch_up,
-                                     seq_len, cfg.llm_intermediate, cfg.llm_dim);
+        // RMSNorm(hidden) → scratch_b (prefill only, the decode GEMVs
+        // normalize in their prologue)
+        if (!is_decode) {
+            ev = dispatch_rms_norm(device, model->norm_program,
+                                   hidden, residual_buf, lw->post_norm_weight,
+                                   seq_len, cfg.llm_dim, 1e-5f);
+            finish_op(model, &ev);
         }
-        if (ev) { clWaitForEvents(1, &ev); clReleaseEvent(ev); }
 
-        // Fused SiLU gate multiply: silu(gate) * up → scratch_gate
-        int mlp_n = seq_len * cfg.llm_intermediate;
-        ev = dispatch_silu_gate_multiply(device, model->activation_program,
-                                         model->scratch_gate, model->scratch_up,
-                                         model->scratch_gate, mlp_n);
-        if (ev) { clWaitForEvents(1, &ev); clReleaseEvent(ev); }
+        // silu(norm_out @ gate_proj) * (norm_out @ up_proj) → scratch_gate,
+        // in one pass over interleaved gate/up weights when available
+        if (lw->gate_up_weight) {
+            if (is_decode) {
+                ev = dispatch_gate_up_silu_gemv(device, model->gemm_program,
+                                                hidden, lw->gate_up_weight,
+                                                model->scratch_gate,
+                                                cfg.llm_intermediate, cfg.llm_dim,
+                                                lw->post_norm_weight, 1e-5f);
+            } else {
+                ev = dispatch_gate_up_silu_gemm(device, model->gemm_program,
+                                                residual_buf, lw->gate_up_weight,
+                                                model->scratch_gate,
+                                                seq_len, cfg.llm_intermediate, cfg.llm_dim);
+            }
+            finish_op(model, &ev);
+        } else {
+            // Gate projection: norm_out @ gate_proj → scratch_gate
+            if (lw->gate_proj_weight) {
+                ev = project_normed(model, device, is_decode, hidden, residual_buf,
+                                    lw->post_norm_weight, lw->gate_proj_weight,
+                                    lw->gate_proj_format, model->scratch_gate, seq_len, cfg.llm_intermediate, cfg.llm_dim);
+            }
+            finish_op(model, &ev);
 
-        // Down projection: mlp_out @ down_proj → scratch_b
-        if (is_decode && lw->down_proj_weight) {
-            ev = dispatch_gemv(device, model->gemm_program,
-                               model->scratch_gate, lw->down_proj_weight,
-                               residual_buf, cfg.llm_dim, cfg.llm_intermediate);
-        } else if (lw->down_proj_weight) {
-            ev = dispatch_gemm_image(device, model->gemm_program,
-                                     model->scratch_gate, lw->down_proj_weight,
-                                     residual_buf,
-                                     seq_len, cfg.llm_dim, cfg.llm_intermediate);
+            // Up projection: norm_out @ up_proj → scratch_up
+            if (lw->up_proj_weight) {
+                ev = project_normed(model, device, is_decode, hidden, residual_buf,
+                                    lw->post_norm_weight, lw->up_proj_weight,
+                                    lw->up_proj_format, model->scratch_up, seq_len, cfg.llm_intermediate, cfg.llm_dim);
+            }
+            finish_op(model, &ev);
+
+            // Fused SiLU gate multiply: silu(gate) * up → scratch_gate
+            int mlp_n = seq_len * cfg.llm_intermediate;
+            ev = dispatch_silu_gate_multiply(device, model->activation_program,
+                                             model->scratch_gate, model->scratch_up,
+                                             model->scratch_gate, mlp_n);
+            finish_op(model, &ev);
         }
-        if (ev) { clWaitForEvents(1, &ev); clReleaseEvent(ev); }
 
-        // Residual: hidden = hidden + mlp_output
-        dispatch_residual_add(device, model->activation_program, hidden, residual_buf, hidden,
-                              seq_len * cfg.llm_dim);
+        // Down projection, accumulated into the residual stream:
+        // hidden += mlp_out @ down_proj
+        if (lw->down_proj_weight) {
+            ev = project_residual(model, device, model->scratch_gate,
+                                  lw->down_proj_weight, lw->down_proj_format,
+                                  hidden, seq_len, cfg.llm_dim, cfg.llm_intermediate);
+        }
+        finish_op(model, &ev);
+
+        // RMSNorm(hidden) → scratch_b with the next layer's input norm, or
+        // the final norm after the last layer. Decode only needs the final one.
+        bool last_layer = (layer + 1 == cfg.llm_layers);
+        if (!is_decode || last_layer) {
+            cl_mem next_norm = last_layer ? w->final_norm_weight
+                                          : w->layers[layer + 1].input_norm_weight;
+            ev = dispatch_rms_norm(device, model->norm_program,
+                                   hidden, residual_buf, next_norm,
+                                   seq_len, cfg.llm_dim, 1e-5f);
+            finish_op(model, &ev);
+        }
 
         if (layer % 8 == 0 || layer == cfg.llm_layers - 1) {
-            printf("[forward] layer %d/%d done\n", layer + 1, cfg.llm_layers);
+            printf("[forward] layer %d/%d enqueued\n", layer + 1, cfg.llm_layers);
         }
     }
 
-    // 4. Final RMSNorm
-    ev = dispatch_rms_norm(device, model->norm_program,
-                           hidden, residual_buf, w->final_norm_weight,
-                           seq_len, cfg.llm_dim, 1e-5f);
-    if (ev) { clWaitForEvents(1, &ev); clReleaseEvent(ev); }
+    // 4. Final RMSNorm: already in scratch_b (fused into the last layer)
 
-    // 5. LM head: last_hidden @ lm_head_weight → logits [1, vocab_size]
-    // Only compute for the last token position
-    size_t last_offset = (size_t)(seq_len - 1) * cfg.llm_dim * sizeof(cl_half);
-    cl_buffer_region region = { last_offset, (size_t)cfg.llm_dim * sizeof(cl_half) };
-    cl_mem last_hidden = clCreateSubBuffer(residual_buf, CL_MEM_READ_ONLY,
+    // 5. LM head on the last token position only
+    if (lm_head_mode == LM_HEAD_ARGMAX) {
+        // Fused GEMV + argmax: the logits are never stored
+        ev = dispatch_lm_head_argmax(device, model->sampling_program,
+                                     residual_buf, w->lm_head_weight, model->topk_result,
+                                     cfg.vocab_size, cfg.llm_dim,
+                                     (seq_len - 1) * cfg.llm_dim);
+        finish_op(model, &ev);
+    } else {
+        // last_hidden @ lm_head_weight → logits [1, vocab_size]
+        cl_mem last_hidden = residual_buf;
+        if (!is_decode) {
+            size_t last_offset = (size_t)(seq_len - 1) * cfg.llm_dim * sizeof(cl_half);
+            cl_buffer_region region = { last_offset, (size_t)cfg.llm_dim * sizeof(cl_half) };
+            last_hidden = clCreateSubBuffer(residual_buf, CL_MEM_READ_ONLY,
                                             CL_BUFFER_CREATE_TYPE_REGION,
                                             &region, &err);
+        }
 
-    cl_mem logits = create_buffer(device, (size_t)cfg.vocab_size * sizeof(cl_half),
-                                  CL_MEM_READ_WRITE);
+        if (last_hidden && w->lm_head_weight) {
+            ev = dispatch_gemv(device, model->gemm_program,
+                               last_hidden, w->lm_head_weight,
+                               model->logits, cfg.vocab_size, cfg.llm_dim);
+            finish_op(model, &ev);
+        }
 
-    if (last_hidden && logits && w->lm_head_weight) {
-        ev = dispatch_gemv(device, model->gemm_program,
-                           last_hidden, w->lm_head_weight,
-                           logits, cfg.vocab_size, cfg.llm_dim);
-        if (ev) { clWaitForEvents(1, &ev); clReleaseEvent(ev); }
+        if (!is_decode && last_hidden) clReleaseMemObject(last_hidden);
     }
 
-    if (last_hidden) clReleaseMemObject(last_hidden);
+    // All layers wrote rows [pos_offset, pos_offset + seq_len)
+    model->kv_cache.length += seq_len;
 
-    printf("[forward] complete, logits ready\n");
-    clFinish(device->queue);
-    return logits;
+    if (use_graph && !decode_graph_end_capture(&model->decode_graph)) {
+        decode_graph_destroy(&model->decode_graph);
+        model->no_decode_graph = true;
+    }
+    if (use_graph) model->decode_graph_scratch = dispatch_scratch_generation();
+
+    // Submit without blocking: the caller's readback is the only host sync.
+    printf("[forward] complete, %s enqueued\n",
+           lm_head_mode == LM_HEAD_ARGMAX ? "argmax" : "logits");
+    clFlush(device->queue);
+    return true;
 }
 
-// --- Argmax on GPU logits ---
+cl_mem moondream2_forward(Moondream2Model* model, const DeviceInfo* device,
+                          const int* tokens, int seq_len) {
+    if (!forward_pass(model, device, tokens, seq_len, LM_HEAD_LOGITS)) return nullptr;
 
-static int argmax_logits(const DeviceInfo* device, cl_mem logits, int vocab_size) {
-    // Read logits back to CPU for argmax
-    // TODO: implement GPU-side argmax kernel
-    cl_half* host_logits = (cl_half*)malloc((size_t)vocab_size * sizeof(cl_half));
-    if (!host_logits) return -1;
+    // The logits buffer is persistent; callers release their reference.
+    clRetainMemObject(model->logits);
+    return model->logits;
+}
 
-    cl_int err = clEnqueueReadBuffer(device->queue, logits, CL_TRUE, 0,
-                                      (size_t)vocab_size * sizeof(cl_half),
-                                      host_logits, 0, nullptr, nullptr);
-    if (err != CL_SUCCESS) {
-        free(host_logits);
+int moondream2_forward_argmax(Moondream2Model* model, const DeviceInfo* device,
+                              const int* tokens, int seq_len) {
+    if (!model->gpu_weights.lm_head_weight) {
+        fprintf(stderr, "Error: lm_head weight not loaded\n");
         return -1;
     }
+    if (!forward_pass(model, device, tokens, seq_len, LM_HEAD_ARGMAX)) return -1;
 
-    // fp16 argmax — convert to float for comparison
-    int best_id = 0;
-    float best_val = -1e30f;
-    for (int i = 0; i < vocab_size; i++) {
-        // Quick fp16→fp32 decode
-        uint16_t h = host_logits[i];
-        uint32_t sign = (h & 0x8000) << 16;
-        uint32_t exp_val = (h >> 10) & 0x1F;
-        uint32_t mant = h & 0x3FF;
-        float val;
-        if (exp_val == 0) {
-            val = 0.0f;
-        } else if (exp_val == 31) {
-            val = (sign ? -1.0f : 1.0f) * 1e30f;
-        } else {
-            uint32_t f32 = sign | ((exp_val - 15 + 127) << 23) | (mant << 13);
-            memcpy(&val, &f32, 4);
-        }
-        if (val > best_val) {
-            best_val = val;
-            best_id = i;
-        }
+    cl_int err;
+    int* result = (int*)clEnqueueMapBuffer(device->queue, model->topk_result, CL_TRUE,
+                                           CL_MAP_READ, 0, sizeof(int), 0, nullptr,
+                                           nullptr, &err);
+    if (err != CL_SUCCESS || !result) {
+        fprintf(stderr, "Error: failed to map argmax result (err=%d)\n", err);
+        return -1;
+    }
+    int token = result[0];
+    clEnqueueUnmapMemObject(device->queue, model->topk_result, result, 0, nullptr, nullptr);
+    return token;
+}
+
+// --- Token Selection ---
+
+bool moondream2_topk(Moondream2Model* model, const DeviceInfo* device,
+                     cl_mem logits, int k, int* ids, float* vals) {
+    cl_event ev = dispatch_topk(device, model->sampling_program, logits,
+                                model->topk_result, model->config.vocab_size, k);
+    if (!ev) return false;
+    clReleaseEvent(ev);
+
+    // Blocking map of the small host-visible result buffer: the only sync
+    // point of a decode step, and no staging copy on unified memory.
+    size_t bytes = (size_t)2 * k * sizeof(int);
+    cl_int err;
+    int* result = (int*)clEnqueueMapBuffer(device->queue, model->topk_result, CL_TRUE,
+                                           CL_MAP_READ, 0, bytes, 0, nullptr, nullptr, &err);
+    if (err != CL_SUCCESS || !result) {
+        fprintf(stderr, "Error: failed to map top-k result (err=%d)\n", err);
+        return false;
     }
 
-    free(host_logits);
-    return best_id;
+    memcpy(ids, result, (size_t)k * sizeof(int));
+    if (vals) memcpy(vals, result + k, (size_t)k * sizeof(float));
+
+    clEnqueueUnmapMemObject(device->queue, model->topk_result, result, 0, nullptr, nullptr);
+    return ids[0] >= 0;
+}
+
+// Penalties -> top-k -> draw, all on the GPU; reads back one int.
+// token_history[0, history_len) must hold the context; the drawn token is
+// appended at history_len.
+static int sample_next_token(Moondream2Model* model, const DeviceInfo* device,
+                             cl_mem logits, const SamplerConfig& sc,
+                             int history_len, unsigned int step) {
+    const int vocab_size = model->config.vocab_size;
+    cl_event ev;
+
+    if ((sc.repetition_penalty != 1.0f || sc.frequency_penalty != 0.0f) &&
+        sc.penalty_last_n > 0 && history_len > 0) {
+        ev = dispatch_apply_penalties(device, model->sampling_program, logits,
+                                      model->token_history, history_len,
+                                      sc.penalty_last_n, vocab_size,
+                                      sc.repetition_penalty, sc.frequency_penalty);
+        if (!ev) return -1;
+        clReleaseEvent(ev);
+    }
+
+    int k = 1;
+    if (sc.temperature > 0.0f) {
+        k = (sc.top_k > 0 && sc.top_k < TOPK_MAX) ? sc.top_k : TOPK_MAX;
+    }
+
+    ev = dispatch_topk(device, model->sampling_program, logits,
+                       model->sample_candidates, vocab_size, k, sc.temperature);
+    if (!ev) return -1;
+    clReleaseEvent(ev);
+
+    ev = dispatch_sample_token(device, model->sampling_program,
+                               model->sample_candidates, model->topk_result,
+                               model->token_history, k, history_len,
+                               model->config.max_seq_len, sc.temperature,
+                               sc.top_p, sc.min_p, sc.seed, step);
+    if (!ev) return -1;
+    clReleaseEvent(ev);
+
+    cl_int err;
+    int* result = (int*)clEnqueueMapBuffer(device->queue, model->topk_result, CL_TRUE,
+                                           CL_MAP_READ, 0, sizeof(int), 0, nullptr,
+                                           nullptr, &err);
+    if (err != CL_SUCCESS || !result) {
+        fprintf(stderr, "Error: failed to map sampled token (err=%d)\n", err);
+        return -1;
+    }
+    int token = result[0];
+    clEnqueueUnmapMemObject(device->queue, model->topk_result, result, 0, nullptr, nullptr);
+    return token;
+}
+
+// Forward pass + token selection. Plain greedy decoding uses the fused LM
+// head (no logits); penalties and sampling need the logits.
+static int forward_next_token(Moondream2Model* model, const DeviceInfo* device,
+                              const int* tokens, int seq_len, const SamplerConfig& sc,
+                              int history_len, unsigned int step) {
+    bool penalties = sc.repetition_penalty != 1.0f || sc.frequency_penalty != 0.0f;
+    if (sc.temperature <= 0.0f && !penalties)
+        return moondream2_forward_argmax(model, device, tokens, seq_len);
+
+    cl_mem logits = moondream2_forward(model, device, tokens, seq_len);
+    if (!logits) return -1;
+    int token = sample_next_token(model, device, logits, sc, history_len, step);
+    clReleaseMemObject(logits);
+    return token;
 }
 
 // --- Text Generation ---
 
 int moondream2_generate(Moondream2Model* model, const DeviceInfo* device,
                         const char* prompt, int max_new_tokens,
-                        const char* vocab_path) {
+                        const char* vocab_path, const SamplerConfig* sampler) {
+    const SamplerConfig sc = sampler ? *sampler : SamplerConfig{};
+
     if (!model->initialized) {
         fprintf(stderr, "Error: model not initialized\n");
         return -1;
@@ -655,7 +1574,25 @@ int moondream2_generate(Moondream2Model* model, const DeviceInfo* device,
     // Reset KV-cache for fresh generation
     moondream2_reset_cache(model);
 
+    // Seed the GPU token history (penalty window) with the prompt
+    int history_len = prompt_len < model->config.max_seq_len ? prompt_len
+                                                             : model->config.max_seq_len;
+    cl_int err = clEnqueueWriteBuffer(device->queue, model->token_history, CL_TRUE, 0,
+                                      (size_t)history_len * sizeof(int), prompt_tokens,
+                                      0, nullptr, nullptr);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "Error: failed to upload token history\n");
+        if (has_tokenizer) tokenizer_free(&vocab);
+        return -1;
+    }
+
     printf("\n--- Generation ---\n");
+    if (sc.temperature > 0.0f) {
+        printf("Sampling: temperature=%.2f top_k=%d top_p=%.2f min_p=%.2f seed=%u\n",
+               sc.temperature, sc.top_k, sc.top_p, sc.min_p, sc.seed);
+    } else {
+        printf("Sampling: greedy\n");
+    }
     if (has_tokenizer && prompt) {
         printf("Prompt: %s\n", prompt);
     }
@@ -664,27 +1601,24 @@ int moondream2_generate(Moondream2Model* model, const DeviceInfo* device,
 
     struct timespec t_start, t_prefill_end;
     clock_gettime(CLOCK_MONOTONIC, &t_start);
+    dispatch_stats_reset();
 
     // Prefill: process all prompt tokens at once
-    cl_mem logits = moondream2_forward(model, device, prompt_tokens, prompt_len);
-    if (!logits) {
-        fprintf(stderr, "Error: prefill forward pass failed\n");
+    int next_token = forward_next_token(model, device, prompt_tokens, prompt_len,
+                                        sc, history_len, 0);
+    if (next_token < 0) {
+        fprintf(stderr, "Error: prefill failed\n");
         if (has_tokenizer) tokenizer_free(&vocab);
         return -1;
     }
+    history_len++;
 
     clock_gettime(CLOCK_MONOTONIC, &t_prefill_end);
+    DispatchStats prefill_stats = dispatch_stats_get();
+    dispatch_stats_reset();
 
     // Decode loop: generate one token at a time
     int generated = 0;
-    int next_token = argmax_logits(device, logits, model->config.vocab_size);
-    clReleaseMemObject(logits);
-
-    if (next_token < 0) {
-        fprintf(stderr, "Error: argmax failed\n");
-        if (has_tokenizer) tokenizer_free(&vocab);
-        return -1;
-    }
 
     for (int i = 0; i < max_new_tokens; i++) {
         // Check for EOS
@@ -713,23 +1647,18 @@ int moondream2_generate(Moondream2Model* model, const DeviceInfo* device,
 
         // Forward pass with single token
         int token_arr[1] = { next_token };
-        logits = moondream2_forward(model, device, token_arr, 1);
-        if (!logits) {
-            fprintf(stderr, "\nError: decode forward pass failed at token %d\n", i);
-            break;
-        }
-
-        next_token = argmax_logits(device, logits, model->config.vocab_size);
-        clReleaseMemObject(logits);
-
+        next_token = forward_next_token(model, device, token_arr, 1, sc, history_len,
+                                        (unsigned int)i + 1);
         if (next_token < 0) {
-            fprintf(stderr, "\nError: argmax failed at token %d\n", i);
+            fprintf(stderr, "\nError: decode step failed at token %d\n", i);
             break;
         }
+        history_len++;
     }
 
     struct timespec t_end;
     clock_gettime(CLOCK_MONOTONIC, &t_end);
+    DispatchStats decode_stats = dispatch_stats_get();
 
     double prefill_ms = (t_prefill_end.tv_sec - t_start.tv_sec) * 1000.0 +
                         (t_prefill_end.tv_nsec - t_start.tv_nsec) / 1e6;
@@ -746,6 +1675,18 @@ int moondream2_generate(Moondream2Model* model, const DeviceInfo* device,
     printf("  Decode:         %.1f ms (%.1f tok/s)\n", decode_ms, tok_per_sec);
     printf("  Total:          %.1f ms\n", total_ms);
 
+    // Host-side enqueue overhead (kernel lookup + arg setup + enqueue)
+    printf("  Host enqueue:   prefill %.2f ms (%llu dispatches, %llu kernels created)\n",
+           prefill_stats.host_enqueue_ns / 1e6,
+           (unsigned long long)prefill_stats.dispatches,
+           (unsigned long long)prefill_stats.kernels_created);
+    if (generated > 0) {
+        printf("                  decode %.1f us/token (%.0f dispatches/token, %llu kernels created)\n",
+               decode_stats.host_enqueue_ns / 1e3 / generated,
+               (double)decode_stats.dispatches / generated,
+               (unsigned long long)decode_stats.kernels_created);
+    }
+
     if (has_tokenizer) tokenizer_free(&vocab);
     return generated;
 }
@@ -863,18 +1804,30 @@ cl_mem moondream2_encode_vision(Moondream2Model* model, const DeviceInfo* device
         }
         clReleaseEvent(ev);
 
-        // MLP: hidden2 -> hidden
+        // MLP: hidden += fc2(gelu(fc1(hidden2) + b1)) + b2, bias, GELU and
+        // the residual add all in the GEMM epilogues
         if (layer.mlp_fc_weight && layer.mlp_proj_weight) {
-            ev = dispatch_vision_mlp(device, model->vision_program,
-                                     hidden2,
-                                     layer.mlp_fc_weight,
-                                     layer.mlp_fc_weight,  // gate and up share weights for simplicity
-                                     layer.mlp_proj_weight,
-                                     hidden,
-                                     num_patches, cfg.vision_dim,
-                                     cfg.vision_dim * 4);  // intermediate = 4x hidden
+            const int mlp_dim = cfg.vision_dim * 4;  // intermediate = 4x hidden
+            GemmEpilogue fc_epi;
+            fc_epi.bias = layer.mlp_fc_bias;
+            fc_epi.activation = GEMM_ACT_GELU;
+            ev = dispatch_gemm_image_epilogue(device, model->gemm_program,
+                                              hidden2, layer.mlp_fc_weight, model->scratch_gate,
+                                              num_patches, mlp_dim, cfg.vision_dim, &fc_epi);
             if (!ev) {
-                fprintf(stderr, "[vision] ERROR: MLP dispatch failed\n");
+                fprintf(stderr, "[vision] ERROR: MLP fc dispatch failed\n");
+                return nullptr;
+            }
+            clReleaseEvent(ev);
+
+            GemmEpilogue proj_epi;
+            proj_epi.bias = layer.mlp_proj_bias;
+            proj_epi.residual = true;
+            ev = dispatch_gemm_image_epilogue(device, model->gemm_program,
+                                              model->scratch_gate, layer.mlp_proj_weight, hidden,
+                                              num_patches, cfg.vision_dim, mlp_dim, &proj_epi);
+            if (!ev) {
+                fprintf(stderr, "[vision] ERROR: MLP proj dispatch failed\n");
                 return nullptr;
             }
             clReleaseEvent(ev);
@@ -902,12 +1855,13 @@ cl_mem moondream2_encode_vision(Moondream2Model* model, const DeviceInfo* device
     // 5. Project to language dimension [num_patches, vision_dim] -> [num_patches, llm_dim]
     if (w->vision_proj_weight) {
         printf("[vision] vision-to-language projection\n");
-        cl_event ev = dispatch_vision_proj(device, model->vision_program,
-                                           hidden,
-                                           w->vision_proj_weight,
-                                           nullptr,  // proj_bias
-                                           model->scratch_q,  // reuse scratch buffer for output
-                                           num_patches, cfg.vision_dim, cfg.llm_dim);
+        // No bias: a plain [num_patches, vision_dim] x [vision_dim, llm_dim]
+        // GEMM, which takes the register-blocked image kernel
+        cl_event ev = dispatch_gemm_image(device, model->gemm_program,
+                                          hidden,
+                                          w->vision_proj_weight,
+                                          model->scratch_q,  // reuse scratch buffer for output
+                                          num_patches, cfg.llm_dim, cfg.vision_dim);
         if (!ev) {
             fprintf(stderr, "[vision] ERROR: vision_proj dispatch failed\n");
             return nullptr;
@@ -974,6 +1928,8 @@ static void release_mem(cl_mem* m) {
 void moondream2_release_gpu(Moondream2Model* model) {
     Moondream2Weights* w = &model->gpu_weights;
 
+    decode_graph_destroy(&model->decode_graph);
+
     release_mem(&w->token_embed);
     release_mem(&w->final_norm_weight);
     release_mem(&w->lm_head_weight);
@@ -986,9 +1942,11 @@ void moondream2_release_gpu(Moondream2Model* model) {
             release_mem(&lw->q_proj_weight);
             release_mem(&lw->k_proj_weight);
             release_mem(&lw->v_proj_weight);
+            release_mem(&lw->qkv_proj_weight);
             release_mem(&lw->o_proj_weight);
             release_mem(&lw->gate_proj_weight);
             release_mem(&lw->up_proj_weight);
+            release_mem(&lw->gate_up_weight);
             release_mem(&lw->down_proj_weight);
             release_mem(&lw->input_norm_weight);
             release_mem(&lw->post_norm_weight);
@@ -998,9 +1956,22 @@ void moondream2_release_gpu(Moondream2Model* model) {
         w->num_layers = 0;
     }
 
-    release_mem(&model->kv_cache.k_cache);
-    release_mem(&model->kv_cache.v_cache);
-    model->kv_cache.length = 0;
+    KVCache* kv = &model->kv_cache;
+    if (kv->layers) {
+        for (int i = 0; i < kv->num_layers; i++) {
+            KVLayerCache* lc = &kv->layers[i];
+            release_mem(&lc->k_image);
+            release_mem(&lc->v_image);
+            release_mem(&lc->k_cache);
+            release_mem(&lc->v_cache);
+            release_mem(&lc->k_scales);
+            release_mem(&lc->v_scales);
+        }
+        free(kv->layers);
+        kv->layers = nullptr;
+        kv->num_layers = 0;
+    }
+    kv->length = 0;
 
     release_mem(&model->scratch_a);
     release_mem(&model->scratch_b);
@@ -1010,14 +1981,122 @@ void moondream2_release_gpu(Moondream2Model* model) {
     release_mem(&model->scratch_attn);
     release_mem(&model->scratch_gate);
     release_mem(&model->scratch_up);
+    release_mem(&model->scratch_act_q);
+    release_mem(&model->scratch_act_scales);
+    release_mem(&model->logits);
+    release_mem(&model->decode_token);
+    release_mem(&model->topk_result);
+    release_mem(&model->sample_candidates);
+    release_mem(&model->token_history);
+}
+
+// --- KV-Cache Read Path ---
+
+static const int KV_READ_BENCH_LEN = 1024;
+static const int KV_READ_BENCH_ITERS = 20;
+
+// Average host time (ms) of one decode attention over the first
+// KV_READ_BENCH_LEN cache positions; < 0 on failure
+static double time_kv_read(Moondream2Model* model, const DeviceInfo* device, bool image) {
+    const Moondream2Config& cfg = model->config;
+    const KVCache* kv = &model->kv_cache;
+    const KVLayerCache* lc = &kv->layers[0];  // all layers read alike
+    int cache_len = kv->capacity < KV_READ_BENCH_LEN ? kv->capacity : KV_READ_BENCH_LEN;
+
+    struct timespec t0, t1;
+    for (int i = -1; i < KV_READ_BENCH_ITERS; i++) {
+        if (i == 0) clock_gettime(CLOCK_MONOTONIC, &t0);  // first launch warms up
+        cl_event ev = image
+            ? dispatch_attention_decode_image(device, model->attention_program,
+                                              model->scratch_q, lc->k_image, lc->v_image,
+                                              model->scratch_attn,
+                                              cache_len, cfg.llm_heads, cfg.head_dim,
+                                              kv->layout, kv->capacity)
+            : dispatch_attention_decode(device, model->attention_program,
+                                        model->scratch_q, lc->k_cache, lc->v_cache,
+                                        model->scratch_attn,
+                                        cache_len, cfg.llm_heads, cfg.head_dim,
+                                        kv->layout, kv->capacity);
+        if (!ev) return -1.0;
+        clReleaseEvent(ev);
+        if (i < 0) clFinish(device->queue);
+    }
+    clFinish(device->queue);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    double ms = (double)(t1.tv_sec - t0.tv_sec) * 1e3 +
+                (double)(t1.tv_nsec - t0.tv_nsec) / 1e6;
+    return ms / KV_READ_BENCH_ITERS;
+}
+
+static void release_kv_images(KVCache* kv) {
+    for (int i = 0; i < kv->num_layers; i++) {
+        release_mem(&kv->layers[i].k_image);
+        release_mem(&kv->layers[i].v_image);
+    }
+}
+
+bool moondream2_set_kv_read(Moondream2Model* model, const DeviceInfo* device,
+                            KVCacheRead mode) {
+    const Moondream2Config& cfg = model->config;
+    KVCache* kv = &model->kv_cache;
+
+    // A captured graph holds the old attention kernel
+    decode_graph_destroy(&model->decode_graph);
+    release_kv_images(kv);
+    if (mode == KV_READ_BUFFER) return true;
+
+    // Image views read fp16 texels; an int8 cache stays on buffers
+    bool ok = kv->type == KV_CACHE_F16;
+    size_t kv_halves = (size_t)kv->capacity * cfg.llm_heads * cfg.head_dim;
+    for (int i = 0; ok && i < kv->num_layers; i++) {
+        KVLayerCache* lc = &kv->layers[i];
+        lc->k_image = create_buffer_image_view(device, lc->k_cache, kv_halves);
+        lc->v_image = create_buffer_image_view(device, lc->v_cache, kv_halves);
+        ok = lc->k_image && lc->v_image;
+    }
+    if (!ok) {
+        release_kv_images(kv);
+        if (mode == KV_READ_IMAGE) {
+            fprintf(stderr, "Error: KV-cache image views are not supported on this %s\n",
+                    kv->type == KV_CACHE_F16 ? "device" : "cache type");
+            return false;
+        }
+        printf("KV-cache read path: buffer (image views unavailable)\n");
+        return true;
+    }
+    if (mode == KV_READ_IMAGE) {
+        printf("KV-cache read path: image\n");
+        return true;
+    }
+
+    // Auto: the cache is empty, so time both paths on zeroed contents
+    const KVLayerCache* lc = &kv->layers[0];
+    const cl_half zero = 0;
+    size_t kv_bytes = kv_halves * sizeof(cl_half);
+    if (clEnqueueFillBuffer(device->queue, lc->k_cache, &zero, sizeof(zero), 0, kv_bytes,
+                            0, nullptr, nullptr) != CL_SUCCESS ||
+        clEnqueueFillBuffer(device->queue, lc->v_cache, &zero, sizeof(zero), 0, kv_bytes,
+                            0, nullptr, nullptr) != CL_SUCCESS) {
+        fprintf(stderr, "Warning: KV-cache clear failed, timing on stale contents\n");
+    }
+
+    double buffer_ms = time_kv_read(model, device, false);
+    double image_ms = time_kv_read(model, device, true);
+    bool use_image = image_ms > 0.0 && (buffer_ms < 0.0 || image_ms < buffer_ms);
+    printf("KV-cache read path: %s (decode attention buffer %.3f ms, image %.3f ms)\n",
+           use_image ? "image" : "buffer", buffer_ms, image_ms);
+    if (!use_image) release_kv_images(kv);
+    return true;
 }
 
 // --- Load / Destroy ---
 
 bool moondream2_load(Moondream2Model* model, const DeviceInfo* device,
-                     const char* gguf_path, const char* kernel_dir) {
+                     const char* gguf_path, const char* kernel_dir,
+                     const Moondream2Config* config) {
     memset(model, 0, sizeof(Moondream2Model));
-    model->config = Moondream2Config{};
+    model->config = config ? *config : Moondream2Config{};
 
     // Load GGUF weights
     printf("Loading model weights from: %s\n", gguf_path);
@@ -1031,17 +2110,49 @@ bool moondream2_load(Moondream2Model* model, const DeviceInfo* device,
     gguf_print_tensors(&model->weights);
 
     // Build kernel programs
-    const char* build_opts = "-cl-mad-enable -cl-fast-relaxed-math";
+    char build_opts[256];
+    char spec_opts[512];
+    moondream2_build_options(device, model->config, build_opts, sizeof(build_opts),
+                             spec_opts, sizeof(spec_opts));
 
     if (kernel_dir) {
         printf("Building kernels from: %s\n", kernel_dir);
-        model->gemm_program       = load_kernel(device, kernel_dir, "gemm.cl", build_opts);
-        model->attention_program  = load_kernel(device, kernel_dir, "attention.cl", build_opts);
-        model->norm_program       = load_kernel(device, kernel_dir, "layernorm.cl", build_opts);
+
+        // Launch shapes tuned for this device + driver by mgpu_tune, if any
+        KernelTuning tuning;
+        char tuning_path[512];
+        char tuned_opts[1024];
+        KernelBuildOptions opts = { build_opts, spec_opts, nullptr, &tuning };
+        snprintf(tuning_path, sizeof(tuning_path), "%s/%s", kernel_dir, TUNING_DB_FILENAME);
+        if (tuning_db_load(tuning_path, device, &tuning)) {
+            int n = snprintf(tuned_opts, sizeof(tuned_opts), "%s ", spec_opts);
+            if (kernel_tuning_build_options(&tuning, tuned_opts + n, sizeof(tuned_opts) - n)) {
+                char summary[512];
+                kernel_tuning_format(&tuning, summary, sizeof(summary));
+                printf("  Tuned shapes: %s\n", summary);
+                opts.tuned = tuned_opts;
+            }
+        }
+
+        model->gemm_program       = load_specialized_kernel(device, kernel_dir, "gemm.cl", &opts, true);
+        model->attention_program  = load_specialized_kernel(device, kernel_dir, "attention.cl", &opts, true);
+        model->norm_program       = load_specialized_kernel(device, kernel_dir, "layernorm.cl", &opts, true);
         model->activation_program = load_kernel(device, kernel_dir, "activations.cl", build_opts);
         model->rope_program       = load_kernel(device, kernel_dir, "rope.cl", build_opts);
         model->embedding_program  = load_kernel(device, kernel_dir, "embedding.cl", build_opts);
-        model->vision_program     = load_kernel(device, kernel_dir, "vision.cl", build_opts);
+        model->vision_program     = load_specialized_kernel(device, kernel_dir, "vision.cl", &opts, false);
+        model->sampling_program   = load_kernel(device, kernel_dir, "sampling.cl", build_opts);
+
+        // Create every kernel object once; dispatch_* reuses them per token
+        cl_program programs[] = {
+            model->gemm_program, model->attention_program, model->norm_program,
+            model->activation_program, model->rope_program, model->embedding_program,
+            model->vision_program, model->sampling_program,
+        };
+        int num_cached = 0;
+        for (cl_program prog : programs)
+            num_cached += kernel_registry_preload(prog);
+        printf("  Kernel registry: %d kernels cached\n", num_cached);
     }
 
     // Print model configuration
@@ -1053,12 +2164,44 @@ bool moondream2_load(Moondream2Model* model, const DeviceInfo* device,
     printf("  Vocab size:     %d, Max seq len: %d\n",
            model->config.vocab_size, model->config.max_seq_len);
 
-    // Upload weights to GPU
-    if (!moondream2_upload_weights(model, device)) {
+    // Upload weights to GPU, from the GPU-native pack next to the GGUF when
+    // mgpu_pack has made one from this very file. W8A8 re-quantizes the
+    // projections from the GGUF, so it never uses a pack.
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    bool uploaded = false;
+    char pack_path[512];
+    moondream2_pack_path(gguf_path, pack_path, sizeof(pack_path));
+    PackFile pack;
+    if (model->config.w8a8) {
+        printf("W8A8: int8 projections (%s dot products)\n",
+               device->has_int_dot_product ? "cl_khr_integer_dot_product" : "char4");
+    } else if (pack_open(&pack, pack_path)) {
+        uint64_t source_size;
+        int64_t source_mtime;
+        if (!pack_source_stat(gguf_path, &source_size, &source_mtime) ||
+            !pack_matches_source(&pack, source_size, source_mtime)) {
+            printf("Ignoring stale weight pack %s (re-run mgpu_pack)\n", pack_path);
+        } else if (!pack_matches_config(&pack, model->config)) {
+            printf("Ignoring weight pack %s: built for another model config\n", pack_path);
+        } else {
+            printf("Using weight pack: %s\n", pack_path);
+            uploaded = moondream2_upload_packed_weights(model, device, &pack);
+            if (!uploaded) {
+                fprintf(stderr, "Warning: weight pack upload failed, using the GGUF\n");
+                moondream2_release_gpu(model);
+            }
+        }
+        pack_close(&pack);
+    }
+    if (!uploaded && !moondream2_upload_weights(model, device)) {
         fprintf(stderr, "Error: Failed to upload weights\n");
         moondream2_destroy(model);
         return false;
     }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    printf("  Weight upload: %.1f ms\n",
+           (double)(t1.tv_sec - t0.tv_sec) * 1e3 + (double)(t1.tv_nsec - t0.tv_nsec) / 1e6);
 
     // Initialize RoPE tables
     if (!moondream2_init_rope(model, device)) {
@@ -1084,6 +2227,14 @@ void moondream2_destroy(Moondream2Model* model) {
 
     moondream2_release_gpu(model);
 
+    cl_program programs[] = {
+        model->gemm_program, model->attention_program, model->norm_program,
+        model->activation_program, model->rope_program, model->embedding_program,
+        model->vision_program, model->sampling_program,
+    };
+    for (cl_program prog : programs)
+        if (prog) kernel_registry_release(prog);
+
     if (model->gemm_program)       clReleaseProgram(model->gemm_program);
     if (model->attention_program)  clReleaseProgram(model->attention_program);
     if (model->norm_program)       clReleaseProgram(model->norm_program);
@@ -1091,6 +2242,7 @@ void moondream2_destroy(Moondream2Model* model) {
     if (model->rope_program)       clReleaseProgram(model->rope_program);
     if (model->embedding_program)  clReleaseProgram(model->embedding_program);
     if (model->vision_program)     clReleaseProgram(model->vision_program);
+    if (model->sampling_program)   clReleaseProgram(model->sampling_program);
 
     gguf_close(&model->weights);
     model->initialized = false;
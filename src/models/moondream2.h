@@ -1,11 +1,20 @@
 #pragma once
 
+#include "../engine/compute.h"
 #include "../engine/device.h"
 #include "../engine/memory.h"
+#include "../engine/pipeline.h"
 #include "gguf_loader.h"
+#include "weight_pack.h"
 
 namespace mgpu {
 
+// Element type of the KV-cache
+enum KVCacheType {
+    KV_CACHE_F16 = 0,  // fp16 K/V
+    KV_CACHE_INT8,     // int8 K/V, fp16 scale per (KV_Q8_BLOCK positions, head): half the memory
+};
+
 // Moondream2 architecture constants
 struct Moondream2Config {
     // Vision encoder (SigLIP)
@@ -27,6 +36,31 @@ struct Moondream2Config {
     int head_dim = 64;          // llm_dim / llm_heads
     int llm_intermediate = 8192; // MLP intermediate size
     int max_seq_len = 2048;
+
+    // Runtime
+    KVCacheType kv_cache_type = KV_CACHE_F16;  // each of llm_layers has its own K/V
+    KVLayout kv_layout = KV_LAYOUT_SEQ_MAJOR;  // element order of every K/V cache
+    bool w8a8 = false;  // LLM projections as WEIGHT_I8, activations quantized per row
+};
+
+// Next-token selection for moondream2_generate. All filters run on the GPU;
+// the defaults are greedy decoding.
+struct SamplerConfig {
+    float temperature = 0.0f;         // <= 0: greedy (argmax)
+    int top_k = 40;                   // candidates kept, clamped to TOPK_MAX; 0 = TOPK_MAX
+    float top_p = 1.0f;               // nucleus cutoff on cumulative probability (full
+                                      // vocabulary), within the top_k candidates
+    float min_p = 0.0f;               // drop tokens with p < min_p * p_max
+    float repetition_penalty = 1.0f;  // 1 = off
+    float frequency_penalty = 0.0f;   // subtracted once per occurrence
+    int penalty_last_n = 64;          // history window for both penalties
+    unsigned int seed = 0;            // RNG seed (same seed, same output)
+};
+
+// What the LM head produces at the end of a forward pass
+enum LmHeadMode {
+    LM_HEAD_LOGITS = 0,  // full logits in Moondream2Model::logits (sampling, scoring)
+    LM_HEAD_ARGMAX,      // fused lm_head + argmax, logits never stored (greedy)
 };
 
 struct TransformerLayerWeights {
@@ -35,15 +69,30 @@ struct TransformerLayerWeights {
     cl_mem k_proj_weight;      // image2d: [dim, dim]
     cl_mem v_proj_weight;      // image2d: [dim, dim]
     cl_mem o_proj_weight;      // image2d: [dim, dim]
+    cl_mem qkv_proj_weight;    // image2d: [dim, 3*dim] — q|k|v side by side;
+                               // when set, q/k/v_proj_weight are not uploaded
 
     // MLP (SwiGLU)
     cl_mem gate_proj_weight;   // image2d: [dim, intermediate]
     cl_mem up_proj_weight;     // image2d: [dim, intermediate]
+    cl_mem gate_up_weight;     // image2d: [dim, 2*intermediate] — gate/up texels
+                               // interleaved; when set, gate/up are not uploaded
     cl_mem down_proj_weight;   // image2d: [intermediate, dim]
 
     // Norms (small vectors — buffers)
     cl_mem input_norm_weight;  // buffer: [dim]
     cl_mem post_norm_weight;   // buffer: [dim]
+
+    // Storage of each projection above, per tensor (a layer may mix them):
+    // WEIGHT_F16 images, the GGUF Q4_0 / Q8_0 blocks in a buffer, or
+    // WEIGHT_I8 (config.w8a8). The fused qkv / gate_up images are always F16.
+    WeightFormat q_proj_format;
+    WeightFormat k_proj_format;
+    WeightFormat v_proj_format;
+    WeightFormat o_proj_format;
+    WeightFormat gate_proj_format;
+    WeightFormat up_proj_format;
+    WeightFormat down_proj_format;
 };
 
 // Vision encoder layer weights (SigLIP)
@@ -91,11 +140,30 @@ struct Moondream2Weights {
     cl_mem sin_table;          // buffer: [max_seq_len, head_dim/2]
 };
 
+// How decode attention reads the KV-cache
+enum KVCacheRead {
+    KV_READ_BUFFER = 0,  // buffer loads
+    KV_READ_IMAGE,       // image1d_buffer views + read_imageh (experimental)
+    KV_READ_AUTO,        // whichever a startup microbenchmark measures faster
+};
+
+// K/V of one transformer layer
+struct KVLayerCache {
+    cl_mem k_cache;   // buffer: max_seq_len * num_heads * head_dim (half or char), ordered by layout
+    cl_mem v_cache;   // buffer: max_seq_len * num_heads * head_dim (half or char), ordered by layout
+    cl_mem k_scales;  // KV_CACHE_INT8: [ceil(max_seq_len / KV_Q8_BLOCK), num_heads] half, else null
+    cl_mem v_scales;  // KV_CACHE_INT8: as k_scales, else null
+    cl_mem k_image;   // image1d_buffer view of k_cache when decode reads images, else null
+    cl_mem v_image;   // image1d_buffer view of v_cache when decode reads images, else null
+};
+
 struct KVCache {
-    cl_mem k_cache;  // buffer: [max_seq_len, num_heads, head_dim]
-    cl_mem v_cache;  // buffer: [max_seq_len, num_heads, head_dim]
-    int length;      // current number of cached positions
-    int capacity;    // max_seq_len
+    KVLayerCache* layers;  // [num_layers]
+    int num_layers;        // llm_layers
+    int length;            // current number of cached positions
+    int capacity;          // max_seq_len
+    KVLayout layout;       // config.kv_layout (same size either way)
+    KVCacheType type;      // config.kv_cache_type
 };
 
 struct Moondream2Model {
@@ -110,6 +178,7 @@ struct Moondream2Model {
     cl_program rope_program;
     cl_program embedding_program;
     cl_program vision_program;
+    cl_program sampling_program;
 
     // GPU weights and caches
     Moondream2Weights gpu_weights;
@@ -124,18 +193,72 @@ struct Moondream2Model {
     cl_mem scratch_k;     // [max_seq_len * dim]
     cl_mem scratch_v;     // [max_seq_len * dim]
     cl_mem scratch_attn;  // [max_seq_len * dim]
+    cl_mem scratch_act_q;       // [max_seq_len * intermediate] int8 (w8a8 only)
+    cl_mem scratch_act_scales;  // [max_seq_len] float (w8a8 only)
+    cl_mem logits;        // [vocab_size], returned (retained) by forward
+    cl_mem decode_token;  // [1] int token id of the current decode step
+    cl_mem topk_result;   // [2 * TOPK_MAX] ids + values, host-visible, reused per token
+    cl_mem sample_candidates; // [2 * TOPK_MAX + 1] top-k + softmax sum feeding sample_token
+    cl_mem token_history;     // [max_seq_len] int prompt + generated ids (penalties)
+    int decode_token_host;
+
+    // Decode graph: the first decode step is captured, later steps replay it
+    DecodeGraph decode_graph;
+    LmHeadMode decode_graph_mode;  // LM head the graph was captured with
+    unsigned decode_graph_scratch;  // dispatch_scratch_generation() at capture
+    bool no_decode_graph;  // always dispatch eagerly
+
+    // Execution mode: by default the forward pass is enqueued without host
+    // waits and synced once at token readback. Set to wait after every op.
+    bool sync_each_op;
 
     bool initialized;
 };
 
-// Load model: open GGUF, compile kernels, upload weights, allocate buffers
+// Kernel build options of moondream2_load: `base` from the device's
+// capabilities (subgroups, integer dot products) and `specialized` = base
+// plus the config's dimensions as -D constants. The tuned build appends
+// kernel_tuning_build_options to `specialized`; mgpu_tune builds the same way.
+void moondream2_build_options(const DeviceInfo* device, const Moondream2Config& cfg,
+                              char* base, size_t base_size,
+                              char* specialized, size_t specialized_size);
+
+// Load model: open GGUF, compile kernels, upload weights, allocate buffers.
+// The LLM kernels are compiled with the config's dimensions as constants,
+// so the fused projection, attention and norm programs only accept them.
+// `config` replaces the defaults (e.g. to pick the KV-cache type).
+// Weights come from the weight pack at moondream2_pack_path(gguf_path) when
+// mgpu_pack made it from this GGUF (same size and mtime) for this config,
+// else the GGUF.
 bool moondream2_load(Moondream2Model* model, const DeviceInfo* device,
-                     const char* gguf_path, const char* kernel_dir);
+                     const char* gguf_path, const char* kernel_dir,
+                     const Moondream2Config* config = nullptr);
 void moondream2_destroy(Moondream2Model* model);
 
 // Upload weights from GGUF to GPU
 bool moondream2_upload_weights(Moondream2Model* model, const DeviceInfo* device);
 
+// Same, from a weight pack (already in GPU layout: one copy per tensor).
+// Fails if the pack was built for another config (pack_matches_config).
+bool moondream2_upload_packed_weights(Moondream2Model* model, const DeviceInfo* device,
+                                      const PackFile* pack);
+
+// Write the LLM weights of `gguf_path` as a weight pack (weight_pack.h) laid
+// out the way moondream2_upload_weights uploads them under `config`
+// (nullptr: the defaults, as in moondream2_load). `quantize` = WEIGHT_Q8_0
+// stores F16 projections as Q8_0 blocks (unfused); WEIGHT_F16 keeps them.
+// No GPU needed.
+bool moondream2_pack(const char* gguf_path, const char* pack_path,
+                     WeightFormat quantize = WEIGHT_F16,
+                     const Moondream2Config* config = nullptr);
+
+// True if the pack's layout was built for `config`'s layer count and
+// dimensions (which decide the layers packed and the QKV / gate-up fusion)
+bool pack_matches_config(const PackFile* pack, const Moondream2Config& config);
+
+// Pack moondream2_load looks for: the GGUF path with ".gguf" replaced by ".mgpu"
+void moondream2_pack_path(const char* gguf_path, char* out, size_t size);
+
 // Precompute RoPE sin/cos tables
 bool moondream2_init_rope(Moondream2Model* model, const DeviceInfo* device);
 
@@ -162,17 +285,36 @@ cl_mem moondream2_forward_vision(Moondream2Model* model, const DeviceInfo* devic
 cl_mem moondream2_forward(Moondream2Model* model, const DeviceInfo* device,
                           const int* tokens, int seq_len);
 
-// Greedy autoregressive text generation
-// Encodes prompt, runs prefill, then decodes token-by-token
+// Forward pass with the fused greedy LM head: returns the argmax token id of
+// the last position (-1 on failure). No logits are written.
+int moondream2_forward_argmax(Moondream2Model* model, const DeviceInfo* device,
+                              const int* tokens, int seq_len);
+
+// Top-k of a logits buffer on the GPU; only the 2*k result words are read
+// back. ids/vals receive k entries, best first (vals may be null).
+// Returns false on failure.
+bool moondream2_topk(Moondream2Model* model, const DeviceInfo* device,
+                     cl_mem logits, int k, int* ids, float* vals);
+
+// Autoregressive text generation
+// Encodes prompt, runs prefill, then decodes token-by-token, selecting each
+// token on the GPU per `sampler` (nullptr: greedy)
 // Prints generated tokens to stdout as they are produced
 // Returns total number of tokens generated (excluding prompt)
 int moondream2_generate(Moondream2Model* model, const DeviceInfo* device,
                         const char* prompt, int max_new_tokens,
-                        const char* vocab_path);
+                        const char* vocab_path, const SamplerConfig* sampler);
 
 // Reset KV-cache (for new conversation)
 void moondream2_reset_cache(Moondream2Model* model);
 
+// Choose the decode attention read path. KV_READ_AUTO times both on the
+// (empty) cache and keeps the faster one; it falls back to buffers when the
+// device cannot create image views or the cache is int8. Call before
+// generating. Returns false only if KV_READ_IMAGE is unavailable.
+bool moondream2_set_kv_read(Moondream2Model* model, const DeviceInfo* device,
+                            KVCacheRead mode);
+
 // Release GPU resources
 void moondream2_release_gpu(Moondream2Model* model);
 
@@ -0,0 +1,178 @@
+#include "weight_pack.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace mgpu {
+
+bool pack_source_stat(const char* path, uint64_t* size, int64_t* mtime) {
+    struct stat st;
+    if (stat(path, &st) != 0) return false;
+    *size = (uint64_t)st.st_size;
+    *mtime = (int64_t)st.st_mtime;
+    return true;
+}
+
+bool pack_open(PackFile* file, const char* path) {
+    memset(file, 0, sizeof(PackFile));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(PackHeader)) {
+        fprintf(stderr, "Error: Not a weight pack: %s\n", path);
+        close(fd);
+        return false;
+    }
+
+    file->file_size = (size_t)st.st_size;
+    file->mapped_data = mmap(nullptr, file->file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (file->mapped_data == MAP_FAILED) {
+        fprintf(stderr, "Error: mmap failed for: %s\n", path);
+        file->mapped_data = nullptr;
+        return false;
+    }
+
+    const PackHeader* h = (const PackHeader*)file->mapped_data;
+    if (h->magic != PACK_MAGIC || h->version != PACK_VERSION) {
+        fprintf(stderr, "Error: Not a version %u weight pack: %s\n", PACK_VERSION, path);
+        pack_close(file);
+        return false;
+    }
+    if (h->table_offset % alignof(PackTensor) != 0 || h->table_offset > file->file_size ||
+        h->tensor_count > (file->file_size - h->table_offset) / sizeof(PackTensor)) {
+        fprintf(stderr, "Error: Truncated weight pack: %s\n", path);
+        pack_close(file);
+        return false;
+    }
+
+    const PackTensor* tensors =
+        (const PackTensor*)((const uint8_t*)file->mapped_data + h->table_offset);
+    for (uint64_t i = 0; i < h->tensor_count; i++) {
+        const PackTensor* t = &tensors[i];
+        if (t->offset % PACK_ALIGN != 0 || t->offset > h->table_offset ||
+            t->size > h->table_offset - t->offset ||
+            memchr(t->name, '\0', sizeof(t->name)) == nullptr) {
+            fprintf(stderr, "Error: Corrupt tensor %llu in weight pack: %s\n",
+                    (unsigned long long)i, path);
+            pack_close(file);
+            return false;
+        }
+    }
+
+    file->header = h;
+    file->tensors = tensors;
+    return true;
+}
+
+bool pack_matches_source(const PackFile* file, uint64_t source_size, int64_t source_mtime) {
+    return file->header && file->header->source_size == source_size &&
+           file->header->source_mtime == source_mtime;
+}
+
+const PackTensor* pack_find_tensor(const PackFile* file, const char* name) {
+    if (!file->header) return nullptr;
+    for (uint64_t i = 0; i < file->header->tensor_count; i++) {
+        if (strcmp(file->tensors[i].name, name) == 0) return &file->tensors[i];
+    }
+    return nullptr;
+}
+
+const void* pack_tensor_data(const PackFile* file, const PackTensor* tensor) {
+    return (const uint8_t*)file->mapped_data + tensor->offset;
+}
+
+void pack_close(PackFile* file) {
+    if (file->mapped_data && file->mapped_data != MAP_FAILED) {
+        munmap(file->mapped_data, file->file_size);
+    }
+    memset(file, 0, sizeof(PackFile));
+}
+
+// --- Writing ---
+
+// Zero-fill the file from writer->data_end up to `offset`
+static bool pack_pad_to(PackWriter* w, uint64_t offset) {
+    static const uint8_t zeros[256] = {};
+    while (w->data_end < offset) {
+        uint64_t n = offset - w->data_end;
+        if (n > sizeof(zeros)) n = sizeof(zeros);
+        if (fwrite(zeros, 1, (size_t)n, w->f) != n) return false;
+        w->data_end += n;
+    }
+    return true;
+}
+
+static uint64_t pack_align(uint64_t offset, uint64_t align) {
+    return (offset + align - 1) / align * align;
+}
+
+bool pack_writer_open(PackWriter* writer, const char* path,
+                      uint64_t source_size, int64_t source_mtime) {
+    memset(writer, 0, sizeof(PackWriter));
+    writer->f = fopen(path, "wb");
+    if (!writer->f) {
+        fprintf(stderr, "Error: Cannot create weight pack: %s\n", path);
+        return false;
+    }
+    writer->header.magic = PACK_MAGIC;
+    writer->header.version = PACK_VERSION;
+    writer->header.source_size = source_size;
+    writer->header.source_mtime = source_mtime;
+    writer->ok = pack_pad_to(writer, PACK_ALIGN);  // header rewritten on close
+    return writer->ok;
+}
+
+bool pack_writer_add(PackWriter* writer, const char* name, PackTensorKind kind,
+                     uint32_t format, uint32_t rows, uint32_t cols,
+                     const void* data, uint64_t size) {
+    PackTensor t;
+    memset(&t, 0, sizeof(t));
+    if (!writer->ok || strlen(name) >= sizeof(t.name)) return writer->ok = false;
+
+    if (writer->header.tensor_count == writer->capacity) {
+        uint64_t capacity = writer->capacity ? writer->capacity * 2 : 64;
+        PackTensor* grown = (PackTensor*)realloc(writer->tensors, capacity * sizeof(PackTensor));
+        if (!grown) return writer->ok = false;
+        writer->tensors = grown;
+        writer->capacity = capacity;
+    }
+
+    snprintf(t.name, sizeof(t.name), "%s", name);
+    t.kind = kind;
+    t.format = format;
+    t.rows = rows;
+    t.cols = cols;
+    t.offset = pack_align(writer->data_end, PACK_ALIGN);
+    t.size = size;
+    if (!pack_pad_to(writer, t.offset) || fwrite(data, 1, (size_t)size, writer->f) != size)
+        return writer->ok = false;
+    writer->data_end += size;
+    writer->tensors[writer->header.tensor_count++] = t;
+    return true;
+}
+
+bool pack_writer_close(PackWriter* writer) {
+    bool ok = writer->ok && writer->f;
+    if (ok) {
+        writer->header.table_offset = pack_align(writer->data_end, alignof(PackTensor));
+        size_t n = (size_t)writer->header.tensor_count;
+        ok = pack_pad_to(writer, writer->header.table_offset) &&
+             fwrite(writer->tensors, sizeof(PackTensor), n, writer->f) == n &&
+             fseek(writer->f, 0, SEEK_SET) == 0 &&
+             fwrite(&writer->header, sizeof(PackHeader), 1, writer->f) == 1;
+    }
+    if (writer->f && fclose(writer->f) != 0) ok = false;
+    free(writer->tensors);
+    memset(writer, 0, sizeof(PackWriter));
+    return ok;
+}
+
+} // namespace mgpu
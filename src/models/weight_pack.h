@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+
+namespace mgpu {
+
+// --- GPU-native weight pack ---
+//
+// A model's weights already in the layout the kernels consume, written
+// offline by mgpu_pack so load skips every host-side conversion:
+//   - F16 matrices padded to whole RGBA texels, fused (QKV) or
+//     interleaved (gate/up) exactly as the upload helpers would build them;
+//   - quantized matrices as their GGUF (or pack-time Q8_0) blocks;
+//   - 1D tensors as raw bytes.
+// Every tensor starts on a PACK_ALIGN boundary of the memory-mapped file,
+// so each one reaches the GPU with a single copy from the mapping.
+//
+// File: PackHeader | tensor data ... | PackTensor[tensor_count] at
+// table_offset. The header records the source GGUF's size and mtime, so a
+// pack made from another file (or an older copy) is detected as stale, and
+// the model dimensions the layout (layer count, QKV / gate-up fusion) was
+// built for.
+
+constexpr uint32_t PACK_MAGIC = 0x4B50474D; // "MGPK"
+constexpr uint32_t PACK_VERSION = 2;
+constexpr size_t PACK_ALIGN = 4096;
+
+enum PackTensorKind : uint32_t {
+    PACK_IMAGE_F16 = 0,  // [rows, cols] fp16, cols a multiple of 4: one RGBA texel per 4
+    PACK_BUFFER = 1,     // raw bytes (quantized blocks, norms, embeddings)
+};
+
+struct PackHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t source_size;   // GGUF file size
+    int64_t source_mtime;   // GGUF modification time (seconds)
+    uint64_t tensor_count;
+    uint64_t table_offset;  // PackTensor table, after the data
+    uint32_t llm_layers;    // model config the layout was built for
+    uint32_t llm_dim;       // (set by the caller before pack_writer_close)
+    uint32_t llm_intermediate;
+    uint32_t head_dim;
+};
+
+struct PackTensor {
+    char name[64];
+    uint32_t kind;      // PackTensorKind
+    uint32_t format;    // WeightFormat of a quantized matrix, 0 (WEIGHT_F16) otherwise
+    uint32_t rows;
+    uint32_t cols;      // elements per row (image: padded to a multiple of 4)
+    uint64_t offset;    // from the start of the file, PACK_ALIGN aligned
+    uint64_t size;      // bytes
+};
+
+struct PackFile {
+    void* mapped_data;
+    size_t file_size;
+    const PackHeader* header;
+    const PackTensor* tensors;
+};
+
+// Map and validate a pack (quietly returns false if `path` does not exist)
+bool pack_open(PackFile* file, const char* path);
+
+// True if the pack was made from a GGUF of this size and mtime
+bool pack_matches_source(const PackFile* file, uint64_t source_size, int64_t source_mtime);
+
+// Find a tensor by name, returns nullptr if not found
+const PackTensor* pack_find_tensor(const PackFile* file, const char* name);
+
+// Pointer to a tensor's data in the mapping
+const void* pack_tensor_data(const PackFile* file, const PackTensor* tensor);
+
+void pack_close(PackFile* file);
+
+// --- Writing ---
+
+struct PackWriter {
+    FILE* f;
+    PackHeader header;
+    PackTensor* tensors;
+    uint64_t capacity;
+    uint64_t data_end;
+    bool ok;            // false after any failed write
+};
+
+bool pack_writer_open(PackWriter* writer, const char* path,
+                      uint64_t source_size, int64_t source_mtime);
+
+// Append one tensor (data: `size` bytes). Names must be unique and < 64 chars.
+bool pack_writer_add(PackWriter* writer, const char* name, PackTensorKind kind,
+                     uint32_t format, uint32_t rows, uint32_t cols,
+                     const void* data, uint64_t size);
+
+// Write the table and header; false if any write failed. Always closes.
+bool pack_writer_close(PackWriter* writer);
+
+// Size and mtime of a file, as recorded in / checked against a pack header
+bool pack_source_stat(const char* path, uint64_t* size, int64_t* mtime);
+
+} // namespace mgpu
@@ -1,7 +1,11 @@
 #include <gtest/gtest.h>
 #include "../src/engine/device.h"
+#include "../src/engine/compute.h"
 #include "../src/engine/memory.h"
+#include "../src/models/gguf_loader.h"
+#include <cmath>
 #include <cstdio>
+#include <vector>
 
 using namespace mgpu;
 
@@ -243,6 +247,231 @@ TEST_F(DeviceTest, BufferPool) {
     }
 }
 
+// Quantized GEMV / GEMM (requires GPU): each GGUF block format against the
+// CPU dequantize reference, M = 1 (gemv_q*) and M > 1 (gemm_q*)
+TEST_F(DeviceTest, QuantizedGemm) {
+    bool success = init_device(&device_);
+    if (!success) {
+        GTEST_SKIP() << "No OpenCL devices available";
+    }
+
+    cl_program program = build_program_from_file(&device_, MGPU_KERNEL_DIR "/gemm.cl",
+                                                 "-cl-mad-enable");
+    if (!program) {
+        GTEST_SKIP() << "Failed to build gemm.cl";
+    }
+
+    struct Case {
+        WeightFormat format;
+        GGMLType type;
+    };
+    const Case cases[] = {
+        { WEIGHT_Q4_0, GGMLType::Q4_0 },
+        { WEIGHT_Q8_0, GGMLType::Q8_0 },
+        { WEIGHT_Q4_K, GGMLType::Q4_K },
+        { WEIGHT_Q5_K, GGMLType::Q5_K },
+        { WEIGHT_Q6_K, GGMLType::Q6_K },
+    };
+    const int K = 96;
+    const int N = 512;
+    srand(1234);
+
+    for (const Case& c : cases) {
+        // Random blocks with small fp16 scales (the d / dmin fields)
+        const int block = ggml_type_block_size(c.type);
+        const size_t block_bytes = ggml_type_size(c.type);
+        std::vector<uint8_t> B((size_t)K * N / block * block_bytes);
+        for (uint8_t& b : B) b = (uint8_t)rand();
+        for (size_t off = 0; off < B.size(); off += block_bytes) {
+            uint16_t d = ggml_fp32_to_fp16(0.002f * (1 + rand() % 8));
+            uint16_t dmin = ggml_fp32_to_fp16(0.001f * (1 + rand() % 8));
+            if (c.type == GGMLType::Q6_K) {
+                memcpy(&B[off + 208], &d, 2);
+            } else {
+                memcpy(&B[off], &d, 2);
+                if (block == 256) memcpy(&B[off + 2], &dmin, 2);
+            }
+        }
+        std::vector<float> W((size_t)K * N);
+        ASSERT_TRUE(ggml_dequantize(c.type, B.data(), W.data(), W.size()));
+
+        for (int M : { 1, 5 }) {
+            std::vector<uint16_t> A((size_t)M * K);
+            for (uint16_t& a : A) a = ggml_fp32_to_fp16((float)rand() / RAND_MAX * 2.0f - 1.0f);
+
+            cl_mem d_a = create_buffer(&device_, A.size() * 2,
+                                       CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, A.data());
+            cl_mem d_b = create_buffer(&device_, B.size(),
+                                       CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, B.data());
+            cl_mem d_c = create_buffer(&device_, (size_t)M * N * 2, CL_MEM_WRITE_ONLY, nullptr);
+            ASSERT_TRUE(d_a && d_b && d_c);
+
+            cl_event event = dispatch_gemm_quant(&device_, program, c.format,
+                                                 d_a, d_b, d_c, M, N, K);
+            ASSERT_NE(event, nullptr) << "format " << (int)c.format << " M=" << M;
+            clWaitForEvents(1, &event);
+            clReleaseEvent(event);
+
+            std::vector<uint16_t> C((size_t)M * N);
+            clEnqueueReadBuffer(device_.queue, d_c, CL_TRUE, 0, C.size() * 2, C.data(),
+                                0, nullptr, nullptr);
+
+            float max_err = 0.0f;
+            for (int m = 0; m < M; m++) {
+                for (int n = 0; n < N; n++) {
+                    double ref = 0.0;
+                    for (int k = 0; k < K; k++)
+                        ref += (double)ggml_fp16_to_fp32(A[(size_t)m * K + k]) * W[(size_t)k * N + n];
+                    float err = fabsf(ggml_fp16_to_fp32(C[(size_t)m * N + n]) - (float)ref);
+                    float tol = 2e-3f + 2e-3f * fabsf((float)ref);
+                    if (err > tol && err > max_err) max_err = err;
+                }
+            }
+            EXPECT_EQ(max_err, 0.0f) << "format " << (int)c.format << " M=" << M;
+
+            clReleaseMemObject(d_a);
+            clReleaseMemObject(d_b);
+            clReleaseMemObject(d_c);
+        }
+    }
+
+    kernel_registry_release(program);
+    clReleaseProgram(program);
+}
+
+// Per-output-column int8 weights: W_q[n][k] * s[n] within half a step of W
+TEST_F(DeviceTest, QuantizeWeightI8) {
+    const int K = 8;
+    const int N = 4;
+    std::vector<float> W((size_t)K * N);
+    for (int k = 0; k < K; k++)
+        for (int n = 0; n < N; n++) W[(size_t)k * N + n] = (n + 1) * 0.1f * (k - 3.5f);
+    for (int k = 0; k < K; k++) W[(size_t)k * N + 3] = 0.0f;  // all-zero column
+
+    std::vector<uint8_t> q(weight_i8_bytes(K, N));
+    EXPECT_EQ(q.size(), (size_t)K * N + N * sizeof(float));
+    quantize_weight_i8(W.data(), K, N, q.data());
+    const int8_t* wq = (const int8_t*)q.data();
+    const float* scales = (const float*)(q.data() + (size_t)K * N);
+
+    for (int n = 0; n < N; n++) {
+        EXPECT_FLOAT_EQ(scales[n], n == 3 ? 0.0f : (n + 1) * 0.35f / 127.0f);
+        for (int k = 0; k < K; k++) {
+            EXPECT_NEAR(wq[(size_t)n * K + k] * scales[n], W[(size_t)k * N + n],
+                        0.5f * scales[n] + 1e-7f);
+        }
+    }
+    EXPECT_EQ(wq[0], -127);       // column 0, k = 0: -amax
+    EXPECT_EQ(wq[K - 1], 127);
+}
+
+// W8A8 GEMV / GEMM (requires GPU; without cl_khr_integer_dot_product the
+// char4 fallback runs): against the fp reference, within the error bound of
+// quantizing A per row and W per column. K, N and M are not multiples of the
+// kernels' tiles.
+TEST_F(DeviceTest, W8A8Gemm) {
+    bool success = init_device(&device_);
+    if (!success) {
+        GTEST_SKIP() << "No OpenCL devices available";
+    }
+
+    cl_program program = build_program_from_file(&device_, MGPU_KERNEL_DIR "/gemm.cl",
+                                                 device_.has_int_dot_product
+                                                     ? "-cl-mad-enable -DMGPU_INT_DOT"
+                                                     : "-cl-mad-enable");
+    if (!program) {
+        GTEST_SKIP() << "Failed to build gemm.cl";
+    }
+
+    const int K = 100;
+    const int N = 200;
+    srand(4321);
+    std::vector<float> W((size_t)K * N);
+    for (float& w : W) w = ((float)rand() / RAND_MAX * 2.0f - 1.0f) * 0.1f;
+    std::vector<uint8_t> B(weight_i8_bytes(K, N));
+    quantize_weight_i8(W.data(), K, N, B.data());
+    const float* w_scales = (const float*)(B.data() + (size_t)K * N);
+
+    std::vector<uint16_t> norm(K);
+    for (uint16_t& g : norm) g = ggml_fp32_to_fp16(0.5f + (float)rand() / RAND_MAX);
+
+    struct Case {
+        int M;
+        bool rms_norm;
+    };
+    const Case cases[] = { { 1, false }, { 1, true }, { 37, false }, { 6, true } };
+
+    for (const Case& c : cases) {
+        const int M = c.M;
+        std::vector<uint16_t> A((size_t)M * K);
+        for (uint16_t& a : A) a = ggml_fp32_to_fp16((float)rand() / RAND_MAX * 4.0f - 2.0f);
+
+        cl_mem d_a = create_buffer(&device_, A.size() * 2,
+                                   CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, A.data());
+        cl_mem d_b = create_buffer(&device_, B.size(),
+                                   CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, B.data());
+        cl_mem d_norm = create_buffer(&device_, norm.size() * 2,
+                                      CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, norm.data());
+        cl_mem d_c = create_buffer(&device_, (size_t)M * N * 2, CL_MEM_WRITE_ONLY, nullptr);
+        cl_mem d_aq = create_buffer(&device_, (size_t)M * K, CL_MEM_READ_WRITE, nullptr);
+        cl_mem d_as = create_buffer(&device_, (size_t)M * sizeof(float), CL_MEM_READ_WRITE,
+                                    nullptr);
+        ASSERT_TRUE(d_a && d_b && d_norm && d_c && d_aq && d_as);
+
+        cl_event event = dispatch_gemm_w8a8(&device_, program, d_a, d_b, d_c, M, N, K,
+                                            d_aq, d_as, nullptr,
+                                            c.rms_norm ? d_norm : nullptr, 1e-5f);
+        ASSERT_NE(event, nullptr) << "M=" << M;
+        clWaitForEvents(1, &event);
+        clReleaseEvent(event);
+
+        std::vector<uint16_t> C((size_t)M * N);
+        clEnqueueReadBuffer(device_.queue, d_c, CL_TRUE, 0, C.size() * 2, C.data(),
+                            0, nullptr, nullptr);
+
+        int bad = 0;
+        for (int m = 0; m < M; m++) {
+            std::vector<float> a(K);
+            double sum_sq = 0.0;
+            for (int k = 0; k < K; k++) {
+                a[k] = ggml_fp16_to_fp32(A[(size_t)m * K + k]);
+                sum_sq += (double)a[k] * a[k];
+            }
+            if (c.rms_norm) {
+                const float inv_rms = 1.0f / sqrtf((float)(sum_sq / K) + 1e-5f);
+                for (int k = 0; k < K; k++) a[k] *= inv_rms * ggml_fp16_to_fp32(norm[k]);
+            }
+            float amax = 0.0f;
+            for (int k = 0; k < K; k++) amax = fmaxf(amax, fabsf(a[k]));
+            const float da = 0.5f * amax / 127.0f;
+
+            for (int n = 0; n < N; n++) {
+                const float dw = 0.5f * w_scales[n];
+                double ref = 0.0;
+                double bound = 0.0;
+                for (int k = 0; k < K; k++) {
+                    const float w = W[(size_t)k * N + n];
+                    ref += (double)a[k] * w;
+                    bound += fabsf(a[k]) * dw + fabsf(w) * da + da * dw;
+                }
+                float err = fabsf(ggml_fp16_to_fp32(C[(size_t)m * N + n]) - (float)ref);
+                if (err > 1.05f * (float)bound + 2e-3f * fabsf((float)ref) + 1e-3f) bad++;
+            }
+        }
+        EXPECT_EQ(bad, 0) << "M=" << M << (c.rms_norm ? " with RMSNorm" : "");
+
+        clReleaseMemObject(d_a);
+        clReleaseMemObject(d_b);
+        clReleaseMemObject(d_norm);
+        clReleaseMemObject(d_c);
+        clReleaseMemObject(d_aq);
+        clReleaseMemObject(d_as);
+    }
+
+    kernel_registry_release(program);
+    clReleaseProgram(program);
+}
+
 int main(int argc, char** argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
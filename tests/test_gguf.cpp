@@ -103,6 +103,164 @@ TEST_F(GGUFLoaderTest, PrintTensors) {
     std::remove(path.c_str());
 }
 
+// fp16 <-> fp32: exact values, rounding, subnormals, overflow
+TEST_F(GGUFLoaderTest, Fp16Conversion) {
+    EXPECT_EQ(ggml_fp32_to_fp16(1.0f), 0x3C00);
+    EXPECT_EQ(ggml_fp32_to_fp16(-2.0f), 0xC000);
+    EXPECT_EQ(ggml_fp32_to_fp16(65504.0f), 0x7BFF);
+    EXPECT_EQ(ggml_fp32_to_fp16(1e6f), 0x7C00);               // overflow -> inf
+    EXPECT_EQ(ggml_fp32_to_fp16(1.0f + 1.0f / 2048.0f), 0x3C00);  // tie -> even
+    EXPECT_EQ(ggml_fp32_to_fp16(5.9604645e-8f), 0x0001);      // smallest subnormal
+
+    EXPECT_FLOAT_EQ(ggml_fp16_to_fp32(0x3C00), 1.0f);
+    EXPECT_FLOAT_EQ(ggml_fp16_to_fp32(0x3555), 0.333251953125f);
+    EXPECT_FLOAT_EQ(ggml_fp16_to_fp32(0x0001), 5.9604645e-8f);
+    for (uint32_t h = 0; h < 0x7C00; h += 7) {
+        EXPECT_EQ(ggml_fp32_to_fp16(ggml_fp16_to_fp32((uint16_t)h)), h);
+    }
+}
+
+// Q4_0 block: fp16 scale, low nibbles = elements 0..15, high = 16..31, minus 8
+TEST_F(GGUFLoaderTest, DequantizeQ4_0) {
+    uint8_t block[18];
+    uint16_t d = ggml_fp32_to_fp16(0.5f);
+    memcpy(block, &d, 2);
+    for (int j = 0; j < 16; j++) block[2 + j] = (uint8_t)((15 - j) << 4 | j);
+
+    float out[32];
+    ASSERT_TRUE(ggml_dequantize(GGMLType::Q4_0, block, out, 32));
+    for (int j = 0; j < 16; j++) {
+        EXPECT_FLOAT_EQ(out[j], (j - 8) * 0.5f);
+        EXPECT_FLOAT_EQ(out[j + 16], (7 - j) * 0.5f);
+    }
+}
+
+// Q8_0 block: fp16 scale times signed bytes
+TEST_F(GGUFLoaderTest, DequantizeQ8_0) {
+    uint8_t blocks[2 * 34];
+    for (int b = 0; b < 2; b++) {
+        uint16_t d = ggml_fp32_to_fp16(b ? -0.25f : 0.125f);
+        memcpy(blocks + 34 * b, &d, 2);
+        for (int j = 0; j < 32; j++) blocks[34 * b + 2 + j] = (uint8_t)(int8_t)(j * 8 - 128);
+    }
+
+    float out[64];
+    ASSERT_TRUE(ggml_dequantize(GGMLType::Q8_0, blocks, out, 64));
+    for (int j = 0; j < 32; j++) {
+        EXPECT_FLOAT_EQ(out[j], (j * 8 - 128) * 0.125f);
+        EXPECT_FLOAT_EQ(out[32 + j], (j * 8 - 128) * -0.25f);
+    }
+
+    EXPECT_FALSE(ggml_dequantize(GGMLType::Q4_1, blocks, out, 32));
+}
+
+// Q8_0 quantization: d = absmax / 127, values round-trip within d / 2
+TEST_F(GGUFLoaderTest, QuantizeQ8_0) {
+    float src[64];
+    for (int j = 0; j < 32; j++) {
+        src[j] = (j - 16) * 0.37f;
+        src[32 + j] = 0.0f;
+    }
+
+    uint8_t blocks[2 * 34];
+    ASSERT_TRUE(ggml_quantize_q8_0(src, blocks, 64));
+    float out[64];
+    ASSERT_TRUE(ggml_dequantize(GGMLType::Q8_0, blocks, out, 64));
+
+    float d = ggml_fp16_to_fp32(ggml_fp32_to_fp16(16 * 0.37f / 127.0f));
+    EXPECT_EQ((int8_t)blocks[2], -127);
+    for (int j = 0; j < 64; j++) EXPECT_NEAR(out[j], src[j], d * 0.5f + 1e-6f);
+
+    EXPECT_FALSE(ggml_quantize_q8_0(src, blocks, 48));
+}
+
+// Pack 6-bit scale/min pairs the way Q4_K / Q5_K store them: sub-blocks
+// 0..3 in the low 6 bits of bytes 0..3 / 4..7, 4..7 as nibbles of bytes
+// 8..11 with their top 2 bits in the high bits of bytes 0..3 / 4..7
+static void pack_k_scales(uint8_t* q, const int* sc, const int* m) {
+    memset(q, 0, 12);
+    for (int j = 0; j < 4; j++) {
+        q[j] = (uint8_t)(sc[j] | (sc[j + 4] >> 4) << 6);
+        q[j + 4] = (uint8_t)(m[j] | (m[j + 4] >> 4) << 6);
+        q[j + 8] = (uint8_t)((sc[j + 4] & 0x0F) | (m[j + 4] & 0x0F) << 4);
+    }
+}
+
+static const int K_SCALES[8] = { 1, 2, 3, 4, 17, 33, 50, 63 };
+static const int K_MINS[8]   = { 0, 5, 10, 63, 2, 18, 36, 7 };
+
+// Q4_K super-block: element 32s + l = d * sc[s] * q - dmin * m[s], with q
+// the low (s even) / high (s odd) nibble of qs[32 * (s / 2) + l]
+TEST_F(GGUFLoaderTest, DequantizeQ4_K) {
+    uint8_t block[144];
+    uint16_t d = ggml_fp32_to_fp16(1.0f);
+    uint16_t dmin = ggml_fp32_to_fp16(0.5f);
+    memcpy(block, &d, 2);
+    memcpy(block + 2, &dmin, 2);
+    pack_k_scales(block + 4, K_SCALES, K_MINS);
+    memset(block + 16, 0, 128);
+    for (int s = 0; s < 8; s++)
+        for (int l = 0; l < 32; l++)
+            block[16 + 32 * (s / 2) + l] |= (uint8_t)(((l + s) & 15) << (4 * (s & 1)));
+
+    float out[256];
+    ASSERT_TRUE(ggml_dequantize(GGMLType::Q4_K, block, out, 256));
+    for (int s = 0; s < 8; s++)
+        for (int l = 0; l < 32; l++)
+            EXPECT_FLOAT_EQ(out[32 * s + l], K_SCALES[s] * ((l + s) & 15) - 0.5f * K_MINS[s]);
+}
+
+// Q5_K: Q4_K with bit s of qh[l] as the fifth bit of element 32s + l
+TEST_F(GGUFLoaderTest, DequantizeQ5_K) {
+    uint8_t block[176];
+    uint16_t d = ggml_fp32_to_fp16(0.5f);
+    uint16_t dmin = ggml_fp32_to_fp16(0.25f);
+    memcpy(block, &d, 2);
+    memcpy(block + 2, &dmin, 2);
+    pack_k_scales(block + 4, K_SCALES, K_MINS);
+    memset(block + 16, 0, 160);
+    for (int s = 0; s < 8; s++) {
+        for (int l = 0; l < 32; l++) {
+            int q = (l * 3 + s) & 31;
+            block[48 + 32 * (s / 2) + l] |= (uint8_t)((q & 15) << (4 * (s & 1)));
+            block[16 + l] |= (uint8_t)((q >> 4) << s);
+        }
+    }
+
+    float out[256];
+    ASSERT_TRUE(ggml_dequantize(GGMLType::Q5_K, block, out, 256));
+    for (int s = 0; s < 8; s++)
+        for (int l = 0; l < 32; l++)
+            EXPECT_FLOAT_EQ(out[32 * s + l],
+                            0.5f * K_SCALES[s] * ((l * 3 + s) & 31) - 0.25f * K_MINS[s]);
+}
+
+// Q6_K: element e = d * scales[e / 16] * (q - 32) with its 6-bit q split
+// into a nibble of ql and 2 bits of qh, two 128-element halves
+TEST_F(GGUFLoaderTest, DequantizeQ6_K) {
+    uint8_t block[210];
+    memset(block, 0, sizeof(block));
+    for (int i = 0; i < 16; i++) block[192 + i] = (uint8_t)(int8_t)(i - 8);
+    uint16_t d = ggml_fp32_to_fp16(0.25f);
+    memcpy(block + 208, &d, 2);
+    for (int e = 0; e < 256; e++) {
+        int q = (e * 7) & 63;
+        int h = e / 128, t = (e % 128) / 32, l = e % 32;
+        block[64 * h + 32 * (t & 1) + l] |= (uint8_t)((q & 15) << (4 * (t >> 1)));
+        block[128 + 32 * h + l] |= (uint8_t)((q >> 4) << (2 * t));
+    }
+
+    float out[512];
+    uint8_t blocks[420];
+    memcpy(blocks, block, 210);
+    memcpy(blocks + 210, block, 210);
+    ASSERT_TRUE(ggml_dequantize(GGMLType::Q6_K, blocks, out, 512));
+    for (int e = 0; e < 512; e++)
+        EXPECT_FLOAT_EQ(out[e], 0.25f * ((e % 256) / 16 - 8) * (((e * 7) & 63) - 32));
+
+    EXPECT_FALSE(ggml_dequantize(GGMLType::Q6_K, blocks, out, 300));
+}
+
 int main(int argc, char** argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
@@ -0,0 +1,171 @@
+#include <gtest/gtest.h>
+#include "test_utils.h"
+#include "../src/models/moondream2.h"
+#include "../src/models/weight_pack.h"
+#include <cstdio>
+
+using namespace mgpu;
+
+class WeightPackTest : public ::testing::Test {
+protected:
+    void SetUp() override {}
+    void TearDown() override {}
+};
+
+// Tensors come back by name, PACK_ALIGN-aligned and byte-identical
+TEST_F(WeightPackTest, WriteAndRead) {
+    std::string path = "/tmp/test_roundtrip.mgpu";
+    uint16_t image[2 * 8];
+    for (int i = 0; i < 16; i++) image[i] = (uint16_t)(0x3C00 + i);
+    uint8_t blocks[34 * 3];
+    for (size_t i = 0; i < sizeof(blocks); i++) blocks[i] = (uint8_t)(i * 7);
+
+    PackWriter w;
+    ASSERT_TRUE(pack_writer_open(&w, path.c_str(), 12345, 678));
+    ASSERT_TRUE(pack_writer_add(&w, "blk.0.attn_qkv", PACK_IMAGE_F16, 0, 2, 8,
+                                image, sizeof(image)));
+    ASSERT_TRUE(pack_writer_add(&w, "blk.0.ffn_down", PACK_BUFFER, 2, 3, 32,
+                                blocks, sizeof(blocks)));
+    ASSERT_TRUE(pack_writer_close(&w));
+
+    PackFile pack;
+    ASSERT_TRUE(pack_open(&pack, path.c_str()));
+    EXPECT_TRUE(pack_matches_source(&pack, 12345, 678));
+    EXPECT_FALSE(pack_matches_source(&pack, 12345, 679));
+    EXPECT_EQ(pack.header->tensor_count, 2u);
+
+    const PackTensor* qkv = pack_find_tensor(&pack, "blk.0.attn_qkv");
+    ASSERT_NE(qkv, nullptr);
+    EXPECT_EQ(qkv->kind, (uint32_t)PACK_IMAGE_F16);
+    EXPECT_EQ(qkv->rows, 2u);
+    EXPECT_EQ(qkv->cols, 8u);
+    EXPECT_EQ(qkv->offset % PACK_ALIGN, 0u);
+    EXPECT_EQ(memcmp(pack_tensor_data(&pack, qkv), image, sizeof(image)), 0);
+
+    const PackTensor* down = pack_find_tensor(&pack, "blk.0.ffn_down");
+    ASSERT_NE(down, nullptr);
+    EXPECT_EQ(down->kind, (uint32_t)PACK_BUFFER);
+    EXPECT_EQ(down->format, 2u);
+    EXPECT_EQ(down->size, sizeof(blocks));
+    EXPECT_EQ(down->offset % PACK_ALIGN, 0u);
+    EXPECT_EQ(memcmp(pack_tensor_data(&pack, down), blocks, sizeof(blocks)), 0);
+
+    EXPECT_EQ(pack_find_tensor(&pack, "blk.1.ffn_down"), nullptr);
+
+    pack_close(&pack);
+    std::remove(path.c_str());
+}
+
+TEST_F(WeightPackTest, RejectsMissingAndForeignFiles) {
+    PackFile pack;
+    EXPECT_FALSE(pack_open(&pack, "/tmp/nonexistent_weights.mgpu"));
+
+    std::string path = "/tmp/test_not_a_pack.mgpu";
+    ASSERT_TRUE(test::create_test_gguf_file(path));
+    EXPECT_FALSE(pack_open(&pack, path.c_str()));
+    std::remove(path.c_str());
+}
+
+TEST_F(WeightPackTest, PackPath) {
+    char path[256];
+    moondream2_pack_path("weights/moondream2.gguf", path, sizeof(path));
+    EXPECT_STREQ(path, "weights/moondream2.mgpu");
+    moondream2_pack_path("model.bin", path, sizeof(path));
+    EXPECT_STREQ(path, "model.bin.mgpu");
+}
+
+// GGUF with an embedding table and two layer-0 projections:
+//   token_embd.weight  F16 [2, 4]
+//   blk.0.attn_q.weight F16 [2, 6]   (not a whole number of texels)
+//   blk.0.attn_k.weight F16 [2, 32]
+static bool write_projection_gguf(const std::string& path) {
+    test::TestGGUFBuilder b;
+    b.write_header(3, 3, 0);
+    const uint64_t embd_dims[2] = { 4, 2 };
+    const uint64_t q_dims[2] = { 6, 2 };
+    const uint64_t k_dims[2] = { 32, 2 };
+    b.write_tensor("token_embd.weight", 2, embd_dims, 1, 0);
+    b.write_tensor("blk.0.attn_q.weight", 2, q_dims, 1, 32);
+    b.write_tensor("blk.0.attn_k.weight", 2, k_dims, 1, 64);
+    b.pad_alignment();
+
+    std::vector<uint16_t> data(64 / 2 + 128 / 2, 0);
+    for (int i = 0; i < 8; i++) data[i] = ggml_fp32_to_fp16(0.5f * i);
+    for (int i = 0; i < 12; i++) data[16 + i] = ggml_fp32_to_fp16(1.0f + i);
+    for (int i = 0; i < 64; i++) data[32 + i] = ggml_fp32_to_fp16((i - 32) / 16.0f);
+    b.write_bytes(data.data(), data.size() * sizeof(uint16_t));
+    return b.save_to_file(path);
+}
+
+TEST_F(WeightPackTest, PackFromGGUF) {
+    std::string gguf = "/tmp/test_pack_src.gguf";
+    std::string out = "/tmp/test_pack_src.mgpu";
+    ASSERT_TRUE(write_projection_gguf(gguf));
+
+    ASSERT_TRUE(moondream2_pack(gguf.c_str(), out.c_str(), WEIGHT_Q8_0));
+
+    PackFile pack;
+    ASSERT_TRUE(pack_open(&pack, out.c_str()));
+    uint64_t size;
+    int64_t mtime;
+    ASSERT_TRUE(pack_source_stat(gguf.c_str(), &size, &mtime));
+    EXPECT_TRUE(pack_matches_source(&pack, size, mtime));
+
+    const PackTensor* embd = pack_find_tensor(&pack, "token_embd");
+    ASSERT_NE(embd, nullptr);
+    EXPECT_EQ(embd->size, 8 * sizeof(uint16_t));
+
+    // 6 columns: no Q8_0 blocks, an F16 image padded to 8 columns
+    const PackTensor* q = pack_find_tensor(&pack, "blk.0.attn_q");
+    ASSERT_NE(q, nullptr);
+    EXPECT_EQ(q->kind, (uint32_t)PACK_IMAGE_F16);
+    EXPECT_EQ(q->cols, 8u);
+    const uint16_t* qd = (const uint16_t*)pack_tensor_data(&pack, q);
+    EXPECT_FLOAT_EQ(ggml_fp16_to_fp32(qd[8 + 5]), 12.0f);
+    EXPECT_EQ(qd[8 + 6], 0);
+    EXPECT_EQ(qd[8 + 7], 0);
+
+    // 32 columns: one Q8_0 block per row
+    const PackTensor* k = pack_find_tensor(&pack, "blk.0.attn_k");
+    ASSERT_NE(k, nullptr);
+    EXPECT_EQ(k->kind, (uint32_t)PACK_BUFFER);
+    EXPECT_EQ(k->format, (uint32_t)WEIGHT_Q8_0);
+    EXPECT_EQ(k->size, 2u * 34);
+    float kf[64];
+    ASSERT_TRUE(ggml_dequantize(GGMLType::Q8_0, pack_tensor_data(&pack, k), kf, 64));
+    for (int i = 0; i < 64; i++) EXPECT_NEAR(kf[i], (i - 32) / 16.0f, 0.01f);
+
+    EXPECT_EQ(pack_find_tensor(&pack, "blk.0.attn_qkv"), nullptr);
+
+    pack_close(&pack);
+    std::remove(gguf.c_str());
+    std::remove(out.c_str());
+}
+
+// The header records the config the layout was built for; a pack is only
+// accepted under the same layer count and dimensions
+TEST_F(WeightPackTest, PackRecordsConfig) {
+    std::string gguf = "/tmp/test_pack_cfg.gguf";
+    std::string out = "/tmp/test_pack_cfg.mgpu";
+    ASSERT_TRUE(write_projection_gguf(gguf));
+
+    Moondream2Config config;
+    config.llm_layers = 1;
+    config.llm_dim = 32;
+    ASSERT_TRUE(moondream2_pack(gguf.c_str(), out.c_str(), WEIGHT_F16, &config));
+
+    PackFile pack;
+    ASSERT_TRUE(pack_open(&pack, out.c_str()));
+    EXPECT_EQ(pack.header->llm_layers, 1u);
+    EXPECT_EQ(pack.header->llm_dim, 32u);
+    EXPECT_TRUE(pack_matches_config(&pack, config));
+
+    Moondream2Config more_layers = config;
+    more_layers.llm_layers = 2;
+    EXPECT_FALSE(pack_matches_config(&pack, more_layers));
+    EXPECT_FALSE(pack_matches_config(&pack, Moondream2Config{}));
+
+    pack_close(&pack);
+    std::remove(gguf.c_str());
+    std::remove(out.c_str());
+}